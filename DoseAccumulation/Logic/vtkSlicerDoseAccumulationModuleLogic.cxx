@@ -30,8 +30,13 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtDataObjectCache.h"
 #include "vtkSlicerIsodoseModuleLogic.h"
 
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScalarVolumeDisplayNode.h>
@@ -41,17 +46,23 @@
 #include <vtkMRMLSelectionNode.h>
 #include <vtkMRMLScene.h>
 
-// Slicer includes
-#include <vtkSlicerVolumesLogic.h>
-
 // VTK includes
 #include <vtkNew.h>
-#include <vtkImageMathematics.h>
 #include <vtkImageData.h>
+#include <vtkCollection.h>
+#include <vtkFloatArray.h>
 #include <vtkSmartPointer.h>
-#include <vtkImageReslice.h>
 #include <vtkGeneralTransform.h>
+#include <vtkLinearTransform.h>
+#include <vtkTransform.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <cstring>
+#include <sstream>
 
 //----------------------------------------------------------------------------
 const std::string vtkSlicerDoseAccumulationModuleLogic::DOSEACCUMULATION_ATTRIBUTE_PREFIX = "DoseAccumulation.";
@@ -61,20 +72,334 @@ const std::string vtkSlicerDoseAccumulationModuleLogic::DOSEACCUMULATION_OUTPUT_
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseAccumulationModuleLogic);
 
+//----------------------------------------------------------------------------
+// Get the two input voxel indices and the interpolation weight of the second one along one axis.
+// Returns false if the continuous index is more than half a voxel outside the input extent
+// (the same border as in vtkImageReslice), in which case the input value is considered zero.
+inline bool vtkSlicerDoseAccumulationInterpolationIndex(double continuousIndex, int minIndex, int maxIndex,
+                                                        int& index0, int& index1, double& fraction)
+{
+  if (continuousIndex < minIndex - 0.5 || continuousIndex > maxIndex + 0.5)
+  {
+    return false;
+  }
+  if (continuousIndex <= minIndex)
+  {
+    index0 = index1 = minIndex;
+    fraction = 0.0;
+    return true;
+  }
+  if (continuousIndex >= maxIndex)
+  {
+    index0 = index1 = maxIndex;
+    fraction = 0.0;
+    return true;
+  }
+  index0 = vtkMath::Floor(continuousIndex);
+  index1 = index0 + 1;
+  fraction = continuousIndex - index0;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Linearly interpolate the input at the given continuous voxel index.
+// Returns false if the index is outside the input (see vtkSlicerDoseAccumulationInterpolationIndex).
+template <class InputScalarType>
+inline bool vtkSlicerDoseAccumulationInterpolate(InputScalarType* inputPtr, const int inputExtent[6], const vtkIdType inputIncrements[3],
+                                                 double x, double y, double z, double& value)
+{
+  int x0 = 0, x1 = 0, y0 = 0, y1 = 0, z0 = 0, z1 = 0;
+  double fx = 0.0, fy = 0.0, fz = 0.0;
+  if ( !vtkSlicerDoseAccumulationInterpolationIndex(x, inputExtent[0], inputExtent[1], x0, x1, fx)
+    || !vtkSlicerDoseAccumulationInterpolationIndex(y, inputExtent[2], inputExtent[3], y0, y1, fy)
+    || !vtkSlicerDoseAccumulationInterpolationIndex(z, inputExtent[4], inputExtent[5], z0, z1, fz) )
+  {
+    return false;
+  }
+
+  InputScalarType* row00 = inputPtr + (y0-inputExtent[2])*inputIncrements[1] + (z0-inputExtent[4])*inputIncrements[2];
+  InputScalarType* row10 = inputPtr + (y1-inputExtent[2])*inputIncrements[1] + (z0-inputExtent[4])*inputIncrements[2];
+  InputScalarType* row01 = inputPtr + (y0-inputExtent[2])*inputIncrements[1] + (z1-inputExtent[4])*inputIncrements[2];
+  InputScalarType* row11 = inputPtr + (y1-inputExtent[2])*inputIncrements[1] + (z1-inputExtent[4])*inputIncrements[2];
+  x0 -= inputExtent[0];
+  x1 -= inputExtent[0];
+  double v00 = row00[x0] + fx*(static_cast<double>(row00[x1])-row00[x0]);
+  double v10 = row10[x0] + fx*(static_cast<double>(row10[x1])-row10[x0]);
+  double v01 = row01[x0] + fx*(static_cast<double>(row01[x1])-row01[x0]);
+  double v11 = row11[x0] + fx*(static_cast<double>(row11[x1])-row11[x0]);
+  double v0 = v00 + fy*(v10-v00);
+  double v1 = v01 + fy*(v11-v01);
+  value = v0 + fz*(v1-v0);
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Add the weighted input values, linearly interpolated at the accumulator voxels, to the accumulator in the given
+// range of slices. If sampleCoordinates is NULL, then the accumulator voxel (i,j,k) is at continuous input voxel
+// index referenceIjkToInputIjk * (i,j,k). Otherwise sampleCoordinates contains the continuous input voxel index
+// of each accumulator voxel (three values per voxel, in the order of the accumulator voxels).
+template <class InputScalarType>
+void vtkSlicerDoseAccumulationAddWeightedSlices(vtkImageData* inputImage, InputScalarType* vtkNotUsed(inputTypePtr),
+                                                const double referenceIjkToInputIjk[3][4], const float* sampleCoordinates,
+                                                double weight, vtkImageData* accumulatedImage, int firstSlice, int lastSlice)
+{
+  int inputExtent[6] = {0,-1,0,-1,0,-1};
+  inputImage->GetExtent(inputExtent);
+  vtkIdType inputIncrements[3] = {0,0,0};
+  inputImage->GetIncrements(inputIncrements);
+  InputScalarType* inputPtr = static_cast<InputScalarType*>(inputImage->GetScalarPointer(inputExtent[0], inputExtent[2], inputExtent[4]));
+
+  int accumulatedExtent[6] = {0,-1,0,-1,0,-1};
+  accumulatedImage->GetExtent(accumulatedExtent);
+  vtkIdType accumulatedIncrements[3] = {0,0,0};
+  accumulatedImage->GetIncrements(accumulatedIncrements);
+
+  double value = 0.0;
+  for (int k=firstSlice; k<=lastSlice; ++k)
+  {
+    for (int j=accumulatedExtent[2]; j<=accumulatedExtent[3]; ++j)
+    {
+      float* accumulatedPtr = static_cast<float*>(accumulatedImage->GetScalarPointer(accumulatedExtent[0], j, k));
+      if (sampleCoordinates)
+      {
+        const float* samplePtr = sampleCoordinates
+          + 3 * ((k-accumulatedExtent[4])*accumulatedIncrements[2] + (j-accumulatedExtent[2])*accumulatedIncrements[1]);
+        for (int i=accumulatedExtent[0]; i<=accumulatedExtent[1]; ++i, ++accumulatedPtr, samplePtr+=3)
+        {
+          if (vtkSlicerDoseAccumulationInterpolate(inputPtr, inputExtent, inputIncrements, samplePtr[0], samplePtr[1], samplePtr[2], value))
+          {
+            (*accumulatedPtr) += static_cast<float>(weight * value);
+          }
+        }
+        continue;
+      }
+      for (int i=accumulatedExtent[0]; i<=accumulatedExtent[1]; ++i, ++accumulatedPtr)
+      {
+        if ( vtkSlicerDoseAccumulationInterpolate(inputPtr, inputExtent, inputIncrements,
+               referenceIjkToInputIjk[0][0]*i + referenceIjkToInputIjk[0][1]*j + referenceIjkToInputIjk[0][2]*k + referenceIjkToInputIjk[0][3],
+               referenceIjkToInputIjk[1][0]*i + referenceIjkToInputIjk[1][1]*j + referenceIjkToInputIjk[1][2]*k + referenceIjkToInputIjk[1][3],
+               referenceIjkToInputIjk[2][0]*i + referenceIjkToInputIjk[2][1]*j + referenceIjkToInputIjk[2][2]*k + referenceIjkToInputIjk[2][3],
+               value) )
+        {
+          (*accumulatedPtr) += static_cast<float>(weight * value);
+        }
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Adds a weighted input image to the accumulator. The slices of the accumulator are distributed among the threads,
+// so each accumulator voxel is written by only one thread.
+class vtkSlicerDoseAccumulationAddWeightedFunctor
+{
+public:
+  /// The input is sampled at the voxel indices mapped by referenceIjkToInputIjkMatrix if given,
+  /// otherwise at the precomputed sample coordinates
+  vtkSlicerDoseAccumulationAddWeightedFunctor(vtkImageData* inputImage, vtkMatrix4x4* referenceIjkToInputIjkMatrix,
+                                              vtkFloatArray* sampleCoordinates, double weight, vtkImageData* accumulatedImage)
+    : InputImage(inputImage)
+    , SampleCoordinates(NULL)
+    , Weight(weight)
+    , AccumulatedImage(accumulatedImage)
+  {
+    for (int row=0; row<3; ++row)
+    {
+      for (int column=0; column<4; ++column)
+      {
+        this->ReferenceIjkToInputIjk[row][column] = (referenceIjkToInputIjkMatrix ? referenceIjkToInputIjkMatrix->GetElement(row, column) : 0.0);
+      }
+    }
+    if (!referenceIjkToInputIjkMatrix && sampleCoordinates)
+    {
+      this->SampleCoordinates = sampleCoordinates->GetPointer(0);
+    }
+    accumulatedImage->GetExtent(this->AccumulatedExtent);
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    int firstSlice = this->AccumulatedExtent[4] + static_cast<int>(begin);
+    int lastSlice = this->AccumulatedExtent[4] + static_cast<int>(end) - 1;
+    switch (this->InputImage->GetScalarType())
+    {
+      vtkTemplateMacro( vtkSlicerDoseAccumulationAddWeightedSlices( this->InputImage, static_cast<VTK_TT*>(NULL),
+        this->ReferenceIjkToInputIjk, this->SampleCoordinates, this->Weight, this->AccumulatedImage, firstSlice, lastSlice ) );
+    default:
+      break;
+    }
+  }
+
+private:
+  vtkImageData* InputImage;
+  double ReferenceIjkToInputIjk[3][4];
+  const float* SampleCoordinates;
+  double Weight;
+  vtkImageData* AccumulatedImage;
+  int AccumulatedExtent[6];
+};
+
+//----------------------------------------------------------------------------
+// Computes the continuous input voxel index of each accumulator voxel by transforming the voxel indices
+// through a (typically non-linear) transform. The slices are distributed among the threads.
+class vtkSlicerDoseAccumulationSampleCoordinatesFunctor
+{
+public:
+  vtkSlicerDoseAccumulationSampleCoordinatesFunctor(vtkAbstractTransform* accumulatedIjkToInputIjkTransform,
+                                                    const int accumulatedExtent[6], float* sampleCoordinates)
+    : AccumulatedIjkToInputIjkTransform(accumulatedIjkToInputIjkTransform)
+    , SampleCoordinates(sampleCoordinates)
+  {
+    for (int i=0; i<6; ++i)
+    {
+      this->AccumulatedExtent[i] = accumulatedExtent[i];
+    }
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    vtkIdType rowSize = this->AccumulatedExtent[1] - this->AccumulatedExtent[0] + 1;
+    vtkIdType sliceSize = rowSize * (this->AccumulatedExtent[3] - this->AccumulatedExtent[2] + 1);
+    float* samplePtr = this->SampleCoordinates + 3 * begin * sliceSize;
+    double accumulatedIjk[3] = {0.0, 0.0, 0.0};
+    double inputIjk[3] = {0.0, 0.0, 0.0};
+    for (vtkIdType slice=begin; slice<end; ++slice)
+    {
+      accumulatedIjk[2] = this->AccumulatedExtent[4] + slice;
+      for (int j=this->AccumulatedExtent[2]; j<=this->AccumulatedExtent[3]; ++j)
+      {
+        accumulatedIjk[1] = j;
+        for (int i=this->AccumulatedExtent[0]; i<=this->AccumulatedExtent[1]; ++i, samplePtr+=3)
+        {
+          accumulatedIjk[0] = i;
+          // The transform is updated before the threads are started, so the internal function can be called
+          // directly (TransformPoint would check for updates for each point, which requires locking)
+          this->AccumulatedIjkToInputIjkTransform->InternalTransformPoint(accumulatedIjk, inputIjk);
+          samplePtr[0] = static_cast<float>(inputIjk[0]);
+          samplePtr[1] = static_cast<float>(inputIjk[1]);
+          samplePtr[2] = static_cast<float>(inputIjk[2]);
+        }
+      }
+    }
+  }
+
+private:
+  vtkAbstractTransform* AccumulatedIjkToInputIjkTransform;
+  float* SampleCoordinates;
+  int AccumulatedExtent[6];
+};
+
+//----------------------------------------------------------------------------
+// Check if the image can be used as accumulated dose
+static bool vtkSlicerDoseAccumulationIsValidAccumulatedImage(vtkImageData* accumulatedImageData)
+{
+  return ( accumulatedImageData && accumulatedImageData->GetScalarType() == VTK_FLOAT
+    && accumulatedImageData->GetNumberOfScalarComponents() == 1 && accumulatedImageData->GetScalarPointer() );
+}
+
+//----------------------------------------------------------------------------
+// Adds a weighted float image to the accumulator on the same lattice, in parallel over the voxels
+class vtkSlicerDoseAccumulationAddScaledFunctor
+{
+public:
+  vtkSlicerDoseAccumulationAddScaledFunctor(const float* source, float weight, float* target)
+    : Source(source)
+    , Weight(weight)
+    , Target(target)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    for (vtkIdType index=begin; index<end; ++index)
+    {
+      this->Target[index] += this->Weight * this->Source[index];
+    }
+  }
+
+private:
+  const float* Source;
+  float Weight;
+  float* Target;
+};
+
+//----------------------------------------------------------------------------
+static void vtkSlicerDoseAccumulationAddScaled(vtkImageData* source, double weight, vtkImageData* target)
+{
+  vtkSlicerDoseAccumulationAddScaledFunctor functor(
+    static_cast<float*>(source->GetScalarPointer()), static_cast<float>(weight), static_cast<float*>(target->GetScalarPointer()));
+  vtkSMPTools::For(0, target->GetNumberOfPoints(), functor);
+}
+
+//----------------------------------------------------------------------------
+class vtkSlicerDoseAccumulationModuleLogic::vtkInternal
+{
+public:
+  /// Input dose contained in the running sum
+  struct AppliedInput
+  {
+    /// Weight the input dose was added with
+    double Weight;
+    /// Key of the input dose when it was added (\sa vtkSlicerRtCommon::GetVolumeNodeStateKey)
+    std::string InputKey;
+  };
+
+  /// Get cached input dose resampled to the lattice of the reference dose with unit weight, and mark it as most recently used
+  /// \param inputKey Key of the input dose (\sa vtkSlicerRtCommon::GetVolumeNodeStateKey)
+  /// \return NULL if not in the cache
+  vtkOrientedImageData* GetResampledDose(const std::string& inputKey)
+  {
+    return vtkOrientedImageData::SafeDownCast(this->ResampledDoses->GetItem(inputKey));
+  }
+
+  /// Remove the running sum
+  void ClearRunningSum()
+  {
+    this->AccumulatedImageData = NULL;
+    this->AppliedInputs.clear();
+    this->ParameterNodeID.clear();
+    this->NumberOfIncrementalUpdates = 0;
+  }
+
+public:
+  /// Input doses resampled to the lattice of the reference dose by input key
+  vtkSmartPointer<vtkSlicerRtDataObjectCache> ResampledDoses;
+
+  /// Key of the reference dose volume the running sum and the resampled doses are on
+  std::string ReferenceKey;
+  /// ID of the parameter node the running sum belongs to
+  std::string ParameterNodeID;
+  /// Running sum of the weighted input doses
+  vtkSmartPointer<vtkOrientedImageData> AccumulatedImageData;
+  /// Input doses contained in the running sum by input volume node ID
+  std::map<std::string, AppliedInput> AppliedInputs;
+  /// Number of weight changes and removals applied to the running sum since it was last computed from scratch
+  int NumberOfIncrementalUpdates;
+};
+
 //----------------------------------------------------------------------------
 vtkSlicerDoseAccumulationModuleLogic::vtkSlicerDoseAccumulationModuleLogic()
 {
+  this->ResampledDoseCacheMemoryLimitMB = 512.0;
+  this->MaximumNumberOfIncrementalUpdates = 32;
+  this->Internal = new vtkInternal();
+  this->Internal->ResampledDoses = vtkSmartPointer<vtkSlicerRtDataObjectCache>::New();
+  this->Internal->NumberOfIncrementalUpdates = 0;
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerDoseAccumulationModuleLogic::~vtkSlicerDoseAccumulationModuleLogic()
 {
+  delete this->Internal;
+  this->Internal = NULL;
 }
 
 //----------------------------------------------------------------------------
 void vtkSlicerDoseAccumulationModuleLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "ResampledDoseCacheMemoryLimitMB: " << this->ResampledDoseCacheMemoryLimitMB << "\n";
+  os << indent << "MaximumNumberOfIncrementalUpdates: " << this->MaximumNumberOfIncrementalUpdates << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -165,6 +490,7 @@ void vtkSlicerDoseAccumulationModuleLogic::OnMRMLSceneEndClose()
     return;
   }
 
+  this->ClearAccumulationCache();
   this->Modified();
 }
 
@@ -203,12 +529,16 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
     return errorMessage;
   }
 
-  // Get reference image info
-  int referenceDimensions[3] = {0, 0, 0};
-  referenceDoseVolumeNode->GetImageData()->GetDimensions(referenceDimensions);
+  if (!referenceDoseVolumeNode->GetImageData())
+  {
+    std::string errorMessage("No image data in reference volume");
+    vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage);
+    return errorMessage;
+  }
 
-  // Apply weight and accumulate input dose volumes
-  vtkSmartPointer<vtkImageData> accumulatedImageData = vtkSmartPointer<vtkImageData>::New();
+  // Collect the selected input doses and their weights
+  std::map<std::string,double>* volumeNodeIdsToWeightsMap = parameterNode->GetVolumeNodeIdsToWeightsMap();
+  std::map<std::string, vtkMRMLScalarVolumeNode*> inputDoseVolumeNodes;
   for (int inputVolumeIndex = 0; inputVolumeIndex<numberOfInputDoseVolumes; inputVolumeIndex++)
   {
     vtkMRMLScalarVolumeNode* currentInputDoseVolumeNode = parameterNode->GetNthSelectedInputVolumeNode(inputVolumeIndex);
@@ -219,39 +549,111 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
       vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage.str());
       return errorMessage.str().c_str();
     }
-    std::map<std::string,double>* volumeNodeIdsToWeightsMap = parameterNode->GetVolumeNodeIdsToWeightsMap();
-    double currentWeight = (*volumeNodeIdsToWeightsMap)[currentInputDoseVolumeNode->GetID()];
+    inputDoseVolumeNodes[currentInputDoseVolumeNode->GetID()] = currentInputDoseVolumeNode;
+  }
 
-    vtkMRMLScalarVolumeNode* resampledInputDoseVolumeNode = 
-      vtkSlicerVolumesLogic::ResampleVolumeToReferenceVolume(currentInputDoseVolumeNode, referenceDoseVolumeNode);
+  // The running sum and the cached resampled doses are only valid for the same parameter node and reference geometry
+  std::string referenceKey = vtkSlicerRtCommon::GetVolumeNodeStateKey(referenceDoseVolumeNode, false);
+  if (referenceKey != this->Internal->ReferenceKey)
+  {
+    this->ClearAccumulationCache();
+    this->Internal->ReferenceKey = referenceKey;
+  }
+  std::string parameterNodeID(parameterNode->GetID() ? parameterNode->GetID() : "");
+  if (parameterNodeID != this->Internal->ParameterNodeID)
+  {
+    this->Internal->ClearRunningSum();
+    this->Internal->ParameterNodeID = parameterNodeID;
+  }
 
-    // Apply weight
-    vtkSmartPointer<vtkImageMathematics> multiplyFilter = vtkSmartPointer<vtkImageMathematics>::New();
-    multiplyFilter->SetInputConnection(resampledInputDoseVolumeNode->GetImageDataConnection());
-    multiplyFilter->SetConstantK(currentWeight);
-    multiplyFilter->SetOperationToMultiplyByK();
-    multiplyFilter->Update();
+  // Input doses that were removed or changed since the last accumulation need to be subtracted from the running sum,
+  // which is only possible if their resampled dose is still in the cache. Otherwise the sum is recomputed.
+  // The sum is also recomputed after a number of incremental updates, so that the rounding errors do not build up.
+  bool recomputeRunningSum = ( this->Internal->AccumulatedImageData.GetPointer() == NULL
+    || this->Internal->NumberOfIncrementalUpdates >= this->MaximumNumberOfIncrementalUpdates );
+  std::map<std::string, vtkInternal::AppliedInput>::iterator appliedIt;
+  for (appliedIt=this->Internal->AppliedInputs.begin(); appliedIt!=this->Internal->AppliedInputs.end() && !recomputeRunningSum; ++appliedIt)
+  {
+    std::map<std::string, vtkMRMLScalarVolumeNode*>::iterator inputIt = inputDoseVolumeNodes.find(appliedIt->first);
+    if ( inputIt != inputDoseVolumeNodes.end()
+      && vtkSlicerRtCommon::GetVolumeNodeStateKey(inputIt->second, true) == appliedIt->second.InputKey )
+    {
+      continue;
+    }
+    if ( appliedIt->second.Weight != 0.0
+      && !this->Internal->GetResampledDose(appliedIt->second.InputKey) )
+    {
+      recomputeRunningSum = true;
+    }
+  }
 
-    // Add (accumulate) current input volume to the intermediate accumulated volume
-    if (inputVolumeIndex > 0)
+  if (recomputeRunningSum)
+  {
+    // Allocate the accumulated dose on the lattice of the reference volume
+    vtkSmartPointer<vtkMatrix4x4> referenceIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    referenceDoseVolumeNode->GetIJKToRASMatrix(referenceIjkToRasMatrix);
+    this->Internal->AccumulatedImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+    this->Internal->AccumulatedImageData->SetExtent(referenceDoseVolumeNode->GetImageData()->GetExtent());
+    this->Internal->AccumulatedImageData->SetGeometryFromImageToWorldMatrix(referenceIjkToRasMatrix);
+    this->Internal->AccumulatedImageData->AllocateScalars(VTK_FLOAT, 1);
+    memset(this->Internal->AccumulatedImageData->GetScalarPointer(), 0,
+      this->Internal->AccumulatedImageData->GetNumberOfPoints() * sizeof(float));
+    this->Internal->AppliedInputs.clear();
+    this->Internal->NumberOfIncrementalUpdates = 0;
+  }
+  else
+  {
+    // Subtract the removed and changed input doses
+    for (appliedIt=this->Internal->AppliedInputs.begin(); appliedIt!=this->Internal->AppliedInputs.end(); )
     {
-      vtkSmartPointer<vtkImageMathematics> addFilter = vtkSmartPointer<vtkImageMathematics>::New(); 
-      addFilter->SetInput1Data(accumulatedImageData);
-      addFilter->SetInput2Data(multiplyFilter->GetOutput());
-      addFilter->SetOperationToAdd();
-      addFilter->Update();
+      std::map<std::string, vtkMRMLScalarVolumeNode*>::iterator inputIt = inputDoseVolumeNodes.find(appliedIt->first);
+      if ( inputIt != inputDoseVolumeNodes.end()
+        && vtkSlicerRtCommon::GetVolumeNodeStateKey(inputIt->second, true) == appliedIt->second.InputKey )
+      {
+        ++appliedIt;
+        continue;
+      }
+      if (appliedIt->second.Weight != 0.0)
+      {
+        vtkSlicerDoseAccumulationAddScaled(this->Internal->GetResampledDose(appliedIt->second.InputKey),
+          -appliedIt->second.Weight, this->Internal->AccumulatedImageData);
+        this->Internal->NumberOfIncrementalUpdates++;
+      }
+      this->Internal->AppliedInputs.erase(appliedIt++);
+    }
+  }
 
-      accumulatedImageData->DeepCopy(addFilter->GetOutput());
+  // Apply the weight changes and add the new input doses
+  std::map<std::string, vtkMRMLScalarVolumeNode*>::iterator inputIt;
+  for (inputIt=inputDoseVolumeNodes.begin(); inputIt!=inputDoseVolumeNodes.end(); ++inputIt)
+  {
+    double currentWeight = (*volumeNodeIdsToWeightsMap)[inputIt->first];
+    double appliedWeight = 0.0;
+    appliedIt = this->Internal->AppliedInputs.find(inputIt->first);
+    if (appliedIt != this->Internal->AppliedInputs.end())
+    {
+      appliedWeight = appliedIt->second.Weight;
+      if (currentWeight != appliedWeight)
+      {
+        this->Internal->NumberOfIncrementalUpdates++;
+      }
     }
-    // If intermediate accumulated volume is empty (first iteration)
-    // then just copy the weighted input dose volume in it
-    else
+
+    std::string inputKey = vtkSlicerRtCommon::GetVolumeNodeStateKey(inputIt->second, true);
+    std::string errorMessage = this->AddWeightedResampledDoseVolume(inputIt->second, inputKey, referenceDoseVolumeNode,
+      currentWeight - appliedWeight, this->Internal->AccumulatedImageData);
+    if (!errorMessage.empty())
     {
-      accumulatedImageData->DeepCopy(multiplyFilter->GetOutput());
+      // The running sum is in an undefined state
+      this->Internal->ClearRunningSum();
+      vtkErrorMacro("AccumulateDoseVolumes: " << errorMessage);
+      return errorMessage;
     }
 
-    // Remove the resample dose currentNode from scene and release the memory
-    this->GetMRMLScene()->RemoveNode(resampledInputDoseVolumeNode);
+    vtkInternal::AppliedInput appliedInput;
+    appliedInput.Weight = currentWeight;
+    appliedInput.InputKey = inputKey;
+    this->Internal->AppliedInputs[inputIt->first] = appliedInput;
   }
 
   // Create display currentNode for the accumulated volume
@@ -270,9 +672,14 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
     vtkErrorMacro("AccumulateDoseVolumes: Failed to get default dose color table");
   }
 
-  // Set output accumulated dose image info
+  // Set output accumulated dose image info (the geometry is stored in the volume node)
+  // (copy the running sum, as it is modified in place by the next accumulation)
+  vtkSmartPointer<vtkImageData> outputAccumulatedImageData = vtkSmartPointer<vtkImageData>::New();
+  outputAccumulatedImageData->DeepCopy(this->Internal->AccumulatedImageData);
+  outputAccumulatedImageData->SetOrigin(0.0, 0.0, 0.0);
+  outputAccumulatedImageData->SetSpacing(1.0, 1.0, 1.0);
   outputAccumulatedDoseVolumeNode->CopyOrientation(referenceDoseVolumeNode);
-  outputAccumulatedDoseVolumeNode->SetAndObserveImageData(accumulatedImageData);
+  outputAccumulatedDoseVolumeNode->SetAndObserveImageData(outputAccumulatedImageData);
   outputAccumulatedDoseVolumeNode->SetAndObserveDisplayNodeID( outputAccumulatedDoseVolumeDisplayNode->GetID() );
   outputAccumulatedDoseVolumeNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_VOLUME_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
 
@@ -325,3 +732,279 @@ std::string vtkSlicerDoseAccumulationModuleLogic::AccumulateDoseVolumes(vtkMRMLD
 
   return "";
 }
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseAccumulationModuleLogic::AddWeightedResampledDoseVolume(vtkMRMLScalarVolumeNode* inputDoseVolumeNode,
+  std::string inputKey, vtkMRMLScalarVolumeNode* referenceDoseVolumeNode, double weight, vtkOrientedImageData* accumulatedImageData)
+{
+  if (weight == 0.0)
+  {
+    return "";
+  }
+
+  // Use the cached resampled dose if available
+  vtkOrientedImageData* resampledDoseImageData = this->Internal->GetResampledDose(inputKey);
+  if (resampledDoseImageData)
+  {
+    vtkSlicerDoseAccumulationAddScaled(resampledDoseImageData, weight, accumulatedImageData);
+    return "";
+  }
+
+  // Get input dose image with its geometry, and the transform between the reference and the input volume
+  // (including non-linear parent transforms) without adding any nodes to the scene
+  vtkSmartPointer<vtkMatrix4x4> inputIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  inputDoseVolumeNode->GetIJKToRASMatrix(inputIjkToRasMatrix);
+  vtkSmartPointer<vtkOrientedImageData> inputDoseImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  inputDoseImageData->vtkImageData::ShallowCopy(inputDoseVolumeNode->GetImageData());
+  inputDoseImageData->SetGeometryFromImageToWorldMatrix(inputIjkToRasMatrix);
+
+  vtkSmartPointer<vtkAbstractTransform> referenceToInputTransform;
+  vtkSmartPointer<vtkMatrix4x4> referenceToInputTransformMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (vtkMRMLTransformNode::GetMatrixTransformBetweenNodes(
+    referenceDoseVolumeNode->GetParentTransformNode(), inputDoseVolumeNode->GetParentTransformNode(), referenceToInputTransformMatrix))
+  {
+    vtkSmartPointer<vtkTransform> referenceToInputLinearTransform = vtkSmartPointer<vtkTransform>::New();
+    referenceToInputLinearTransform->SetMatrix(referenceToInputTransformMatrix);
+    referenceToInputTransform = referenceToInputLinearTransform;
+  }
+  else
+  {
+    vtkSmartPointer<vtkGeneralTransform> referenceToInputGeneralTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+    vtkMRMLTransformNode::GetTransformBetweenNodes(
+      referenceDoseVolumeNode->GetParentTransformNode(), inputDoseVolumeNode->GetParentTransformNode(), referenceToInputGeneralTransform);
+    referenceToInputTransform = referenceToInputGeneralTransform;
+  }
+
+  // Add weighted input dose directly to the accumulated dose if it does not fit in the cache
+  double resampledDoseSizeMB = accumulatedImageData->GetNumberOfPoints() * sizeof(float) / (1024.0 * 1024.0);
+  if (resampledDoseSizeMB > this->ResampledDoseCacheMemoryLimitMB)
+  {
+    return this->AddWeightedDoseImage(inputDoseImageData, referenceToInputTransform, weight, accumulatedImageData);
+  }
+
+  // Resample input dose with unit weight, cache it, and add it to the accumulated dose
+  vtkSmartPointer<vtkMatrix4x4> accumulatedIjkToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  accumulatedImageData->GetImageToWorldMatrix(accumulatedIjkToWorldMatrix);
+  vtkSmartPointer<vtkOrientedImageData> newResampledDoseImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  newResampledDoseImageData->SetExtent(accumulatedImageData->GetExtent());
+  newResampledDoseImageData->SetGeometryFromImageToWorldMatrix(accumulatedIjkToWorldMatrix);
+  newResampledDoseImageData->AllocateScalars(VTK_FLOAT, 1);
+  memset(newResampledDoseImageData->GetScalarPointer(), 0, newResampledDoseImageData->GetNumberOfPoints() * sizeof(float));
+  std::string errorMessage = this->AddWeightedDoseImage(inputDoseImageData, referenceToInputTransform, 1.0, newResampledDoseImageData);
+  if (!errorMessage.empty())
+  {
+    return errorMessage;
+  }
+  this->Internal->ResampledDoses->SetMemoryLimitMB(this->ResampledDoseCacheMemoryLimitMB);
+  this->Internal->ResampledDoses->AddItem(inputKey, newResampledDoseImageData);
+
+  vtkSlicerDoseAccumulationAddScaled(newResampledDoseImageData, weight, accumulatedImageData);
+  return "";
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerDoseAccumulationModuleLogic::ClearAccumulationCache()
+{
+  this->Internal->ResampledDoses->RemoveAllItems();
+  this->Internal->ClearRunningSum();
+  this->Internal->ReferenceKey.clear();
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseAccumulationModuleLogic::AddWeightedDoseImage(vtkOrientedImageData* inputDoseImageData,
+  vtkAbstractTransform* accumulatedToInputTransform, double weight, vtkOrientedImageData* accumulatedImageData)
+{
+  if (!inputDoseImageData || inputDoseImageData->GetNumberOfScalarComponents() != 1 || !inputDoseImageData->GetScalarPointer())
+  {
+    std::string errorMessage("Input dose image needs to have a single scalar component");
+    vtkErrorMacro("AddWeightedDoseImage: " << errorMessage);
+    return errorMessage;
+  }
+  if (!vtkSlicerDoseAccumulationIsValidAccumulatedImage(accumulatedImageData))
+  {
+    std::string errorMessage("Accumulated dose needs to be an allocated single component float image");
+    vtkErrorMacro("AddWeightedDoseImage: " << errorMessage);
+    return errorMessage;
+  }
+
+  int accumulatedExtent[6] = {0,-1,0,-1,0,-1};
+  accumulatedImageData->GetExtent(accumulatedExtent);
+  if (accumulatedExtent[5] < accumulatedExtent[4])
+  {
+    return "";
+  }
+
+  vtkLinearTransform* accumulatedToInputLinearTransform = vtkLinearTransform::SafeDownCast(accumulatedToInputTransform);
+  if (accumulatedToInputTransform && !accumulatedToInputLinearTransform)
+  {
+    // Non-linear transform (e.g. deformation field) cannot be expressed as a mapping between voxel indices,
+    // so compute the input voxel index of each accumulated voxel first
+    vtkSmartPointer<vtkFloatArray> sampleCoordinates = vtkSmartPointer<vtkFloatArray>::New();
+    std::string errorMessage = this->ComputeSampleCoordinates(inputDoseImageData, accumulatedToInputTransform, accumulatedImageData, sampleCoordinates);
+    if (!errorMessage.empty())
+    {
+      return errorMessage;
+    }
+    return this->AddWeightedDoseImageAtSampleCoordinates(inputDoseImageData, sampleCoordinates, weight, accumulatedImageData);
+  }
+
+  // Sample the input dose directly at the accumulated voxels
+  vtkSmartPointer<vtkMatrix4x4> accumulatedIjkToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  accumulatedImageData->GetImageToWorldMatrix(accumulatedIjkToWorldMatrix);
+  vtkSmartPointer<vtkMatrix4x4> inputWorldToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  inputDoseImageData->GetWorldToImageMatrix(inputWorldToIjkMatrix);
+
+  vtkSmartPointer<vtkMatrix4x4> accumulatedIjkToInputWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  accumulatedIjkToInputWorldMatrix->DeepCopy(accumulatedIjkToWorldMatrix);
+  if (accumulatedToInputLinearTransform)
+  {
+    vtkMatrix4x4::Multiply4x4(accumulatedToInputLinearTransform->GetMatrix(), accumulatedIjkToWorldMatrix, accumulatedIjkToInputWorldMatrix);
+  }
+  vtkSmartPointer<vtkMatrix4x4> accumulatedIjkToInputIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Multiply4x4(inputWorldToIjkMatrix, accumulatedIjkToInputWorldMatrix, accumulatedIjkToInputIjkMatrix);
+
+  // Add the weighted input dose to the accumulated dose in parallel over the slices
+  vtkSlicerDoseAccumulationAddWeightedFunctor functor(inputDoseImageData, accumulatedIjkToInputIjkMatrix, NULL, weight, accumulatedImageData);
+  vtkSMPTools::For(0, accumulatedExtent[5] - accumulatedExtent[4] + 1, functor);
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseAccumulationModuleLogic::ComputeSampleCoordinates(vtkOrientedImageData* inputGeometryImageData,
+  vtkAbstractTransform* accumulatedToInputTransform, vtkOrientedImageData* accumulatedGeometryImageData, vtkFloatArray* sampleCoordinates)
+{
+  if (!inputGeometryImageData || !accumulatedGeometryImageData || !sampleCoordinates)
+  {
+    std::string errorMessage("Invalid input arguments");
+    vtkErrorMacro("ComputeSampleCoordinates: " << errorMessage);
+    return errorMessage;
+  }
+
+  int accumulatedExtent[6] = {0,-1,0,-1,0,-1};
+  accumulatedGeometryImageData->GetExtent(accumulatedExtent);
+  sampleCoordinates->SetNumberOfComponents(3);
+  sampleCoordinates->SetNumberOfTuples(accumulatedGeometryImageData->GetNumberOfPoints());
+  if (accumulatedExtent[5] < accumulatedExtent[4])
+  {
+    return "";
+  }
+
+  // Accumulated voxel index -> accumulated world -> input world -> input voxel index
+  vtkSmartPointer<vtkMatrix4x4> accumulatedIjkToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  accumulatedGeometryImageData->GetImageToWorldMatrix(accumulatedIjkToWorldMatrix);
+  vtkSmartPointer<vtkMatrix4x4> inputWorldToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  inputGeometryImageData->GetWorldToImageMatrix(inputWorldToIjkMatrix);
+
+  vtkSmartPointer<vtkGeneralTransform> accumulatedIjkToInputIjkTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  accumulatedIjkToInputIjkTransform->PostMultiply();
+  accumulatedIjkToInputIjkTransform->Concatenate(accumulatedIjkToWorldMatrix);
+  if (accumulatedToInputTransform)
+  {
+    accumulatedIjkToInputIjkTransform->Concatenate(accumulatedToInputTransform);
+  }
+  accumulatedIjkToInputIjkTransform->Concatenate(inputWorldToIjkMatrix);
+  accumulatedIjkToInputIjkTransform->Update();
+
+  vtkSlicerDoseAccumulationSampleCoordinatesFunctor functor(accumulatedIjkToInputIjkTransform, accumulatedExtent, sampleCoordinates->GetPointer(0));
+  vtkSMPTools::For(0, accumulatedExtent[5] - accumulatedExtent[4] + 1, functor);
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseAccumulationModuleLogic::AddWeightedDoseImageAtSampleCoordinates(vtkOrientedImageData* inputDoseImageData,
+  vtkFloatArray* sampleCoordinates, double weight, vtkOrientedImageData* accumulatedImageData)
+{
+  if (!inputDoseImageData || inputDoseImageData->GetNumberOfScalarComponents() != 1 || !inputDoseImageData->GetScalarPointer())
+  {
+    std::string errorMessage("Input dose image needs to have a single scalar component");
+    vtkErrorMacro("AddWeightedDoseImageAtSampleCoordinates: " << errorMessage);
+    return errorMessage;
+  }
+  if (!vtkSlicerDoseAccumulationIsValidAccumulatedImage(accumulatedImageData))
+  {
+    std::string errorMessage("Accumulated dose needs to be an allocated single component float image");
+    vtkErrorMacro("AddWeightedDoseImageAtSampleCoordinates: " << errorMessage);
+    return errorMessage;
+  }
+  if ( !sampleCoordinates || sampleCoordinates->GetNumberOfComponents() != 3
+    || sampleCoordinates->GetNumberOfTuples() != accumulatedImageData->GetNumberOfPoints() )
+  {
+    std::string errorMessage("Sample coordinates do not match the accumulated dose image");
+    vtkErrorMacro("AddWeightedDoseImageAtSampleCoordinates: " << errorMessage);
+    return errorMessage;
+  }
+
+  int accumulatedExtent[6] = {0,-1,0,-1,0,-1};
+  accumulatedImageData->GetExtent(accumulatedExtent);
+  if (accumulatedExtent[5] < accumulatedExtent[4])
+  {
+    return "";
+  }
+
+  vtkSlicerDoseAccumulationAddWeightedFunctor functor(inputDoseImageData, NULL, sampleCoordinates, weight, accumulatedImageData);
+  vtkSMPTools::For(0, accumulatedExtent[5] - accumulatedExtent[4] + 1, functor);
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseAccumulationModuleLogic::AddWeightedDoseImages(vtkCollection* inputDoseImages,
+  vtkAbstractTransform* accumulatedToInputTransform, double weight, vtkCollection* accumulatedImages)
+{
+  if ( !inputDoseImages || !accumulatedImages || inputDoseImages->GetNumberOfItems() != accumulatedImages->GetNumberOfItems() )
+  {
+    std::string errorMessage("There needs to be one accumulated image for each input dose image");
+    vtkErrorMacro("AddWeightedDoseImages: " << errorMessage);
+    return errorMessage;
+  }
+  if (inputDoseImages->GetNumberOfItems() == 0)
+  {
+    return "";
+  }
+
+  vtkOrientedImageData* firstInputDoseImageData = vtkOrientedImageData::SafeDownCast(inputDoseImages->GetItemAsObject(0));
+  vtkOrientedImageData* firstAccumulatedImageData = vtkOrientedImageData::SafeDownCast(accumulatedImages->GetItemAsObject(0));
+  for (int channelIndex=0; channelIndex<inputDoseImages->GetNumberOfItems(); ++channelIndex)
+  {
+    vtkOrientedImageData* inputDoseImageData = vtkOrientedImageData::SafeDownCast(inputDoseImages->GetItemAsObject(channelIndex));
+    vtkOrientedImageData* accumulatedImageData = vtkOrientedImageData::SafeDownCast(accumulatedImages->GetItemAsObject(channelIndex));
+    if ( !inputDoseImageData || !accumulatedImageData
+      || !vtkOrientedImageDataResample::DoGeometriesMatch(inputDoseImageData, firstInputDoseImageData)
+      || !vtkOrientedImageDataResample::DoGeometriesMatch(accumulatedImageData, firstAccumulatedImageData) )
+    {
+      std::stringstream errorMessage;
+      errorMessage << "Dose channel #" << channelIndex << " is not an oriented image with the same geometry as the first channel";
+      vtkErrorMacro("AddWeightedDoseImages: " << errorMessage.str());
+      return errorMessage.str();
+    }
+  }
+
+  // Linear transforms need no precomputation
+  if (!accumulatedToInputTransform || vtkLinearTransform::SafeDownCast(accumulatedToInputTransform))
+  {
+    for (int channelIndex=0; channelIndex<inputDoseImages->GetNumberOfItems(); ++channelIndex)
+    {
+      std::string errorMessage = this->AddWeightedDoseImage(
+        vtkOrientedImageData::SafeDownCast(inputDoseImages->GetItemAsObject(channelIndex)), accumulatedToInputTransform,
+        weight, vtkOrientedImageData::SafeDownCast(accumulatedImages->GetItemAsObject(channelIndex)) );
+      if (!errorMessage.empty())
+      {
+        return errorMessage;
+      }
+    }
+    return "";
+  }
+
+  // Evaluate the non-linear transform once for all channels
+  vtkSmartPointer<vtkFloatArray> sampleCoordinates = vtkSmartPointer<vtkFloatArray>::New();
+  std::string errorMessage = this->ComputeSampleCoordinates(firstInputDoseImageData, accumulatedToInputTransform, firstAccumulatedImageData, sampleCoordinates);
+  for (int channelIndex=0; channelIndex<inputDoseImages->GetNumberOfItems() && errorMessage.empty(); ++channelIndex)
+  {
+    errorMessage = this->AddWeightedDoseImageAtSampleCoordinates(
+      vtkOrientedImageData::SafeDownCast(inputDoseImages->GetItemAsObject(channelIndex)), sampleCoordinates,
+      weight, vtkOrientedImageData::SafeDownCast(accumulatedImages->GetItemAsObject(channelIndex)) );
+  }
+  return errorMessage;
+}
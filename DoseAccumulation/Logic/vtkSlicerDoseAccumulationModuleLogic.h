@@ -34,6 +34,11 @@
 #include "vtkSlicerDoseAccumulationModuleLogicExport.h"
 
 class vtkMRMLDoseAccumulationNode;
+class vtkMRMLScalarVolumeNode;
+class vtkOrientedImageData;
+class vtkAbstractTransform;
+class vtkCollection;
+class vtkFloatArray;
 
 /// \ingroup SlicerRt_QtModules_DoseAccumulation
 class VTK_SLICER_DOSEACCUMULATION_LOGIC_EXPORT vtkSlicerDoseAccumulationModuleLogic :
@@ -51,9 +56,69 @@ public:
   void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
 
   /// Accumulates dose volumes with the given IDs and corresponding weights
+  ///
+  /// The accumulated dose is kept as a running sum between calls, so if only weights are changed or input
+  /// doses are added or removed, then only the weight differences are applied. The input doses resampled
+  /// to the reference lattice are cached (\sa ResampledDoseCacheMemoryLimitMB), which makes re-weighting
+  /// a single pass over the voxels. The sum is recomputed if the reference volume changes, if an input
+  /// dose that needs to be subtracted from the running sum is not in the cache any more, or if the number of
+  /// incremental updates reaches \sa MaximumNumberOfIncrementalUpdates.
   /// \return Error message on failure, NULL otherwise
   std::string AccumulateDoseVolumes(vtkMRMLDoseAccumulationNode* parameterNode);
 
+  /// Remove the running sum and the cached resampled doses
+  void ClearAccumulationCache();
+
+  /// Memory limit for the cached resampled input doses in megabytes. Least recently used resampled doses are
+  /// removed from the cache when it is exceeded. 0 disables caching. Default is 512.
+  vtkGetMacro(ResampledDoseCacheMemoryLimitMB, double);
+  vtkSetMacro(ResampledDoseCacheMemoryLimitMB, double);
+
+  /// Maximum number of incremental updates (weight changes and removals of input doses already in the running sum)
+  /// before the running sum is recomputed from the resampled input doses. The float running sum accumulates rounding
+  /// errors with each addition and subtraction, which this bounds. 0 means that the sum is always recomputed. Default is 32.
+  vtkGetMacro(MaximumNumberOfIncrementalUpdates, int);
+  vtkSetMacro(MaximumNumberOfIncrementalUpdates, int);
+
+  /// Add weighted input dose image, resampled to the geometry of the accumulated dose image using linear interpolation,
+  /// to the accumulated dose. Does not use the MRML scene, so it can be used for batch accumulation without a GUI.
+  /// If the transform is linear, the input is sampled directly at the accumulated voxels (in parallel over the slices),
+  /// so neither a resampled nor a weighted copy of the input is created. For non-linear transforms (e.g. deformation fields)
+  /// the input voxel index of each accumulated voxel is computed first (\sa ComputeSampleCoordinates).
+  /// \param inputDoseImageData Input dose image with its geometry
+  /// \param accumulatedToInputTransform Transform from the world coordinate system of the accumulated image to that of the
+  ///   input image (e.g. the transform between the parent transforms of the reference and the input volume). NULL means identity.
+  /// \param accumulatedImageData Allocated float image with the geometry of the reference volume that the weighted dose is added to
+  /// \return Error message, empty string if no error
+  std::string AddWeightedDoseImage(vtkOrientedImageData* inputDoseImageData, vtkAbstractTransform* accumulatedToInputTransform,
+    double weight, vtkOrientedImageData* accumulatedImageData);
+
+  /// Compute the continuous voxel index of the input image at each voxel of the accumulated image by evaluating
+  /// the transform (e.g. a displacement field) once per voxel, in parallel over the slices. The coordinates only
+  /// depend on the geometries and the transform, so they can be reused for all dose channels of a fraction
+  /// (e.g. physical dose and LET) that are on the same lattice. \sa AddWeightedDoseImageAtSampleCoordinates
+  /// \param inputGeometryImageData Image defining the geometry of the input dose (only the geometry is used)
+  /// \param accumulatedToInputTransform Transform from the world coordinate system of the accumulated image to that of the input image
+  /// \param accumulatedGeometryImageData Image defining the geometry of the accumulated dose (only the geometry is used)
+  /// \param sampleCoordinates Output array with three components and one tuple per accumulated voxel
+  /// \return Error message, empty string if no error
+  std::string ComputeSampleCoordinates(vtkOrientedImageData* inputGeometryImageData, vtkAbstractTransform* accumulatedToInputTransform,
+    vtkOrientedImageData* accumulatedGeometryImageData, vtkFloatArray* sampleCoordinates);
+
+  /// Add weighted input dose image, linearly interpolated at precomputed sample coordinates, to the accumulated dose.
+  /// \param sampleCoordinates Input voxel indices computed by \sa ComputeSampleCoordinates for the geometries of the two images
+  /// \return Error message, empty string if no error
+  std::string AddWeightedDoseImageAtSampleCoordinates(vtkOrientedImageData* inputDoseImageData, vtkFloatArray* sampleCoordinates,
+    double weight, vtkOrientedImageData* accumulatedImageData);
+
+  /// Add multiple weighted dose channels of a fraction (e.g. physical dose and LET) to the corresponding accumulated images.
+  /// A non-linear transform is evaluated only once for all the channels. \sa AddWeightedDoseImage
+  /// \param inputDoseImages Input dose images (vtkOrientedImageData) on the same lattice
+  /// \param accumulatedImages Accumulated images (vtkOrientedImageData) on the same lattice, one for each input dose image
+  /// \return Error message, empty string if no error
+  std::string AddWeightedDoseImages(vtkCollection* inputDoseImages, vtkAbstractTransform* accumulatedToInputTransform,
+    double weight, vtkCollection* accumulatedImages);
+
 protected:
   vtkSlicerDoseAccumulationModuleLogic();
   virtual ~vtkSlicerDoseAccumulationModuleLogic();
@@ -68,6 +133,23 @@ protected:
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node) VTK_OVERRIDE;
   virtual void OnMRMLSceneEndClose() VTK_OVERRIDE;
 
+  /// Add weighted input dose volume to the accumulated dose on the lattice of the reference volume.
+  /// Uses and fills the cache of resampled input doses.
+  /// \param inputKey Key identifying the current state of the input volume
+  /// \return Error message, empty string if no error
+  std::string AddWeightedResampledDoseVolume(vtkMRMLScalarVolumeNode* inputDoseVolumeNode, std::string inputKey,
+    vtkMRMLScalarVolumeNode* referenceDoseVolumeNode, double weight, vtkOrientedImageData* accumulatedImageData);
+
+protected:
+  /// Memory limit for the cached resampled input doses in megabytes
+  double ResampledDoseCacheMemoryLimitMB;
+
+  /// Maximum number of incremental updates of the running sum before it is recomputed
+  int MaximumNumberOfIncrementalUpdates;
+
+  class vtkInternal;
+  vtkInternal* Internal;
+
 private:
   vtkSlicerDoseAccumulationModuleLogic(const vtkSlicerDoseAccumulationModuleLogic&); // Not implemented
   void operator=(const vtkSlicerDoseAccumulationModuleLogic&);               // Not implemented
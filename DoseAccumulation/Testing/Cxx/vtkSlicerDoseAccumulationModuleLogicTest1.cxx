@@ -43,6 +43,15 @@
 #include <vtkImageAccumulate.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkFloatArray.h>
+#include <vtkCollection.h>
+#include <vtkTransform.h>
+#include <vtkGridTransform.h>
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
 
 // ITK includes
 #if ITK_VERSION_MAJOR > 3
@@ -52,6 +61,280 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+// Get the maximum absolute voxel difference of two images with the same number of voxels
+// Returns -1 if the images cannot be compared.
+double GetMaximumAbsoluteDoseDifference(vtkImageData* image1, vtkImageData* image2)
+{
+  if ( !image1 || !image2 || !image1->GetPointData()->GetScalars() || !image2->GetPointData()->GetScalars()
+    || image1->GetNumberOfPoints() != image2->GetNumberOfPoints() )
+  {
+    return -1.0;
+  }
+  vtkDataArray* scalars1 = image1->GetPointData()->GetScalars();
+  vtkDataArray* scalars2 = image2->GetPointData()->GetScalars();
+  double maximumDifference = 0.0;
+  for (vtkIdType pointId = 0; pointId < image1->GetNumberOfPoints(); ++pointId)
+  {
+    maximumDifference = std::max(maximumDifference, fabs(scalars1->GetTuple1(pointId) - scalars2->GetTuple1(pointId)));
+  }
+  return maximumDifference;
+}
+
+//-----------------------------------------------------------------------------
+// Accumulate with the given logic, which updates its running sum incrementally, and compare the result
+// to the accumulation of a new logic that computes the sum from scratch
+bool CheckIncrementalAccumulation(vtkSlicerDoseAccumulationModuleLogic* logic, vtkMRMLDoseAccumulationNode* paramNode, const char* stepName)
+{
+  std::string errorMessage = logic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Incremental accumulation failed (" << stepName << "): " << errorMessage << std::endl;
+    return false;
+  }
+  vtkSmartPointer<vtkImageData> incrementalDose = vtkSmartPointer<vtkImageData>::New();
+  incrementalDose->DeepCopy(paramNode->GetAccumulatedDoseVolumeNode()->GetImageData());
+
+  vtkSmartPointer<vtkSlicerDoseAccumulationModuleLogic> referenceLogic = vtkSmartPointer<vtkSlicerDoseAccumulationModuleLogic>::New();
+  referenceLogic->SetMRMLScene(logic->GetMRMLScene());
+  errorMessage = referenceLogic->AccumulateDoseVolumes(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Full accumulation failed (" << stepName << "): " << errorMessage << std::endl;
+    return false;
+  }
+  vtkImageData* fullDose = paramNode->GetAccumulatedDoseVolumeNode()->GetImageData();
+
+  // The float running sum is allowed to differ by rounding errors relative to the dose range
+  double fullDoseRange[2] = {0.0, 0.0};
+  fullDose->GetScalarRange(fullDoseRange);
+  double tolerance = 1.0e-4 * std::max(fabs(fullDoseRange[0]), fabs(fullDoseRange[1]));
+  double maximumDifference = GetMaximumAbsoluteDoseDifference(incrementalDose, fullDose);
+  if (maximumDifference < 0.0 || maximumDifference > tolerance)
+  {
+    std::cerr << "ERROR: Incrementally accumulated dose differs from the full accumulation (" << stepName
+      << "): maximum difference " << maximumDifference << ", tolerance " << tolerance << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Synthetic dose that is linear in world coordinates, so linear interpolation reproduces it exactly
+double GetSyntheticDose(const double worldPosition[3])
+{
+  return 50.0 + 0.5 * worldPosition[0] + 0.25 * worldPosition[1] - 0.2 * worldPosition[2];
+}
+
+//-----------------------------------------------------------------------------
+// Create an allocated float image with the given geometry, filled with zeros or with the synthetic dose
+vtkSmartPointer<vtkOrientedImageData> CreateSyntheticImage(const double spacing[3], const double origin[3], int dimension, bool fillWithDose)
+{
+  vtkSmartPointer<vtkMatrix4x4> ijkToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  for (int axis=0; axis<3; ++axis)
+  {
+    ijkToWorldMatrix->SetElement(axis, axis, spacing[axis]);
+    ijkToWorldMatrix->SetElement(axis, 3, origin[axis]);
+  }
+  vtkSmartPointer<vtkOrientedImageData> image = vtkSmartPointer<vtkOrientedImageData>::New();
+  image->SetExtent(0, dimension-1, 0, dimension-1, 0, dimension-1);
+  image->SetGeometryFromImageToWorldMatrix(ijkToWorldMatrix);
+  image->AllocateScalars(VTK_FLOAT, 1);
+  float* imagePtr = static_cast<float*>(image->GetScalarPointer());
+  for (int k=0; k<dimension; ++k)
+  {
+    for (int j=0; j<dimension; ++j)
+    {
+      for (int i=0; i<dimension; ++i, ++imagePtr)
+      {
+        double ijk[4] = {double(i), double(j), double(k), 1.0};
+        double world[4] = {0.0, 0.0, 0.0, 1.0};
+        ijkToWorldMatrix->MultiplyPoint(ijk, world);
+        *imagePtr = (fillWithDose ? static_cast<float>(GetSyntheticDose(world)) : 0.0f);
+      }
+    }
+  }
+  return image;
+}
+
+//-----------------------------------------------------------------------------
+// Warp a synthetic dose through a constant displacement field and compare it to the same dose shifted by
+// the equivalent linear transform and to the analytic values. Also tests the sample coordinates and multiple channels.
+bool TestDisplacementFieldAccumulation(vtkSlicerDoseAccumulationModuleLogic* logic)
+{
+  // Input dose with a flipped first axis, and an accumulated lattice partly outside the warped input
+  const double inputSpacing[3] = {-2.0, 2.5, 3.0};
+  const double inputOrigin[3] = {30.0, -5.0, 4.0};
+  const int inputDimension = 16;
+  const double accumulatedSpacing[3] = {1.5, 1.5, 2.0};
+  const double accumulatedOrigin[3] = {0.0, 5.0, 10.0};
+  const int accumulatedDimension = 22;
+  const double displacement[3] = {2.3, -1.7, 0.6};
+  const double weight = 2.0;
+  const double tolerance = 1.0e-3;
+
+  vtkSmartPointer<vtkOrientedImageData> inputDose = CreateSyntheticImage(inputSpacing, inputOrigin, inputDimension, true);
+
+  // Constant displacement field covering the accumulated lattice
+  vtkSmartPointer<vtkImageData> displacementGrid = vtkSmartPointer<vtkImageData>::New();
+  displacementGrid->SetExtent(0, 7, 0, 7, 0, 7);
+  displacementGrid->SetOrigin(-10.0, -10.0, -10.0);
+  displacementGrid->SetSpacing(10.0, 10.0, 10.0);
+  displacementGrid->AllocateScalars(VTK_DOUBLE, 3);
+  for (vtkIdType pointId=0; pointId<displacementGrid->GetNumberOfPoints(); ++pointId)
+  {
+    displacementGrid->GetPointData()->GetScalars()->SetTuple(pointId, displacement);
+  }
+  vtkSmartPointer<vtkGridTransform> gridTransform = vtkSmartPointer<vtkGridTransform>::New();
+  gridTransform->SetInterpolationModeToLinear();
+  gridTransform->SetDisplacementGridData(displacementGrid);
+
+  vtkSmartPointer<vtkTransform> translation = vtkSmartPointer<vtkTransform>::New();
+  translation->Translate(displacement);
+
+  // Sample coordinates are the continuous input voxel indices of the displaced accumulated voxel positions
+  vtkSmartPointer<vtkOrientedImageData> warpedDose = CreateSyntheticImage(accumulatedSpacing, accumulatedOrigin, accumulatedDimension, false);
+  vtkSmartPointer<vtkFloatArray> sampleCoordinates = vtkSmartPointer<vtkFloatArray>::New();
+  std::string errorMessage = logic->ComputeSampleCoordinates(inputDose, gridTransform, warpedDose, sampleCoordinates);
+  if (!errorMessage.empty() || sampleCoordinates->GetNumberOfTuples() != warpedDose->GetNumberOfPoints())
+  {
+    std::cerr << "ERROR: Failed to compute sample coordinates: " << errorMessage << std::endl;
+    return false;
+  }
+  vtkIdType pointId = 0;
+  for (int k=0; k<accumulatedDimension; ++k)
+  {
+    for (int j=0; j<accumulatedDimension; ++j)
+    {
+      for (int i=0; i<accumulatedDimension; ++i, ++pointId)
+      {
+        const int ijk[3] = {i, j, k};
+        for (int axis=0; axis<3; ++axis)
+        {
+          double expectedInputIndex = (accumulatedOrigin[axis] + ijk[axis] * accumulatedSpacing[axis]
+            + displacement[axis] - inputOrigin[axis]) / inputSpacing[axis];
+          if (fabs(sampleCoordinates->GetComponent(pointId, axis) - expectedInputIndex) > tolerance)
+          {
+            std::cerr << "ERROR: Sample coordinate of voxel (" << i << "," << j << "," << k << ") along axis " << axis << " is "
+              << sampleCoordinates->GetComponent(pointId, axis) << " instead of " << expectedInputIndex << std::endl;
+            return false;
+          }
+        }
+      }
+    }
+  }
+
+  // Warping through the displacement field must give the same result as the linear shift
+  errorMessage = logic->AddWeightedDoseImage(inputDose, gridTransform, weight, warpedDose);
+  vtkSmartPointer<vtkOrientedImageData> shiftedDose = CreateSyntheticImage(accumulatedSpacing, accumulatedOrigin, accumulatedDimension, false);
+  if (errorMessage.empty())
+  {
+    errorMessage = logic->AddWeightedDoseImage(inputDose, translation, weight, shiftedDose);
+  }
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Failed to add weighted dose image: " << errorMessage << std::endl;
+    return false;
+  }
+  double maximumDifference = GetMaximumAbsoluteDoseDifference(warpedDose, shiftedDose);
+  if (maximumDifference < 0.0 || maximumDifference > tolerance)
+  {
+    std::cerr << "ERROR: Dose warped by constant displacement field differs from the shifted dose by " << maximumDifference << std::endl;
+    return false;
+  }
+
+  // Inside the input the linear dose is reproduced exactly, and more than half a voxel outside it is zero
+  float* warpedDosePtr = static_cast<float*>(warpedDose->GetScalarPointer());
+  int numberOfInsideVoxels = 0;
+  int numberOfOutsideVoxels = 0;
+  pointId = 0;
+  for (int k=0; k<accumulatedDimension; ++k)
+  {
+    for (int j=0; j<accumulatedDimension; ++j)
+    {
+      for (int i=0; i<accumulatedDimension; ++i, ++pointId)
+      {
+        const int ijk[3] = {i, j, k};
+        double inputWorld[3] = {0.0, 0.0, 0.0};
+        bool inside = true;
+        bool outside = false;
+        for (int axis=0; axis<3; ++axis)
+        {
+          inputWorld[axis] = accumulatedOrigin[axis] + ijk[axis] * accumulatedSpacing[axis] + displacement[axis];
+          double inputIndex = (inputWorld[axis] - inputOrigin[axis]) / inputSpacing[axis];
+          inside = inside && inputIndex >= 0.0 && inputIndex <= inputDimension - 1;
+          outside = outside || inputIndex < -0.5 || inputIndex > inputDimension - 0.5;
+        }
+        double expectedDose = (inside ? weight * GetSyntheticDose(inputWorld) : 0.0);
+        if ((inside || outside) && fabs(warpedDosePtr[pointId] - expectedDose) > tolerance)
+        {
+          std::cerr << "ERROR: Warped dose at voxel (" << i << "," << j << "," << k << ") is " << warpedDosePtr[pointId]
+            << " instead of " << expectedDose << std::endl;
+          return false;
+        }
+        numberOfInsideVoxels += (inside ? 1 : 0);
+        numberOfOutsideVoxels += (outside ? 1 : 0);
+      }
+    }
+  }
+  if (numberOfInsideVoxels == 0 || numberOfOutsideVoxels == 0)
+  {
+    std::cerr << "ERROR: Synthetic lattice does not cover both the inside and the outside of the input dose" << std::endl;
+    return false;
+  }
+
+  // Dose channels warped together through the displacement field are the same as warped one by one
+  vtkSmartPointer<vtkOrientedImageData> inputDose2 = vtkSmartPointer<vtkOrientedImageData>::New();
+  inputDose2->DeepCopy(inputDose);
+  float* inputDose2Ptr = static_cast<float*>(inputDose2->GetScalarPointer());
+  for (vtkIdType inputPointId=0; inputPointId<inputDose2->GetNumberOfPoints(); ++inputPointId)
+  {
+    inputDose2Ptr[inputPointId] *= 2.0f;
+  }
+  vtkSmartPointer<vtkCollection> inputDoses = vtkSmartPointer<vtkCollection>::New();
+  inputDoses->AddItem(inputDose);
+  inputDoses->AddItem(inputDose2);
+  vtkSmartPointer<vtkOrientedImageData> channelDose = CreateSyntheticImage(accumulatedSpacing, accumulatedOrigin, accumulatedDimension, false);
+  vtkSmartPointer<vtkOrientedImageData> channelDose2 = CreateSyntheticImage(accumulatedSpacing, accumulatedOrigin, accumulatedDimension, false);
+  vtkSmartPointer<vtkCollection> accumulatedDoses = vtkSmartPointer<vtkCollection>::New();
+  accumulatedDoses->AddItem(channelDose);
+  accumulatedDoses->AddItem(channelDose2);
+  errorMessage = logic->AddWeightedDoseImages(inputDoses, gridTransform, weight, accumulatedDoses);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Failed to add weighted dose images: " << errorMessage << std::endl;
+    return false;
+  }
+  vtkSmartPointer<vtkOrientedImageData> warpedDose2 = CreateSyntheticImage(accumulatedSpacing, accumulatedOrigin, accumulatedDimension, false);
+  errorMessage = logic->AddWeightedDoseImageAtSampleCoordinates(inputDose2, sampleCoordinates, weight, warpedDose2);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Failed to add weighted dose image at sample coordinates: " << errorMessage << std::endl;
+    return false;
+  }
+  if ( GetMaximumAbsoluteDoseDifference(channelDose, warpedDose) > tolerance
+    || GetMaximumAbsoluteDoseDifference(channelDose2, warpedDose2) > tolerance )
+  {
+    std::cerr << "ERROR: Dose channels warped together differ from the dose warped separately" << std::endl;
+    return false;
+  }
+  float* channelDosePtr = static_cast<float*>(channelDose->GetScalarPointer());
+  float* channelDose2Ptr = static_cast<float*>(channelDose2->GetScalarPointer());
+  for (pointId=0; pointId<channelDose->GetNumberOfPoints(); ++pointId)
+  {
+    if (fabs(channelDose2Ptr[pointId] - 2.0 * channelDosePtr[pointId]) > tolerance)
+    {
+      std::cerr << "ERROR: Second dose channel is not twice the first one at voxel " << pointId << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseAccumulationModuleLogicTest1( int argc, char * argv[] )
 {
@@ -233,6 +516,49 @@ int vtkSlicerDoseAccumulationModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Update the running sum incrementally and compare it to the full accumulation after each change
+  paramNode->SetWeightForDoseVolume(doseScalarVolumeNode2, 1.5);
+  if (!CheckIncrementalAccumulation(doseAccumulationLogic, paramNode, "weight change"))
+  {
+    return EXIT_FAILURE;
+  }
+  paramNode->RemoveSelectedInputVolumeNode(doseScalarVolumeNode2);
+  if (!CheckIncrementalAccumulation(doseAccumulationLogic, paramNode, "input removal"))
+  {
+    return EXIT_FAILURE;
+  }
+  paramNode->AddSelectedInputVolumeNode(doseScalarVolumeNode2, 0.25);
+  if (!CheckIncrementalAccumulation(doseAccumulationLogic, paramNode, "input re-addition"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Many weight changes must not build up rounding errors in the running sum
+  // (the number of weight changes exceeds the default maximum number of incremental updates)
+  for (int weightChangeIndex = 0; weightChangeIndex < 100; ++weightChangeIndex)
+  {
+    paramNode->SetWeightForDoseVolume(doseScalarVolumeNode, 0.1 + 0.37 * (weightChangeIndex % 7));
+    paramNode->SetWeightForDoseVolume(doseScalarVolumeNode2, 3.3 - 0.29 * (weightChangeIndex % 11));
+    errorMessage = doseAccumulationLogic->AccumulateDoseVolumes(paramNode);
+    if (!errorMessage.empty())
+    {
+      std::cerr << "ERROR: " << errorMessage << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  paramNode->SetWeightForDoseVolume(doseScalarVolumeNode, 0.5);
+  paramNode->SetWeightForDoseVolume(doseScalarVolumeNode2, 0.5);
+  if (!CheckIncrementalAccumulation(doseAccumulationLogic, paramNode, "repeated weight changes"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Accumulate a synthetic dose through a displacement field without the scene
+  if (!TestDisplacementFieldAccumulation(doseAccumulationLogic))
+  {
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
 
@@ -24,6 +24,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkGammaDoseComparison.h"
 #include "PlmCommon.h"
 
 // Plastimatch includes
@@ -33,6 +34,7 @@
 #include "vtkMRMLSegmentationNode.h"
 #include "vtkSlicerSegmentationsModuleLogic.h"
 #include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
 #include "vtkClosedSurfaceToBinaryLabelmapConversionRule.h"
 
 // MRML includes
@@ -51,13 +53,19 @@
 #include <vtkSlicerSubjectHierarchyModuleLogic.h>
 
 // VTK includes
+#include <vtkCallbackCommand.h>
 #include <vtkNew.h>
 #include <vtkTimerLog.h>
 #include <vtkLookupTable.h>
 #include <vtkImageConstantPad.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
 #include <vtkObjectFactory.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <sstream>
+
 // SlicerBase includes
 #include "vtkSlicerApplicationLogic.h"
 
@@ -78,6 +86,17 @@ void GammaProgressCallback(float progress)
   }
 }
 
+//---------------------------------------------------------------------------
+void NativeGammaProgressCallback(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid), void* clientData, void* callData)
+{
+  vtkSlicerDoseComparisonModuleLogic* logic = reinterpret_cast<vtkSlicerDoseComparisonModuleLogic*>(clientData);
+  double* progress = reinterpret_cast<double*>(callData);
+  if (logic && progress)
+  {
+    logic->GammaProgressUpdated(static_cast<float>(*progress));
+  }
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseComparisonModuleLogic);
 
@@ -86,6 +105,8 @@ vtkSlicerDoseComparisonModuleLogic::vtkSlicerDoseComparisonModuleLogic()
 {
   this->DefaultGammaColorTableNodeId = NULL;
   this->Progress = 0.0;
+  this->UsePlastimatchGamma = false;
+  this->InterpolatedGammaSearch = false;
 
   this->LogSpeedMeasurementsOff();
 
@@ -198,10 +219,15 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
 
   double checkpointConvertStart = timer->GetUniversalTime();
   vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
-  Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
-  Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(parameterNode->GetCompareDoseVolumeNode());
+  vtkMRMLScalarVolumeNode* compareDoseVolumeNode = parameterNode->GetCompareDoseVolumeNode();
+  if (!referenceDoseVolumeNode || !referenceDoseVolumeNode->GetImageData() || !compareDoseVolumeNode || !compareDoseVolumeNode->GetImageData())
+  {
+    std::string errorMessage("Invalid input dose volumes");
+    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    return errorMessage;
+  }
 
-  Plm_image::Pointer maskVolume;
+  vtkSmartPointer<vtkOrientedImageData> maskSegmentLabelmap;
   vtkMRMLSegmentationNode* maskSegmentationNode = parameterNode->GetMaskSegmentationNode();
   const char* maskSegmentID = parameterNode->GetMaskSegmentID();
   if (maskSegmentationNode && maskSegmentID)
@@ -228,7 +254,7 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
       return errorMessage;
     }
     // Get segment binary labelmap
-    vtkOrientedImageData* maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
+    maskSegmentLabelmap = vtkOrientedImageData::SafeDownCast( segmentationCopy->GetSegment(maskSegmentID)->GetRepresentation(
       vtkSegmentationConverter::GetSegmentationBinaryLabelmapRepresentationName() ) );
 
     // Apply parent transformation nodes if necessary
@@ -239,57 +265,76 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
       vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
       return errorMessage;
     }
-
-    // Convert mask to Plm image
-    maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap);
-    if (!maskVolume)
-    {
-      std::string errorMessage("Failed to convert mask segment labelmap into Plm_image");
-      vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
-      return errorMessage;
-    }
   }
 
-  // Compute gamma dose volume
-  double checkpointGammaStart = timer->GetUniversalTime();
-  Gamma_dose_comparison gamma;
-  gamma.set_reference_image(referenceDose->itk_float());
-  gamma.set_compare_image(compareDose->itk_float());
-  if (maskSegmentationNode && maskSegmentID)
+  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
+  if (gammaVolumeNode == NULL)
   {
-    gamma.set_mask_image(maskVolume->itk_uchar());
+    std::string errorMessage("Invalid gamma volume node in parameter set node");
+    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+    return errorMessage;
   }
-  gamma.set_spatial_tolerance(parameterNode->GetDtaDistanceToleranceMm());
-  gamma.set_dose_difference_tolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
-  gamma.set_resample_nn(!parameterNode->GetUseLinearInterpolation());
-  gamma.set_local_gamma(parameterNode->GetLocalDoseDifference());
-  if (!parameterNode->GetUseMaximumDose())
+
+  double checkpointGammaStart = 0.0;
+  double checkpointVtkConvertStart = 0.0;
+  if (this->UsePlastimatchGamma)
   {
-    gamma.set_reference_dose(parameterNode->GetReferenceDoseGy());
-  }
-  gamma.set_analysis_threshold(parameterNode->GetAnalysisThresholdPercent() / 100.0 );
-  gamma.set_gamma_max(parameterNode->GetMaximumGamma());
-  gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
-  gamma.set_progress_callback(&GammaProgressCallback);
+    Plm_image::Pointer referenceDose = PlmCommon::ConvertVolumeNodeToPlmImage(referenceDoseVolumeNode);
+    Plm_image::Pointer compareDose = PlmCommon::ConvertVolumeNodeToPlmImage(compareDoseVolumeNode);
 
-  gamma.run();
+    // Convert mask to Plm image
+    Plm_image::Pointer maskVolume;
+    if (maskSegmentLabelmap)
+    {
+      maskVolume = PlmCommon::ConvertVtkOrientedImageDataToPlmImage(maskSegmentLabelmap);
+      if (!maskVolume)
+      {
+        std::string errorMessage("Failed to convert mask segment labelmap into Plm_image");
+        vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
+        return errorMessage;
+      }
+    }
 
-  itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
-  parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
-  parameterNode->SetReportString(gamma.get_report_string().c_str());
+    // Compute gamma dose volume
+    checkpointGammaStart = timer->GetUniversalTime();
+    Gamma_dose_comparison gamma;
+    gamma.set_reference_image(referenceDose->itk_float());
+    gamma.set_compare_image(compareDose->itk_float());
+    if (maskVolume)
+    {
+      gamma.set_mask_image(maskVolume->itk_uchar());
+    }
+    gamma.set_spatial_tolerance(parameterNode->GetDtaDistanceToleranceMm());
+    gamma.set_dose_difference_tolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
+    gamma.set_resample_nn(!parameterNode->GetUseLinearInterpolation());
+    gamma.set_local_gamma(parameterNode->GetLocalDoseDifference());
+    if (!parameterNode->GetUseMaximumDose())
+    {
+      gamma.set_reference_dose(parameterNode->GetReferenceDoseGy());
+    }
+    gamma.set_analysis_threshold(parameterNode->GetAnalysisThresholdPercent() / 100.0 );
+    gamma.set_gamma_max(parameterNode->GetMaximumGamma());
+    gamma.set_ref_only_threshold(parameterNode->GetDoseThresholdOnReferenceOnly());
+    gamma.set_progress_callback(&GammaProgressCallback);
 
-  // Convert output to VTK
-  double checkpointVtkConvertStart = timer->GetUniversalTime();
+    gamma.run();
 
-  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
-  if (gammaVolumeNode == NULL)
+    itk::Image<float, 3>::Pointer gammaVolumeItk = gamma.get_gamma_image_itk();
+    parameterNode->SetPassFractionPercent( gamma.get_pass_fraction() * 100.0 );
+    parameterNode->SetReportString(gamma.get_report_string().c_str());
+
+    // Convert output to VTK
+    checkpointVtkConvertStart = timer->GetUniversalTime();
+    vtkSlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
+  }
+  else
   {
-    std::string errorMessage("Invalid gamma volume node in parameter set node");
-    vtkErrorMacro("ComputeGammaDoseDifference: " << errorMessage);
-    return errorMessage;
+    std::string errorMessage = this->ComputeGammaDoseDifferenceNative(parameterNode, maskSegmentLabelmap, checkpointGammaStart, checkpointVtkConvertStart);
+    if (!errorMessage.empty())
+    {
+      return errorMessage;
+    }
   }
-
-  vtkSlicerRtCommon::ConvertItkImageToVolumeNode<float>(gammaVolumeItk, gammaVolumeNode, VTK_FLOAT);
   gammaVolumeNode->SetAttribute(vtkSlicerDoseComparisonModuleLogic::DOSECOMPARISON_GAMMA_VOLUME_IDENTIFIER_ATTRIBUTE_NAME, "1");
 
   // Set default colormap to red
@@ -363,14 +408,116 @@ std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifference(vtkMR
     double checkpointEnd = timer->GetUniversalTime();
     std::cout << "Total gamma computation time: " << checkpointEnd-checkpointStart << " s" << std::endl
               << "\tApplying transforms: " << checkpointConvertStart-checkpointStart << " s" << std::endl
-              << "\tConverting from VTK to ITK: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
+              << "\tConverting and resampling inputs: " << checkpointGammaStart-checkpointConvertStart << " s" << std::endl
               << "\tGamma computation: " << checkpointVtkConvertStart-checkpointGammaStart << " s" << std::endl
-              << "\tConverting back from ITK to VTK: " << checkpointEnd-checkpointVtkConvertStart << " s" << std::endl;
+              << "\tSetting output: " << checkpointEnd-checkpointVtkConvertStart << " s" << std::endl;
   }
 
   return "";
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseComparisonModuleLogic::ComputeGammaDoseDifferenceNative(vtkMRMLDoseComparisonNode* parameterNode,
+  vtkOrientedImageData* maskSegmentLabelmap, double &checkpointGammaStart, double &checkpointOutputStart)
+{
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = parameterNode->GetReferenceDoseVolumeNode();
+  vtkMRMLScalarVolumeNode* compareDoseVolumeNode = parameterNode->GetCompareDoseVolumeNode();
+  vtkMRMLScalarVolumeNode* gammaVolumeNode = parameterNode->GetGammaVolumeNode();
+
+  // Get input doses in world coordinate system
+  vtkSmartPointer<vtkOrientedImageData> referenceDoseImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+    vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(referenceDoseVolumeNode) );
+  vtkSmartPointer<vtkOrientedImageData> compareDoseImageData = vtkSmartPointer<vtkOrientedImageData>::Take(
+    vtkSlicerSegmentationsModuleLogic::CreateOrientedImageDataFromVolumeNode(compareDoseVolumeNode) );
+  if (!referenceDoseImageData.GetPointer() || !compareDoseImageData.GetPointer())
+  {
+    std::string errorMessage("Failed to get image data from dose volumes");
+    vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+    return errorMessage;
+  }
+  if ( ( referenceDoseVolumeNode->GetParentTransformNode()
+      && !vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(referenceDoseVolumeNode, referenceDoseImageData) )
+    || ( compareDoseVolumeNode->GetParentTransformNode()
+      && !vtkSlicerSegmentationsModuleLogic::ApplyParentTransformToOrientedImageData(compareDoseVolumeNode, compareDoseImageData) ) )
+  {
+    std::string errorMessage("Failed to apply parent transformation to dose volumes");
+    vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Resample compare dose and mask to the reference dose lattice
+  vtkSmartPointer<vtkOrientedImageData> resampledCompareDoseImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+  if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+    compareDoseImageData, referenceDoseImageData, resampledCompareDoseImageData, parameterNode->GetUseLinearInterpolation()) )
+  {
+    std::string errorMessage("Failed to resample compare dose volume");
+    vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+    return errorMessage;
+  }
+  vtkSmartPointer<vtkOrientedImageData> resampledMaskImageData;
+  if (maskSegmentLabelmap)
+  {
+    resampledMaskImageData = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      maskSegmentLabelmap, referenceDoseImageData, resampledMaskImageData, false) )
+    {
+      std::string errorMessage("Failed to resample mask segment labelmap");
+      vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+      return errorMessage;
+    }
+  }
+
+  // Compute gamma
+  checkpointGammaStart = timer->GetUniversalTime();
+  vtkSmartPointer<vtkGammaDoseComparison> gamma = vtkSmartPointer<vtkGammaDoseComparison>::New();
+  vtkSmartPointer<vtkCallbackCommand> progressCallback = vtkSmartPointer<vtkCallbackCommand>::New();
+  progressCallback->SetCallback(NativeGammaProgressCallback);
+  progressCallback->SetClientData(this);
+  gamma->AddObserver(vtkCommand::ProgressEvent, progressCallback);
+  gamma->SetReferenceImage(referenceDoseImageData);
+  gamma->SetCompareImage(resampledCompareDoseImageData);
+  gamma->SetMaskImage(resampledMaskImageData);
+  gamma->SetDtaDistanceTolerance(parameterNode->GetDtaDistanceToleranceMm());
+  gamma->SetDoseDifferenceTolerance(parameterNode->GetDoseDifferenceTolerancePercent() / 100.0);
+  gamma->SetLocalGamma(parameterNode->GetLocalDoseDifference());
+  gamma->SetReferenceDose(parameterNode->GetUseMaximumDose() ? 0.0 : parameterNode->GetReferenceDoseGy());
+  gamma->SetAnalysisThreshold(parameterNode->GetAnalysisThresholdPercent() / 100.0);
+  gamma->SetMaximumGamma(parameterNode->GetMaximumGamma());
+  gamma->SetThresholdOnReferenceOnly(parameterNode->GetDoseThresholdOnReferenceOnly());
+  gamma->SetInterpolatedSearch(this->InterpolatedGammaSearch && parameterNode->GetUseLinearInterpolation());
+  if (!gamma->Update())
+  {
+    std::string errorMessage("Failed to compute gamma");
+    vtkErrorMacro("ComputeGammaDoseDifferenceNative: " << errorMessage);
+    return errorMessage;
+  }
+
+  parameterNode->SetPassFractionPercent(gamma->GetPassFraction() * 100.0);
+  std::ostringstream reportStream;
+  reportStream << "Reference dose: " << gamma->GetUsedReferenceDose() << " Gy" << std::endl
+    << "Number of voxels analyzed: " << gamma->GetNumberOfAnalyzedVoxels() << std::endl
+    << "Number of voxels passing: " << gamma->GetNumberOfPassingVoxels() << std::endl
+    << "Pass rate: " << gamma->GetPassFraction() * 100.0 << " %" << std::endl;
+  if (gamma->GetInterpolatedSearch())
+  {
+    reportStream << "Number of interpolations: " << gamma->GetNumberOfInterpolations() << std::endl;
+  }
+  parameterNode->SetReportString(reportStream.str().c_str());
+
+  // Set gamma image to the output volume on the reference dose lattice (the geometry is stored in the volume node)
+  checkpointOutputStart = timer->GetUniversalTime();
+  vtkSmartPointer<vtkMatrix4x4> referenceIjkToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  referenceDoseImageData->GetImageToWorldMatrix(referenceIjkToWorldMatrix);
+  vtkSmartPointer<vtkImageData> gammaImageData = vtkSmartPointer<vtkImageData>::New();
+  gammaImageData->ShallowCopy(gamma->GetGammaImage());
+  gammaImageData->SetOrigin(0.0, 0.0, 0.0);
+  gammaImageData->SetSpacing(1.0, 1.0, 1.0);
+  gammaVolumeNode->SetIJKToRASMatrix(referenceIjkToWorldMatrix);
+  gammaVolumeNode->SetAndObserveImageData(gammaImageData);
+  return "";
+}
+
 //---------------------------------------------------------------------------
 void vtkSlicerDoseComparisonModuleLogic::CreateDefaultGammaColorTable()
 {
@@ -33,6 +33,7 @@
 #include "vtkSlicerDoseComparisonModuleLogicExport.h"
 
 class vtkMRMLDoseComparisonNode;
+class vtkOrientedImageData;
 
 /// \ingroup SlicerRt_QtModules_DoseComparison
 class VTK_SLICER_DOSECOMPARISON_LOGIC_EXPORT vtkSlicerDoseComparisonModuleLogic :
@@ -52,6 +53,11 @@ public:
 
 public:
   /// Compute gamma metric according to the selected input volumes and parameters (DoseComparison parameter set node content)
+  ///
+  /// By default the gamma is computed natively (\sa vtkGammaDoseComparison) using multiple threads, with the
+  /// same metric and pass rate as Plastimatch. The Plastimatch implementation can be selected using \sa UsePlastimatchGamma
+  /// If linear interpolation is enabled in the parameter node and \sa InterpolatedGammaSearch is on, then the compare
+  /// dose is also searched between the voxels
   /// \return Error message, empty string if no error
   std::string ComputeGammaDoseDifference(vtkMRMLDoseComparisonNode* parameterNode);
 
@@ -59,6 +65,14 @@ public:
   void GammaProgressUpdated(float progress);
 
 protected:
+  /// Compute gamma using \sa vtkGammaDoseComparison and set the result to the gamma volume of the parameter node
+  /// \param maskSegmentLabelmap Mask labelmap in world coordinate system, NULL if no mask is used
+  /// \param checkpointGammaStart Output time when the gamma computation started (for speed measurements)
+  /// \param checkpointOutputStart Output time when setting the output started (for speed measurements)
+  /// \return Error message, empty string if no error
+  std::string ComputeGammaDoseDifferenceNative(vtkMRMLDoseComparisonNode* parameterNode, vtkOrientedImageData* maskSegmentLabelmap,
+    double &checkpointGammaStart, double &checkpointOutputStart);
+
   /// Creates default gamma color table.
   /// Should not be called, except when updating the default gamma color table file manually, or when the file cannot be found (\sa LoadDefaultGammaColorTable)
   void CreateDefaultGammaColorTable();
@@ -77,6 +91,21 @@ public:
   vtkGetMacro(Progress, double);
   vtkSetMacro(Progress, double);
 
+  /// Set flag determining whether gamma is computed using Plastimatch instead of the native implementation
+  vtkSetMacro(UsePlastimatchGamma, bool);
+  /// Get flag determining whether gamma is computed using Plastimatch instead of the native implementation
+  vtkGetMacro(UsePlastimatchGamma, bool);
+  /// Set flag determining whether gamma is computed using Plastimatch instead of the native implementation
+  vtkBooleanMacro(UsePlastimatchGamma, bool);
+
+  /// Set flag determining whether the native gamma computation samples the compare dose between the voxels
+  /// using trilinear interpolation (only if linear interpolation is enabled in the parameter node)
+  vtkSetMacro(InterpolatedGammaSearch, bool);
+  /// Get flag determining whether the native gamma computation samples the compare dose between the voxels
+  vtkGetMacro(InterpolatedGammaSearch, bool);
+  /// Set flag determining whether the native gamma computation samples the compare dose between the voxels
+  vtkBooleanMacro(InterpolatedGammaSearch, bool);
+
 protected:
   vtkSlicerDoseComparisonModuleLogic();
   virtual ~vtkSlicerDoseComparisonModuleLogic();
@@ -105,6 +134,12 @@ protected:
   /// Progress value (between 0 and 1).
   /// Note: Needed for python support
   double Progress;
+
+  /// Flag determining whether gamma is computed using Plastimatch instead of the native implementation
+  bool UsePlastimatchGamma;
+
+  /// Flag determining whether the native gamma computation samples the compare dose between the voxels
+  bool InterpolatedGammaSearch;
 };
 
 #endif
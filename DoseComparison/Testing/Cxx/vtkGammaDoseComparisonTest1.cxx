@@ -0,0 +1,267 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkGammaDoseComparison.h"
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkCommand.h>
+#include <vtkImageData.h>
+#include <vtkNew.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  const int DIMENSIONS[3] = {20, 16, 12};
+  const double SPACING[3] = {1.5, 2.0, 2.5};
+
+  //-----------------------------------------------------------------------------
+  // Reference implementation: exhaustive search over all compare voxels, using the parameters of the filter
+  void ReferenceGamma(vtkGammaDoseComparison* gammaFilter, std::vector<float>& gammaValues,
+    vtkIdType& numberOfAnalyzedVoxels, vtkIdType& numberOfPassingVoxels)
+  {
+    float* referencePtr = static_cast<float*>(gammaFilter->GetReferenceImage()->GetScalarPointer());
+    float* comparePtr = static_cast<float*>(gammaFilter->GetCompareImage()->GetScalarPointer());
+    unsigned char* maskPtr = (gammaFilter->GetMaskImage() ? static_cast<unsigned char*>(gammaFilter->GetMaskImage()->GetScalarPointer()) : NULL);
+    vtkIdType numberOfVoxels = gammaFilter->GetReferenceImage()->GetNumberOfPoints();
+
+    double referenceDose = gammaFilter->GetReferenceDose();
+    if (referenceDose <= 0.0)
+    {
+      referenceDose = gammaFilter->GetReferenceImage()->GetScalarRange()[1];
+    }
+    double thresholdDose = gammaFilter->GetAnalysisThreshold() * referenceDose;
+    double dtaSquared = gammaFilter->GetDtaDistanceTolerance() * gammaFilter->GetDtaDistanceTolerance();
+    double maximumGamma = gammaFilter->GetMaximumGamma();
+
+    gammaValues.assign(numberOfVoxels, 0.0f);
+    numberOfAnalyzedVoxels = 0;
+    numberOfPassingVoxels = 0;
+    for (vtkIdType voxelIndex=0; voxelIndex<numberOfVoxels; ++voxelIndex)
+    {
+      if (maskPtr && !maskPtr[voxelIndex])
+      {
+        continue;
+      }
+      if ( referencePtr[voxelIndex] < thresholdDose
+        && (gammaFilter->GetThresholdOnReferenceOnly() || comparePtr[voxelIndex] < thresholdDose) )
+      {
+        continue;
+      }
+
+      double doseTolerance = gammaFilter->GetDoseDifferenceTolerance() * (gammaFilter->GetLocalGamma() ? referencePtr[voxelIndex] : referenceDose);
+      double inverseDoseToleranceSquared = 1.0 / (doseTolerance * doseTolerance);
+      int i = voxelIndex % DIMENSIONS[0];
+      int j = (voxelIndex / DIMENSIONS[0]) % DIMENSIONS[1];
+      int k = voxelIndex / (DIMENSIONS[0] * DIMENSIONS[1]);
+      double gammaSquared = maximumGamma * maximumGamma;
+      for (vtkIdType compareIndex=0; compareIndex<numberOfVoxels; ++compareIndex)
+      {
+        int di = compareIndex % DIMENSIONS[0] - i;
+        int dj = (compareIndex / DIMENSIONS[0]) % DIMENSIONS[1] - j;
+        int dk = compareIndex / (DIMENSIONS[0] * DIMENSIONS[1]) - k;
+        double distanceSquared = (di*SPACING[0])*(di*SPACING[0]) + (dj*SPACING[1])*(dj*SPACING[1]) + (dk*SPACING[2])*(dk*SPACING[2]);
+        double doseDifference = comparePtr[compareIndex] - referencePtr[voxelIndex];
+        gammaSquared = std::min(gammaSquared, distanceSquared / dtaSquared + doseDifference * doseDifference * inverseDoseToleranceSquared);
+      }
+
+      double gamma = std::min(sqrt(gammaSquared), maximumGamma);
+      gammaValues[voxelIndex] = static_cast<float>(gamma);
+      ++numberOfAnalyzedVoxels;
+      if (gamma <= 1.0)
+      {
+        ++numberOfPassingVoxels;
+      }
+    }
+  }
+
+  //-----------------------------------------------------------------------------
+  // Runs the filter and compares its gamma image and pass statistics to the reference implementation
+  bool CompareToReferenceGamma(vtkGammaDoseComparison* gammaFilter, const char* caseName)
+  {
+    if (!gammaFilter->Update())
+    {
+      std::cerr << "ERROR: Failed to compute gamma (" << caseName << ")" << std::endl;
+      return false;
+    }
+
+    std::vector<float> referenceGammaValues;
+    vtkIdType referenceNumberOfAnalyzedVoxels = 0;
+    vtkIdType referenceNumberOfPassingVoxels = 0;
+    ReferenceGamma(gammaFilter, referenceGammaValues, referenceNumberOfAnalyzedVoxels, referenceNumberOfPassingVoxels);
+
+    if ( gammaFilter->GetNumberOfAnalyzedVoxels() != referenceNumberOfAnalyzedVoxels
+      || gammaFilter->GetNumberOfPassingVoxels() != referenceNumberOfPassingVoxels )
+    {
+      std::cerr << "ERROR: Pass statistics mismatch (" << caseName << "): " << gammaFilter->GetNumberOfPassingVoxels() << " of "
+        << gammaFilter->GetNumberOfAnalyzedVoxels() << " voxels pass instead of " << referenceNumberOfPassingVoxels << " of "
+        << referenceNumberOfAnalyzedVoxels << std::endl;
+      return false;
+    }
+    // Make sure that the case checks both passing and failing voxels
+    if (referenceNumberOfPassingVoxels == 0 || referenceNumberOfPassingVoxels == referenceNumberOfAnalyzedVoxels)
+    {
+      std::cerr << "ERROR: Either none or all of the analyzed voxels pass (" << caseName << ")" << std::endl;
+      return false;
+    }
+
+    float* gammaPtr = static_cast<float*>(gammaFilter->GetGammaImage()->GetScalarPointer());
+    for (size_t voxelIndex=0; voxelIndex<referenceGammaValues.size(); ++voxelIndex)
+    {
+      if (fabs(gammaPtr[voxelIndex] - referenceGammaValues[voxelIndex]) > 1.0e-6)
+      {
+        std::cerr << "ERROR: Gamma mismatch in voxel " << voxelIndex << " (" << caseName << "): "
+          << gammaPtr[voxelIndex] << " != " << referenceGammaValues[voxelIndex] << std::endl;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //-----------------------------------------------------------------------------
+  void ProgressCallback(vtkObject* vtkNotUsed(caller), unsigned long vtkNotUsed(eid), void* clientData, void* callData)
+  {
+    std::vector<double>* progressValues = reinterpret_cast<std::vector<double>*>(clientData);
+    progressValues->push_back(*reinterpret_cast<double*>(callData));
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Compares the gamma values and pass statistics of vtkGammaDoseComparison (limited, early-exit search)
+// to an exhaustive search with global and local dose difference, analysis threshold and mask.
+int vtkGammaDoseComparisonTest1( int vtkNotUsed(argc), char * vtkNotUsed(argv)[] )
+{
+  // Create synthetic doses on an anisotropic lattice: Gaussian reference dose, and compare dose that is
+  // shifted, scaled, and has a hot spot so that some voxels fail
+  vtkNew<vtkImageData> referenceImage;
+  referenceImage->SetExtent(0, DIMENSIONS[0]-1, 0, DIMENSIONS[1]-1, 0, DIMENSIONS[2]-1);
+  referenceImage->SetSpacing(SPACING[0], SPACING[1], SPACING[2]);
+  referenceImage->AllocateScalars(VTK_FLOAT, 1);
+  float* referencePtr = static_cast<float*>(referenceImage->GetScalarPointer());
+
+  vtkNew<vtkImageData> compareImage;
+  compareImage->SetExtent(referenceImage->GetExtent());
+  compareImage->SetSpacing(SPACING[0], SPACING[1], SPACING[2]);
+  compareImage->AllocateScalars(VTK_FLOAT, 1);
+  float* comparePtr = static_cast<float*>(compareImage->GetScalarPointer());
+
+  vtkNew<vtkImageData> maskImage;
+  maskImage->SetExtent(referenceImage->GetExtent());
+  maskImage->SetSpacing(SPACING[0], SPACING[1], SPACING[2]);
+  maskImage->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* maskPtr = static_cast<unsigned char*>(maskImage->GetScalarPointer());
+
+  const double center[3] = { DIMENSIONS[0] * SPACING[0] / 2.0, DIMENSIONS[1] * SPACING[1] / 2.0, DIMENSIONS[2] * SPACING[2] / 2.0 };
+  const double shift[3] = { 1.2, -0.8, 0.5 };
+  const double sigma = 8.0;
+  for (int k=0; k<DIMENSIONS[2]; ++k)
+  {
+    for (int j=0; j<DIMENSIONS[1]; ++j)
+    {
+      for (int i=0; i<DIMENSIONS[0]; ++i)
+      {
+        double position[3] = { i * SPACING[0], j * SPACING[1], k * SPACING[2] };
+        double referenceDistanceSquared = 0.0;
+        double compareDistanceSquared = 0.0;
+        for (int axis=0; axis<3; ++axis)
+        {
+          referenceDistanceSquared += (position[axis] - center[axis]) * (position[axis] - center[axis]);
+          compareDistanceSquared += (position[axis] - center[axis] - shift[axis]) * (position[axis] - center[axis] - shift[axis]);
+        }
+        *(referencePtr++) = static_cast<float>( 60.0 * exp(-referenceDistanceSquared / (2.0 * sigma * sigma)) );
+        double hotSpot = (i >= 12 && i < 16 && j >= 4 && j < 9 ? 6.0 : 0.0);
+        *(comparePtr++) = static_cast<float>( 1.02 * 60.0 * exp(-compareDistanceSquared / (2.0 * sigma * sigma)) + hotSpot );
+        *(maskPtr++) = (i >= 3 && i < 17 && j >= 2 && j < 13 && k >= 2 && k < 10 ? 1 : 0);
+      }
+    }
+  }
+
+  vtkNew<vtkGammaDoseComparison> gammaFilter;
+  gammaFilter->SetReferenceImage(referenceImage.GetPointer());
+  gammaFilter->SetCompareImage(compareImage.GetPointer());
+  gammaFilter->SetDtaDistanceTolerance(3.0);
+  gammaFilter->SetDoseDifferenceTolerance(0.03);
+  gammaFilter->SetMaximumGamma(2.0);
+
+  // Progress needs to be reported while processing the slices
+  std::vector<double> progressValues;
+  vtkNew<vtkCallbackCommand> progressCallback;
+  progressCallback->SetCallback(ProgressCallback);
+  progressCallback->SetClientData(&progressValues);
+  gammaFilter->AddObserver(vtkCommand::ProgressEvent, progressCallback.GetPointer());
+
+  // Global gamma, threshold on the reference dose only
+  gammaFilter->SetAnalysisThreshold(0.1);
+  gammaFilter->ThresholdOnReferenceOnlyOn();
+  if (!CompareToReferenceGamma(gammaFilter.GetPointer(), "global"))
+  {
+    return EXIT_FAILURE;
+  }
+  bool progressIncreasing = true;
+  for (size_t progressIndex=1; progressIndex<progressValues.size(); ++progressIndex)
+  {
+    progressIncreasing = progressIncreasing && (progressValues[progressIndex] >= progressValues[progressIndex-1]);
+  }
+  if (progressValues.size() < 3 || progressValues.front() != 0.0 || progressValues.back() != 1.0 || !progressIncreasing)
+  {
+    std::cerr << "ERROR: Progress is not reported from 0 to 1 between the slices" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Threshold on either dose, with a given reference dose
+  gammaFilter->SetReferenceDose(50.0);
+  gammaFilter->SetAnalysisThreshold(0.3);
+  gammaFilter->ThresholdOnReferenceOnlyOff();
+  if (!CompareToReferenceGamma(gammaFilter.GetPointer(), "threshold on either dose"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Local gamma
+  gammaFilter->SetReferenceDose(0.0);
+  gammaFilter->SetAnalysisThreshold(0.1);
+  gammaFilter->ThresholdOnReferenceOnlyOn();
+  gammaFilter->LocalGammaOn();
+  if (!CompareToReferenceGamma(gammaFilter.GetPointer(), "local"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Local gamma within mask
+  gammaFilter->SetMaskImage(maskImage.GetPointer());
+  if (!CompareToReferenceGamma(gammaFilter.GetPointer(), "local with mask"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Global gamma within mask
+  gammaFilter->LocalGammaOff();
+  if (!CompareToReferenceGamma(gammaFilter.GetPointer(), "global with mask"))
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -25,6 +25,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkGammaDoseComparison.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
@@ -33,9 +34,11 @@
 
 // VTK includes
 #include <vtkNew.h>
+#include <vtkDataArray.h>
 #include <vtkImageData.h>
 #include <vtkMatrix4x4.h>
 #include <vtkImageMathematics.h>
+#include <vtkPointData.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -43,6 +46,110 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <algorithm>
+
+//-----------------------------------------------------------------------------
+// Compare two gamma images voxel by voxel. The gamma values need to agree within the tolerance,
+// and each voxel needs to pass (gamma <= 1) in both images or in neither of them.
+bool CompareGammaImages(vtkImageData* gammaImage, vtkImageData* baselineGammaImage, double tolerance)
+{
+  int dimensions[3] = {0, 0, 0};
+  gammaImage->GetDimensions(dimensions);
+  int baselineDimensions[3] = {0, 0, 0};
+  baselineGammaImage->GetDimensions(baselineDimensions);
+  if ( dimensions[0] != baselineDimensions[0] || dimensions[1] != baselineDimensions[1] || dimensions[2] != baselineDimensions[2]
+    || !gammaImage->GetPointData()->GetScalars() || !baselineGammaImage->GetPointData()->GetScalars() )
+  {
+    std::cerr << "ERROR: Gamma image does not have the same dimensions as the baseline gamma image" << std::endl;
+    return false;
+  }
+
+  vtkDataArray* gammaArray = gammaImage->GetPointData()->GetScalars();
+  vtkDataArray* baselineGammaArray = baselineGammaImage->GetPointData()->GetScalars();
+  vtkIdType numberOfDifferentVoxels = 0;
+  double maximumDifference = 0.0;
+  for (vtkIdType voxelIndex=0; voxelIndex<gammaArray->GetNumberOfTuples(); ++voxelIndex)
+  {
+    double gamma = gammaArray->GetTuple1(voxelIndex);
+    double baselineGamma = baselineGammaArray->GetTuple1(voxelIndex);
+    double difference = fabs(gamma - baselineGamma);
+    maximumDifference = std::max(maximumDifference, difference);
+    if (difference > tolerance || (gamma <= 1.0) != (baselineGamma <= 1.0))
+    {
+      ++numberOfDifferentVoxels;
+    }
+  }
+  if (numberOfDifferentVoxels > 0)
+  {
+    std::cerr << "ERROR: Gamma differs from the baseline in " << numberOfDifferentVoxels
+      << " voxels (maximum difference: " << maximumDifference << ")" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Compute gamma with the interpolated search both with and without pruning by the compare dose bounds.
+// The gamma values need to be identical, and pruning needs to save at least an order of magnitude of interpolations.
+// The reference and compare doses of the test scene have the same lattice, so they are used without resampling.
+bool TestPrunedInterpolatedGammaSearch(vtkMRMLDoseComparisonNode* paramNode)
+{
+  vtkMRMLScalarVolumeNode* referenceDoseVolumeNode = paramNode->GetReferenceDoseVolumeNode();
+  vtkMRMLScalarVolumeNode* compareDoseVolumeNode = paramNode->GetCompareDoseVolumeNode();
+  vtkSmartPointer<vtkImageData> referenceDoseImage = vtkSmartPointer<vtkImageData>::New();
+  referenceDoseImage->ShallowCopy(referenceDoseVolumeNode->GetImageData());
+  referenceDoseImage->SetSpacing(referenceDoseVolumeNode->GetSpacing());
+  vtkSmartPointer<vtkImageData> compareDoseImage = vtkSmartPointer<vtkImageData>::New();
+  compareDoseImage->ShallowCopy(compareDoseVolumeNode->GetImageData());
+  compareDoseImage->SetSpacing(compareDoseVolumeNode->GetSpacing());
+
+  vtkSmartPointer<vtkImageData> gammaImages[2];
+  vtkIdType numberOfInterpolations[2] = {0, 0};
+  for (int pruned=0; pruned<2; ++pruned)
+  {
+    vtkSmartPointer<vtkGammaDoseComparison> gamma = vtkSmartPointer<vtkGammaDoseComparison>::New();
+    gamma->SetReferenceImage(referenceDoseImage);
+    gamma->SetCompareImage(compareDoseImage);
+    gamma->SetDtaDistanceTolerance(paramNode->GetDtaDistanceToleranceMm());
+    gamma->SetDoseDifferenceTolerance(paramNode->GetDoseDifferenceTolerancePercent() / 100.0);
+    gamma->SetLocalGamma(paramNode->GetLocalDoseDifference());
+    gamma->SetReferenceDose(paramNode->GetUseMaximumDose() ? 0.0 : paramNode->GetReferenceDoseGy());
+    gamma->SetAnalysisThreshold(paramNode->GetAnalysisThresholdPercent() / 100.0);
+    gamma->SetMaximumGamma(paramNode->GetMaximumGamma());
+    gamma->SetThresholdOnReferenceOnly(paramNode->GetDoseThresholdOnReferenceOnly());
+    gamma->InterpolatedSearchOn();
+    gamma->SetPruneInterpolatedSearch(pruned != 0);
+    if (!gamma->Update())
+    {
+      std::cerr << "ERROR: Failed to compute gamma with interpolated search" << std::endl;
+      return false;
+    }
+    gammaImages[pruned] = gamma->GetGammaImage();
+    numberOfInterpolations[pruned] = gamma->GetNumberOfInterpolations();
+  }
+
+  float* unprunedGammaPtr = static_cast<float*>(gammaImages[0]->GetScalarPointer());
+  float* prunedGammaPtr = static_cast<float*>(gammaImages[1]->GetScalarPointer());
+  for (vtkIdType voxelIndex=0; voxelIndex<gammaImages[0]->GetNumberOfPoints(); ++voxelIndex)
+  {
+    if (prunedGammaPtr[voxelIndex] != unprunedGammaPtr[voxelIndex])
+    {
+      std::cerr << "ERROR: Pruned interpolated search gives gamma " << prunedGammaPtr[voxelIndex] << " in voxel " << voxelIndex
+        << " instead of " << unprunedGammaPtr[voxelIndex] << std::endl;
+      return false;
+    }
+  }
+
+  std::cout << "Number of interpolations: " << numberOfInterpolations[1] << " (without pruning: " << numberOfInterpolations[0] << ")" << std::endl;
+  if (numberOfInterpolations[1] <= 0 || numberOfInterpolations[0] < 10 * numberOfInterpolations[1])
+  {
+    std::cerr << "ERROR: Pruning does not reduce the number of interpolations by an order of magnitude" << std::endl;
+    return false;
+  }
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
 {
@@ -151,13 +258,15 @@ int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
   vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic> doseComparisonLogic = vtkSmartPointer<vtkSlicerDoseComparisonModuleLogic>::New();
   doseComparisonLogic->SetMRMLScene(mrmlScene);
 
-  // Compute DoseAccumulation
+  // Compute gamma using Plastimatch (the baseline was computed with it)
+  doseComparisonLogic->UsePlastimatchGammaOn();
   doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  double plastimatchPassFractionPercent = paramNode->GetPassFractionPercent();
 
   // Get saved volume
   vtkSmartPointer<vtkCollection> gammaVolumeNodes = vtkSmartPointer<vtkCollection>::Take(
     mrmlScene->GetNodesByName("GammaVolume_EclipseEnt_Day1Day2_Baseline") );
-  if (doseVolumeNodes->GetNumberOfItems() != 1)
+  if (gammaVolumeNodes->GetNumberOfItems() != 1)
   {
     mrmlScene->Commit();
     errorStream << "ERROR: Failed to get baseline gamma volume!" << std::endl;
@@ -182,5 +291,53 @@ int vtkSlicerDoseComparisonModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // Compute gamma natively, which needs to give the baseline gamma values. The search on the voxel lattice
+  // is the same as in Plastimatch, so only the float rounding of the gamma values may differ.
+  doseComparisonLogic->UsePlastimatchGammaOff();
+  std::string errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty())
+  {
+    errorStream << "ERROR: Native gamma computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (!CompareGammaImages(outputGammaVolumeNode->GetImageData(), baselineGammaVolumeNode->GetImageData(), 1.0e-5))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // The same voxels pass, so the pass rates can only differ by the rounding of the percentage
+  double nativePassFractionPercent = paramNode->GetPassFractionPercent();
+  outputStream << "Pass rate: " << nativePassFractionPercent << "% (Plastimatch: " << plastimatchPassFractionPercent << "%)" << std::endl;
+  if (fabs(nativePassFractionPercent - plastimatchPassFractionPercent) > 1.0e-6)
+  {
+    errorStream << "ERROR: Native gamma pass rate " << nativePassFractionPercent
+      << "% differs from the Plastimatch pass rate " << plastimatchPassFractionPercent << "%" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Searching between the voxels (if linear interpolation is enabled) can only find lower gamma values,
+  // so the pass rate cannot decrease
+  doseComparisonLogic->InterpolatedGammaSearchOn();
+  errorMessage = doseComparisonLogic->ComputeGammaDoseDifference(paramNode);
+  if (!errorMessage.empty())
+  {
+    errorStream << "ERROR: Interpolated gamma computation failed: " << errorMessage << std::endl;
+    return EXIT_FAILURE;
+  }
+  double interpolatedPassFractionPercent = paramNode->GetPassFractionPercent();
+  outputStream << "Pass rate with interpolated search: " << interpolatedPassFractionPercent << "%" << std::endl;
+  if (interpolatedPassFractionPercent < nativePassFractionPercent)
+  {
+    errorStream << "ERROR: Interpolated gamma pass rate " << interpolatedPassFractionPercent
+      << "% is lower than the pass rate on the voxel lattice " << nativePassFractionPercent << "%" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Pruning the interpolated search needs to keep the gamma values
+  if (!TestPrunedInterpolatedGammaSearch(paramNode))
+  {
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
@@ -24,7 +24,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
-#include "vtkFractionalImageAccumulate.h"
+#include "vtkMultiLabelImageAccumulate.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -48,20 +48,21 @@
 #include <vtkMRMLLayoutNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTransformNode.h>
 #include <vtkEventBroker.h>
 
 // VTK includes
 #include <vtkImageAccumulate.h>
-#include <vtkImageStencilData.h>
-#include <vtkImageToImageStencil.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
-#include <vtkPiecewiseFunction.h>
 #include <vtkDoubleArray.h>
 #include <vtkStringArray.h>
 #include <vtkBitArray.h>
+#include <vtkByteSwap.h>
 #include <vtkImageConstantPad.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPointData.h>
 #include <vtkTable.h>
 #include <vtkTimerLog.h>
 #include <vtkCallbackCommand.h>
@@ -69,10 +70,17 @@
 #include <vtkWeakPointer.h>
 #include <vtkFieldData.h>
 
+// VTK zlib includes
+#include <vtk_zlib.h>
+
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
 // STD includes
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <map>
 #include <set>
 
 //----------------------------------------------------------------------------
@@ -99,6 +107,56 @@ const std::string vtkSlicerDoseVolumeHistogramModuleLogic::DVH_CSV_HEADER_VOLUME
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerDoseVolumeHistogramModuleLogic);
 
+//----------------------------------------------------------------------------
+struct vtkSlicerDoseVolumeHistogramModuleLogic::DvhResult
+{
+  DvhResult()
+    : UseFractionalLabelmap(false)
+    , TotalVoxels(0.0)
+    , CubicMMPerVoxel(0.0)
+    , Mean(0.0)
+    , Min(0.0)
+    , Max(0.0)
+    , BinOrigin(0.0)
+    , BinSpacing(0.0)
+    , HistogramUnderflow(0.0)
+    , AutomaticOversamplingFactor(-1.0)
+  {
+  }
+
+  bool UseFractionalLabelmap;
+  /// Number of voxels in the structure (sum of fractions in case of fractional labelmap)
+  double TotalVoxels;
+  double CubicMMPerVoxel;
+  double Mean;
+  double Min;
+  double Max;
+  double BinOrigin;
+  double BinSpacing;
+  /// Number of voxels below the first bin
+  double HistogramUnderflow;
+  std::vector<double> Histogram;
+  /// Oversampling factor calculated for the segment if automatic oversampling was used, -1 otherwise
+  double AutomaticOversamplingFactor;
+};
+
+//----------------------------------------------------------------------------
+/// DVH result of a segment and the cache key of the inputs it was computed from
+struct DvhCacheEntry
+{
+  std::string Key;
+  DvhResult Result;
+};
+
+//----------------------------------------------------------------------------
+class vtkSlicerDoseVolumeHistogramModuleLogic::vtkInternal
+{
+public:
+  /// Latest DVH result of each segment by cache entry ID (\sa GetDvhCacheEntryID).
+  /// The result is valid only if its key matches the current cache key (\sa GetDvhCacheKey)
+  std::map<std::string, DvhCacheEntry> DvhCache;
+};
+
 //---------------------------------------------------------------------------
 class vtkDoseVolumeHistogramEventCallbackCommand : public vtkCallbackCommand
 {
@@ -121,11 +179,20 @@ vtkSlicerDoseVolumeHistogramModuleLogic::vtkSlicerDoseVolumeHistogramModuleLogic
   this->DefaultDoseVolumeOversamplingFactor = 2.0;
 
   this->LogSpeedMeasurements = false;
+  this->UseCroppedLabelmaps = true;
+  this->OversampledDoseVolumeMemoryLimitMB = 0.0;
+  this->UseOnTheFlyDoseInterpolation = false;
+
+  this->DvhCacheHits = 0;
+  this->DvhCacheMisses = 0;
+  this->Internal = new vtkInternal();
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerDoseVolumeHistogramModuleLogic::~vtkSlicerDoseVolumeHistogramModuleLogic()
 {
+  delete this->Internal;
+  this->Internal = NULL;
 }
 
 //---------------------------------------------------------------------------
@@ -158,9 +225,112 @@ void vtkSlicerDoseVolumeHistogramModuleLogic::OnMRMLSceneEndClose()
     return;
   }
 
+  // Node IDs are reused in the new scene, so the cached results are not valid any more
+  this->ClearDvhCache();
+
   this->Modified();
 }
 
+//---------------------------------------------------------------------------
+void vtkSlicerDoseVolumeHistogramModuleLogic::ClearDvhCache()
+{
+  this->Internal->DvhCache.clear();
+}
+
+//---------------------------------------------------------------------------
+int vtkSlicerDoseVolumeHistogramModuleLogic::GetNumberOfCachedDvhs()
+{
+  return static_cast<int>(this->Internal->DvhCache.size());
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhCacheEntryID(vtkMRMLDoseVolumeHistogramNode* parameterNode, std::string segmentID)
+{
+  if (!parameterNode)
+  {
+    return "";
+  }
+  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if (!segmentationNode || !segmentationNode->GetID() || !doseVolumeNode || !doseVolumeNode->GetID())
+  {
+    return "";
+  }
+  return std::string(doseVolumeNode->GetID()) + ";" + segmentationNode->GetID() + ";" + segmentID;
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhCacheKey(vtkMRMLDoseVolumeHistogramNode* parameterNode, std::string segmentID, double maxDoseGy)
+{
+  if (!parameterNode)
+  {
+    return "";
+  }
+  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if (!segmentationNode || !segmentationNode->GetSegmentation() || !doseVolumeNode || !doseVolumeNode->GetImageData())
+  {
+    return "";
+  }
+  vtkSegment* segment = segmentationNode->GetSegmentation()->GetSegment(segmentID);
+  if (!segment)
+  {
+    return "";
+  }
+  vtkDataObject* masterRepresentation = segment->GetRepresentation(segmentationNode->GetSegmentation()->GetMasterRepresentationName());
+  if (!masterRepresentation)
+  {
+    return "";
+  }
+
+  std::stringstream keyStream;
+  keyStream.precision(17);
+
+  // Dose volume content, geometry, and transform
+  keyStream << doseVolumeNode->GetID() << ";" << doseVolumeNode->GetImageData()->GetMTime() << ";";
+  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseVolumeNode->GetIJKToRASMatrix(doseIjkToRasMatrix);
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      keyStream << doseIjkToRasMatrix->GetElement(row, column) << ",";
+    }
+  }
+  keyStream << ";" << (vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode) ? "dose" : "intensity") << ";";
+  if (doseVolumeNode->GetParentTransformNode())
+  {
+    keyStream << doseVolumeNode->GetParentTransformNode()->GetID() << ":" << doseVolumeNode->GetParentTransformNode()->GetTransformToWorldMTime();
+  }
+  keyStream << ";";
+
+  // Segment content and transform
+  keyStream << segmentationNode->GetID() << ";" << segmentID << ";" << masterRepresentation->GetMTime() << ";";
+  if (segmentationNode->GetParentTransformNode())
+  {
+    keyStream << segmentationNode->GetParentTransformNode()->GetID() << ":" << segmentationNode->GetParentTransformNode()->GetTransformToWorldMTime();
+  }
+  keyStream << ";";
+
+  // Conversion parameters of the segmentation (the labelmaps are converted from the master representation using them)
+  keyStream << segmentationNode->GetSegmentation()->SerializeAllConversionParameters() << ";";
+
+  // Computation parameters
+  if (parameterNode->GetAutomaticOversampling())
+  {
+    keyStream << "A;";
+  }
+  else
+  {
+    keyStream << this->DefaultDoseVolumeOversamplingFactor << ";";
+  }
+  keyStream << (parameterNode->GetUseFractionalLabelmap() ? "fractional" : "binary") << ";"
+    << this->StartValue << ";" << this->StepSize << ";" << this->NumberOfSamplesForNonDoseVolumes << ";" << maxDoseGy << ";"
+    << (this->UseOnTheFlyDoseInterpolation ? "interpolated" : "resampled");
+
+  return keyStream.str();
+}
+
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode)
 {
@@ -202,6 +372,47 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     selectedSegmentation->GetSegmentIDs(segmentIDs);
   }
 
+  // Store the DVHs of the segments that have not changed since they were last computed from the cache,
+  // and only compute the rest
+  std::vector<std::string> uncachedSegmentIDs;
+  for (std::vector<std::string>::iterator segmentIt = segmentIDs.begin(); segmentIt != segmentIDs.end(); ++segmentIt)
+  {
+    std::string cacheKey = this->GetDvhCacheKey(parameterNode, *segmentIt, maxDose);
+    std::map<std::string, DvhCacheEntry>::iterator cacheIt =
+      this->Internal->DvhCache.find(vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhCacheEntryID(parameterNode, *segmentIt));
+    if (cacheKey.empty() || cacheIt == this->Internal->DvhCache.end() || cacheIt->second.Key != cacheKey)
+    {
+      this->DvhCacheMisses++;
+      uncachedSegmentIDs.push_back(*segmentIt);
+      continue;
+    }
+
+    this->DvhCacheHits++;
+    if (cacheIt->second.Result.AutomaticOversamplingFactor > 0.0)
+    {
+      parameterNode->AddAutomaticOversamplingFactor(*segmentIt, cacheIt->second.Result.AutomaticOversamplingFactor);
+    }
+    std::string errorMessage = this->StoreDvh(parameterNode, cacheIt->second.Result, *segmentIt);
+    if (!errorMessage.empty())
+    {
+      vtkErrorMacro("ComputeDvh: " << errorMessage);
+      return errorMessage;
+    }
+  }
+  segmentIDs = uncachedSegmentIDs;
+  if (segmentIDs.empty())
+  {
+    // All DVHs were found in the cache
+    this->SetDisableModifiedEvent(0);
+    this->Modified();
+    parameterNode->EndModify(disabledNodeModify);
+    if (parameterNode->GetMetricsTableNode())
+    {
+      parameterNode->GetMetricsTableNode()->Modified();
+    }
+    return "";
+  }
+
   // Temporarily duplicate selected segments to contain binary labelmap of a different geometry (tied to dose volume)
   vtkSmartPointer<vtkSegmentation> segmentationCopy = vtkSmartPointer<vtkSegmentation>::New();
   segmentationCopy->SetMasterRepresentationName(selectedSegmentation->GetMasterRepresentationName());
@@ -303,26 +514,26 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     }
   }
 
-  // Use the same resampled dose volume if oversampling is fixed
-  vtkSmartPointer<vtkOrientedImageData> fixedOversampledDoseVolume;
+  // Use the same oversampled dose volume geometry if oversampling is fixed.
+  // The dose volume itself is only resampled when accumulating (in slabs if a memory limit is set).
+  vtkSmartPointer<vtkOrientedImageData> fixedOversampledDoseGeometry;
   if (!parameterNode->GetAutomaticOversampling())
   {
-    // Get geometry of oversampled dose volume
-    fixedOversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
-    fixedOversampledDoseVolume->ShallowCopy(doseImageData);
-    vtkCalculateOversamplingFactor::ApplyOversamplingOnImageGeometry(fixedOversampledDoseVolume, this->DefaultDoseVolumeOversamplingFactor);
-
-    // Resample dose volume using linear interpolation
-    if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-      doseImageData, fixedOversampledDoseVolume, fixedOversampledDoseVolume, true ) )
-    {
-      std::string errorMessage("Failed to resample dose volume");
-      vtkErrorMacro("ComputeDvh: " << errorMessage);
-      return errorMessage;
-    }
-  }
-
-  // Compute DVH for each selected segment
+    vtkSmartPointer<vtkMatrix4x4> doseImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    doseImageData->GetImageToWorldMatrix(doseImageToWorldMatrix);
+    fixedOversampledDoseGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+    fixedOversampledDoseGeometry->SetGeometryFromImageToWorldMatrix(doseImageToWorldMatrix);
+    fixedOversampledDoseGeometry->SetExtent(doseImageData->GetExtent());
+    vtkCalculateOversamplingFactor::ApplyOversamplingOnImageGeometry(fixedOversampledDoseGeometry, this->DefaultDoseVolumeOversamplingFactor);
+  }
+
+  // Compute DVH for each selected segment.
+  // If oversampling is fixed, then all segment labelmaps are on the lattice of the same oversampled dose volume,
+  // so the DVHs of all segments are accumulated together, traversing the dose volume only once. In case of
+  // automatic oversampling the dose volume is resampled for each segment, so they are accumulated one by one.
+  vtkSmartPointer<vtkMultiLabelImageAccumulate> labelmapAccumulator = vtkSmartPointer<vtkMultiLabelImageAccumulate>::New();
+  labelmapAccumulator->SetUseFractionalLabelmap(useFractionalLabelmap);
+  std::vector<std::string> accumulatedSegmentIDs;
   int counter = 1; // Start at one so that progress can reach 100%
   int numberOfSelectedSegments = segmentationCopy->GetNumberOfSegments();
   for (std::vector< std::string >::const_iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt, ++counter)
@@ -341,11 +552,13 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     }
 
     double minimumValue = 0.0;
+    double maximumValue = 1.0;
     vtkDoubleArray* scalarRange = vtkDoubleArray::SafeDownCast(
       segmentLabelmap->GetFieldData()->GetAbstractArray(vtkSegmentationConverter::GetScalarRangeFieldName()));
     if (scalarRange && scalarRange->GetNumberOfValues() == 2)
     {
       minimumValue = scalarRange->GetValue(0);
+      maximumValue = scalarRange->GetValue(1);
     }
 
     // Apply parent transformation nodes if necessary
@@ -366,7 +579,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
 
       // Resample segmentation labelmap volume
       if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-        segmentLabelmap, fixedOversampledDoseVolume, segmentLabelmap, useFractionalLabelmap, false, NULL, minimumValue ) )
+        segmentLabelmap, fixedOversampledDoseGeometry, segmentLabelmap, useFractionalLabelmap, false, NULL, minimumValue ) )
       {
         std::string errorMessage("Failed to resample segment binary labelmap");
         vtkErrorMacro("ComputeDvh: " << errorMessage);
@@ -374,38 +587,37 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
       }
     }
 
-    // Get oversampled dose volume
-    vtkSmartPointer<vtkOrientedImageData> oversampledDoseVolume;
-    // Use the same resampled dose volume if oversampling is fixed
-    if (!parameterNode->GetAutomaticOversampling())
+    // Crop segment labelmap to the region containing the structure so that small structures
+    // do not keep buffers of the size of the whole oversampled dose volume
+    if (this->UseCroppedLabelmaps)
     {
-      oversampledDoseVolume = fixedOversampledDoseVolume;
-    }
-    // Resample dose volume to match automatically oversampled segment labelmap geometry
-    else
-    {
-      oversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
-      if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
-        doseImageData, segmentLabelmap, oversampledDoseVolume, true ) )
+      int effectiveExtent[6] = {0,-1,0,-1,0,-1};
+      if ( vtkOrientedImageDataResample::CalculateEffectiveExtent(segmentLabelmap, effectiveExtent, useFractionalLabelmap ? minimumValue : 0.0)
+        && effectiveExtent[0] <= effectiveExtent[1] && effectiveExtent[2] <= effectiveExtent[3] && effectiveExtent[4] <= effectiveExtent[5] )
       {
-        std::string errorMessage("Failed to resample dose volume");
-        vtkErrorMacro("ComputeDvh: " << errorMessage);
-        return errorMessage;
+        vtkSmartPointer<vtkImageConstantPad> cropper = vtkSmartPointer<vtkImageConstantPad>::New();
+        cropper->SetInputData(segmentLabelmap);
+        cropper->SetConstant(minimumValue);
+        cropper->SetOutputWholeExtent(effectiveExtent);
+        cropper->Update();
+        segmentLabelmap->vtkImageData::DeepCopy(cropper->GetOutput());
       }
     }
 
-    // Make sure the segment labelmap is the same dimension as the dose volume
-    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
-    padder->SetInputData(segmentLabelmap);
-    padder->SetConstant(minimumValue);
-    int extent[6] = {0,-1,0,-1,0,-1};
-    oversampledDoseVolume->GetExtent(extent);
-    padder->SetOutputWholeExtent(extent);
-    padder->Update();
-    segmentLabelmap->vtkImageData::DeepCopy(padder->GetOutput());
+    // Use the same oversampled dose volume if oversampling is fixed.
+    // The segment labelmap does not need to be padded to the extent of the dose volume, as the accumulator
+    // only visits the part of the dose volume that is covered by the labelmap.
+    if (!parameterNode->GetAutomaticOversampling())
+    {
+      labelmapAccumulator->AddLabelmap(segmentLabelmap, minimumValue, maximumValue);
+      accumulatedSegmentIDs.push_back(segmentID);
+      continue;
+    }
 
-    // Calculate DVH for current segment
-    std::string errorMessage = this->ComputeDvh(parameterNode, segmentLabelmap, oversampledDoseVolume, segmentID, maxDose);
+    // Calculate DVH for current segment, resampling the dose volume to match the automatically oversampled segment labelmap geometry
+    labelmapAccumulator->RemoveAllLabelmaps();
+    labelmapAccumulator->AddLabelmap(segmentLabelmap, minimumValue, maximumValue);
+    std::string errorMessage = this->ComputeDvh(parameterNode, labelmapAccumulator, doseImageData, segmentLabelmap, std::vector<std::string>(1, segmentID), maxDose);
     if (!errorMessage.empty())
     {
       vtkErrorMacro("ComputeDvh: " << errorMessage);
@@ -417,6 +629,21 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
   } // For each segment
 
+  // Calculate DVH for all segments at once if oversampling is fixed
+  if (!parameterNode->GetAutomaticOversampling())
+  {
+    std::string errorMessage = this->ComputeDvh(parameterNode, labelmapAccumulator, doseImageData, fixedOversampledDoseGeometry, accumulatedSegmentIDs, maxDose);
+    if (!errorMessage.empty())
+    {
+      vtkErrorMacro("ComputeDvh: " << errorMessage);
+      return errorMessage;
+    }
+
+    // Update progress bar
+    double progress = 1.0;
+    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+  }
+
   // Fire only one modified event when the computation is done
   this->SetDisableModifiedEvent(0);
   this->Modified();
@@ -431,7 +658,8 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
 }
 
 //---------------------------------------------------------------------------
-std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, vtkOrientedImageData* segmentLabelmap, vtkOrientedImageData* oversampledDoseVolume, std::string segmentID, double maxDoseGy)
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, vtkMultiLabelImageAccumulate* labelmapAccumulator,
+  vtkOrientedImageData* doseImageData, vtkOrientedImageData* oversampledDoseGeometry, std::vector<std::string> segmentIDs, double maxDoseGy)
 {
   if (!this->GetMRMLScene() || !parameterNode)
   {
@@ -439,101 +667,344 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     vtkErrorMacro("ComputeDvh: " << errorMessage);
     return errorMessage;
   }
-  if (!segmentLabelmap)
+  if (!labelmapAccumulator || !doseImageData || !oversampledDoseGeometry)
   {
-    std::string errorMessage("Invalid segment labelmap");
+    std::string errorMessage("Invalid oversampled dose volume");
     vtkErrorMacro("ComputeDvh: " << errorMessage);
     return errorMessage;
   }
-  if (!oversampledDoseVolume)
+  if (labelmapAccumulator->GetNumberOfLabelmaps() != static_cast<int>(segmentIDs.size()))
   {
-    std::string errorMessage("Invalid oversampled dose volume");
+    std::string errorMessage("Invalid segment labelmaps");
     vtkErrorMacro("ComputeDvh: " << errorMessage);
     return errorMessage;
   }
-  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
   vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
-  if ( !segmentationNode || !doseVolumeNode )
+  if (!doseVolumeNode)
   {
-    std::string errorMessage("Both segmentation node and dose volume node need to be set");
+    std::string errorMessage("Invalid dose volume node");
     vtkErrorMacro("ComputeDvh: " << errorMessage);
     return errorMessage;
   }
-  std::string segmentName = parameterNode->GetSegmentationNode()->GetSegmentation()->GetSegment(segmentID)->GetName();
+  int numberOfLabelmaps = labelmapAccumulator->GetNumberOfLabelmaps();
 
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
 
-  // Create stencil for structure
-  vtkNew<vtkImageToImageStencil> stencil;
-  stencil->SetInputData(segmentLabelmap);
-  // Foreground voxels are all those with an intensity >0.
-  // Unfortunately, vtkImageToImageStencil only have options for < and >= comparison.
-  // So, we have to choose >=epsilon (epsilon is a very small positive number).
-  // How small the number is has a significance when the segmentLabelmap is a floating-point image,
-  // which is a rare scenario, but may still happen.
-  double minimumValue = 0.0;
-  double maximumValue = 1.0;
-  segmentLabelmap->GetFieldData();
-  vtkDoubleArray* scalarRange = vtkDoubleArray::SafeDownCast(
-    segmentLabelmap->GetFieldData()->GetAbstractArray( vtkSegmentationConverter::GetScalarRangeFieldName() )
-    );
-  if (scalarRange && scalarRange->GetNumberOfValues() == 2)
-  {
-    minimumValue = scalarRange->GetValue(0);
-    maximumValue = scalarRange->GetValue(1);
+  // The labelmaps are considered to be padded to the extent of the oversampled dose volume.
+  // The extent may be a single slice thick if it was resampled to a cropped labelmap of a thin structure.
+  int doseExtent[6] = {0,-1,0,-1,0,-1};
+  oversampledDoseGeometry->GetExtent(doseExtent);
+  if (doseExtent[1] < doseExtent[0] || doseExtent[3] < doseExtent[2] || doseExtent[5] < doseExtent[4])
+  {
+    std::string errorMessage("Invalid oversampled dose volume geometry");
+    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    return errorMessage;
   }
 
-  bool useFractionalLabelmap = parameterNode->GetUseFractionalLabelmap();
-  if (useFractionalLabelmap)
+  // Determine DVH bins. For dose volumes the bins only depend on the maximum dose of the whole volume,
+  // so the statistics, the histogram, and the number of voxels below the start value (histogram underflow)
+  // are all computed in a single pass. For other volumes the bins span the range within the structure,
+  // so the histogram is accumulated in a second pass after the statistics.
+  bool isDoseVolume = vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode);
+  if (isDoseVolume)
   {
-    stencil->ThresholdByUpper(minimumValue + 1e-10);
+    int numSamples = (int)ceil( (maxDoseGy-this->StartValue)/this->StepSize ) + 1;
+    labelmapAccumulator->SetBinningForAllLabelmaps(this->StartValue, this->StepSize, numSamples);
   }
   else
   {
-    stencil->ThresholdByUpper(1e-10);
+    labelmapAccumulator->SetBinningForAllLabelmaps(0.0, 1.0, 0);
   }
-  stencil->Update();
 
-  vtkSmartPointer<vtkImageStencilData> structureStencil = vtkSmartPointer<vtkImageStencilData>::New();
-  structureStencil->DeepCopy(stencil->GetOutput());
+  // Compute statistics (and histogram for dose volumes) for all segments (in parallel).
+  // The resampled dose volume is kept for the second pass if it was not streamed in slabs.
+  vtkSmartPointer<vtkOrientedImageData> oversampledDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
+  std::string accumulateErrorMessage = this->AccumulateOversampledDose(labelmapAccumulator, doseImageData, oversampledDoseGeometry, oversampledDoseVolume);
+  if (!accumulateErrorMessage.empty())
+  {
+    vtkErrorMacro("ComputeDvh: " << accumulateErrorMessage);
+    return accumulateErrorMessage;
+  }
 
-  int stencilExtent[6] = {0,-1,0,-1,0,-1};
-  structureStencil->GetExtent(stencilExtent);
-  if (stencilExtent[1]-stencilExtent[0] <= 0 || stencilExtent[3]-stencilExtent[2] <= 0 || stencilExtent[5]-stencilExtent[4] <= 0)
+  // Segments that do not overlap the dose volume are skipped, so that they do not prevent storing the DVHs of the other segments
+  std::vector<bool> overlapsDose(numberOfLabelmaps, true);
+  int numberOfOverlappingLabelmaps = 0;
+  for (int labelIndex=0; labelIndex<numberOfLabelmaps; ++labelIndex)
   {
-    std::string errorMessage("Invalid stenciled dose volume");
+    // Skip segment if there are no voxels in the stenciled dose volume (no non-zero voxels in the resampled labelmap)
+    if (labelmapAccumulator->GetVoxelCount(labelIndex) < 1)
+    {
+      vtkWarningMacro("ComputeDvh: Dose volume and segment " << segmentIDs[labelIndex] << " do not overlap, DVH is not computed for the segment");
+      overlapsDose[labelIndex] = false;
+      continue;
+    }
+    ++numberOfOverlappingLabelmaps;
+
+    double rangeMin = labelmapAccumulator->GetMin(labelIndex);
+    double rangeMax = labelmapAccumulator->GetMax(labelIndex);
+    if (isDoseVolume)
+    {
+      if (rangeMin<0)
+      {
+        std::string errorMessage("The dose volume contains negative dose values");
+        vtkErrorMacro("ComputeDvh: " << errorMessage);
+        return errorMessage;
+      }
+    }
+    else
+    {
+      int numSamples = this->NumberOfSamplesForNonDoseVolumes;
+      double stepSize = (rangeMax - rangeMin) / (double)(numSamples-1);
+      labelmapAccumulator->SetBinning(labelIndex, rangeMin, stepSize, numSamples);
+    }
+  }
+  if (numberOfOverlappingLabelmaps == 0)
+  {
+    std::string errorMessage("Dose volume and the structure do not overlap"); // User-friendly error to help troubleshooting
     vtkErrorMacro("ComputeDvh: " << errorMessage);
     return errorMessage;
   }
 
-  // Compute statistics
-  vtkSmartPointer<vtkImageAccumulate> structureStat;
-  if (useFractionalLabelmap)
+  // Compute histograms for non-dose volumes now that the ranges are known
+  if (!isDoseVolume)
   {
-    structureStat = vtkSmartPointer<vtkFractionalImageAccumulate>::New();
-    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->UseFractionalLabelmapOn();
-    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetFractionalLabelmap(segmentLabelmap);
-    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetMinimumFractionalValue(minimumValue);
-    vtkFractionalImageAccumulate::SafeDownCast(structureStat)->SetMaximumFractionalValue(maximumValue);
+    accumulateErrorMessage = this->AccumulateOversampledDose(labelmapAccumulator, doseImageData, oversampledDoseGeometry, oversampledDoseVolume);
+    if (!accumulateErrorMessage.empty())
+    {
+      vtkErrorMacro("ComputeDvh: " << accumulateErrorMessage);
+      return accumulateErrorMessage;
+    }
   }
-  else
+
+  // Store DVH for each segment. The accumulation above runs the segments on multiple threads, but
+  // the MRML nodes and the metrics table are only modified here, serially on the calling thread.
+  std::map<std::string, double> oversamplingFactors;
+  parameterNode->GetAutomaticOversamplingFactors(oversamplingFactors);
+  for (int labelIndex=0; labelIndex<numberOfLabelmaps; ++labelIndex)
   {
-    structureStat = vtkSmartPointer<vtkImageAccumulate>::New();
+    if (!overlapsDose[labelIndex])
+    {
+      continue;
+    }
+    std::string segmentID = segmentIDs[labelIndex];
+    DvhResult result;
+    result.UseFractionalLabelmap = labelmapAccumulator->GetUseFractionalLabelmap();
+    if (result.UseFractionalLabelmap)
+    {
+      result.TotalVoxels = labelmapAccumulator->GetFractionalVoxelCount(labelIndex);
+    }
+    else
+    {
+      result.TotalVoxels = labelmapAccumulator->GetVoxelCount(labelIndex);
+    }
+    double* segmentLabelmapSpacing = labelmapAccumulator->GetLabelmap(labelIndex)->GetSpacing();
+    result.CubicMMPerVoxel = segmentLabelmapSpacing[0] * segmentLabelmapSpacing[1] * segmentLabelmapSpacing[2];
+    result.Mean = labelmapAccumulator->GetMean(labelIndex);
+    result.Min = labelmapAccumulator->GetMin(labelIndex);
+    result.Max = labelmapAccumulator->GetMax(labelIndex);
+    result.BinOrigin = labelmapAccumulator->GetBinOrigin(labelIndex);
+    result.BinSpacing = labelmapAccumulator->GetBinSpacing(labelIndex);
+    result.HistogramUnderflow = labelmapAccumulator->GetHistogramUnderflow(labelIndex);
+    result.Histogram.resize(labelmapAccumulator->GetNumberOfBins(labelIndex));
+    for (int binIndex=0; binIndex<labelmapAccumulator->GetNumberOfBins(labelIndex); ++binIndex)
+    {
+      result.Histogram[binIndex] = labelmapAccumulator->GetHistogramValue(labelIndex, binIndex);
+    }
+    if (oversamplingFactors.find(segmentID) != oversamplingFactors.end())
+    {
+      result.AutomaticOversamplingFactor = oversamplingFactors[segmentID];
+    }
+
+    // Store result in the cache so that it does not need to be computed again until the inputs change.
+    // The result replaces the superseded one of the same segment, so the cache does not grow with the edits
+    std::string cacheKey = this->GetDvhCacheKey(parameterNode, segmentID, maxDoseGy);
+    if (!cacheKey.empty())
+    {
+      DvhCacheEntry& cacheEntry = this->Internal->DvhCache[vtkSlicerDoseVolumeHistogramModuleLogic::GetDvhCacheEntryID(parameterNode, segmentID)];
+      cacheEntry.Key = cacheKey;
+      cacheEntry.Result = result;
+    }
+
+    std::string errorMessage = this->StoreDvh(parameterNode, result, segmentID);
+    if (!errorMessage.empty())
+    {
+      vtkErrorMacro("ComputeDvh: " << errorMessage);
+      return errorMessage;
+    }
   }
-  structureStat->SetInputData(oversampledDoseVolume);
-  structureStat->SetStencilData(structureStencil);
-  structureStat->Update();
 
-  // Report error if there are no voxels in the stenciled dose volume (no non-zero voxels in the resampled labelmap)
-  if (structureStat->GetVoxelCount() < 1)
+  // Log measured time
+  double checkpointEnd = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
+  if (this->LogSpeedMeasurements)
   {
-    std::string errorMessage("Dose volume and the structure do not overlap"); // User-friendly error to help troubleshooting
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    vtkDebugMacro("ComputeDvh: DVH computation time for " << numberOfLabelmaps << " structure(s): " << checkpointEnd-checkpointStart << " s");
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::AccumulateOversampledDose(vtkMultiLabelImageAccumulate* labelmapAccumulator,
+  vtkOrientedImageData* doseImageData, vtkOrientedImageData* oversampledDoseGeometry, vtkOrientedImageData* oversampledDoseVolume)
+{
+  if (!labelmapAccumulator || !doseImageData || !oversampledDoseGeometry || !oversampledDoseVolume)
+  {
+    std::string errorMessage("Invalid input");
+    vtkErrorMacro("AccumulateOversampledDose: " << errorMessage);
     return errorMessage;
   }
 
+  // Interpolate the dose volume at the oversampled voxels within the accumulator if the oversampled lattice
+  // is aligned with the dose volume, so that no oversampled dose volume is allocated at all
+  labelmapAccumulator->InterpolateInputOff();
+  double inputIndexScale[3] = {1.0, 1.0, 1.0};
+  double inputIndexOffset[3] = {0.0, 0.0, 0.0};
+  if ( this->UseOnTheFlyDoseInterpolation
+    && vtkSlicerDoseVolumeHistogramModuleLogic::GetAlignedLatticeIndexMapping(oversampledDoseGeometry, doseImageData, inputIndexScale, inputIndexOffset) )
+  {
+    labelmapAccumulator->SetInputData(doseImageData);
+    labelmapAccumulator->InterpolateInputOn();
+    labelmapAccumulator->SetInputIndexScale(inputIndexScale);
+    labelmapAccumulator->SetInputIndexOffset(inputIndexOffset);
+    bool success = labelmapAccumulator->Update();
+    labelmapAccumulator->InterpolateInputOff();
+    labelmapAccumulator->SetInputData(NULL);
+    if (!success)
+    {
+      std::string errorMessage("Failed to compute dose statistics");
+      vtkErrorMacro("AccumulateOversampledDose: " << errorMessage);
+      return errorMessage;
+    }
+    return "";
+  }
+
+  // Use the whole resampled dose volume if it has been created in a previous pass
+  if (oversampledDoseVolume->GetPointData()->GetScalars())
+  {
+    labelmapAccumulator->SetInputData(oversampledDoseVolume);
+    if (!labelmapAccumulator->Update())
+    {
+      std::string errorMessage("Failed to compute dose statistics");
+      vtkErrorMacro("AccumulateOversampledDose: " << errorMessage);
+      return errorMessage;
+    }
+    return "";
+  }
+
+  // Determine slab thickness so that the resampled dose of one slab fits in the memory limit
+  int oversampledExtent[6] = {0,-1,0,-1,0,-1};
+  oversampledDoseGeometry->GetExtent(oversampledExtent);
+  int numberOfSlices = oversampledExtent[5] - oversampledExtent[4] + 1;
+  int numberOfSlicesPerSlab = numberOfSlices;
+  if (this->OversampledDoseVolumeMemoryLimitMB > 0.0)
+  {
+    double sliceSizeMB = static_cast<double>(oversampledExtent[1] - oversampledExtent[0] + 1)
+      * static_cast<double>(oversampledExtent[3] - oversampledExtent[2] + 1) * doseImageData->GetScalarSize() / (1024.0 * 1024.0);
+    numberOfSlicesPerSlab = std::max(1, std::min(numberOfSlices, (int)floor(this->OversampledDoseVolumeMemoryLimitMB / sliceSizeMB)));
+  }
+
+  vtkSmartPointer<vtkMatrix4x4> oversampledImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  oversampledDoseGeometry->GetImageToWorldMatrix(oversampledImageToWorldMatrix);
+
+  // Resample and accumulate the slabs in increasing slice order, so that the results are the same as when
+  // accumulating the whole resampled dose volume at once. Each slab is released before the next one is resampled.
+  for (int firstSlice = oversampledExtent[4]; firstSlice <= oversampledExtent[5]; firstSlice += numberOfSlicesPerSlab)
+  {
+    int slabExtent[6] = { oversampledExtent[0], oversampledExtent[1], oversampledExtent[2], oversampledExtent[3],
+      firstSlice, std::min(firstSlice + numberOfSlicesPerSlab - 1, oversampledExtent[5]) };
+    vtkSmartPointer<vtkOrientedImageData> slabGeometry = vtkSmartPointer<vtkOrientedImageData>::New();
+    slabGeometry->SetGeometryFromImageToWorldMatrix(oversampledImageToWorldMatrix);
+    slabGeometry->SetExtent(slabExtent);
+
+    // Keep the resampled dose volume for subsequent passes if it is not split into slabs
+    vtkSmartPointer<vtkOrientedImageData> slabDoseVolume = oversampledDoseVolume;
+    if (numberOfSlicesPerSlab < numberOfSlices)
+    {
+      slabDoseVolume = vtkSmartPointer<vtkOrientedImageData>::New();
+    }
+
+    // Resample dose volume using linear interpolation
+    if ( !vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      doseImageData, slabGeometry, slabDoseVolume, true ) )
+    {
+      std::string errorMessage("Failed to resample dose volume");
+      vtkErrorMacro("AccumulateOversampledDose: " << errorMessage);
+      return errorMessage;
+    }
+
+    labelmapAccumulator->SetInputData(slabDoseVolume);
+    bool success = (firstSlice == oversampledExtent[4] ? labelmapAccumulator->Update() : labelmapAccumulator->Accumulate());
+    if (!success)
+    {
+      std::string errorMessage("Failed to compute dose statistics");
+      vtkErrorMacro("AccumulateOversampledDose: " << errorMessage);
+      return errorMessage;
+    }
+  }
+  labelmapAccumulator->SetInputData(NULL);
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::GetAlignedLatticeIndexMapping(vtkOrientedImageData* fromImage, vtkOrientedImageData* toImage,
+  double scale[3], double offset[3])
+{
+  if (!fromImage || !toImage)
+  {
+    return false;
+  }
+
+  // Mapping from the voxel indices of one image to the other: toWorldToIjk * fromIjkToWorld
+  vtkSmartPointer<vtkMatrix4x4> fromImageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  fromImage->GetImageToWorldMatrix(fromImageToWorldMatrix);
+  vtkSmartPointer<vtkMatrix4x4> toWorldToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  toImage->GetImageToWorldMatrix(toWorldToImageMatrix);
+  toWorldToImageMatrix->Invert();
+  vtkSmartPointer<vtkMatrix4x4> fromImageToToImageMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkMatrix4x4::Multiply4x4(toWorldToImageMatrix, fromImageToWorldMatrix, fromImageToToImageMatrix);
+
+  // The lattices are aligned if the mapping is a scaling and translation along the axes
+  const double tolerance = 1e-4;
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<3; ++column)
+    {
+      double element = fromImageToToImageMatrix->GetElement(row, column);
+      if (row == column ? element <= tolerance : fabs(element) > tolerance)
+      {
+        return false;
+      }
+    }
+    scale[row] = fromImageToToImageMatrix->GetElement(row, row);
+    offset[row] = fromImageToToImageMatrix->GetElement(row, 3);
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerDoseVolumeHistogramModuleLogic::StoreDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, const DvhResult& result, std::string segmentID)
+{
+  if (!this->GetMRMLScene() || !parameterNode)
+  {
+    std::string errorMessage("Invalid MRML scene or parameter set node");
+    vtkErrorMacro("StoreDvh: " << errorMessage);
+    return errorMessage;
+  }
+  vtkMRMLSegmentationNode* segmentationNode = parameterNode->GetSegmentationNode();
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if ( !segmentationNode || !doseVolumeNode )
+  {
+    std::string errorMessage("Both segmentation node and dose volume node need to be set");
+    vtkErrorMacro("StoreDvh: " << errorMessage);
+    return errorMessage;
+  }
+  std::string segmentName = parameterNode->GetSegmentationNode()->GetSegmentation()->GetSegment(segmentID)->GetName();
+  bool useFractionalLabelmap = result.UseFractionalLabelmap;
+
   // Get metrics table for the parameter node; Create one if missing
   vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
   vtkTable* metricsTable = metricsTableNode->GetTable();
@@ -576,7 +1047,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   else
   {
     std::string errorMessage("Failed to find metrics table row for structure " + segmentName);
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    vtkErrorMacro("StoreDvh: " << errorMessage);
     return errorMessage;
   }
 
@@ -588,9 +1059,8 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   oversamplingAttrValueStream << (parameterNode->GetAutomaticOversampling() ? (-1.0) : this->DefaultDoseVolumeOversamplingFactor);
   arrayNode->SetAttribute(DVH_DOSE_VOLUME_OVERSAMPLING_FACTOR_ATTRIBUTE_NAME.c_str(), oversamplingAttrValueStream.str().c_str());
 
-  // Get spacing and voxel volume
-  double* segmentLabelmapSpacing = segmentLabelmap->GetSpacing();
-  double cubicMMPerVoxel = segmentLabelmapSpacing[0] * segmentLabelmapSpacing[1] * segmentLabelmapSpacing[2];
+  // Get voxel volume
+  double cubicMMPerVoxel = result.CubicMMPerVoxel;
   double ccPerCubicMM = 0.001;
 
   // Set default column values
@@ -600,15 +1070,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   // Volume name
   metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnDoseVolume, vtkVariant(doseVolumeNode->GetName()));
   // Volume (cc) - save as attribute too (the DVH contains percentages that often need to be converted to volume)
-  double volumeCc = 0;
-  if (useFractionalLabelmap)
-  {
-    volumeCc = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount() * cubicMMPerVoxel * ccPerCubicMM;
-  }
-  else
-  {
-    volumeCc = structureStat->GetVoxelCount() * cubicMMPerVoxel * ccPerCubicMM;
-  }
+  double volumeCc = result.TotalVoxels * cubicMMPerVoxel * ccPerCubicMM;
   metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc, vtkVariant(volumeCc));
   std::ostringstream attributeNameStream;
   std::ostringstream attributeValueStream;
@@ -616,44 +1078,17 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   attributeValueStream << volumeCc;
   arrayNode->SetAttribute(attributeNameStream.str().c_str(), attributeValueStream.str().c_str());
   // Mean dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMeanDose, vtkVariant(structureStat->GetMean()[0]));
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMeanDose, vtkVariant(result.Mean));
   // Min dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMinDose, vtkVariant(structureStat->GetMin()[0]));
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMinDose, vtkVariant(result.Min));
   // Max dose
-  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMaxDose, vtkVariant(structureStat->GetMax()[0]));
+  metricsTable->SetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnMaxDose, vtkVariant(result.Max));
 
-  // Create DVH plot values
-  int numSamples = 0;
-  double startValue;
-  double stepSize;
-  double rangeMin = structureStat->GetMin()[0];
-  double rangeMax = structureStat->GetMax()[0];
-  if (vtkSlicerRtCommon::IsDoseVolumeNode(doseVolumeNode))
-  {
-    if (rangeMin<0)
-    {
-      std::string errorMessage("The dose volume contains negative dose values");
-      vtkErrorMacro("ComputeDvh: " << errorMessage);
-      return errorMessage;
-    }
-
-    startValue = this->StartValue;
-    stepSize = this->StepSize;
-    numSamples = (int)ceil( (maxDoseGy-startValue)/stepSize ) + 1;
-  }
-  else
-  {
-    startValue = rangeMin;
-    numSamples = this->NumberOfSamplesForNonDoseVolumes;
-    stepSize = (rangeMax - rangeMin) / (double)(numSamples-1);
-  }
-
-  // Get the number of voxels with smaller dose than at the start value
-  structureStat->SetComponentExtent(0,1,0,0,0,0);
-  structureStat->SetComponentOrigin(0,0,0);
-  structureStat->SetComponentSpacing(startValue,1,1);
-  structureStat->Update();
-  double voxelBelowDose = structureStat->GetOutput()->GetScalarComponentAsDouble(0,0,0,0);
+  // Get DVH bins
+  double startValue = result.BinOrigin;
+  double stepSize = result.BinSpacing;
+  int numSamples = static_cast<int>(result.Histogram.size());
+  double voxelBelowDose = result.HistogramUnderflow;
 
   // We put a fixed point at (0.0, 100%), but only if there are only positive values in the histogram
   // Negative values can occur when the user requests histogram for an image, such as s CT volume (in this case Intensity Volume Histogram is computed),
@@ -664,11 +1099,6 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     insertPointAtOrigin=false;
   }
 
-  structureStat->SetComponentExtent(0,numSamples-1,0,0,0,0);
-  structureStat->SetComponentOrigin(startValue,0,0);
-  structureStat->SetComponentSpacing(stepSize,1,1);
-  structureStat->Update();
-
   vtkDoubleArray* doubleArray = arrayNode->GetArray();
   doubleArray->SetNumberOfTuples(numSamples + (insertPointAtOrigin?1:0));
 
@@ -683,20 +1113,11 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
     ++outputArrayIndex;
   }
 
-  vtkImageData* statArray = structureStat->GetOutput();
-  double totalVoxels = 0;
-  if (useFractionalLabelmap)
-  {
-    totalVoxels = vtkFractionalImageAccumulate::SafeDownCast(structureStat)->GetFractionalVoxelCount();
-  }
-  else
-  {
-    totalVoxels = structureStat->GetVoxelCount();
-  }
+  double totalVoxels = result.TotalVoxels;
 
   for (int sampleIndex=0; sampleIndex<numSamples; ++sampleIndex)
   {
-    double voxelsInBin = statArray->GetScalarComponentAsDouble(sampleIndex,0,0,0);
+    double voxelsInBin = result.Histogram[sampleIndex];
     doubleArray->SetComponent( outputArrayIndex, 0, startValue + sampleIndex * stepSize );
     if (useFractionalLabelmap)
     {
@@ -722,7 +1143,7 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   if (!shNode)
   {
     std::string errorMessage("Failed to access subject hierarchy node");
-    vtkErrorMacro("ComputeDvh: " << errorMessage);
+    vtkErrorMacro("StoreDvh: " << errorMessage);
     return errorMessage;
   }
   vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
@@ -741,14 +1162,6 @@ std::string vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDvh(vtkMRMLDoseVolum
   segmentationNode->AddNodeReferenceID(DVH_CREATED_DVH_NODE_REFERENCE_ROLE.c_str(), arrayNode->GetID());
   doseVolumeNode->AddNodeReferenceID(DVH_CREATED_DVH_NODE_REFERENCE_ROLE.c_str(), arrayNode->GetID());
 
-  // Log measured time
-  double checkpointEnd = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
-  if (this->LogSpeedMeasurements)
-  {
-    vtkDebugMacro("ComputeDvh: DVH computation time for structure '" << segmentID << "': " << checkpointEnd-checkpointStart << " s");
-  }
-
   return "";
 }
 
@@ -1039,149 +1452,6 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::IsVMetricName(std::string name)
   return !secondCharStream.fail();
 }
 
-//---------------------------------------------------------------------------
-bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode)
-{
-  if (!this->GetMRMLScene() || !parameterNode)
-  {
-    vtkErrorMacro("ComputeVMetrics: Invalid MRML scene or parameter set node");
-    return false;
-  }
-  vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
-  if (!metricsTableNode)
-  {
-    vtkErrorMacro("ComputeVMetrics: Unable to access DVH metrics table");
-    return false;
-  }
-
-  // Remove all V metrics from the table
-  vtkTable* metricsTable = metricsTableNode->GetTable();
-  int numberOfColumnsBeforeRemoval = -1;
-  do
-  {
-    numberOfColumnsBeforeRemoval = metricsTable->GetNumberOfColumns();
-    for (int col=0; col<metricsTable->GetNumberOfColumns(); ++col)
-    {
-      std::string columnName(metricsTable->GetColumnName(col));
-      if (this->IsVMetricName(columnName))
-      {
-        metricsTable->RemoveColumn(col);
-        break;
-      }
-    }
-  }
-  while (numberOfColumnsBeforeRemoval != metricsTable->GetNumberOfColumns());
-
-  // If no V metrics need to be shown then exit
-  if (!parameterNode->GetShowVMetricsCc() && !parameterNode->GetShowVMetricsPercent())
-  {
-    return true;
-  }
-
-  // Get V metric dose values from input string
-  std::string doseValuesStr(parameterNode->GetVDoseValues()?parameterNode->GetVDoseValues():"");
-  std::vector<double> doseValues;
-  this->GetNumbersFromMetricString(doseValuesStr, doseValues);
-
-  // Create table columns for requested V metrics
-  int numberOfColumnsBefore = metricsTable->GetNumberOfColumns();
-  for (std::vector<double>::iterator doseValueIt=doseValues.begin(); doseValueIt!=doseValues.end(); ++doseValueIt)
-  {
-    if (parameterNode->GetShowVMetricsCc())
-    {
-      std::stringstream newColumnName;
-      newColumnName << "V" << (*doseValueIt) << " (cc)";
-      vtkAbstractArray* newColumn = metricsTableNode->AddColumn();
-      newColumn->SetName(newColumnName.str().c_str());
-      metricsTable->AddColumn(newColumn);
-    }
-    if (parameterNode->GetShowVMetricsPercent())
-    {
-      std::stringstream newColumnName;
-      newColumnName << "V" << (*doseValueIt) << " (%)";
-      vtkAbstractArray* newColumn = metricsTableNode->AddColumn();
-      newColumn->SetName(newColumnName.str().c_str());
-      metricsTable->AddColumn(newColumn);
-    }
-  }
-
-  // Traverse all DVH nodes referenced from metrics table and calculate V metrics
-  std::vector<std::string> roles;
-  metricsTableNode->GetNodeReferenceRoles(roles);
-  for (std::vector<std::string>::iterator roleIt=roles.begin(); roleIt!=roles.end(); ++roleIt)
-  {
-    if ( roleIt->substr(0, vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX.size()).compare(
-      vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX ) )
-    {
-      // Not a DVH reference
-      continue;
-    }
-
-    // Get DVH node
-    vtkMRMLDoubleArrayNode* dvhArrayNode = vtkMRMLDoubleArrayNode::SafeDownCast(
-      metricsTableNode->GetNodeReference(roleIt->c_str()) );
-    if (!dvhArrayNode)
-    {
-      vtkErrorMacro("ComputeVMetrics: Metrics table node reference '" << (*roleIt) << "' does not contain DVH node");
-      continue;
-    }
-
-    // Get corresponding table row
-    int tableRow = -1;
-    std::stringstream ss;
-    ss << dvhArrayNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str());
-    ss >> tableRow;
-    if (ss.fail())
-    {
-      vtkErrorMacro("ComputeVMetrics: Failed to get metrics table row from DVH node " << dvhArrayNode->GetName());
-      continue;
-    }
-
-    // Get structure volume
-    double structureVolume = metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc).ToDouble();
-    if (structureVolume == 0)
-    {
-      vtkErrorMacro("ComputeVMetrics: Failed to get structure volume for structure " << metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure).ToString());
-      continue;
-    }
-
-    // Compute volume for all V's
-    vtkDoubleArray* doubleArray = dvhArrayNode->GetArray();
-    vtkNew<vtkPiecewiseFunction> interpolator;
-    interpolator->ClampingOn();
-
-    // Starting from second point, because BuildFunctionFromTable needs uniform distance between X coordinates
-    //  and the first point may be 0 (with different distance to neighbors than the second)
-    double* dvhArrayDouble = new double[doubleArray->GetNumberOfTuples()-1];
-    for (int i=1; i<doubleArray->GetNumberOfTuples(); ++i)
-    {
-      dvhArrayDouble[i-1] = doubleArray->GetComponent(i, 1);
-    }
-    interpolator->BuildFunctionFromTable(doubleArray->GetComponent(1, 0), doubleArray->GetComponent(doubleArray->GetNumberOfTuples()-1, 0), doubleArray->GetNumberOfTuples()-1, dvhArrayDouble);
-
-    // Add first point
-    interpolator->AddPoint(doubleArray->GetComponent(0, 0), doubleArray->GetComponent(0, 1));
-
-    // Calculate metrics and set table entries
-    int tableColumn = numberOfColumnsBefore;
-    for (std::vector<double>::iterator it = doseValues.begin(); it != doseValues.end(); ++it)
-    {
-      double volumePercentEstimated = interpolator->GetValue(*it);
-      if (parameterNode->GetShowVMetricsCc())
-      {
-        metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(volumePercentEstimated*structureVolume/100.0) );
-      }
-      if (parameterNode->GetShowVMetricsPercent())
-      {
-        metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(volumePercentEstimated) );
-      }
-    }
-  } // For all DVHs
-
-  metricsTableNode->Modified();
-  return true;
-}
-
 //---------------------------------------------------------------------------
 bool vtkSlicerDoseVolumeHistogramModuleLogic::IsDMetricName(std::string name)
 {
@@ -1202,45 +1472,66 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::IsDMetricName(std::string name)
   return !secondCharStream.fail();
 }
 
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode)
+{
+  return this->ComputeMetrics(parameterNode, true, false);
+}
+
 //---------------------------------------------------------------------------
 bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode)
+{
+  return this->ComputeMetrics(parameterNode, false, true);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVAndDMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode)
+{
+  return this->ComputeMetrics(parameterNode, true, true);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode, bool computeVMetrics, bool computeDMetrics)
 {
   if (!this->GetMRMLScene() || !parameterNode)
   {
-    vtkErrorMacro("ComputeDMetrics: Invalid MRML scene or parameter set node");
+    vtkErrorMacro("ComputeMetrics: Invalid MRML scene or parameter set node");
     return false;
   }
   vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
   if (!metricsTableNode)
   {
-    vtkErrorMacro("ComputeDMetrics: Unable to access DVH metrics table");
-    return false;
-  }
-  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
-  if (!doseVolumeNode)
-  {
-    vtkErrorMacro("ComputeDMetrics: Unable to find dose volume node");
-    return false;
-  }
-  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
-  if (!shNode)
-  {
-    vtkErrorMacro("ComputeDMetrics: Failed to access subject hierarchy node");
+    vtkErrorMacro("ComputeMetrics: Unable to access DVH metrics table");
     return false;
   }
 
-  // Get dose unit name
+  // Get dose unit name (only needed for D metrics)
   std::string doseUnitPostfix = "";
-  vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
-  if (doseShItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  if (computeDMetrics)
   {
-    doseUnitPostfix = " (" +
-      shNode->GetAttributeFromItemAncestor(
-        doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy())
-      + ")";
+    vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+    if (!doseVolumeNode)
+    {
+      vtkErrorMacro("ComputeMetrics: Unable to find dose volume node");
+      return false;
+    }
+    vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
+    if (!shNode)
+    {
+      vtkErrorMacro("ComputeMetrics: Failed to access subject hierarchy node");
+      return false;
+    }
+    vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
+    if (doseShItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+    {
+      doseUnitPostfix = " (" +
+        shNode->GetAttributeFromItemAncestor(
+          doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy())
+        + ")";
+    }
   }
 
-  // Remove all D metrics from the table
+  // Remove all V and/or D metrics from the table
   vtkTable* metricsTable = metricsTableNode->GetTable();
   int numberOfColumnsBeforeRemoval = -1;
   do
@@ -1249,7 +1540,7 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
     for (int col=0; col<metricsTable->GetNumberOfColumns(); ++col)
     {
       std::string columnName(metricsTable->GetColumnName(col));
-      if (this->IsDMetricName(columnName))
+      if ((computeVMetrics && this->IsVMetricName(columnName)) || (computeDMetrics && this->IsDMetricName(columnName)))
       {
         metricsTable->RemoveColumn(col);
         break;
@@ -1258,28 +1549,55 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
   }
   while (numberOfColumnsBeforeRemoval != metricsTable->GetNumberOfColumns());
 
-  // If no D metrics need to be shown then exit
-  if (!parameterNode->GetShowDMetrics())
+  // Get V metric dose values and D metric volume values from input strings
+  bool showVMetricsCc = computeVMetrics && parameterNode->GetShowVMetricsCc();
+  bool showVMetricsPercent = computeVMetrics && parameterNode->GetShowVMetricsPercent();
+  std::vector<double> doseValues;
+  if (showVMetricsCc || showVMetricsPercent)
   {
-    return true;
+    std::string doseValuesStr(parameterNode->GetVDoseValues()?parameterNode->GetVDoseValues():"");
+    this->GetNumbersFromMetricString(doseValuesStr, doseValues);
   }
-
-  // Get D metric dose values from input string
   std::vector<double> volumeValuesCc;
   std::vector<double> volumeValuesPercent;
-  if (parameterNode->GetDVolumeValuesCc())
+  if (computeDMetrics && parameterNode->GetShowDMetrics())
   {
     std::string volumeValuesCcStr(parameterNode->GetDVolumeValuesCc()?parameterNode->GetDVolumeValuesCc():"");
     this->GetNumbersFromMetricString(volumeValuesCcStr, volumeValuesCc);
-  }
-  if (parameterNode->GetDVolumeValuesPercent())
-  {
     std::string volumeValuesPercentStr(parameterNode->GetDVolumeValuesPercent()?parameterNode->GetDVolumeValuesPercent():"");
     this->GetNumbersFromMetricString(volumeValuesPercentStr, volumeValuesPercent);
   }
 
+  // If no metrics need to be shown then exit
+  if (doseValues.empty() && volumeValuesCc.empty() && volumeValuesPercent.empty())
+  {
+    metricsTableNode->Modified();
+    return true;
+  }
+
+  // Create table columns for requested V metrics
+  int numberOfColumnsBefore = metricsTable->GetNumberOfColumns();
+  for (std::vector<double>::iterator doseValueIt=doseValues.begin(); doseValueIt!=doseValues.end(); ++doseValueIt)
+  {
+    if (showVMetricsCc)
+    {
+      std::stringstream newColumnName;
+      newColumnName << "V" << (*doseValueIt) << " (cc)";
+      vtkAbstractArray* newColumn = metricsTableNode->AddColumn();
+      newColumn->SetName(newColumnName.str().c_str());
+      metricsTable->AddColumn(newColumn);
+    }
+    if (showVMetricsPercent)
+    {
+      std::stringstream newColumnName;
+      newColumnName << "V" << (*doseValueIt) << " (%)";
+      vtkAbstractArray* newColumn = metricsTableNode->AddColumn();
+      newColumn->SetName(newColumnName.str().c_str());
+      metricsTable->AddColumn(newColumn);
+    }
+  }
+
   // Create table columns for requested D metrics
-  int numberOfColumnsBefore = metricsTable->GetNumberOfColumns();
   for (std::vector<double>::iterator ccIt=volumeValuesCc.begin(); ccIt!=volumeValuesCc.end(); ++ccIt)
   {
     std::stringstream newColumnName;
@@ -1297,7 +1615,10 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
     metricsTable->AddColumn(newColumn);
   }
 
-  // Traverse all DVH nodes referenced from metrics table and calculate V metrics
+  // Traverse all DVH nodes referenced from metrics table once and calculate all the requested metrics
+  std::vector<double> volumePercents;
+  std::vector<double> dosesForVolumesCc;
+  std::vector<double> dosesForVolumesPercent;
   std::vector<std::string> roles;
   metricsTableNode->GetNodeReferenceRoles(roles);
   for (std::vector<std::string>::iterator roleIt=roles.begin(); roleIt!=roles.end(); ++roleIt)
@@ -1312,9 +1633,9 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
     // Get DVH node
     vtkMRMLDoubleArrayNode* dvhArrayNode = vtkMRMLDoubleArrayNode::SafeDownCast(
       metricsTableNode->GetNodeReference(roleIt->c_str()) );
-    if (!dvhArrayNode)
+    if (!dvhArrayNode || !dvhArrayNode->GetArray() || dvhArrayNode->GetArray()->GetNumberOfTuples() < 1)
     {
-      vtkErrorMacro("ComputeDMetrics: Metrics table node reference '" << (*roleIt) << "' does not contain DVH node");
+      vtkErrorMacro("ComputeMetrics: Metrics table node reference '" << (*roleIt) << "' does not contain DVH node");
       continue;
     }
 
@@ -1325,7 +1646,7 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
     ss >> tableRow;
     if (ss.fail())
     {
-      vtkErrorMacro("ComputeDMetrics: Failed to get metrics table row from DVH node " << dvhArrayNode->GetName());
+      vtkErrorMacro("ComputeMetrics: Failed to get metrics table row from DVH node " << dvhArrayNode->GetName());
       continue;
     }
 
@@ -1333,21 +1654,35 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
     double structureVolume = metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc).ToDouble();
     if (structureVolume == 0)
     {
-      vtkErrorMacro("ComputeDMetrics: Failed to get structure volume for structure " << metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure).ToString());
+      vtkErrorMacro("ComputeMetrics: Failed to get structure volume for structure " << metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure).ToString());
       continue;
     }
 
     // Calculate metrics and set table entries
+    vtkDoubleArray* dvhArray = dvhArrayNode->GetArray();
+    vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetricValues(dvhArray, doseValues, volumePercents);
+    vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetricValues(dvhArray, structureVolume, volumeValuesCc, false, dosesForVolumesCc);
+    vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetricValues(dvhArray, structureVolume, volumeValuesPercent, true, dosesForVolumesPercent);
+
     int tableColumn = numberOfColumnsBefore;
-    for (std::vector<double>::iterator ccIt=volumeValuesCc.begin(); ccIt!=volumeValuesCc.end(); ++ccIt)
+    for (std::vector<double>::iterator it = volumePercents.begin(); it != volumePercents.end(); ++it)
+    {
+      if (showVMetricsCc)
+      {
+        metricsTable->SetValue( tableRow, tableColumn++, vtkVariant((*it)*structureVolume/100.0) );
+      }
+      if (showVMetricsPercent)
+      {
+        metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(*it) );
+      }
+    }
+    for (std::vector<double>::iterator it = dosesForVolumesCc.begin(); it != dosesForVolumesCc.end(); ++it)
     {
-      double d = ComputeDMetric(dvhArrayNode, (*ccIt), structureVolume, false);
-      metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(d) );
+      metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(*it) );
     }
-    for (std::vector<double>::iterator percentIt=volumeValuesPercent.begin(); percentIt!=volumeValuesPercent.end(); ++percentIt)
+    for (std::vector<double>::iterator it = dosesForVolumesPercent.begin(); it != dosesForVolumesPercent.end(); ++it)
     {
-      double d = ComputeDMetric(dvhArrayNode, (*percentIt), structureVolume, true);
-      metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(d) );
+      metricsTable->SetValue( tableRow, tableColumn++, vtkVariant(*it) );
     }
   } // For all DVHs
 
@@ -1356,62 +1691,133 @@ bool vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetrics(vtkMRMLDoseVolumeH
 }
 
 //---------------------------------------------------------------------------
-double vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetric(vtkMRMLDoubleArrayNode* dvhArrayNode, double volume, double structureVolume, bool isPercent)
+void vtkSlicerDoseVolumeHistogramModuleLogic::ComputeVMetricValues(vtkDoubleArray* dvhArray, const std::vector<double>& doseValues, std::vector<double>& volumePercents)
 {
-  if (!dvhArrayNode)
+  volumePercents.clear();
+  if (!dvhArray || dvhArray->GetNumberOfTuples() < 1 || dvhArray->GetNumberOfComponents() < 2)
   {
-    vtkErrorMacro("ComputeDMetric: Invalid DVH array node");
-    return 0.0;
+    volumePercents.resize(doseValues.size(), 0.0);
+    return;
   }
-  if (isPercent && structureVolume == 0.0)
+
+  // The doses of the cumulative DVH are increasing, so the segment containing each requested dose
+  // is found by binary search. Doses outside the DVH are clamped to the first and last volume.
+  double* dvhValues = dvhArray->GetPointer(0);
+  int numberOfComponents = dvhArray->GetNumberOfComponents();
+  vtkIdType numberOfTuples = dvhArray->GetNumberOfTuples();
+  for (std::vector<double>::const_iterator doseIt = doseValues.begin(); doseIt != doseValues.end(); ++doseIt)
   {
-    vtkErrorMacro("ComputeDMetric: Invalid structure volume");
-    return 0.0;
-  }
+    double dose = (*doseIt);
+    if (dose <= dvhValues[0])
+    {
+      volumePercents.push_back(dvhValues[1]);
+      continue;
+    }
+    if (dose >= dvhValues[(numberOfTuples-1)*numberOfComponents])
+    {
+      volumePercents.push_back(dvhValues[(numberOfTuples-1)*numberOfComponents+1]);
+      continue;
+    }
 
-  vtkDoubleArray* doubleArray = dvhArrayNode->GetArray();
-  double volumeSize = 0.0;
-  double doseForVolume = 0.0;
+    // Find the first point with dose above the requested one (there is one, and it is not the first point)
+    vtkIdType lowerIndex = 0;
+    vtkIdType upperIndex = numberOfTuples-1;
+    while (upperIndex - lowerIndex > 1)
+    {
+      vtkIdType middleIndex = (lowerIndex + upperIndex) / 2;
+      if (dvhValues[middleIndex*numberOfComponents] > dose)
+      {
+        upperIndex = middleIndex;
+      }
+      else
+      {
+        lowerIndex = middleIndex;
+      }
+    }
 
-  if (isPercent)
-  {
-    volumeSize = volume * structureVolume / 100.0;
-  }
-  else
-  {
-    volumeSize = volume;
+    // Linear interpolation between the two points
+    double dosePrevious = dvhValues[lowerIndex*numberOfComponents];
+    double doseNext = dvhValues[upperIndex*numberOfComponents];
+    double volumePrevious = dvhValues[lowerIndex*numberOfComponents+1];
+    double volumeNext = dvhValues[upperIndex*numberOfComponents+1];
+    volumePercents.push_back( volumePrevious + (volumeNext-volumePrevious)*(dose-dosePrevious)/(doseNext-dosePrevious) );
   }
+}
 
-  // Check if the given volume is above the highest (first) in the array then assign no dose
-  if (volumeSize >= doubleArray->GetComponent(0, 1) / 100.0 * structureVolume)
-  {
-    doseForVolume = 0.0;
-  }
-  // If volume is below the lowest (last) in the array then assign maximum dose
-  else if (volumeSize < doubleArray->GetComponent(doubleArray->GetNumberOfTuples()-1, 1) / 100.0 * structureVolume)
+//---------------------------------------------------------------------------
+void vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetricValues(vtkDoubleArray* dvhArray, double structureVolume, const std::vector<double>& volumes,
+  bool isPercent, std::vector<double>& doses)
+{
+  doses.clear();
+  if (!dvhArray || dvhArray->GetNumberOfTuples() < 1 || dvhArray->GetNumberOfComponents() < 2 || (isPercent && structureVolume == 0.0))
   {
-    doseForVolume = doubleArray->GetComponent(doubleArray->GetNumberOfTuples()-1, 0);
+    doses.resize(volumes.size(), 0.0);
+    return;
   }
-  else
+
+  double* dvhValues = dvhArray->GetPointer(0);
+  int numberOfComponents = dvhArray->GetNumberOfComponents();
+  vtkIdType numberOfTuples = dvhArray->GetNumberOfTuples();
+  for (std::vector<double>::const_iterator volumeIt = volumes.begin(); volumeIt != volumes.end(); ++volumeIt)
   {
-    for (int i=0; i<doubleArray->GetNumberOfTuples()-1; ++i)
+    double volumeSize = (isPercent ? (*volumeIt) * structureVolume / 100.0 : (*volumeIt));
+
+    // Check if the given volume is above the highest (first) in the array then assign no dose
+    if (volumeSize >= dvhValues[1] / 100.0 * structureVolume)
     {
-      double volumePrevious = doubleArray->GetComponent(i, 1) / 100.0 * structureVolume;
-      double volumeNext = doubleArray->GetComponent(i+1, 1) / 100.0 * structureVolume;
-      if (volumePrevious > volumeSize && volumeSize >= volumeNext)
-      {
-        // Compute the dose using linear interpolation
-        double dosePrevious = doubleArray->GetComponent(i, 0);
-        double doseNext = doubleArray->GetComponent(i+1, 0);
-        double doseEstimated = dosePrevious + (doseNext-dosePrevious)*(volumeSize-volumePrevious)/(volumeNext-volumePrevious);
-        doseForVolume = doseEstimated;
+      doses.push_back(0.0);
+      continue;
+    }
+    // If volume is below the lowest (last) in the array then assign maximum dose
+    if (volumeSize < dvhValues[(numberOfTuples-1)*numberOfComponents+1] / 100.0 * structureVolume)
+    {
+      doses.push_back(dvhValues[(numberOfTuples-1)*numberOfComponents]);
+      continue;
+    }
 
-        break;
+    // The volumes of the cumulative DVH are decreasing, so the first point with volume not above the
+    // requested one is found by binary search. It is the same point that a linear scan would find.
+    vtkIdType lowerIndex = 0;
+    vtkIdType upperIndex = numberOfTuples-1;
+    while (upperIndex - lowerIndex > 1)
+    {
+      vtkIdType middleIndex = (lowerIndex + upperIndex) / 2;
+      if (volumeSize >= dvhValues[middleIndex*numberOfComponents+1] / 100.0 * structureVolume)
+      {
+        upperIndex = middleIndex;
+      }
+      else
+      {
+        lowerIndex = middleIndex;
       }
     }
+
+    // Compute the dose using linear interpolation
+    double volumePrevious = dvhValues[lowerIndex*numberOfComponents+1] / 100.0 * structureVolume;
+    double volumeNext = dvhValues[upperIndex*numberOfComponents+1] / 100.0 * structureVolume;
+    double dosePrevious = dvhValues[lowerIndex*numberOfComponents];
+    double doseNext = dvhValues[upperIndex*numberOfComponents];
+    doses.push_back( dosePrevious + (doseNext-dosePrevious)*(volumeSize-volumePrevious)/(volumeNext-volumePrevious) );
+  }
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetric(vtkMRMLDoubleArrayNode* dvhArrayNode, double volume, double structureVolume, bool isPercent)
+{
+  if (!dvhArrayNode)
+  {
+    vtkErrorMacro("ComputeDMetric: Invalid DVH array node");
+    return 0.0;
+  }
+  if (isPercent && structureVolume == 0.0)
+  {
+    vtkErrorMacro("ComputeDMetric: Invalid structure volume");
+    return 0.0;
   }
 
-  return doseForVolume;
+  std::vector<double> doses;
+  vtkSlicerDoseVolumeHistogramModuleLogic::ComputeDMetricValues(dvhArrayNode->GetArray(), structureVolume, std::vector<double>(1, volume), isPercent, doses);
+  return doses[0];
 }
 
 //---------------------------------------------------------------------------
@@ -1758,6 +2164,394 @@ vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadCsvToDoubleArrayNode
   return doubleArrayNodes;
 }
 
+//---------------------------------------------------------------------------
+// Binary DVH file helpers. All values are stored in little endian byte order.
+namespace
+{
+  const char DVH_BINARY_FILE_MAGIC[8] = {'S','R','T','D','V','H','B','1'};
+  const vtkTypeUInt32 DVH_BINARY_FILE_VERSION = 1;
+  const vtkTypeUInt32 DVH_BINARY_FILE_FLAG_COMPRESSED = 1;
+  // Size of a structure directory entry without the strings, and maximum compression ratio of zlib. They limit the counts
+  // and sizes that a file of a given size can contain, so that corrupt values are detected before allocating memory for them.
+  const vtkTypeUInt64 DVH_BINARY_FILE_MINIMUM_DIRECTORY_ENTRY_SIZE = 4 + 4 + 8 + 4 + 4 + 8 + 8;
+  const vtkTypeUInt64 DVH_BINARY_FILE_MAXIMUM_COMPRESSION_RATIO = 1032;
+
+  //---------------------------------------------------------------------------
+  void WriteDvhBinaryUInt32(std::ostream& stream, vtkTypeUInt32 value)
+  {
+    vtkByteSwap::Swap4LE(&value);
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  //---------------------------------------------------------------------------
+  void WriteDvhBinaryUInt64(std::ostream& stream, vtkTypeUInt64 value)
+  {
+    vtkByteSwap::Swap8LE(&value);
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  //---------------------------------------------------------------------------
+  void WriteDvhBinaryDouble(std::ostream& stream, double value)
+  {
+    vtkByteSwap::Swap8LE(&value);
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  //---------------------------------------------------------------------------
+  void WriteDvhBinaryString(std::ostream& stream, const std::string& value)
+  {
+    WriteDvhBinaryUInt32(stream, static_cast<vtkTypeUInt32>(value.size()));
+    stream.write(value.c_str(), value.size());
+  }
+
+  //---------------------------------------------------------------------------
+  vtkTypeUInt64 GetDvhBinaryRemainingBytes(std::istream& stream, vtkTypeUInt64 fileSize)
+  {
+    std::streamoff position = stream.tellg();
+    if (position < 0 || static_cast<vtkTypeUInt64>(position) > fileSize)
+    {
+      return 0;
+    }
+    return fileSize - static_cast<vtkTypeUInt64>(position);
+  }
+
+  //---------------------------------------------------------------------------
+  bool ReadDvhBinaryUInt32(std::istream& stream, vtkTypeUInt32& value)
+  {
+    stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+    vtkByteSwap::Swap4LE(&value);
+    return !stream.fail();
+  }
+
+  //---------------------------------------------------------------------------
+  bool ReadDvhBinaryUInt64(std::istream& stream, vtkTypeUInt64& value)
+  {
+    stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+    vtkByteSwap::Swap8LE(&value);
+    return !stream.fail();
+  }
+
+  //---------------------------------------------------------------------------
+  bool ReadDvhBinaryDouble(std::istream& stream, double& value)
+  {
+    stream.read(reinterpret_cast<char*>(&value), sizeof(value));
+    vtkByteSwap::Swap8LE(&value);
+    return !stream.fail();
+  }
+
+  //---------------------------------------------------------------------------
+  bool ReadDvhBinaryString(std::istream& stream, vtkTypeUInt64 fileSize, std::string& value)
+  {
+    vtkTypeUInt32 length = 0;
+    if (!ReadDvhBinaryUInt32(stream, length) || length > GetDvhBinaryRemainingBytes(stream, fileSize))
+    {
+      return false;
+    }
+    value.assign(length, '\0');
+    if (length > 0)
+    {
+      stream.read(&(value[0]), length);
+    }
+    return !stream.fail();
+  }
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerDoseVolumeHistogramModuleLogic::ExportDvhToBinary(vtkMRMLDoseVolumeHistogramNode* parameterNode, const char* fileName, bool compress/*=false*/)
+{
+  if (!this->GetMRMLScene() || !parameterNode)
+  {
+    vtkErrorMacro("ExportDvhToBinary: Invalid MRML scene or parameter set node");
+    return false;
+  }
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if (!doseVolumeNode)
+  {
+    vtkErrorMacro("ExportDvhToBinary: Unable to find dose volume node");
+    return false;
+  }
+  vtkMRMLTableNode* metricsTableNode = parameterNode->GetMetricsTableNode();
+  if (!metricsTableNode)
+  {
+    vtkErrorMacro("ExportDvhToBinary: Unable to access DVH metrics table node");
+    return false;
+  }
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
+  if (!shNode)
+  {
+    vtkErrorMacro("ExportDvhToBinary: Failed to access subject hierarchy node");
+    return false;
+  }
+
+  vtkTable* metricsTable = metricsTableNode->GetTable();
+
+  // Get dose unit name
+  std::string doseUnitName("");
+  vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
+  if (doseShItemID != vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  {
+    doseUnitName = shNode->GetAttributeFromItemAncestor(
+      doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
+  }
+
+  // Get all DVH array nodes from the parameter set node
+  std::vector<vtkMRMLDoubleArrayNode*> dvhArrayNodes;
+  parameterNode->GetDvhArrayNodes(dvhArrayNodes);
+
+  // Open output file
+  std::ofstream outfile;
+  outfile.open(fileName, std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+  if (!outfile)
+  {
+    vtkErrorMacro("ExportDvhToBinary: Output file '" << fileName << "' cannot be opened");
+    return false;
+  }
+
+  // Write header
+  outfile.write(DVH_BINARY_FILE_MAGIC, sizeof(DVH_BINARY_FILE_MAGIC));
+  WriteDvhBinaryUInt32(outfile, DVH_BINARY_FILE_VERSION);
+  WriteDvhBinaryUInt32(outfile, compress ? DVH_BINARY_FILE_FLAG_COMPRESSED : 0);
+  WriteDvhBinaryString(outfile, doseUnitName);
+  WriteDvhBinaryUInt32(outfile, static_cast<vtkTypeUInt32>(dvhArrayNodes.size()));
+
+  // Write directory of structures. The block locations are filled in when the blocks are written,
+  // so that a single structure can be read later without parsing the others.
+  std::vector<std::streampos> blockLocationPositions;
+  for (std::vector<vtkMRMLDoubleArrayNode*>::iterator dvhIt=dvhArrayNodes.begin(); dvhIt!=dvhArrayNodes.end(); ++dvhIt)
+  {
+    vtkMRMLDoubleArrayNode* dvhArrayNode = (*dvhIt);
+    int tableRow = vtkVariant(dvhArrayNode->GetAttribute(DVH_TABLE_ROW_ATTRIBUTE_NAME.c_str())).ToInt();
+    const char* segmentID = dvhArrayNode->GetAttribute(DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str());
+
+    WriteDvhBinaryString(outfile, metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnStructure).ToString());
+    WriteDvhBinaryString(outfile, segmentID ? segmentID : "");
+    WriteDvhBinaryDouble(outfile, metricsTable->GetValue(tableRow, vtkMRMLDoseVolumeHistogramNode::MetricColumnVolumeCc).ToDouble());
+    WriteDvhBinaryUInt32(outfile, static_cast<vtkTypeUInt32>(dvhArrayNode->GetArray()->GetNumberOfTuples()));
+    WriteDvhBinaryUInt32(outfile, static_cast<vtkTypeUInt32>(dvhArrayNode->GetArray()->GetNumberOfComponents()));
+    blockLocationPositions.push_back(outfile.tellp());
+    WriteDvhBinaryUInt64(outfile, 0); // Block offset
+    WriteDvhBinaryUInt64(outfile, 0); // Block size
+  }
+
+  // Write one block per structure containing the components of the DVH array as float64 columns
+  std::vector<vtkTypeUInt64> blockOffsets;
+  std::vector<vtkTypeUInt64> blockSizes;
+  std::vector<double> columns;
+  std::vector<unsigned char> compressedColumns;
+  for (std::vector<vtkMRMLDoubleArrayNode*>::iterator dvhIt=dvhArrayNodes.begin(); dvhIt!=dvhArrayNodes.end(); ++dvhIt)
+  {
+    vtkDoubleArray* dvhArray = (*dvhIt)->GetArray();
+    vtkIdType numberOfTuples = dvhArray->GetNumberOfTuples();
+    int numberOfComponents = dvhArray->GetNumberOfComponents();
+    columns.resize(numberOfTuples * numberOfComponents);
+    for (int component=0; component<numberOfComponents; ++component)
+    {
+      for (vtkIdType tuple=0; tuple<numberOfTuples; ++tuple)
+      {
+        columns[component*numberOfTuples + tuple] = dvhArray->GetComponent(tuple, component);
+      }
+    }
+    if (!columns.empty())
+    {
+      vtkByteSwap::SwapLERange(&(columns[0]), columns.size());
+    }
+
+    const char* blockData = (columns.empty() ? NULL : reinterpret_cast<const char*>(&(columns[0])));
+    uLongf blockSize = static_cast<uLongf>(columns.size() * sizeof(double));
+    if (compress && !columns.empty())
+    {
+      uLongf compressedSize = compressBound(blockSize);
+      compressedColumns.resize(compressedSize);
+      if (compress2(&(compressedColumns[0]), &compressedSize, reinterpret_cast<const Bytef*>(blockData), blockSize, Z_BEST_SPEED) != Z_OK)
+      {
+        vtkErrorMacro("ExportDvhToBinary: Failed to compress DVH of " << (*dvhIt)->GetName());
+        outfile.close();
+        return false;
+      }
+      blockData = reinterpret_cast<const char*>(&(compressedColumns[0]));
+      blockSize = compressedSize;
+    }
+
+    blockOffsets.push_back(static_cast<vtkTypeUInt64>(outfile.tellp()));
+    blockSizes.push_back(static_cast<vtkTypeUInt64>(blockSize));
+    if (blockSize > 0)
+    {
+      outfile.write(blockData, blockSize);
+    }
+  }
+
+  // Fill in block locations in the directory
+  for (unsigned int structureIndex=0; structureIndex<blockLocationPositions.size(); ++structureIndex)
+  {
+    outfile.seekp(blockLocationPositions[structureIndex]);
+    WriteDvhBinaryUInt64(outfile, blockOffsets[structureIndex]);
+    WriteDvhBinaryUInt64(outfile, blockSizes[structureIndex]);
+  }
+
+  if (outfile.fail())
+  {
+    vtkErrorMacro("ExportDvhToBinary: Failed to write DVH to file " << fileName);
+    outfile.close();
+    return false;
+  }
+
+  outfile.close();
+  return true;
+}
+
+//---------------------------------------------------------------------------
+vtkCollection* vtkSlicerDoseVolumeHistogramModuleLogic::ReadBinaryToDoubleArrayNode(std::string fileName, std::string structureName/*=""*/)
+{
+  std::ifstream infile;
+  infile.open(fileName.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!infile)
+  {
+    vtkErrorMacro("ReadBinaryToDoubleArrayNode: Input file '" << fileName << "' cannot be opened");
+    return NULL;
+  }
+
+  // Get file size to check the counts and sizes read from the file before allocating memory for them
+  infile.seekg(0, std::ios_base::end);
+  std::streamoff fileSizeOffset = infile.tellg();
+  infile.seekg(0, std::ios_base::beg);
+  if (infile.fail() || fileSizeOffset < 0)
+  {
+    vtkErrorMacro("ReadBinaryToDoubleArrayNode: Failed to get size of file '" << fileName << "'");
+    return NULL;
+  }
+  vtkTypeUInt64 fileSize = static_cast<vtkTypeUInt64>(fileSizeOffset);
+
+  // Read header
+  char magic[sizeof(DVH_BINARY_FILE_MAGIC)] = {0};
+  infile.read(magic, sizeof(magic));
+  vtkTypeUInt32 version = 0;
+  vtkTypeUInt32 flags = 0;
+  std::string doseUnitName;
+  vtkTypeUInt32 numberOfStructures = 0;
+  if ( infile.fail() || memcmp(magic, DVH_BINARY_FILE_MAGIC, sizeof(magic))
+    || !ReadDvhBinaryUInt32(infile, version) || version != DVH_BINARY_FILE_VERSION
+    || !ReadDvhBinaryUInt32(infile, flags) || !ReadDvhBinaryString(infile, fileSize, doseUnitName)
+    || !ReadDvhBinaryUInt32(infile, numberOfStructures)
+    || numberOfStructures > GetDvhBinaryRemainingBytes(infile, fileSize) / DVH_BINARY_FILE_MINIMUM_DIRECTORY_ENTRY_SIZE )
+  {
+    vtkErrorMacro("ReadBinaryToDoubleArrayNode: File '" << fileName << "' is not a valid binary DVH file");
+    return NULL;
+  }
+
+  // Read directory
+  std::vector<std::string> structureNames(numberOfStructures);
+  std::vector<std::string> segmentIDs(numberOfStructures);
+  std::vector<double> structureVolumeCCs(numberOfStructures, 0.0);
+  std::vector<vtkTypeUInt32> numberOfTuples(numberOfStructures, 0);
+  std::vector<vtkTypeUInt32> numberOfComponents(numberOfStructures, 0);
+  std::vector<vtkTypeUInt64> blockOffsets(numberOfStructures, 0);
+  std::vector<vtkTypeUInt64> blockSizes(numberOfStructures, 0);
+  for (vtkTypeUInt32 structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+  {
+    if ( !ReadDvhBinaryString(infile, fileSize, structureNames[structureIndex]) || !ReadDvhBinaryString(infile, fileSize, segmentIDs[structureIndex])
+      || !ReadDvhBinaryDouble(infile, structureVolumeCCs[structureIndex])
+      || !ReadDvhBinaryUInt32(infile, numberOfTuples[structureIndex]) || !ReadDvhBinaryUInt32(infile, numberOfComponents[structureIndex])
+      || !ReadDvhBinaryUInt64(infile, blockOffsets[structureIndex]) || !ReadDvhBinaryUInt64(infile, blockSizes[structureIndex]) )
+    {
+      vtkErrorMacro("ReadBinaryToDoubleArrayNode: Failed to read structure directory from file '" << fileName << "'");
+      return NULL;
+    }
+
+    // The block needs to be within the file, and its size needs to be consistent with the size of the DVH array
+    vtkTypeUInt64 numberOfValues = static_cast<vtkTypeUInt64>(numberOfTuples[structureIndex]) * numberOfComponents[structureIndex];
+    vtkTypeUInt64 maximumNumberOfValues = blockSizes[structureIndex] / sizeof(double);
+    if (flags & DVH_BINARY_FILE_FLAG_COMPRESSED)
+    {
+      maximumNumberOfValues = blockSizes[structureIndex] * DVH_BINARY_FILE_MAXIMUM_COMPRESSION_RATIO / sizeof(double);
+    }
+    if ( blockOffsets[structureIndex] > fileSize || blockSizes[structureIndex] > fileSize - blockOffsets[structureIndex]
+      || numberOfValues > maximumNumberOfValues || numberOfValues > std::numeric_limits<uLongf>::max() / sizeof(double)
+      || numberOfComponents[structureIndex] < 1 || numberOfComponents[structureIndex] > static_cast<vtkTypeUInt32>(VTK_INT_MAX) )
+    {
+      vtkErrorMacro("ReadBinaryToDoubleArrayNode: Invalid DVH array size or location for structure " << structureNames[structureIndex]
+        << " in file '" << fileName << "'");
+      return NULL;
+    }
+  }
+
+  // Read the blocks of the requested structures only
+  vtkCollection* doubleArrayNodes = vtkCollection::New();
+  std::vector<double> columns;
+  std::vector<unsigned char> blockData;
+  for (vtkTypeUInt32 structureIndex=0; structureIndex<numberOfStructures; ++structureIndex)
+  {
+    if (!structureName.empty() && structureNames[structureIndex] != structureName)
+    {
+      continue;
+    }
+
+    columns.resize(static_cast<size_t>(numberOfTuples[structureIndex]) * numberOfComponents[structureIndex]);
+    uLongf columnsSize = static_cast<uLongf>(columns.size() * sizeof(double));
+    if (!columns.empty())
+    {
+      blockData.resize(blockSizes[structureIndex]);
+      infile.seekg(static_cast<std::streamoff>(blockOffsets[structureIndex]));
+      if (!blockData.empty())
+      {
+        infile.read(reinterpret_cast<char*>(&(blockData[0])), blockData.size());
+      }
+      bool success = !infile.fail();
+      if (success && (flags & DVH_BINARY_FILE_FLAG_COMPRESSED))
+      {
+        uLongf uncompressedSize = columnsSize;
+        success = ( !blockData.empty() && uncompress(reinterpret_cast<Bytef*>(&(columns[0])), &uncompressedSize, &(blockData[0]), blockData.size()) == Z_OK
+          && uncompressedSize == columnsSize );
+      }
+      else if (success)
+      {
+        success = (blockData.size() == columnsSize);
+        if (success)
+        {
+          memcpy(&(columns[0]), &(blockData[0]), columnsSize);
+        }
+      }
+      if (!success)
+      {
+        vtkErrorMacro("ReadBinaryToDoubleArrayNode: Failed to read DVH of structure " << structureNames[structureIndex] << " from file '" << fileName << "'");
+        doubleArrayNodes->Delete();
+        return NULL;
+      }
+      vtkByteSwap::SwapLERange(&(columns[0]), columns.size());
+    }
+
+    vtkSmartPointer<vtkDoubleArray> dvhArray = vtkSmartPointer<vtkDoubleArray>::New();
+    dvhArray->SetNumberOfComponents(numberOfComponents[structureIndex]);
+    dvhArray->SetNumberOfTuples(numberOfTuples[structureIndex]);
+    for (vtkTypeUInt32 component=0; component<numberOfComponents[structureIndex]; ++component)
+    {
+      for (vtkTypeUInt32 tuple=0; tuple<numberOfTuples[structureIndex]; ++tuple)
+      {
+        dvhArray->SetComponent(tuple, component, columns[component*numberOfTuples[structureIndex] + tuple]);
+      }
+    }
+
+    // Create the node with the same attributes as the ones read from CSV
+    vtkNew<vtkMRMLDoubleArrayNode> currentNode;
+    currentNode->SetArray(dvhArray);
+
+    std::ostringstream attributeNameStream;
+    attributeNameStream << vtkMRMLDoseVolumeHistogramNode::DVH_ATTRIBUTE_PREFIX << vtkSlicerDoseVolumeHistogramModuleLogic::DVH_METRIC_TOTAL_VOLUME_CC;
+    std::ostringstream attributeValueStream;
+    attributeValueStream << std::setprecision(17) << structureVolumeCCs[structureIndex];
+    currentNode->SetAttribute(attributeNameStream.str().c_str(), attributeValueStream.str().c_str());
+
+    currentNode->SetAttribute(DVH_SEGMENT_ID_ATTRIBUTE_NAME.c_str(),
+      segmentIDs[structureIndex].empty() ? structureNames[structureIndex].c_str() : segmentIDs[structureIndex].c_str());
+    std::string nameAttribute = structureNames[structureIndex] + DVH_ARRAY_NODE_NAME_POSTFIX;
+    currentNode->SetName(nameAttribute.c_str());
+
+    doubleArrayNodes->AddItem(currentNode.GetPointer());
+  }
+
+  infile.close();
+  return doubleArrayNodes;
+}
+
 //---------------------------------------------------------------------------
 std::string vtkSlicerDoseVolumeHistogramModuleLogic::AssembleDoseMetricName(vtkMRMLScalarVolumeNode* doseVolumeNode, std::string doseMetricAttributeNamePrefix)
 {
@@ -33,8 +33,10 @@
 #include "vtkSlicerDoseVolumeHistogramModuleLogicExport.h"
 
 class vtkOrientedImageData;
+class vtkMultiLabelImageAccumulate;
 class vtkCallbackCommand;
 class vtkMRMLDoubleArrayNode;
+class vtkDoubleArray;
 class vtkMRMLScalarVolumeNode;
 class vtkMRMLChartNode;
 class vtkMRMLChartViewNode;
@@ -86,6 +88,25 @@ public:
   /// Compute D metrics for existing DVHs using the given dose values and add them in the metrics table
   bool ComputeDMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode);
 
+  /// Compute both V and D metrics for existing DVHs and add them in the metrics table.
+  /// The metric strings are parsed once and every DVH is visited only once for all the metrics.
+  bool ComputeVAndDMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode);
+
+  /// Compute V metrics (percentage of the structure volume receiving at least the given doses) from a cumulative DVH.
+  /// The point containing each dose is found by binary search, so many metrics can be evaluated on many DVHs quickly.
+  /// \param dvhArray Cumulative DVH array (dose, volume percent)
+  /// \param doseValues Doses to compute the V metrics for
+  /// \param volumePercents Output volume percentages in the same order as the doses
+  static void ComputeVMetricValues(vtkDoubleArray* dvhArray, const std::vector<double>& doseValues, std::vector<double>& volumePercents);
+
+  /// Compute D metrics (minimum dose received by the given volumes of the structure) from a cumulative DVH using binary search
+  /// \param dvhArray Cumulative DVH array (dose, volume percent)
+  /// \param structureVolume Volume of the structure in cc
+  /// \param volumes Volumes to compute the D metrics for, in cc or percent of the structure volume
+  /// \param isPercent Flag determining whether the volumes are given in percent
+  /// \param doses Output doses in the same order as the volumes
+  static void ComputeDMetricValues(vtkDoubleArray* dvhArray, double structureVolume, const std::vector<double>& volumes, bool isPercent, std::vector<double>& doses);
+
   /// Add dose volume histogram of a structure (ROI) to the selected chart given its double array node
   void AddDvhToChart(vtkMRMLChartNode* chartNode, vtkMRMLDoubleArrayNode* dvhArrayNode);
 
@@ -107,10 +128,27 @@ public:
   /// \return a vtkCollection containing vtkMRMLDoubleArrayNodes. Each node represents one structure DVH and contains the vtkDoubleArray as well as the name and total volume attributes for the structure.
   vtkCollection* ReadCsvToDoubleArrayNode(std::string csvFilename);
 
+  /// Export DVH values to a binary columnar file. Unlike CSV, the values are stored without conversion, so reading
+  /// the file gives exactly the DVH arrays that were computed. The file contains a directory of the structures (name,
+  /// segment ID, volume, number of values, location of the values) followed by one block of float64 columns per structure.
+  /// \param compress Flag determining whether the blocks are compressed using zlib
+  /// \return True if file written and saved successfully, false otherwise
+  bool ExportDvhToBinary(vtkMRMLDoseVolumeHistogramNode* parameterNode, const char* fileName, bool compress=false);
+
+  /// Read DVH double arrays from a binary DVH file written by \sa ExportDvhToBinary
+  /// \param structureName If not empty, then only the DVH of this structure is read. The other blocks are skipped
+  ///   using the directory in the file header, so a single DVH can be queried from a large archive without parsing it
+  /// \return a vtkCollection containing vtkMRMLDoubleArrayNodes, with the same attributes as in \sa ReadCsvToDoubleArrayNode.
+  ///   NULL if the file is invalid.
+  vtkCollection* ReadBinaryToDoubleArrayNode(std::string fileName, std::string structureName="");
+
   /// Assemble dose metric name, e.g. "Mean dose (Gy)". If selected volume is not a dose, it will contain "intensity" instead of "dose"
   /// \param doseMetricAttributeNamePrefix Prefix of the desired dose metric attribute name, e.g. "Mean "
   std::string AssembleDoseMetricName(vtkMRMLScalarVolumeNode* doseVolumeNode, std::string doseMetricAttributeNamePrefix);
 
+  /// Remove all DVH results from the cache, so that all DVHs are computed again on the next \sa ComputeDvh call
+  void ClearDvhCache();
+
 public:
   vtkGetMacro(StartValue, double);
   vtkSetMacro(StartValue, double);
@@ -128,16 +166,75 @@ public:
   vtkSetMacro(LogSpeedMeasurements, bool);
   vtkBooleanMacro(LogSpeedMeasurements, bool);
 
+  vtkGetMacro(UseCroppedLabelmaps, bool);
+  vtkSetMacro(UseCroppedLabelmaps, bool);
+  vtkBooleanMacro(UseCroppedLabelmaps, bool);
+
+  vtkGetMacro(OversampledDoseVolumeMemoryLimitMB, double);
+  vtkSetMacro(OversampledDoseVolumeMemoryLimitMB, double);
+
+  vtkGetMacro(UseOnTheFlyDoseInterpolation, bool);
+  vtkSetMacro(UseOnTheFlyDoseInterpolation, bool);
+  vtkBooleanMacro(UseOnTheFlyDoseInterpolation, bool);
+
+  /// Get number of segment DVHs that were taken from the cache instead of computing them
+  vtkGetMacro(DvhCacheHits, int);
+  /// Get number of segment DVHs that were not found in the cache and needed to be computed
+  vtkGetMacro(DvhCacheMisses, int);
+  /// Get number of DVH results in the cache. There is at most one for each segment and dose volume
+  int GetNumberOfCachedDvhs();
+
 protected:
-  /// Compute DVH for the given structure segment with the stenciled dose volume
-  /// (the labelmap representation of a segment but with dose values instead of the labels)
+  /// Compute DVHs for the structure segments whose labelmaps are added to the given accumulator.
+  /// The dose volume is traversed only once for all the segments: statistics and histogram are computed
+  /// in the same pass for dose volumes. For other volumes the histogram needs a second pass, as the bins
+  /// depend on the value range within the structures.
   /// \param parameterNode Dose volume histogram parameter set node
-  /// \param segmentLabelmap Binary representation of the labelmap representation of the segment the DVH is calculated on
-  /// \param oversampledDoseVolume Dose volume resampled to match the geometry of the segment labelmap (to allow stenciling)
-  /// \param segmentID ID of segment the DVH is calculated on
+  /// \param labelmapAccumulator Accumulator containing the labelmaps of the segments in the same order as the segment IDs
+  /// \param doseImageData Dose volume (in world coordinate system) that is resampled to the oversampled geometry
+  /// \param oversampledDoseGeometry Geometry of the oversampled dose volume, i.e. the lattice of the segment labelmaps
+  /// \param segmentIDs IDs of the segments the DVHs are calculated on
   /// \param maxDoseGy Maximum dose determining the number of DVH bins (passed as argument so that it is only calculated once in \sa ComputeDvh() )
   /// \return Error message, empty string if no error
-  std::string ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, vtkOrientedImageData* segmentLabelmap, vtkOrientedImageData* oversampledDoseVolume, std::string segmentID, double maxDoseGy);
+  std::string ComputeDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, vtkMultiLabelImageAccumulate* labelmapAccumulator,
+    vtkOrientedImageData* doseImageData, vtkOrientedImageData* oversampledDoseGeometry, std::vector<std::string> segmentIDs, double maxDoseGy);
+
+  /// Resample the dose volume to the oversampled geometry and compute statistics and histograms in the given accumulator.
+  /// If \sa UseOnTheFlyDoseInterpolation is enabled and the oversampled geometry is aligned with the dose volume, then
+  /// the dose volume is interpolated by the accumulator instead and the oversampled dose volume is not created.
+  /// If the resampled dose volume would exceed \sa OversampledDoseVolumeMemoryLimitMB, then it is resampled and
+  /// accumulated in slabs along the third axis, each slab being released before the next one is resampled.
+  /// \param oversampledDoseVolume Whole resampled dose volume. It is filled if the dose volume is not split into slabs,
+  ///   and used without resampling again if it already contains scalars (e.g. in the second pass for non-dose volumes)
+  /// \return Error message, empty string if no error
+  std::string AccumulateOversampledDose(vtkMultiLabelImageAccumulate* labelmapAccumulator, vtkOrientedImageData* doseImageData,
+    vtkOrientedImageData* oversampledDoseGeometry, vtkOrientedImageData* oversampledDoseVolume);
+
+  /// Statistics and histogram of a structure segment the DVH is assembled from. Also stored in the DVH cache.
+  struct DvhResult;
+
+  /// Store DVH of a structure segment in a double array node and set its row in the metrics table
+  /// \param parameterNode Dose volume histogram parameter set node
+  /// \param result Statistics and histogram of the segment
+  /// \param segmentID ID of segment the DVH is calculated on
+  /// \return Error message, empty string if no error
+  std::string StoreDvh(vtkMRMLDoseVolumeHistogramNode* parameterNode, const DvhResult& result, std::string segmentID);
+
+  /// Get the mapping between the voxel indices of two images if their lattices are aligned:
+  /// toIndex[axis] = fromIndex[axis] * scale[axis] + offset[axis]
+  /// \return False if the axes of the lattices are not aligned (e.g. rotated or flipped)
+  static bool GetAlignedLatticeIndexMapping(vtkOrientedImageData* fromImage, vtkOrientedImageData* toImage, double scale[3], double offset[3]);
+
+  /// Assemble key identifying the DVH of a segment in the cache. The key contains the modification times of the
+  /// dose volume and the segment, the conversion parameters of the segmentation, and all the parameters affecting
+  /// the DVH, so the key changes whenever the DVH needs to be computed again.
+  /// \return Cache key, empty string if the inputs are invalid (in which case the DVH is not cached)
+  std::string GetDvhCacheKey(vtkMRMLDoseVolumeHistogramNode* parameterNode, std::string segmentID, double maxDoseGy);
+
+  /// Assemble identifier of the cache entry of a segment DVH from the dose volume, segmentation, and segment IDs.
+  /// Each entry holds only the latest result, which is replaced when the DVH of the segment is computed again.
+  /// \return Cache entry identifier, empty string if the inputs are invalid
+  static std::string GetDvhCacheEntryID(vtkMRMLDoseVolumeHistogramNode* parameterNode, std::string segmentID);
 
   /// Return the chart view node object from the layout
   vtkMRMLChartViewNode* GetChartViewNode();
@@ -154,7 +251,10 @@ protected:
   /// Get numbers from V or D metric parameters list
   void GetNumbersFromMetricString(std::string metricStr, std::vector<double> &metricNumbers);
 
-  /// Calculate one D metric. Called from \sa ComputeDMetrics
+  /// Compute the requested V and/or D metrics for existing DVHs and add them in the metrics table
+  bool ComputeMetrics(vtkMRMLDoseVolumeHistogramNode* parameterNode, bool computeVMetrics, bool computeDMetrics);
+
+  /// Calculate one D metric. \sa ComputeDMetricValues
   double ComputeDMetric(vtkMRMLDoubleArrayNode* dvhArrayNode, double volume, double structureVolume, bool isPercent);
 
   /// Callback function observing the visibility column of the metrics table
@@ -191,6 +291,31 @@ protected:
 
   /// Flag telling whether the speed measurements are logged on standard output
   bool LogSpeedMeasurements;
+
+  /// Flag telling whether the segment labelmaps are cropped to their effective extent before computing the DVH.
+  /// If enabled, the labelmaps of small structures only cover their bounding box instead of the whole dose volume,
+  /// and only that part of the dose volume is visited (and resampled in case of automatic oversampling). On by default.
+  bool UseCroppedLabelmaps;
+
+  /// Maximum size of the resampled dose volume held in memory while computing the DVH (in megabytes).
+  /// If the oversampled dose volume is larger, it is resampled and accumulated slab by slab, which gives identical results.
+  /// The segment labelmaps are not affected by the limit. Zero (default) means no limit.
+  double OversampledDoseVolumeMemoryLimitMB;
+
+  /// Flag telling whether the dose volume is linearly interpolated at the voxels of the oversampled segment labelmaps
+  /// while accumulating, instead of resampling it to an oversampled dose volume first. This way oversampling does not
+  /// multiply the memory needed for the dose volume. Only used if the oversampled lattice is aligned with the dose
+  /// volume, which is normally the case as the oversampled geometry is derived from the dose volume. Off by default.
+  bool UseOnTheFlyDoseInterpolation;
+
+  /// Number of segment DVHs taken from the cache
+  int DvhCacheHits;
+
+  /// Number of segment DVHs that needed to be computed
+  int DvhCacheMisses;
+
+  class vtkInternal;
+  vtkInternal* Internal;
 };
 
 #endif
@@ -0,0 +1,191 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+// SlicerRt includes
+#include "vtkFractionalImageAccumulate.h"
+#include "vtkMultiLabelImageAccumulate.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkImageStencilData.h>
+#include <vtkImageToImageStencil.h>
+#include <vtkMath.h>
+#include <vtkNew.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+  const int DIMENSION = 160;
+  const int NUMBER_OF_BINS = 100;
+  const double BIN_SPACING = 0.5;
+  const double MINIMUM_FRACTIONAL_VALUE = -108.0;
+  const double MAXIMUM_FRACTIONAL_VALUE = 108.0;
+
+  //-----------------------------------------------------------------------------
+  // Reference implementation: straightforward per-voxel loop, as in the templated
+  // execute function of vtkFractionalImageAccumulate before the fast path was added.
+  void ReferenceAccumulate(vtkImageData* doseImage, vtkImageData* fractionalLabelmap,
+    std::vector<double>& histogram, double& sum, double& fractionalVoxelCount)
+  {
+    histogram.assign(NUMBER_OF_BINS, 0.0);
+    sum = 0.0;
+    fractionalVoxelCount = 0.0;
+
+    float* dosePtr = static_cast<float*>(doseImage->GetScalarPointer());
+    char* labelPtr = static_cast<char*>(fractionalLabelmap->GetScalarPointer());
+    vtkIdType numberOfVoxels = doseImage->GetNumberOfPoints();
+    for (vtkIdType i=0; i<numberOfVoxels; ++i)
+    {
+      if (labelPtr[i] < MINIMUM_FRACTIONAL_VALUE + 1e-10)
+      {
+        continue;
+      }
+      double v = static_cast<double>(dosePtr[i]);
+      double f = (labelPtr[i] - MINIMUM_FRACTIONAL_VALUE) / (MAXIMUM_FRACTIONAL_VALUE - MINIMUM_FRACTIONAL_VALUE);
+      sum += v*f;
+      fractionalVoxelCount += f;
+      int binIndex = vtkMath::Floor(v / BIN_SPACING);
+      if (binIndex >= 0 && binIndex < NUMBER_OF_BINS)
+      {
+        histogram[binIndex] += f;
+      }
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Compares the single component fast path of vtkFractionalImageAccumulate and the row loop of
+// vtkMultiLabelImageAccumulate (used for DVH computation) to the reference per-voxel loop.
+int vtkFractionalImageAccumulateTest1( int vtkNotUsed(argc), char * vtkNotUsed(argv)[] )
+{
+  // Create synthetic dose: linear gradient along the diagonal
+  vtkNew<vtkImageData> doseImage;
+  doseImage->SetExtent(0, DIMENSION-1, 0, DIMENSION-1, 0, DIMENSION-1);
+  doseImage->AllocateScalars(VTK_FLOAT, 1);
+  float* dosePtr = static_cast<float*>(doseImage->GetScalarPointer());
+
+  // Create fractional labelmap of a sphere in the same char representation that the
+  // fractional labelmap conversion produces, with fractional values at the boundary
+  vtkNew<vtkImageData> fractionalLabelmap;
+  fractionalLabelmap->SetExtent(doseImage->GetExtent());
+  fractionalLabelmap->AllocateScalars(VTK_CHAR, 1);
+  char* labelPtr = static_cast<char*>(fractionalLabelmap->GetScalarPointer());
+
+  double center = DIMENSION / 2.0;
+  double radius = DIMENSION / 3.0;
+  for (int k=0; k<DIMENSION; ++k)
+  {
+    for (int j=0; j<DIMENSION; ++j)
+    {
+      for (int i=0; i<DIMENSION; ++i)
+      {
+        *(dosePtr++) = static_cast<float>( (i + j + k) * 0.01 * NUMBER_OF_BINS * BIN_SPACING / DIMENSION );
+        double distance = sqrt( (i-center)*(i-center) + (j-center)*(j-center) + (k-center)*(k-center) );
+        double fraction = std::max(0.0, std::min(1.0, radius - distance + 0.5));
+        *(labelPtr++) = static_cast<char>( vtkMath::Round( MINIMUM_FRACTIONAL_VALUE + fraction * (MAXIMUM_FRACTIONAL_VALUE - MINIMUM_FRACTIONAL_VALUE) ) );
+      }
+    }
+  }
+
+  // Reference loop
+  std::vector<double> referenceHistogram;
+  double referenceSum = 0.0;
+  double referenceFractionalVoxelCount = 0.0;
+  ReferenceAccumulate(doseImage.GetPointer(), fractionalLabelmap.GetPointer(), referenceHistogram, referenceSum, referenceFractionalVoxelCount);
+
+  // Filter
+  vtkNew<vtkImageToImageStencil> stencil;
+  stencil->SetInputData(fractionalLabelmap.GetPointer());
+  stencil->ThresholdByUpper(MINIMUM_FRACTIONAL_VALUE + 1e-10);
+  stencil->Update();
+
+  vtkNew<vtkFractionalImageAccumulate> accumulate;
+  accumulate->SetInputData(doseImage.GetPointer());
+  accumulate->SetStencilData(stencil->GetOutput());
+  accumulate->UseFractionalLabelmapOn();
+  accumulate->SetFractionalLabelmap(fractionalLabelmap.GetPointer());
+  accumulate->SetMinimumFractionalValue(MINIMUM_FRACTIONAL_VALUE);
+  accumulate->SetMaximumFractionalValue(MAXIMUM_FRACTIONAL_VALUE);
+  accumulate->SetComponentExtent(0,NUMBER_OF_BINS-1,0,0,0,0);
+  accumulate->SetComponentOrigin(0,0,0);
+  accumulate->SetComponentSpacing(BIN_SPACING,1,1);
+  accumulate->Update();
+
+  // Results need to be identical
+  if (accumulate->GetFractionalVoxelCount() != referenceFractionalVoxelCount)
+  {
+    std::cerr << "ERROR: Fractional voxel count mismatch: " << accumulate->GetFractionalVoxelCount()
+      << " != " << referenceFractionalVoxelCount << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (referenceFractionalVoxelCount == 0.0 || accumulate->GetMean()[0] != referenceSum / referenceFractionalVoxelCount)
+  {
+    std::cerr << "ERROR: Mean mismatch: " << accumulate->GetMean()[0] << " != " << referenceSum / referenceFractionalVoxelCount << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int binIndex=0; binIndex<NUMBER_OF_BINS; ++binIndex)
+  {
+    double binValue = accumulate->GetOutput()->GetScalarComponentAsDouble(binIndex,0,0,0);
+    if (binValue != referenceHistogram[binIndex])
+    {
+      std::cerr << "ERROR: Histogram mismatch in bin " << binIndex << ": " << binValue << " != " << referenceHistogram[binIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Multi-label accumulation of the same labelmap (as done for DVH computation)
+  vtkNew<vtkMultiLabelImageAccumulate> multiLabelAccumulate;
+  multiLabelAccumulate->SetInputData(doseImage.GetPointer());
+  multiLabelAccumulate->UseFractionalLabelmapOn();
+  int labelIndex = multiLabelAccumulate->AddLabelmap(fractionalLabelmap.GetPointer(), MINIMUM_FRACTIONAL_VALUE, MAXIMUM_FRACTIONAL_VALUE);
+  multiLabelAccumulate->SetBinning(labelIndex, 0.0, BIN_SPACING, NUMBER_OF_BINS);
+  if (!multiLabelAccumulate->Update())
+  {
+    std::cerr << "ERROR: Failed to update vtkMultiLabelImageAccumulate" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (multiLabelAccumulate->GetFractionalVoxelCount(labelIndex) != referenceFractionalVoxelCount)
+  {
+    std::cerr << "ERROR: Multi-label fractional voxel count mismatch: " << multiLabelAccumulate->GetFractionalVoxelCount(labelIndex)
+      << " != " << referenceFractionalVoxelCount << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (multiLabelAccumulate->GetMean(labelIndex) != referenceSum / referenceFractionalVoxelCount)
+  {
+    std::cerr << "ERROR: Multi-label mean mismatch: " << multiLabelAccumulate->GetMean(labelIndex) << " != " << referenceSum / referenceFractionalVoxelCount << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int binIndex=0; binIndex<NUMBER_OF_BINS; ++binIndex)
+  {
+    double binValue = multiLabelAccumulate->GetHistogramValue(labelIndex, binIndex);
+    if (binValue != referenceHistogram[binIndex])
+    {
+      std::cerr << "ERROR: Multi-label histogram mismatch in bin " << binIndex << ": " << binValue << " != " << referenceHistogram[binIndex] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
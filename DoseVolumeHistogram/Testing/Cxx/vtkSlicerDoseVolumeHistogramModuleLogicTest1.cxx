@@ -43,6 +43,7 @@
 #include <vtkMRMLChartNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkDoubleArray.h>
@@ -51,6 +52,7 @@
 #include <vtkImageData.h>
 #include <vtkImageAccumulate.h>
 #include <vtkLookupTable.h>
+#include <vtkTable.h>
 #include <vtkTimerLog.h>
 
 // ITK includes
@@ -59,6 +61,10 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <fstream>
+#include <iterator>
+
 std::string csvSeparatorCharacter(",");
 
 //-----------------------------------------------------------------------------
@@ -68,6 +74,15 @@ int CompareCsvDvhTables(std::string dvhMetricsCsvFileName, std::string baselineC
 
 int CompareCsvDvhMetrics(std::string dvhMetricsCsvFileName, std::string baselineDvhMetricCsvFileName, double metricDifferenceThreshold);
 
+int ComputeDvhAndMetrics(vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, vtkMRMLDoseVolumeHistogramNode* paramNode,
+                         std::vector<vtkSmartPointer<vtkDoubleArray> >& dvhArrays, vtkTable* metricsTable);
+
+int CompareDvhAndMetrics(std::vector<vtkSmartPointer<vtkDoubleArray> >& dvhArrays, vtkTable* metricsTable,
+                         std::vector<vtkSmartPointer<vtkDoubleArray> >& baselineDvhArrays, vtkTable* baselineMetricsTable,
+                         double volumeDifferenceTolerance, double metricRelativeDifferenceTolerance);
+
+int TestReadCorruptBinaryDvhFile(vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, std::string binaryFileName);
+
 //-----------------------------------------------------------------------------
 int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
 {
@@ -465,6 +480,47 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
   vtksys::SystemTools::RemoveFile(temporaryDvhTableCsvFileName);
   dvhLogic->ExportDvhToCsv(paramNode, temporaryDvhTableCsvFileName);
 
+  // Export DVH to binary file (compressed) and check that reading it back gives exactly the computed DVHs
+  std::string temporaryDvhBinaryFileName = std::string(temporaryDvhTableCsvFileName) + ".dvhb";
+  vtksys::SystemTools::RemoveFile(temporaryDvhBinaryFileName.c_str());
+  if (!dvhLogic->ExportDvhToBinary(paramNode, temporaryDvhBinaryFileName.c_str(), true))
+  {
+    std::cerr << "ERROR: Failed to export DVH to binary file!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkCollection> binaryDvhNodes = vtkSmartPointer<vtkCollection>::Take(
+    dvhLogic->ReadBinaryToDoubleArrayNode(temporaryDvhBinaryFileName) );
+  if (!binaryDvhNodes.GetPointer() || binaryDvhNodes->GetNumberOfItems() != static_cast<int>(dvhNodes.size()))
+  {
+    std::cerr << "ERROR: Failed to read DVHs from binary file!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  for (int dvhIndex=0; dvhIndex<binaryDvhNodes->GetNumberOfItems(); ++dvhIndex)
+  {
+    vtkDoubleArray* computedArray = dvhNodes[dvhIndex]->GetArray();
+    vtkDoubleArray* readArray = vtkMRMLDoubleArrayNode::SafeDownCast(binaryDvhNodes->GetItemAsObject(dvhIndex))->GetArray();
+    if ( readArray->GetNumberOfTuples() != computedArray->GetNumberOfTuples()
+      || readArray->GetNumberOfComponents() != computedArray->GetNumberOfComponents() )
+    {
+      std::cerr << "ERROR: DVH read from binary file has different size than the computed one: " << dvhNodes[dvhIndex]->GetName() << std::endl;
+      return EXIT_FAILURE;
+    }
+    for (vtkIdType valueIndex=0; valueIndex<computedArray->GetNumberOfValues(); ++valueIndex)
+    {
+      if (readArray->GetValue(valueIndex) != computedArray->GetValue(valueIndex))
+      {
+        std::cerr << "ERROR: DVH read from binary file differs from the computed one: " << dvhNodes[dvhIndex]->GetName() << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  if (TestReadCorruptBinaryDvhFile(dvhLogic, temporaryDvhBinaryFileName) > 0)
+  {
+    std::cerr << "ERROR: Corrupt binary DVH file is not rejected!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  vtksys::SystemTools::RemoveFile(temporaryDvhBinaryFileName.c_str());
+
   // Compute DVH metrics
   paramNode->SetVDoseValues("5, 20");
   paramNode->SetShowVMetricsCc(true);
@@ -521,6 +577,76 @@ int vtkSlicerDoseVolumeHistogramModuleLogicTest1( int argc, char * argv[] )
     }
   }
 
+  // Compute DVH again without changes: all DVHs are taken from the cache
+  int numberOfDvhs = static_cast<int>(dvhNodes.size());
+  int dvhCacheHits = dvhLogic->GetDvhCacheHits();
+  int dvhCacheMisses = dvhLogic->GetDvhCacheMisses();
+  errorMessage = dvhLogic->ComputeDvh(paramNode);
+  if ( !errorMessage.empty() || dvhLogic->GetDvhCacheHits() != dvhCacheHits + numberOfDvhs
+    || dvhLogic->GetDvhCacheMisses() != dvhCacheMisses || dvhLogic->GetNumberOfCachedDvhs() != numberOfDvhs )
+  {
+    std::cerr << "DVH cache mismatch after recomputation without changes: " << dvhLogic->GetDvhCacheHits() - dvhCacheHits
+      << " hits, " << dvhLogic->GetDvhCacheMisses() - dvhCacheMisses << " misses, " << dvhLogic->GetNumberOfCachedDvhs()
+      << " cached DVHs (expected " << numberOfDvhs << ", 0, " << numberOfDvhs << ")" << std::endl;
+    returnWithSuccess = false;
+  }
+
+  // Change a conversion parameter of the segmentation: all DVHs are computed again and replace the superseded ones
+  std::string defaultSliceThicknessParameterName = vtkPlanarContourToClosedSurfaceConversionRule::GetDefaultSliceThicknessParameterName();
+  std::string defaultSliceThickness = segmentationNode->GetSegmentation()->GetConversionParameter(defaultSliceThicknessParameterName);
+  segmentationNode->GetSegmentation()->SetConversionParameter(defaultSliceThicknessParameterName, "2.5");
+  dvhCacheHits = dvhLogic->GetDvhCacheHits();
+  dvhCacheMisses = dvhLogic->GetDvhCacheMisses();
+  errorMessage = dvhLogic->ComputeDvh(paramNode);
+  segmentationNode->GetSegmentation()->SetConversionParameter(defaultSliceThicknessParameterName, defaultSliceThickness);
+  if ( !errorMessage.empty() || dvhLogic->GetDvhCacheHits() != dvhCacheHits
+    || dvhLogic->GetDvhCacheMisses() != dvhCacheMisses + numberOfDvhs || dvhLogic->GetNumberOfCachedDvhs() != numberOfDvhs )
+  {
+    std::cerr << "DVH cache mismatch after changing conversion parameters: " << dvhLogic->GetDvhCacheHits() - dvhCacheHits
+      << " hits, " << dvhLogic->GetDvhCacheMisses() - dvhCacheMisses << " misses, " << dvhLogic->GetNumberOfCachedDvhs()
+      << " cached DVHs (expected 0, " << numberOfDvhs << ", " << numberOfDvhs << ")" << std::endl;
+    returnWithSuccess = false;
+  }
+
+  // Compute reference DVHs and metrics without cache for the comparisons below
+  std::vector<vtkSmartPointer<vtkDoubleArray> > referenceDvhArrays;
+  vtkSmartPointer<vtkTable> referenceMetricsTable = vtkSmartPointer<vtkTable>::New();
+  dvhLogic->ClearDvhCache();
+  if (ComputeDvhAndMetrics(dvhLogic, paramNode, referenceDvhArrays, referenceMetricsTable) > 0)
+  {
+    std::cerr << "Failed to compute reference DVHs!" << std::endl;
+    returnWithSuccess = false;
+  }
+
+  // Limit the memory of the resampled dose volume so that it is resampled and accumulated one slice at a time.
+  // The DVHs and metrics need to be identical to the ones computed from the whole resampled dose volume.
+  std::vector<vtkSmartPointer<vtkDoubleArray> > slabDvhArrays;
+  vtkSmartPointer<vtkTable> slabMetricsTable = vtkSmartPointer<vtkTable>::New();
+  dvhLogic->SetOversampledDoseVolumeMemoryLimitMB(1.0e-6);
+  dvhLogic->ClearDvhCache();
+  if ( ComputeDvhAndMetrics(dvhLogic, paramNode, slabDvhArrays, slabMetricsTable) > 0
+    || CompareDvhAndMetrics(slabDvhArrays, slabMetricsTable, referenceDvhArrays, referenceMetricsTable, 0.0, 0.0) > 0 )
+  {
+    std::cerr << "DVHs computed from slabs of the resampled dose volume differ from the ones computed from the whole volume!" << std::endl;
+    returnWithSuccess = false;
+  }
+  dvhLogic->SetOversampledDoseVolumeMemoryLimitMB(0.0);
+
+  // Interpolate the dose volume at the oversampled labelmap voxels instead of resampling it. The interpolation is the same,
+  // but the resampled dose volume is rounded to float, which may move voxels lying at bin boundaries to the neighboring bin.
+  // Tolerance is 0.1 percentage points for the DVH volume values and 0.5% relative difference for the metrics.
+  std::vector<vtkSmartPointer<vtkDoubleArray> > interpolatedDvhArrays;
+  vtkSmartPointer<vtkTable> interpolatedMetricsTable = vtkSmartPointer<vtkTable>::New();
+  dvhLogic->UseOnTheFlyDoseInterpolationOn();
+  dvhLogic->ClearDvhCache();
+  if ( ComputeDvhAndMetrics(dvhLogic, paramNode, interpolatedDvhArrays, interpolatedMetricsTable) > 0
+    || CompareDvhAndMetrics(interpolatedDvhArrays, interpolatedMetricsTable, referenceDvhArrays, referenceMetricsTable, 0.1, 0.005) > 0 )
+  {
+    std::cerr << "DVHs computed with on the fly dose interpolation differ from the ones computed from the resampled dose volume!" << std::endl;
+    returnWithSuccess = false;
+  }
+  dvhLogic->UseOnTheFlyDoseInterpolationOff();
+
   if (!returnWithSuccess)
   {
     return EXIT_FAILURE;
@@ -752,3 +878,209 @@ int CompareCsvDvhMetrics(std::string dvhMetricsCsvFileName, std::string baseline
 
   return 0;
 }
+
+//-----------------------------------------------------------------------------
+int ComputeDvhAndMetrics(vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, vtkMRMLDoseVolumeHistogramNode* paramNode,
+                         std::vector<vtkSmartPointer<vtkDoubleArray> >& dvhArrays, vtkTable* metricsTable)
+{
+  std::string errorMessage = dvhLogic->ComputeDvh(paramNode);
+  if (!errorMessage.empty())
+  {
+    std::cerr << "ERROR: Failed to compute DVH: " << errorMessage << std::endl;
+    return 1;
+  }
+  if (!dvhLogic->ComputeVAndDMetrics(paramNode))
+  {
+    std::cerr << "ERROR: Failed to compute DVH metrics!" << std::endl;
+    return 1;
+  }
+
+  // Store copies, as the DVH array nodes and the metrics table are overwritten by the next computation
+  std::vector<vtkMRMLDoubleArrayNode*> dvhNodes;
+  paramNode->GetDvhArrayNodes(dvhNodes);
+  dvhArrays.clear();
+  for (std::vector<vtkMRMLDoubleArrayNode*>::iterator dvhIt = dvhNodes.begin(); dvhIt != dvhNodes.end(); ++dvhIt)
+  {
+    vtkSmartPointer<vtkDoubleArray> dvhArray = vtkSmartPointer<vtkDoubleArray>::New();
+    dvhArray->DeepCopy((*dvhIt)->GetArray());
+    dvhArrays.push_back(dvhArray);
+  }
+  metricsTable->DeepCopy(paramNode->GetMetricsTableNode()->GetTable());
+
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+int CompareDvhAndMetrics(std::vector<vtkSmartPointer<vtkDoubleArray> >& dvhArrays, vtkTable* metricsTable,
+                         std::vector<vtkSmartPointer<vtkDoubleArray> >& baselineDvhArrays, vtkTable* baselineMetricsTable,
+                         double volumeDifferenceTolerance, double metricRelativeDifferenceTolerance)
+{
+  // DVHs: the dose values need to be identical, the volume values (percentage) may differ by the tolerance
+  if (dvhArrays.size() != baselineDvhArrays.size())
+  {
+    std::cerr << "ERROR: Number of DVHs do not match (" << dvhArrays.size() << "<>" << baselineDvhArrays.size() << ")!" << std::endl;
+    return 1;
+  }
+  for (unsigned int dvhIndex=0; dvhIndex<dvhArrays.size(); ++dvhIndex)
+  {
+    vtkDoubleArray* dvhArray = dvhArrays[dvhIndex];
+    vtkDoubleArray* baselineDvhArray = baselineDvhArrays[dvhIndex];
+    if ( dvhArray->GetNumberOfTuples() != baselineDvhArray->GetNumberOfTuples()
+      || dvhArray->GetNumberOfComponents() != baselineDvhArray->GetNumberOfComponents() )
+    {
+      std::cerr << "ERROR: Size of DVH " << dvhIndex << " does not match the baseline!" << std::endl;
+      return 1;
+    }
+    for (vtkIdType binIndex=0; binIndex<dvhArray->GetNumberOfTuples(); ++binIndex)
+    {
+      if ( dvhArray->GetComponent(binIndex, 0) != baselineDvhArray->GetComponent(binIndex, 0)
+        || fabs(dvhArray->GetComponent(binIndex, 1) - baselineDvhArray->GetComponent(binIndex, 1)) > volumeDifferenceTolerance )
+      {
+        std::cerr << "ERROR: DVH " << dvhIndex << " differs from the baseline in bin " << binIndex << ": ("
+          << dvhArray->GetComponent(binIndex, 0) << ", " << dvhArray->GetComponent(binIndex, 1) << ") <> ("
+          << baselineDvhArray->GetComponent(binIndex, 0) << ", " << baselineDvhArray->GetComponent(binIndex, 1) << ")" << std::endl;
+        return 1;
+      }
+    }
+  }
+
+  // Metrics: numeric values may differ by the relative tolerance, other values need to be identical
+  if ( metricsTable->GetNumberOfRows() != baselineMetricsTable->GetNumberOfRows()
+    || metricsTable->GetNumberOfColumns() != baselineMetricsTable->GetNumberOfColumns() )
+  {
+    std::cerr << "ERROR: Size of the metrics table does not match the baseline!" << std::endl;
+    return 1;
+  }
+  for (vtkIdType row=0; row<metricsTable->GetNumberOfRows(); ++row)
+  {
+    for (vtkIdType column=0; column<metricsTable->GetNumberOfColumns(); ++column)
+    {
+      vtkVariant value = metricsTable->GetValue(row, column);
+      vtkVariant baselineValue = baselineMetricsTable->GetValue(row, column);
+      bool valueIsNumeric = false;
+      bool baselineValueIsNumeric = false;
+      double numericValue = value.ToDouble(&valueIsNumeric);
+      double baselineNumericValue = baselineValue.ToDouble(&baselineValueIsNumeric);
+      bool match = false;
+      if (valueIsNumeric && baselineValueIsNumeric)
+      {
+        match = ( numericValue == baselineNumericValue
+          || fabs(numericValue - baselineNumericValue) <= metricRelativeDifferenceTolerance * fabs(baselineNumericValue) );
+      }
+      else
+      {
+        match = (value.ToString() == baselineValue.ToString());
+      }
+      if (!match)
+      {
+        std::cerr << "ERROR: Metric " << metricsTable->GetColumnName(column) << " in row " << row << " differs from the baseline: "
+          << value.ToString() << " <> " << baselineValue.ToString() << std::endl;
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+vtkTypeUInt64 GetLittleEndianValue(const std::string& data, size_t position, int numberOfBytes)
+{
+  vtkTypeUInt64 value = 0;
+  for (int byteIndex=numberOfBytes-1; byteIndex>=0; --byteIndex)
+  {
+    value = (value << 8) | static_cast<unsigned char>(data[position + byteIndex]);
+  }
+  return value;
+}
+
+//-----------------------------------------------------------------------------
+void SetLittleEndianValue(std::string& data, size_t position, int numberOfBytes, vtkTypeUInt64 value)
+{
+  for (int byteIndex=0; byteIndex<numberOfBytes; ++byteIndex)
+  {
+    data[position + byteIndex] = static_cast<char>((value >> (8*byteIndex)) & 0xFF);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Corrupts the counts, sizes, and block locations of a valid binary DVH file one by one (and truncates it),
+// and checks that reading each corrupt file fails instead of allocating memory based on the corrupt values
+int TestReadCorruptBinaryDvhFile(vtkSlicerDoseVolumeHistogramModuleLogic* dvhLogic, std::string binaryFileName)
+{
+  std::ifstream infile(binaryFileName.c_str(), std::ios_base::in | std::ios_base::binary);
+  std::string data((std::istreambuf_iterator<char>(infile)), std::istreambuf_iterator<char>());
+  infile.close();
+
+  // Locate the fields in the header and the directory entry of the first structure
+  size_t doseUnitNameLengthPosition = 8 + 4 + 4;
+  size_t numberOfStructuresPosition = doseUnitNameLengthPosition + 4 + GetLittleEndianValue(data, doseUnitNameLengthPosition, 4);
+  size_t structureNameLengthPosition = numberOfStructuresPosition + 4;
+  size_t segmentIdLengthPosition = structureNameLengthPosition + 4 + GetLittleEndianValue(data, structureNameLengthPosition, 4);
+  size_t numberOfTuplesPosition = segmentIdLengthPosition + 4 + GetLittleEndianValue(data, segmentIdLengthPosition, 4) + 8;
+  size_t numberOfComponentsPosition = numberOfTuplesPosition + 4;
+  size_t blockOffsetPosition = numberOfComponentsPosition + 4;
+  size_t blockSizePosition = blockOffsetPosition + 8;
+  if (GetLittleEndianValue(data, numberOfStructuresPosition, 4) < 1 || data.size() < blockSizePosition + 8)
+  {
+    std::cerr << "ERROR: Binary DVH file does not contain any structures: " << binaryFileName << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> corruptDataList;
+  std::vector<std::string> corruptionNames;
+  std::string corruptData = data;
+  SetLittleEndianValue(corruptData, doseUnitNameLengthPosition, 4, 0xFFFFFFFF);
+  corruptDataList.push_back(corruptData);
+  corruptionNames.push_back("dose unit name length");
+  corruptData = data;
+  SetLittleEndianValue(corruptData, numberOfStructuresPosition, 4, 0xFFFFFFFF);
+  corruptDataList.push_back(corruptData);
+  corruptionNames.push_back("number of structures");
+  corruptData = data;
+  SetLittleEndianValue(corruptData, structureNameLengthPosition, 4, 0xFFFFFFFF);
+  corruptDataList.push_back(corruptData);
+  corruptionNames.push_back("structure name length");
+  corruptData = data;
+  SetLittleEndianValue(corruptData, numberOfTuplesPosition, 4, 0xFFFFFFFF);
+  corruptDataList.push_back(corruptData);
+  corruptionNames.push_back("number of tuples");
+  corruptData = data;
+  SetLittleEndianValue(corruptData, numberOfComponentsPosition, 4, 0xFFFFFFFF);
+  corruptDataList.push_back(corruptData);
+  corruptionNames.push_back("number of components");
+  corruptData = data;
+  SetLittleEndianValue(corruptData, blockOffsetPosition, 8, VTK_TYPE_UINT64_MAX);
+  corruptDataList.push_back(corruptData);
+  corruptionNames.push_back("block offset");
+  corruptData = data;
+  SetLittleEndianValue(corruptData, blockSizePosition, 8, VTK_TYPE_UINT64_MAX);
+  corruptDataList.push_back(corruptData);
+  corruptionNames.push_back("block size");
+  corruptDataList.push_back(data.substr(0, data.size() - 1));
+  corruptionNames.push_back("truncated file");
+
+  // Reading the corrupt files logs errors, which are expected here
+  std::string corruptFileName = binaryFileName + ".corrupt";
+  int globalWarningDisplay = vtkObject::GetGlobalWarningDisplay();
+  vtkObject::GlobalWarningDisplayOff();
+  int numberOfFailures = 0;
+  for (unsigned int corruptionIndex=0; corruptionIndex<corruptDataList.size(); ++corruptionIndex)
+  {
+    std::ofstream outfile(corruptFileName.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary);
+    outfile.write(corruptDataList[corruptionIndex].c_str(), corruptDataList[corruptionIndex].size());
+    outfile.close();
+
+    vtkSmartPointer<vtkCollection> dvhNodes = vtkSmartPointer<vtkCollection>::Take(
+      dvhLogic->ReadBinaryToDoubleArrayNode(corruptFileName) );
+    if (dvhNodes.GetPointer())
+    {
+      std::cerr << "ERROR: Binary DVH file with corrupt " << corruptionNames[corruptionIndex] << " is read without error" << std::endl;
+      ++numberOfFailures;
+    }
+  }
+  vtkObject::SetGlobalWarningDisplay(globalWarningDisplay);
+  vtksys::SystemTools::RemoveFile(corruptFileName.c_str());
+
+  return (numberOfFailures > 0 ? 1 : 0);
+}
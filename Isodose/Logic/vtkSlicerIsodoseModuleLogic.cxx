@@ -30,6 +30,7 @@
 
 // SlicerRT includes
 #include "vtkSlicerRtCommon.h"
+#include "vtkSlicerRtDataObjectCache.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
@@ -48,13 +49,13 @@
 
 // VTK includes
 #include <vtkNew.h>
+#include <vtkAtomic.h>
 #include <vtkImageData.h>
-#include <vtkImageMarchingCubes.h>
+#include <vtkFlyingEdges3D.h>
 #include <vtkImageChangeInformation.h>
 #include <vtkImageReslice.h>
 #include <vtkSmartPointer.h>
 #include <vtkLookupTable.h>
-#include <vtkTriangleFilter.h>
 #include <vtkDecimatePro.h>
 #include <vtkPolyDataNormals.h>
 #include <vtkGeneralTransform.h>
@@ -63,8 +64,20 @@
 #include <vtkWindowedSincPolyDataFilter.h>
 #include <vtkTransformPolyDataFilter.h>
 #include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkTransform.h>
+#include <vtkCellArray.h>
+#include <vtkSMPTools.h>
+#include <vtkImageShrink3D.h>
 #include "vtksys/SystemTools.hxx"
 
+// STD includes
+#include <algorithm>
+#include <map>
+#include <sstream>
+
 //----------------------------------------------------------------------------
 const char* vtkSlicerIsodoseModuleLogic::DEFAULT_ISODOSE_COLOR_TABLE_FILE_NAME = "Isodose_ColorTable.ctbl";
 const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX = "IsodoseLevel_";
@@ -74,23 +87,126 @@ const std::string vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTF
 static const char* ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE = "isodoseRootModelHierarchyRef";
 static const char* ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE = "isodoseRootModelHierarchyDisplayRef";
 
+// Isodose surface post-processing parameters (also part of the isodose surface cache keys)
+static const double ISODOSE_DECIMATION_TARGET_REDUCTION = 0.6;
+static const double ISODOSE_DECIMATION_FEATURE_ANGLE = 60.0;
+static const double ISODOSE_DECIMATION_MAXIMUM_ERROR = 1.0;
+static const double ISODOSE_SMOOTHING_PASS_BAND = 0.1;
+static const int ISODOSE_SMOOTHING_NUMBER_OF_ITERATIONS = 2;
+static const double ISODOSE_NORMALS_FEATURE_ANGLE = 60.0;
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerIsodoseModuleLogic);
 
+//----------------------------------------------------------------------------
+class vtkSlicerIsodoseModuleLogic::vtkInternal
+{
+public:
+  /// Multi-resolution representation of a dose volume used for the preview surfaces
+  struct DosePyramid
+  {
+    /// Identifies the dose image and transform state the pyramid was built from
+    std::string Key;
+    /// Dose images in IJK coordinate system of the dose volume, from finest (original) to coarsest
+    std::vector<vtkSmartPointer<vtkImageData> > Levels;
+  };
+
+  /// Remove the dose pyramid and the cached isodose surfaces of a dose volume (e.g. when it is removed from the scene)
+  void RemoveDoseVolume(const std::string& doseVolumeNodeID)
+  {
+    this->DosePyramids.erase(doseVolumeNodeID);
+
+    // The keys of the surfaces start with the key of the dose volume, which starts with the node ID (\sa GetDoseVolumeKey)
+    this->IsodoseSurfaces->RemoveItemsWithKeyPrefix(doseVolumeNodeID + ";");
+  }
+
+public:
+  vtkInternal()
+  {
+    this->IsodoseSurfaces = vtkSmartPointer<vtkSlicerRtDataObjectCache>::New();
+  }
+
+public:
+  /// Dose pyramids by dose volume node ID
+  std::map<std::string, DosePyramid> DosePyramids;
+
+  /// Isodose surfaces by the dose, the level, and the post-processing parameters they were created with
+  vtkSmartPointer<vtkSlicerRtDataObjectCache> IsodoseSurfaces;
+};
+
+//----------------------------------------------------------------------------
+// Get cache key of an isodose surface of the dose given by its key (\sa GetDoseVolumeKey)
+static std::string vtkSlicerIsodoseGetSurfaceKey(const std::string& doseVolumeKey, double isoLevel)
+{
+  std::ostringstream surfaceKey;
+  surfaceKey.precision(17);
+  surfaceKey << doseVolumeKey << "|" << isoLevel
+    << "|" << ISODOSE_DECIMATION_TARGET_REDUCTION << "," << ISODOSE_DECIMATION_FEATURE_ANGLE << "," << ISODOSE_DECIMATION_MAXIMUM_ERROR
+    << "|" << ISODOSE_SMOOTHING_PASS_BAND << "," << ISODOSE_SMOOTHING_NUMBER_OF_ITERATIONS
+    << "|" << ISODOSE_NORMALS_FEATURE_ANGLE;
+  return surfaceKey.str();
+}
+
+//----------------------------------------------------------------------------
+// Creates the final isodose surfaces from the raw contours of each level: decimation, smoothing,
+// normals, and transform from IJK to RAS. The levels are independent, so they are processed in parallel.
+class vtkSlicerIsodoseSurfaceFunctor
+{
+public:
+  vtkSlicerIsodoseSurfaceFunctor(std::vector<vtkSmartPointer<vtkPolyData> >& isodosePolyDatas, vtkMatrix4x4* ijkToRasMatrix,
+                                 vtkAtomic<int>* abortRequested)
+    : IsodosePolyDatas(isodosePolyDatas)
+    , IjkToRasMatrix(ijkToRasMatrix)
+    , AbortRequested(abortRequested)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    for (vtkIdType levelIndex=begin; levelIndex<end; ++levelIndex)
+    {
+      if (this->AbortRequested && this->AbortRequested->load())
+      {
+        // Do not return unprocessed contours as surfaces
+        this->IsodosePolyDatas[levelIndex] = vtkSmartPointer<vtkPolyData>::New();
+        continue;
+      }
+      if (this->IsodosePolyDatas[levelIndex]->GetNumberOfPoints() < 1)
+      {
+        continue;
+      }
+      this->IsodosePolyDatas[levelIndex] = vtkSlicerIsodoseModuleLogic::CreateIsodoseSurface(
+        this->IsodosePolyDatas[levelIndex], this->IjkToRasMatrix);
+    }
+  }
+
+private:
+  std::vector<vtkSmartPointer<vtkPolyData> >& IsodosePolyDatas;
+  vtkMatrix4x4* IjkToRasMatrix;
+  vtkAtomic<int>* AbortRequested;
+};
+
 //----------------------------------------------------------------------------
 vtkSlicerIsodoseModuleLogic::vtkSlicerIsodoseModuleLogic()
 {
+  this->PreviewMaximumNumberOfVoxels = 1000000;
+  this->IsodoseSurfaceCacheMemoryLimitMB = 256.0;
+  this->Internal = new vtkInternal();
 }
 
 //----------------------------------------------------------------------------
 vtkSlicerIsodoseModuleLogic::~vtkSlicerIsodoseModuleLogic()
 {
+  delete this->Internal;
+  this->Internal = NULL;
 }
 
 //----------------------------------------------------------------------------
 void vtkSlicerIsodoseModuleLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "PreviewMaximumNumberOfVoxels: " << this->PreviewMaximumNumberOfVoxels << "\n";
+  os << indent << "IsodoseSurfaceCacheMemoryLimitMB: " << this->IsodoseSurfaceCacheMemoryLimitMB << "\n";
 }
 
 //---------------------------------------------------------------------------
@@ -153,6 +269,9 @@ void vtkSlicerIsodoseModuleLogic::OnMRMLSceneEndClose()
     return;
   }
 
+  this->Internal->DosePyramids.clear();
+  this->Internal->IsodoseSurfaces->RemoveAllItems();
+
   this->Modified();
 }
 
@@ -186,6 +305,12 @@ void vtkSlicerIsodoseModuleLogic::OnMRMLSceneNodeRemoved(vtkMRMLNode* node)
     return;
   }
 
+  // Release the cached data of a removed dose volume (also during batch processing)
+  if (node->IsA("vtkMRMLScalarVolumeNode") && node->GetID())
+  {
+    this->Internal->RemoveDoseVolume(node->GetID());
+  }
+
   // if the scene is still updating, jump out
   if (this->GetMRMLScene()->IsBatchProcessing())
   {
@@ -410,107 +535,170 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
     vtkErrorMacro("CreateIsodoseSurfaces: Invalid scene or parameter set node!");
     return;
   }
-  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
-  if (!shNode)
+
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+  if (!doseVolumeNode || !doseVolumeNode->GetImageData() || !colorTableNode)
   {
-    vtkErrorMacro("CreateIsodoseSurfaces: Failed to access subject hierarchy node");
+    vtkErrorMacro("CreateIsodoseSurfaces: Invalid dose volume or color table!");
     return;
   }
 
-  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
-  if (!doseVolumeNode || !doseVolumeNode->GetImageData())
+  // Progress
+  int stepCount = 3 /* dose image, surface extraction, and model creation steps */;
+  int currentStep = 0;
+
+  // Get the surfaces of the levels that have not changed since they were last computed
+  std::vector<vtkSmartPointer<vtkPolyData> > isodoseSurfaces;
+  if (!this->GetCachedIsodoseSurfaces(parameterNode, isodoseSurfaces))
   {
-    vtkErrorMacro("CreateIsodoseSurfaces: Invalid dose volume!");
-    return;
+    // Get dose image to contour in IJK coordinate system
+    vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+    vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    if (!vtkSlicerIsodoseModuleLogic::GetDoseImageInIjk(doseVolumeNode, doseImageData, doseIjkToRasMatrix))
+    {
+      vtkErrorMacro("CreateIsodoseSurfaces: Failed to get dose image");
+      return;
+    }
+
+    // Report progress
+    ++currentStep;
+    double progress = (double)(currentStep) / (double)stepCount;
+    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+
+    // Extract the isodose surfaces of the levels that are not in the cache
+    std::vector<double> isoLevels;
+    vtkSlicerIsodoseModuleLogic::GetIsoLevels(parameterNode, isoLevels);
+    vtkSlicerIsodoseModuleLogic::ComputeMissingIsodoseSurfaces(doseImageData, doseIjkToRasMatrix, isoLevels, isodoseSurfaces);
+    this->AddIsodoseSurfacesToCache(parameterNode, isodoseSurfaces);
+  }
+  else
+  {
+    ++currentStep;
   }
 
-  this->GetMRMLScene()->StartState(vtkMRMLScene::BatchProcessState); 
+  // Report progress
+  ++currentStep;
+  double progress = (double)(currentStep) / (double)stepCount;
+  this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
 
-  // Get subject hierarchy item for the dose volume
-  vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
-  if (doseShItemID == vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  // Create isodose models
+  this->SetIsodoseSurfaces(parameterNode, isodoseSurfaces);
+
+  // Report progress
+  ++currentStep;
+  progress = (double)(currentStep) / (double)stepCount;
+  this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfacesPreview(vtkMRMLIsodoseNode* parameterNode)
+{
+  if (!this->GetMRMLScene() || !parameterNode)
   {
-    vtkErrorMacro("CreateIsodoseSurfaces: Failed to get subject hierarchy item for dose volume '" << doseVolumeNode->GetName() << "'");
+    vtkErrorMacro("CreateIsodoseSurfacesPreview: Invalid scene or parameter set node!");
+    return;
   }
 
-  // Model hierarchy node for the loaded structure set
-  vtkMRMLModelHierarchyNode* rootModelHierarchyNode = vtkMRMLModelHierarchyNode::SafeDownCast( doseVolumeNode->GetNodeReference(ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE) );
-  if (!rootModelHierarchyNode)
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  if (!doseVolumeNode || !doseVolumeNode->GetImageData() || !parameterNode->GetColorTableNode())
   {
-    rootModelHierarchyNode = vtkMRMLModelHierarchyNode::New();
-    this->GetMRMLScene()->AddNode(rootModelHierarchyNode);
-    rootModelHierarchyNode->Delete();
+    vtkErrorMacro("CreateIsodoseSurfacesPreview: Invalid dose volume or color table!");
+    return;
   }
-  else 
+
+  vtkImageData* previewDoseImageData = this->GetPreviewDoseImage(doseVolumeNode);
+  if (!previewDoseImageData)
   {
-    std::vector< vtkMRMLHierarchyNode *> children = rootModelHierarchyNode->GetChildrenNodes(); 
-    for (unsigned int i=0; i<children.size(); i++)
-    {
-      vtkMRMLHierarchyNode *child = children[i];
-      vtkMRMLModelNode* mnode = vtkMRMLModelNode::SafeDownCast(child->GetAssociatedNode());
-      this->GetMRMLScene()->RemoveNode(mnode);
-      this->GetMRMLScene()->RemoveNode(child);
-    }
-    this->GetMRMLScene()->RemoveNode(rootModelHierarchyNode);
-    rootModelHierarchyNode = vtkMRMLModelHierarchyNode::New();
-    this->GetMRMLScene()->AddNode(rootModelHierarchyNode);
-    rootModelHierarchyNode->Delete();    
+    vtkErrorMacro("CreateIsodoseSurfacesPreview: Failed to get preview dose image");
+    return;
   }
-  std::string modelHierarchyNodeName = std::string(doseVolumeNode->GetName()) + vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTFIX;
-  rootModelHierarchyNode->SetName(modelHierarchyNodeName.c_str());
-  doseVolumeNode->SetNodeReferenceID(ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE, rootModelHierarchyNode->GetID());
- 
-  // Create display node for the model hierarchy node
-  vtkMRMLModelDisplayNode* rootModelHierarchyDisplayNode = vtkMRMLModelDisplayNode::SafeDownCast( doseVolumeNode->GetNodeReference(ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE) );
-  if (rootModelHierarchyDisplayNode)
+  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  vtkSlicerIsodoseModuleLogic::GetDoseIjkToWorldMatrix(doseVolumeNode, doseIjkToRasMatrix);
+
+  // Only the levels that are not in the cache are computed from the downsampled dose
+  std::vector<double> isoLevels;
+  vtkSlicerIsodoseModuleLogic::GetIsoLevels(parameterNode, isoLevels);
+  std::vector<vtkSmartPointer<vtkPolyData> > isodoseSurfaces;
+  this->GetCachedIsodoseSurfaces(parameterNode, isodoseSurfaces);
+  vtkSlicerIsodoseModuleLogic::ComputeMissingIsodoseSurfaces(previewDoseImageData, doseIjkToRasMatrix, isoLevels, isodoseSurfaces);
+
+  this->SetIsodoseSurfaces(parameterNode, isodoseSurfaces);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::GetIsoLevels(vtkMRMLIsodoseNode* parameterNode, std::vector<double>& isoLevels)
+{
+  isoLevels.clear();
+  vtkMRMLColorTableNode* colorTableNode = (parameterNode ? parameterNode->GetColorTableNode() : NULL);
+  if (!colorTableNode)
   {
-    rootModelHierarchyDisplayNode = vtkMRMLModelDisplayNode::New();
-    this->GetMRMLScene()->AddNode(rootModelHierarchyDisplayNode);
-    rootModelHierarchyDisplayNode->Delete();
+    return;
   }
-  else
+  for (int i = 0; i < colorTableNode->GetNumberOfColors(); i++)
   {
-    this->GetMRMLScene()->RemoveNode(rootModelHierarchyDisplayNode);
-    rootModelHierarchyDisplayNode = vtkMRMLModelDisplayNode::New();
-    this->GetMRMLScene()->AddNode(rootModelHierarchyDisplayNode);
-    rootModelHierarchyDisplayNode->Delete();
+    isoLevels.push_back(vtkVariant(colorTableNode->GetColorName(i)).ToDouble());
   }
-  rootModelHierarchyDisplayNode->SetName(modelHierarchyNodeName.c_str());
-  rootModelHierarchyDisplayNode->SetVisibility(1);
-  rootModelHierarchyNode->SetAndObserveDisplayNodeID( rootModelHierarchyDisplayNode->GetID() );
-  doseVolumeNode->SetNodeReferenceID(ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE, rootModelHierarchyDisplayNode->GetID() );
-
-  // Remove previous isodoses
-  shNode->RemoveItemChildren(doseShItemID, true, false);
+}
 
-  // Get color table
-  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+//---------------------------------------------------------------------------
+bool vtkSlicerIsodoseModuleLogic::GetDoseIjkToWorldMatrix(vtkMRMLScalarVolumeNode* doseVolumeNode, vtkMatrix4x4* ijkToWorldMatrix)
+{
+  if (!doseVolumeNode || !ijkToWorldMatrix)
+  {
+    return false;
+  }
 
-  // Progress
-  int stepCount = 1 /* reslice step */ + colorTableNode->GetNumberOfColors();
-  int currentStep = 0;
+  doseVolumeNode->GetIJKToRASMatrix(ijkToWorldMatrix);
+  vtkMRMLTransformNode* doseVolumeNodeTransformNode = doseVolumeNode->GetParentTransformNode();
+  if (!doseVolumeNodeTransformNode)
+  {
+    return true;
+  }
+  if (!doseVolumeNodeTransformNode->IsTransformToWorldLinear())
+  {
+    // Non-linear transforms are applied by reslicing on the original lattice (see GetDoseImageInIjk)
+    return false;
+  }
 
-  // Reslice dose volume
-  vtkSmartPointer<vtkMatrix4x4> inputIJK2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  doseVolumeNode->GetIJKToRASMatrix(inputIJK2RASMatrix);
-  vtkSmartPointer<vtkMatrix4x4> inputRAS2IJKMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  doseVolumeNode->GetRASToIJKMatrix(inputRAS2IJKMatrix); 
+  vtkSmartPointer<vtkMatrix4x4> doseRasToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseVolumeNodeTransformNode->GetMatrixTransformToWorld(doseRasToWorldMatrix);
+  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseIjkToRasMatrix->DeepCopy(ijkToWorldMatrix);
+  vtkMatrix4x4::Multiply4x4(doseRasToWorldMatrix, doseIjkToRasMatrix, ijkToWorldMatrix);
+  return true;
+}
 
-  vtkSmartPointer<vtkTransform> outputIJK2IJKResliceTransform = vtkSmartPointer<vtkTransform>::New(); 
-  outputIJK2IJKResliceTransform->Identity();
-  outputIJK2IJKResliceTransform->PostMultiply();
-  outputIJK2IJKResliceTransform->SetMatrix(inputIJK2RASMatrix);
+//---------------------------------------------------------------------------
+bool vtkSlicerIsodoseModuleLogic::GetDoseImageInIjk(vtkMRMLScalarVolumeNode* doseVolumeNode, vtkImageData* doseImageData, vtkMatrix4x4* ijkToWorldMatrix)
+{
+  if (!doseVolumeNode || !doseVolumeNode->GetImageData() || !doseImageData || !ijkToWorldMatrix)
+  {
+    return false;
+  }
 
-  vtkSmartPointer<vtkMRMLTransformNode> inputVolumeNodeTransformNode = doseVolumeNode->GetParentTransformNode();
-  vtkSmartPointer<vtkMatrix4x4> inputRAS2RASMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
-  if (inputVolumeNodeTransformNode!=NULL)
+  vtkMRMLTransformNode* doseVolumeNodeTransformNode = doseVolumeNode->GetParentTransformNode();
+  if (vtkSlicerIsodoseModuleLogic::GetDoseIjkToWorldMatrix(doseVolumeNode, ijkToWorldMatrix))
   {
-    inputVolumeNodeTransformNode->GetMatrixTransformToWorld(inputRAS2RASMatrix);  
-    outputIJK2IJKResliceTransform->Concatenate(inputRAS2RASMatrix);
+    // Linear (or no) transform: contour the original dose voxels and transform only the output points.
+    // The image is shallow copied, so the voxels are not copied.
+    doseImageData->ShallowCopy(doseVolumeNode->GetImageData());
+    doseImageData->SetOrigin(0.0, 0.0, 0.0);
+    doseImageData->SetSpacing(1.0, 1.0, 1.0);
+    return true;
   }
-  
-  outputIJK2IJKResliceTransform->Concatenate(inputRAS2IJKMatrix);
-  outputIJK2IJKResliceTransform->Inverse();
+
+  // Non-linear transform: reslice the transformed dose on the original lattice
+  vtkSmartPointer<vtkMatrix4x4> doseRasToIjkMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseVolumeNode->GetRASToIJKMatrix(doseRasToIjkMatrix);
+  vtkSmartPointer<vtkGeneralTransform> worldToDoseRasTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  vtkMRMLTransformNode::GetTransformBetweenNodes(NULL, doseVolumeNodeTransformNode, worldToDoseRasTransform);
+
+  vtkSmartPointer<vtkGeneralTransform> outputIjkToInputIjkTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  outputIjkToInputIjkTransform->PostMultiply();
+  outputIjkToInputIjkTransform->Concatenate(ijkToWorldMatrix);
+  outputIjkToInputIjkTransform->Concatenate(worldToDoseRasTransform);
+  outputIjkToInputIjkTransform->Concatenate(doseRasToIjkMatrix);
 
   int dimensions[3] = {0, 0, 0};
   doseVolumeNode->GetImageData()->GetDimensions(dimensions);
@@ -519,110 +707,502 @@ void vtkSlicerIsodoseModuleLogic::CreateIsodoseSurfaces(vtkMRMLIsodoseNode* para
   reslice->SetOutputOrigin(0, 0, 0);
   reslice->SetOutputSpacing(1, 1, 1);
   reslice->SetOutputExtent(0, dimensions[0]-1, 0, dimensions[1]-1, 0, dimensions[2]-1);
-  reslice->SetResliceTransform(outputIJK2IJKResliceTransform);
+  reslice->SetResliceTransform(outputIjkToInputIjkTransform);
   reslice->Update();
-  vtkSmartPointer<vtkImageData> reslicedDoseVolumeImage = reslice->GetOutput(); 
+  doseImageData->ShallowCopy(reslice->GetOutput());
+  return true;
+}
 
-  // Report progress
-  ++currentStep;
-  double progress = (double)(currentStep) / (double)stepCount;
-  this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+//---------------------------------------------------------------------------
+std::string vtkSlicerIsodoseModuleLogic::GetDoseVolumeKey(vtkMRMLScalarVolumeNode* doseVolumeNode)
+{
+  if (!doseVolumeNode || !doseVolumeNode->GetID() || !doseVolumeNode->GetImageData())
+  {
+    return "";
+  }
+
+  // Same key as used for the resampled doses in dose accumulation
+  return vtkSlicerRtCommon::GetVolumeNodeStateKey(doseVolumeNode, true);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerIsodoseModuleLogic::GetCachedIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces)
+{
+  std::vector<double> isoLevels;
+  vtkSlicerIsodoseModuleLogic::GetIsoLevels(parameterNode, isoLevels);
+  isodoseSurfaces.assign(isoLevels.size(), vtkSmartPointer<vtkPolyData>());
+
+  std::string doseVolumeKey = vtkSlicerIsodoseModuleLogic::GetDoseVolumeKey(parameterNode ? parameterNode->GetDoseVolumeNode() : NULL);
+  if (doseVolumeKey.empty())
+  {
+    return false;
+  }
+  bool allLevelsCached = true;
+  for (size_t levelIndex = 0; levelIndex < isoLevels.size(); ++levelIndex)
+  {
+    isodoseSurfaces[levelIndex] = vtkPolyData::SafeDownCast(
+      this->Internal->IsodoseSurfaces->GetItem(vtkSlicerIsodoseGetSurfaceKey(doseVolumeKey, isoLevels[levelIndex])) );
+    if (!isodoseSurfaces[levelIndex])
+    {
+      allLevelsCached = false;
+    }
+  }
+  return allLevelsCached;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::AddIsodoseSurfacesToCache(vtkMRMLIsodoseNode* parameterNode, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces)
+{
+  std::vector<double> isoLevels;
+  vtkSlicerIsodoseModuleLogic::GetIsoLevels(parameterNode, isoLevels);
+  std::string doseVolumeKey = vtkSlicerIsodoseModuleLogic::GetDoseVolumeKey(parameterNode ? parameterNode->GetDoseVolumeNode() : NULL);
+  if (doseVolumeKey.empty() || isoLevels.size() != isodoseSurfaces.size())
+  {
+    vtkErrorMacro("AddIsodoseSurfacesToCache: Invalid dose volume or isodose surfaces!");
+    return;
+  }
+  this->Internal->IsodoseSurfaces->SetMemoryLimitMB(this->IsodoseSurfaceCacheMemoryLimitMB);
+  for (size_t levelIndex = 0; levelIndex < isoLevels.size(); ++levelIndex)
+  {
+    if (isodoseSurfaces[levelIndex])
+    {
+      this->Internal->IsodoseSurfaces->AddItem(vtkSlicerIsodoseGetSurfaceKey(doseVolumeKey, isoLevels[levelIndex]), isodoseSurfaces[levelIndex]);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+vtkImageData* vtkSlicerIsodoseModuleLogic::GetPreviewDoseImage(vtkMRMLScalarVolumeNode* doseVolumeNode)
+{
+  if (!doseVolumeNode || !doseVolumeNode->GetID() || !doseVolumeNode->GetImageData())
+  {
+    vtkErrorMacro("GetPreviewDoseImage: Invalid dose volume!");
+    return NULL;
+  }
 
-  // Create isodose surfaces
+  // Rebuild the pyramid if the dose or its transform changed since it was built
+  std::string pyramidKey = vtkSlicerIsodoseModuleLogic::GetDoseVolumeKey(doseVolumeNode);
+  vtkInternal::DosePyramid& pyramid = this->Internal->DosePyramids[doseVolumeNode->GetID()];
+  if (pyramid.Key != pyramidKey || pyramid.Levels.empty())
+  {
+    pyramid.Key = pyramidKey;
+    pyramid.Levels.clear();
+    vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+    vtkSmartPointer<vtkMatrix4x4> doseIjkToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    if (!vtkSlicerIsodoseModuleLogic::GetDoseImageInIjk(doseVolumeNode, doseImageData, doseIjkToWorldMatrix))
+    {
+      this->Internal->DosePyramids.erase(doseVolumeNode->GetID());
+      vtkErrorMacro("GetPreviewDoseImage: Failed to get dose image");
+      return NULL;
+    }
+    pyramid.Levels.push_back(doseImageData);
+  }
+
+  // Add coarser levels (each halving the resolution) until a level fits in the preview voxel budget
+  while ( pyramid.Levels.back()->GetNumberOfPoints() > this->PreviewMaximumNumberOfVoxels
+    && pyramid.Levels.size() < 8 )
+  {
+    vtkImageData* fineImageData = pyramid.Levels.back();
+    vtkSmartPointer<vtkImageShrink3D> shrink = vtkSmartPointer<vtkImageShrink3D>::New();
+    shrink->SetInputData(fineImageData);
+    shrink->SetShrinkFactors(2, 2, 2);
+    shrink->AveragingOn();
+    shrink->Update();
+
+    // Output voxel i is the average of fine voxels 2i and 2i+1, so its center is half a fine voxel further
+    vtkSmartPointer<vtkImageData> coarseImageData = vtkSmartPointer<vtkImageData>::New();
+    coarseImageData->ShallowCopy(shrink->GetOutput());
+    double fineOrigin[3] = {0.0, 0.0, 0.0};
+    fineImageData->GetOrigin(fineOrigin);
+    double fineSpacing[3] = {1.0, 1.0, 1.0};
+    fineImageData->GetSpacing(fineSpacing);
+    coarseImageData->SetOrigin(fineOrigin[0] + 0.5*fineSpacing[0], fineOrigin[1] + 0.5*fineSpacing[1], fineOrigin[2] + 0.5*fineSpacing[2]);
+    if (coarseImageData->GetNumberOfPoints() == 0)
+    {
+      break;
+    }
+    pyramid.Levels.push_back(coarseImageData);
+  }
+
+  // Use the finest level within the budget
+  for (std::vector<vtkSmartPointer<vtkImageData> >::iterator levelIt=pyramid.Levels.begin(); levelIt!=pyramid.Levels.end(); ++levelIt)
+  {
+    if ((*levelIt)->GetNumberOfPoints() <= this->PreviewMaximumNumberOfVoxels)
+    {
+      return *levelIt;
+    }
+  }
+  return pyramid.Levels.back();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::ComputeIsodoseSurfaces(vtkImageData* doseImageData, vtkMatrix4x4* ijkToRasMatrix,
+  const std::vector<double>& isoLevels, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces,
+  vtkAtomic<int>* abortRequested/*=NULL*/)
+{
+  if (abortRequested && abortRequested->load())
+  {
+    isodoseSurfaces.clear();
+    for (size_t levelIndex=0; levelIndex<isoLevels.size(); ++levelIndex)
+    {
+      isodoseSurfaces.push_back(vtkSmartPointer<vtkPolyData>::New());
+    }
+    return;
+  }
+
+  // Extract the contours of all isodose levels in one pass over the dose, and post-process them in parallel
+  vtkSlicerIsodoseModuleLogic::ExtractIsodoseContours(doseImageData, isoLevels, isodoseSurfaces);
+  vtkSlicerIsodoseSurfaceFunctor isodoseSurfaceFunctor(isodoseSurfaces, ijkToRasMatrix, abortRequested);
+  vtkSMPTools::For(0, static_cast<vtkIdType>(isodoseSurfaces.size()), 1, isodoseSurfaceFunctor);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::ComputeMissingIsodoseSurfaces(vtkImageData* doseImageData, vtkMatrix4x4* ijkToRasMatrix,
+  const std::vector<double>& isoLevels, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces,
+  vtkAtomic<int>* abortRequested/*=NULL*/)
+{
+  isodoseSurfaces.resize(isoLevels.size());
+  std::vector<double> missingIsoLevels;
+  for (size_t levelIndex = 0; levelIndex < isoLevels.size(); ++levelIndex)
+  {
+    if (!isodoseSurfaces[levelIndex])
+    {
+      missingIsoLevels.push_back(isoLevels[levelIndex]);
+    }
+  }
+  if (missingIsoLevels.empty())
+  {
+    return;
+  }
+
+  std::vector<vtkSmartPointer<vtkPolyData> > missingIsodoseSurfaces;
+  vtkSlicerIsodoseModuleLogic::ComputeIsodoseSurfaces(doseImageData, ijkToRasMatrix, missingIsoLevels, missingIsodoseSurfaces, abortRequested);
+  size_t missingLevelIndex = 0;
+  for (size_t levelIndex = 0; levelIndex < isoLevels.size(); ++levelIndex)
+  {
+    if (!isodoseSurfaces[levelIndex])
+    {
+      isodoseSurfaces[levelIndex] = missingIsodoseSurfaces[missingLevelIndex++];
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::SetIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces)
+{
+  if (!this->GetMRMLScene() || !parameterNode)
+  {
+    vtkErrorMacro("SetIsodoseSurfaces: Invalid scene or parameter set node!");
+    return;
+  }
+  vtkMRMLSubjectHierarchyNode* shNode = vtkMRMLSubjectHierarchyNode::GetSubjectHierarchyNode(this->GetMRMLScene());
+  if (!shNode)
+  {
+    vtkErrorMacro("SetIsodoseSurfaces: Failed to access subject hierarchy node");
+    return;
+  }
+
+  vtkMRMLScalarVolumeNode* doseVolumeNode = parameterNode->GetDoseVolumeNode();
+  vtkMRMLColorTableNode* colorTableNode = parameterNode->GetColorTableNode();
+  if (!doseVolumeNode || !doseVolumeNode->GetImageData() || !colorTableNode
+    || static_cast<int>(isodoseSurfaces.size()) != colorTableNode->GetNumberOfColors())
+  {
+    vtkErrorMacro("SetIsodoseSurfaces: Invalid dose volume or isodose surfaces!");
+    return;
+  }
+
+  // Get subject hierarchy item for the dose volume
+  vtkIdType doseShItemID = shNode->GetItemByDataNode(doseVolumeNode);
+  if (doseShItemID == vtkMRMLSubjectHierarchyNode::INVALID_ITEM_ID)
+  {
+    vtkErrorMacro("SetIsodoseSurfaces: Failed to get subject hierarchy item for dose volume '" << doseVolumeNode->GetName() << "'");
+  }
+
+  // Get dose unit name
+  std::string doseUnitName = shNode->GetAttributeFromItemAncestor(
+    doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
+
+  // Existing isodose models by name. The models of levels that are still present are kept and only their
+  // surface and color are updated, so that changing some of the levels does not re-create all the models.
+  vtkMRMLModelHierarchyNode* rootModelHierarchyNode = vtkMRMLModelHierarchyNode::SafeDownCast( doseVolumeNode->GetNodeReference(ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE) );
+  std::map<std::string, vtkMRMLHierarchyNode*> isodoseModelHierarchyNodes;
+  if (rootModelHierarchyNode)
+  {
+    std::vector< vtkMRMLHierarchyNode *> children = rootModelHierarchyNode->GetChildrenNodes();
+    for (unsigned int i=0; i<children.size(); i++)
+    {
+      vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast(children[i]->GetAssociatedNode());
+      if (modelNode && modelNode->GetName() && !isodoseModelHierarchyNodes.count(modelNode->GetName()))
+      {
+        isodoseModelHierarchyNodes[modelNode->GetName()] = children[i];
+      }
+      else
+      {
+        // Duplicate or invalid entries are removed
+        isodoseModelHierarchyNodes[std::string("#") + children[i]->GetID()] = children[i];
+      }
+    }
+  }
+
+  // Update the surfaces of the existing models, and collect the levels that need new models
+  std::vector<int> newModelLevelIndices;
   for (int i = 0; i < colorTableNode->GetNumberOfColors(); i++)
   {
+    if (isodoseSurfaces[i]->GetNumberOfPoints() < 1)
+    {
+      continue;
+    }
+    std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + colorTableNode->GetColorName(i) + doseUnitName;
+    std::map<std::string, vtkMRMLHierarchyNode*>::iterator modelIt = isodoseModelHierarchyNodes.find(isodoseModelNodeName);
+    if (modelIt == isodoseModelHierarchyNodes.end())
+    {
+      newModelLevelIndices.push_back(i);
+      continue;
+    }
+    vtkMRMLModelNode* isodoseModelNode = vtkMRMLModelNode::SafeDownCast(modelIt->second->GetAssociatedNode());
+    isodoseModelHierarchyNodes.erase(modelIt); // Each model is used only once, the remaining ones are removed
     double val[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
-    const char* strIsoLevel = colorTableNode->GetColorName(i);
-    double isoLevel = vtkVariant(strIsoLevel).ToDouble();
     colorTableNode->GetColor(i, val);
-
-    vtkSmartPointer<vtkImageMarchingCubes> marchingCubes = vtkSmartPointer<vtkImageMarchingCubes>::New();
-    marchingCubes->SetInputData(reslicedDoseVolumeImage);
-    marchingCubes->SetNumberOfContours(1); 
-    marchingCubes->SetValue(0, isoLevel);
-    marchingCubes->ComputeScalarsOff();
-    marchingCubes->ComputeGradientsOff();
-    marchingCubes->ComputeNormalsOff();
-    marchingCubes->Update();
-
-    vtkSmartPointer<vtkPolyData> isoPolyData= marchingCubes->GetOutput();
-    if (isoPolyData->GetNumberOfPoints() >= 1)
+    vtkMRMLModelDisplayNode* displayNode = vtkMRMLModelDisplayNode::SafeDownCast(isodoseModelNode->GetDisplayNode());
+    if (displayNode)
     {
-      vtkSmartPointer<vtkTriangleFilter> triangleFilter = vtkSmartPointer<vtkTriangleFilter>::New();
-      triangleFilter->SetInputData(marchingCubes->GetOutput());
-      triangleFilter->Update();
-
-      vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
-      decimate->SetInputData(triangleFilter->GetOutput());
-      decimate->SetTargetReduction(0.6);
-      decimate->SetFeatureAngle(60);
-      decimate->SplittingOff();
-      decimate->PreserveTopologyOn();
-      decimate->SetMaximumError(1);
-      decimate->Update();
-
-      vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
-      smootherSinc->SetPassBand(0.1);
-      smootherSinc->SetInputData(decimate->GetOutput() );
-      smootherSinc->SetNumberOfIterations(2);
-      smootherSinc->FeatureEdgeSmoothingOff();
-      smootherSinc->BoundarySmoothingOff();
-      smootherSinc->Update();
-
-      vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
-      normals->SetInputData(smootherSinc->GetOutput());
-      normals->ComputePointNormalsOn();
-      normals->SetFeatureAngle(60);
-      normals->Update();
-
-      vtkSmartPointer<vtkTransform> inputIJKToRASTransform = vtkSmartPointer<vtkTransform>::New();
-      inputIJKToRASTransform->Identity();
-      inputIJKToRASTransform->SetMatrix(inputIJK2RASMatrix);
-
-      vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
-      transformPolyData->SetInputData(normals->GetOutput());
-      transformPolyData->SetTransform(inputIJKToRASTransform);
-      transformPolyData->Update();
-  
-      vtkSmartPointer<vtkMRMLModelDisplayNode> displayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
-      displayNode = vtkMRMLModelDisplayNode::SafeDownCast(this->GetMRMLScene()->AddNode(displayNode));
-      displayNode->SliceIntersectionVisibilityOn();  
-      displayNode->VisibilityOn(); 
       displayNode->SetColor(val[0], val[1], val[2]);
       displayNode->SetOpacity(val[3]);
-    
-      // Disable backface culling to make the back side of the model visible as well
-      displayNode->SetBackfaceCulling(0);
-
-      // Get dose unit name
-      std::string doseUnitName = shNode->GetAttributeFromItemAncestor(
-        doseShItemID, vtkSlicerRtCommon::DICOMRTIMPORT_DOSE_UNIT_NAME_ATTRIBUTE_NAME, vtkMRMLSubjectHierarchyConstants::GetDICOMLevelStudy());
-
-      vtkSmartPointer<vtkMRMLModelNode> isodoseModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
-      isodoseModelNode = vtkMRMLModelNode::SafeDownCast(this->GetMRMLScene()->AddNode(isodoseModelNode));
-      std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + strIsoLevel + doseUnitName;
-      isodoseModelNode->SetName(isodoseModelNodeName.c_str());
-      isodoseModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
-      isodoseModelNode->SetAndObservePolyData(transformPolyData->GetOutput());
-      isodoseModelNode->SetSelectable(1);
-      isodoseModelNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_ISODOSE_MODEL_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
-      shNode->RequestOwnerPluginSearch(isodoseModelNode); // The attribute above distinguishes isodoses from regular models
-
-      // Put the new node in the model hierarchy
-      vtkSmartPointer<vtkMRMLModelHierarchyNode> isodoseModelHierarchyNode = vtkSmartPointer<vtkMRMLModelHierarchyNode>::New();
-      this->GetMRMLScene()->AddNode(isodoseModelHierarchyNode);
-      std::string modelHierarchyNodeName = std::string(isodoseModelNodeName) + vtkSlicerRtCommon::DICOMRTIMPORT_MODEL_HIERARCHY_NODE_NAME_POSTFIX;
-      isodoseModelHierarchyNode->SetName(modelHierarchyNodeName.c_str());
-      isodoseModelHierarchyNode->SetModelNodeID(isodoseModelNode->GetID());
-      isodoseModelHierarchyNode->SetParentNodeID(rootModelHierarchyNode->GetID());
-      isodoseModelHierarchyNode->HideFromEditorsOn();
     }
+    if (isodoseModelNode->GetPolyData() != isodoseSurfaces[i])
+    {
+      isodoseModelNode->SetAndObservePolyData(isodoseSurfaces[i]);
+    }
+  }
+  if (rootModelHierarchyNode && newModelLevelIndices.empty() && isodoseModelHierarchyNodes.empty())
+  {
+    return;
+  }
 
-    // Report progress
-    ++currentStep;
-    progress = (double)(currentStep) / (double)stepCount;
-    this->InvokeEvent(vtkSlicerRtCommon::ProgressUpdated, (void*)&progress);
+  this->GetMRMLScene()->StartState(vtkMRMLScene::BatchProcessState); 
+
+  // Remove the models of the levels that are not present any more
+  for (std::map<std::string, vtkMRMLHierarchyNode*>::iterator modelIt = isodoseModelHierarchyNodes.begin(); modelIt != isodoseModelHierarchyNodes.end(); ++modelIt)
+  {
+    vtkMRMLHierarchyNode* child = modelIt->second;
+    vtkMRMLModelNode* mnode = vtkMRMLModelNode::SafeDownCast(child->GetAssociatedNode());
+    if (mnode)
+    {
+      this->GetMRMLScene()->RemoveNode(mnode->GetDisplayNode());
+      this->GetMRMLScene()->RemoveNode(mnode);
+    }
+    this->GetMRMLScene()->RemoveNode(child);
+  }
+
+  // Model hierarchy node for the loaded structure set
+  if (!rootModelHierarchyNode)
+  {
+    rootModelHierarchyNode = vtkMRMLModelHierarchyNode::New();
+    this->GetMRMLScene()->AddNode(rootModelHierarchyNode);
+    rootModelHierarchyNode->Delete();
+    std::string modelHierarchyNodeName = std::string(doseVolumeNode->GetName()) + vtkSlicerIsodoseModuleLogic::ISODOSE_ROOT_HIERARCHY_NAME_POSTFIX;
+    rootModelHierarchyNode->SetName(modelHierarchyNodeName.c_str());
+    doseVolumeNode->SetNodeReferenceID(ISODOSE_ROOT_MODEL_HIERARCHY_REFERENCE_ROLE, rootModelHierarchyNode->GetID());
+
+    // Create display node for the model hierarchy node
+    vtkMRMLModelDisplayNode* rootModelHierarchyDisplayNode = vtkMRMLModelDisplayNode::SafeDownCast( doseVolumeNode->GetNodeReference(ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE) );
+    if (rootModelHierarchyDisplayNode)
+    {
+      this->GetMRMLScene()->RemoveNode(rootModelHierarchyDisplayNode);
+    }
+    rootModelHierarchyDisplayNode = vtkMRMLModelDisplayNode::New();
+    this->GetMRMLScene()->AddNode(rootModelHierarchyDisplayNode);
+    rootModelHierarchyDisplayNode->Delete();
+    rootModelHierarchyDisplayNode->SetName(modelHierarchyNodeName.c_str());
+    rootModelHierarchyDisplayNode->SetVisibility(1);
+    rootModelHierarchyNode->SetAndObserveDisplayNodeID( rootModelHierarchyDisplayNode->GetID() );
+    doseVolumeNode->SetNodeReferenceID(ISODOSE_ROOT_MODEL_HIERARCHY_DISPLAY_REFERENCE_ROLE, rootModelHierarchyDisplayNode->GetID() );
+  }
+
+  // Create isodose models for the new levels
+  for (std::vector<int>::iterator levelIt = newModelLevelIndices.begin(); levelIt != newModelLevelIndices.end(); ++levelIt)
+  {
+    int i = (*levelIt);
+    double val[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    const char* strIsoLevel = colorTableNode->GetColorName(i);
+    colorTableNode->GetColor(i, val);
+
+    vtkPolyData* isodosePolyData = isodoseSurfaces[i];
+    vtkSmartPointer<vtkMRMLModelDisplayNode> displayNode = vtkSmartPointer<vtkMRMLModelDisplayNode>::New();
+    displayNode = vtkMRMLModelDisplayNode::SafeDownCast(this->GetMRMLScene()->AddNode(displayNode));
+    displayNode->SliceIntersectionVisibilityOn();  
+    displayNode->VisibilityOn(); 
+    displayNode->SetColor(val[0], val[1], val[2]);
+    displayNode->SetOpacity(val[3]);
+  
+    // Disable backface culling to make the back side of the model visible as well
+    displayNode->SetBackfaceCulling(0);
+
+    vtkSmartPointer<vtkMRMLModelNode> isodoseModelNode = vtkSmartPointer<vtkMRMLModelNode>::New();
+    isodoseModelNode = vtkMRMLModelNode::SafeDownCast(this->GetMRMLScene()->AddNode(isodoseModelNode));
+    std::string isodoseModelNodeName = vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + strIsoLevel + doseUnitName;
+    isodoseModelNode->SetName(isodoseModelNodeName.c_str());
+    isodoseModelNode->SetAndObserveDisplayNodeID(displayNode->GetID());
+    isodoseModelNode->SetAndObservePolyData(isodosePolyData);
+    isodoseModelNode->SetSelectable(1);
+    isodoseModelNode->SetAttribute(vtkSlicerRtCommon::DICOMRTIMPORT_ISODOSE_MODEL_IDENTIFIER_ATTRIBUTE_NAME.c_str(), "1");
+    shNode->RequestOwnerPluginSearch(isodoseModelNode); // The attribute above distinguishes isodoses from regular models
+
+    // Put the new node in the model hierarchy
+    vtkSmartPointer<vtkMRMLModelHierarchyNode> isodoseModelHierarchyNode = vtkSmartPointer<vtkMRMLModelHierarchyNode>::New();
+    this->GetMRMLScene()->AddNode(isodoseModelHierarchyNode);
+    std::string modelHierarchyNodeName = std::string(isodoseModelNodeName) + vtkSlicerRtCommon::DICOMRTIMPORT_MODEL_HIERARCHY_NODE_NAME_POSTFIX;
+    isodoseModelHierarchyNode->SetName(modelHierarchyNodeName.c_str());
+    isodoseModelHierarchyNode->SetModelNodeID(isodoseModelNode->GetID());
+    isodoseModelHierarchyNode->SetParentNodeID(rootModelHierarchyNode->GetID());
+    isodoseModelHierarchyNode->HideFromEditorsOn();
   }
 
   this->GetMRMLScene()->EndState(vtkMRMLScene::BatchProcessState); 
 }
+
+//---------------------------------------------------------------------------
+void vtkSlicerIsodoseModuleLogic::ExtractIsodoseContours(vtkImageData* doseImageData, const std::vector<double>& isoLevels,
+  std::vector<vtkSmartPointer<vtkPolyData> >& isodosePolyDatas)
+{
+  isodosePolyDatas.clear();
+  for (size_t levelIndex=0; levelIndex<isoLevels.size(); ++levelIndex)
+  {
+    isodosePolyDatas.push_back(vtkSmartPointer<vtkPolyData>::New());
+  }
+  if (!doseImageData || isoLevels.empty())
+  {
+    return;
+  }
+
+  // Contour all distinct levels at once. The output point scalars are the contour values, which identify the levels.
+  std::vector<double> distinctIsoLevels(isoLevels);
+  std::sort(distinctIsoLevels.begin(), distinctIsoLevels.end());
+  distinctIsoLevels.erase(std::unique(distinctIsoLevels.begin(), distinctIsoLevels.end()), distinctIsoLevels.end());
+
+  vtkSmartPointer<vtkFlyingEdges3D> flyingEdges = vtkSmartPointer<vtkFlyingEdges3D>::New();
+  flyingEdges->SetInputData(doseImageData);
+  flyingEdges->SetNumberOfContours(static_cast<int>(distinctIsoLevels.size()));
+  for (size_t distinctLevelIndex=0; distinctLevelIndex<distinctIsoLevels.size(); ++distinctLevelIndex)
+  {
+    flyingEdges->SetValue(static_cast<int>(distinctLevelIndex), distinctIsoLevels[distinctLevelIndex]);
+  }
+  flyingEdges->ComputeScalarsOn();
+  flyingEdges->ComputeGradientsOff();
+  flyingEdges->ComputeNormalsOff();
+  flyingEdges->Update();
+
+  vtkPolyData* contours = flyingEdges->GetOutput();
+  vtkDataArray* contourValues = contours->GetPointData()->GetScalars();
+  if (!contours->GetPolys() || !contourValues || contours->GetNumberOfPoints() == 0)
+  {
+    return;
+  }
+
+  // Split the contours by level. The contour values are stored in the scalar type of the dose,
+  // so the level of a point is the nearest level (e.g. fractional levels on integer doses)
+  vtkIdType numberOfPoints = contours->GetNumberOfPoints();
+  std::vector<int> pointLevelIndices(numberOfPoints, 0);
+  for (vtkIdType pointIndex=0; pointIndex<numberOfPoints; ++pointIndex)
+  {
+    double value = contourValues->GetTuple1(pointIndex);
+    std::vector<double>::iterator upperIt = std::lower_bound(distinctIsoLevels.begin(), distinctIsoLevels.end(), value);
+    int levelIndex = static_cast<int>(upperIt - distinctIsoLevels.begin());
+    if ( upperIt == distinctIsoLevels.end()
+      || (levelIndex > 0 && value - distinctIsoLevels[levelIndex-1] < distinctIsoLevels[levelIndex] - value) )
+    {
+      --levelIndex;
+    }
+    pointLevelIndices[pointIndex] = levelIndex;
+  }
+
+  std::vector<vtkSmartPointer<vtkPoints> > distinctLevelPoints;
+  std::vector<vtkSmartPointer<vtkCellArray> > distinctLevelPolys;
+  for (size_t distinctLevelIndex=0; distinctLevelIndex<distinctIsoLevels.size(); ++distinctLevelIndex)
+  {
+    distinctLevelPoints.push_back(vtkSmartPointer<vtkPoints>::New());
+    distinctLevelPolys.push_back(vtkSmartPointer<vtkCellArray>::New());
+  }
+  std::vector<vtkIdType> levelPointIds(numberOfPoints, -1);
+  vtkCellArray* polys = contours->GetPolys();
+  vtkIdType numberOfCellPoints = 0;
+  vtkIdType* cellPointIds = NULL;
+  for (polys->InitTraversal(); polys->GetNextCell(numberOfCellPoints, cellPointIds); )
+  {
+    if (numberOfCellPoints < 1)
+    {
+      continue;
+    }
+    int levelIndex = pointLevelIndices[cellPointIds[0]];
+    vtkCellArray* levelPolys = distinctLevelPolys[levelIndex];
+    levelPolys->InsertNextCell(numberOfCellPoints);
+    for (vtkIdType cellPointIndex=0; cellPointIndex<numberOfCellPoints; ++cellPointIndex)
+    {
+      vtkIdType pointId = cellPointIds[cellPointIndex];
+      if (levelPointIds[pointId] < 0)
+      {
+        levelPointIds[pointId] = distinctLevelPoints[levelIndex]->InsertNextPoint(contours->GetPoint(pointId));
+      }
+      levelPolys->InsertCellPoint(levelPointIds[pointId]);
+    }
+  }
+
+  // Assign the contours to the requested levels (duplicate levels get their own copy)
+  std::vector<bool> distinctLevelAssigned(distinctIsoLevels.size(), false);
+  for (size_t levelIndex=0; levelIndex<isoLevels.size(); ++levelIndex)
+  {
+    int distinctLevelIndex = static_cast<int>( std::lower_bound(distinctIsoLevels.begin(), distinctIsoLevels.end(), isoLevels[levelIndex])
+      - distinctIsoLevels.begin() );
+    vtkSmartPointer<vtkPolyData> levelPolyData = vtkSmartPointer<vtkPolyData>::New();
+    levelPolyData->SetPoints(distinctLevelPoints[distinctLevelIndex]);
+    levelPolyData->SetPolys(distinctLevelPolys[distinctLevelIndex]);
+    if (distinctLevelAssigned[distinctLevelIndex])
+    {
+      isodosePolyDatas[levelIndex]->DeepCopy(levelPolyData);
+    }
+    else
+    {
+      isodosePolyDatas[levelIndex] = levelPolyData;
+      distinctLevelAssigned[distinctLevelIndex] = true;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+vtkSmartPointer<vtkPolyData> vtkSlicerIsodoseModuleLogic::CreateIsodoseSurface(vtkPolyData* isodoseContourPolyData, vtkMatrix4x4* ijkToRasMatrix)
+{
+  vtkSmartPointer<vtkDecimatePro> decimate = vtkSmartPointer<vtkDecimatePro>::New();
+  decimate->SetInputData(isodoseContourPolyData);
+  decimate->SetTargetReduction(ISODOSE_DECIMATION_TARGET_REDUCTION);
+  decimate->SetFeatureAngle(ISODOSE_DECIMATION_FEATURE_ANGLE);
+  decimate->SplittingOff();
+  decimate->PreserveTopologyOn();
+  decimate->SetMaximumError(ISODOSE_DECIMATION_MAXIMUM_ERROR);
+  decimate->Update();
+
+  vtkSmartPointer<vtkWindowedSincPolyDataFilter> smootherSinc = vtkSmartPointer<vtkWindowedSincPolyDataFilter>::New();
+  smootherSinc->SetPassBand(ISODOSE_SMOOTHING_PASS_BAND);
+  smootherSinc->SetInputData(decimate->GetOutput() );
+  smootherSinc->SetNumberOfIterations(ISODOSE_SMOOTHING_NUMBER_OF_ITERATIONS);
+  smootherSinc->FeatureEdgeSmoothingOff();
+  smootherSinc->BoundarySmoothingOff();
+  smootherSinc->Update();
+
+  vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+  normals->SetInputData(smootherSinc->GetOutput());
+  normals->ComputePointNormalsOn();
+  normals->SetFeatureAngle(ISODOSE_NORMALS_FEATURE_ANGLE);
+  normals->Update();
+
+  vtkSmartPointer<vtkTransform> ijkToRasTransform = vtkSmartPointer<vtkTransform>::New();
+  ijkToRasTransform->Identity();
+  ijkToRasTransform->SetMatrix(ijkToRasMatrix);
+
+  vtkSmartPointer<vtkTransformPolyDataFilter> transformPolyData = vtkSmartPointer<vtkTransformPolyDataFilter>::New();
+  transformPolyData->SetInputData(normals->GetOutput());
+  transformPolyData->SetTransform(ijkToRasTransform);
+  transformPolyData->Update();
+
+  vtkSmartPointer<vtkPolyData> isodoseSurfacePolyData = transformPolyData->GetOutput();
+  return isodoseSurfacePolyData;
+}
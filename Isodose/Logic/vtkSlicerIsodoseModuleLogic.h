@@ -33,10 +33,22 @@
 
 #include "vtkSlicerIsodoseModuleLogicExport.h"
 
+// VTK includes
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+template <typename T> class vtkAtomic;
+class vtkImageData;
+class vtkMatrix4x4;
+class vtkPolyData;
+
 // MRML includes
 class vtkMRMLIsodoseNode;
 class vtkMRMLModelHierarchyNode;
 class vtkMRMLColorTableNode;
+class vtkMRMLScalarVolumeNode;
 
 /// \ingroup SlicerRt_QtModules_Isodose
 class VTK_SLICER_ISODOSE_LOGIC_EXPORT vtkSlicerIsodoseModuleLogic : public vtkSlicerModuleLogic
@@ -57,8 +69,36 @@ public:
   void SetNumberOfIsodoseLevels(vtkMRMLIsodoseNode* parameterNode, int newNumberOfColors);
 
   /// Accumulates dose volumes with the given IDs and corresponding weights
+  ///
+  /// The surfaces are cached per level (\sa IsodoseSurfaceCacheMemoryLimitMB), keyed by the dose image and
+  /// its transform state, the dose value of the level, and the post-processing parameters. Only the levels
+  /// that are not in the cache are computed, so e.g. adding a level or changing colors is fast.
   void CreateIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode);
 
+  /// Create isodose surfaces quickly from a downsampled dose (\sa GetPreviewDoseImage) for immediate feedback.
+  /// The levels that are in the cache use the cached full resolution surfaces instead.
+  /// The full resolution surfaces can be computed afterwards (e.g. in a background thread using
+  /// \sa GetDoseImageInIjk and \sa ComputeIsodoseSurfaces) and swapped in using \sa SetIsodoseSurfaces
+  void CreateIsodoseSurfacesPreview(vtkMRMLIsodoseNode* parameterNode);
+
+  /// Set the given isodose surfaces (one for each level of the color table, in RAS) to the isodose models.
+  /// Models of levels that already exist are kept and only their poly data and color are updated, models
+  /// of new levels are created, and models of levels that are not present any more are removed.
+  void SetIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces);
+
+  /// Get downsampled dose image in IJK coordinate system of the dose volume, with at most
+  /// \sa PreviewMaximumNumberOfVoxels voxels. The resolution levels are cached until the dose or its transform changes.
+  /// \return Dose image of the preview, owned by the logic. NULL on failure
+  vtkImageData* GetPreviewDoseImage(vtkMRMLScalarVolumeNode* doseVolumeNode);
+
+  /// Get the cached isodose surfaces of the levels of the parameter node
+  /// \param isodoseSurfaces Output surfaces, one for each level (NULL if the level is not in the cache)
+  /// \return True if all the levels were found in the cache
+  bool GetCachedIsodoseSurfaces(vtkMRMLIsodoseNode* parameterNode, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces);
+
+  /// Add isodose surfaces (one for each level) of the current dose of the parameter node to the cache
+  void AddIsodoseSurfacesToCache(vtkMRMLIsodoseNode* parameterNode, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces);
+
   /// Get dose volume node
   vtkMRMLModelHierarchyNode* GetRootModelHierarchyNode(vtkMRMLIsodoseNode* parameterNode);
 
@@ -70,6 +110,67 @@ public:
   /// Gets and returns if already exists
   static vtkMRMLColorTableNode* CreateDefaultDoseColorTable(vtkMRMLScene *scene);
 
+  /// Extract the raw isodose contours of all levels in one (multi-threaded) sweep over the dose image,
+  /// and split them into one poly data per level
+  /// \param doseImageData Dose image the contours are extracted from (in the coordinate system of the image)
+  /// \param isoLevels Dose values of the isodose levels
+  /// \param isodosePolyDatas Output contours, one for each level (empty poly data if the level does not occur)
+  static void ExtractIsodoseContours(vtkImageData* doseImageData, const std::vector<double>& isoLevels,
+    std::vector<vtkSmartPointer<vtkPolyData> >& isodosePolyDatas);
+
+  /// Create the final isodose surface from the raw contour of a level: decimate, smooth, compute normals,
+  /// and transform it to RAS. Only uses its own filters, so it can be called for multiple levels in parallel.
+  static vtkSmartPointer<vtkPolyData> CreateIsodoseSurface(vtkPolyData* isodoseContourPolyData, vtkMatrix4x4* ijkToRasMatrix);
+
+  /// Compute the isodose surfaces of all levels. Does not access the scene, so it can run in a background thread
+  /// \param doseImageData Dose image in IJK coordinate system (\sa GetDoseImageInIjk, \sa GetPreviewDoseImage)
+  /// \param ijkToRasMatrix Transform from the IJK coordinate system of the dose to RAS
+  /// \param isoLevels Dose values of the isodose levels
+  /// \param isodoseSurfaces Output surfaces in RAS, one for each level (empty poly data if the level does not occur)
+  /// \param abortRequested Optional flag that can be set from another thread to stop the computation. It is checked
+  ///   before the contours are extracted and before each level is post-processed, the levels not processed are empty.
+  static void ComputeIsodoseSurfaces(vtkImageData* doseImageData, vtkMatrix4x4* ijkToRasMatrix,
+    const std::vector<double>& isoLevels, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces,
+    vtkAtomic<int>* abortRequested=NULL);
+
+  /// Compute the isodose surfaces of the levels that have no surface yet (e.g. the ones not found in the cache,
+  /// \sa GetCachedIsodoseSurfaces), and keep the surfaces of the other levels. Does not access the scene either.
+  /// \param isodoseSurfaces Input and output surfaces in RAS, one for each level. NULL entries are computed
+  /// \sa ComputeIsodoseSurfaces for the other arguments
+  static void ComputeMissingIsodoseSurfaces(vtkImageData* doseImageData, vtkMatrix4x4* ijkToRasMatrix,
+    const std::vector<double>& isoLevels, std::vector<vtkSmartPointer<vtkPolyData> >& isodoseSurfaces,
+    vtkAtomic<int>* abortRequested=NULL);
+
+  /// Get the dose values of the isodose levels from the color table of the parameter node
+  static void GetIsoLevels(vtkMRMLIsodoseNode* parameterNode, std::vector<double>& isoLevels);
+
+  /// Get dose image to contour in IJK coordinate system. If the dose is transformed linearly (or not at all) then
+  /// the original voxels are used (shallow copy) and the transform is included in the matrix, otherwise the
+  /// transformed dose is resliced on the original lattice.
+  /// \param ijkToWorldMatrix Output transform from the IJK coordinate system of the output image to world
+  /// \return Success flag
+  static bool GetDoseImageInIjk(vtkMRMLScalarVolumeNode* doseVolumeNode, vtkImageData* doseImageData, vtkMatrix4x4* ijkToWorldMatrix);
+
+  /// Get transform from the IJK coordinate system of the dose volume to world including its parent transforms.
+  /// \return False if the parent transform is non-linear (then the matrix does not include the parent transform)
+  static bool GetDoseIjkToWorldMatrix(vtkMRMLScalarVolumeNode* doseVolumeNode, vtkMatrix4x4* ijkToWorldMatrix);
+
+  /// Get string identifying the dose image, its geometry, and its transforms. Changes if any of them changes.
+  /// Starts with the dose volume node ID followed by a semicolon (\sa vtkSlicerRtCommon::GetVolumeNodeStateKey)
+  /// \return Empty string if the dose volume is invalid
+  static std::string GetDoseVolumeKey(vtkMRMLScalarVolumeNode* doseVolumeNode);
+
+public:
+  /// Set maximum number of voxels of the dose image the preview surfaces are computed from
+  vtkSetMacro(PreviewMaximumNumberOfVoxels, vtkIdType);
+  /// Get maximum number of voxels of the dose image the preview surfaces are computed from
+  vtkGetMacro(PreviewMaximumNumberOfVoxels, vtkIdType);
+
+  /// Memory limit for the cached isodose surfaces in megabytes. Least recently used surfaces are
+  /// removed from the cache when it is exceeded. 0 disables caching. Default is 256.
+  vtkGetMacro(IsodoseSurfaceCacheMemoryLimitMB, double);
+  vtkSetMacro(IsodoseSurfaceCacheMemoryLimitMB, double);
+
 protected:
   /// Loads default isodose color table from the supplied color table file
   /// \return The loaded color table node if loading succeeded, NULL otherwise
@@ -92,6 +193,17 @@ protected:
   vtkSlicerIsodoseModuleLogic();
   virtual ~vtkSlicerIsodoseModuleLogic();
 
+protected:
+  /// Maximum number of voxels of the dose image the preview surfaces are computed from.
+  /// Determines the latency of the preview (about a million voxels are contoured in well under 100 ms)
+  vtkIdType PreviewMaximumNumberOfVoxels;
+
+  /// Memory limit for the cached isodose surfaces in megabytes
+  double IsodoseSurfaceCacheMemoryLimitMB;
+
+  class vtkInternal;
+  vtkInternal* Internal;
+
 private:
   vtkSlicerIsodoseModuleLogic(const vtkSlicerIsodoseModuleLogic&); // Not implemented
   void operator=(const vtkSlicerIsodoseModuleLogic&);               // Not implemented
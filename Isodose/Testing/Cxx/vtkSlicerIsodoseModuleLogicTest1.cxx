@@ -31,6 +31,7 @@
 #include <vtkMRMLModelNode.h>
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLColorTableNode.h>
+#include <vtkMRMLLinearTransformNode.h>
 #include <vtkMRMLSubjectHierarchyNode.h>
 #include <vtkMRMLScene.h>
 
@@ -42,6 +43,11 @@
 #include <vtkImageData.h>
 #include <vtkCollection.h>
 #include <vtkMassProperties.h>
+#include <vtkFlyingEdges3D.h>
+#include <vtkMatrix4x4.h>
+#include <vtkCellArray.h>
+#include <vtkPoints.h>
+#include <vtkMath.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -49,6 +55,436 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <map>
+#include <sstream>
+
+//-----------------------------------------------------------------------------
+// Compare two contours triangle by triangle after transforming their points with the given matrices.
+// The point order of the contours may differ, but the order of the triangles needs to be the same.
+bool CompareContours(vtkPolyData* contour, vtkMatrix4x4* contourToRasMatrix,
+                     vtkPolyData* baselineContour, vtkMatrix4x4* baselineContourToRasMatrix, double tolerance)
+{
+  if ( contour->GetNumberOfPoints() != baselineContour->GetNumberOfPoints()
+    || contour->GetNumberOfPolys() != baselineContour->GetNumberOfPolys() )
+  {
+    std::cerr << "Contour has " << contour->GetNumberOfPoints() << " points and " << contour->GetNumberOfPolys()
+      << " triangles instead of " << baselineContour->GetNumberOfPoints() << " and " << baselineContour->GetNumberOfPolys() << std::endl;
+    return false;
+  }
+  if (contour->GetNumberOfPolys() == 0)
+  {
+    return true;
+  }
+
+  vtkCellArray* polys = contour->GetPolys();
+  vtkCellArray* baselinePolys = baselineContour->GetPolys();
+  vtkIdType numberOfCellPoints = 0;
+  vtkIdType* cellPointIds = NULL;
+  vtkIdType numberOfBaselineCellPoints = 0;
+  vtkIdType* baselineCellPointIds = NULL;
+  polys->InitTraversal();
+  baselinePolys->InitTraversal();
+  while (polys->GetNextCell(numberOfCellPoints, cellPointIds))
+  {
+    if (!baselinePolys->GetNextCell(numberOfBaselineCellPoints, baselineCellPointIds) || numberOfCellPoints != numberOfBaselineCellPoints)
+    {
+      std::cerr << "Contour triangles differ from the baseline" << std::endl;
+      return false;
+    }
+    for (vtkIdType cellPointIndex=0; cellPointIndex<numberOfCellPoints; ++cellPointIndex)
+    {
+      double point[4] = {0.0, 0.0, 0.0, 1.0};
+      contour->GetPoint(cellPointIds[cellPointIndex], point);
+      contourToRasMatrix->MultiplyPoint(point, point);
+      double baselinePoint[4] = {0.0, 0.0, 0.0, 1.0};
+      baselineContour->GetPoint(baselineCellPointIds[cellPointIndex], baselinePoint);
+      baselineContourToRasMatrix->MultiplyPoint(baselinePoint, baselinePoint);
+      if (sqrt(vtkMath::Distance2BetweenPoints(point, baselinePoint)) > tolerance)
+      {
+        std::cerr << "Contour point (" << point[0] << ", " << point[1] << ", " << point[2] << ") differs from the baseline point ("
+          << baselinePoint[0] << ", " << baselinePoint[1] << ", " << baselinePoint[2] << ")" << std::endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Copy the triangles of a contour with its points numbered in the order they are first used by the triangles,
+// which is the order the single pass multi-level extraction stores the points of each level in
+vtkSmartPointer<vtkPolyData> RenumberContourPoints(vtkPolyData* contour)
+{
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+  std::vector<vtkIdType> newPointIds(contour->GetNumberOfPoints(), -1);
+  vtkIdType numberOfCellPoints = 0;
+  vtkIdType* cellPointIds = NULL;
+  vtkCellArray* contourPolys = contour->GetPolys();
+  for (contourPolys->InitTraversal(); contourPolys->GetNextCell(numberOfCellPoints, cellPointIds); )
+  {
+    polys->InsertNextCell(numberOfCellPoints);
+    for (vtkIdType cellPointIndex=0; cellPointIndex<numberOfCellPoints; ++cellPointIndex)
+    {
+      vtkIdType pointId = cellPointIds[cellPointIndex];
+      if (newPointIds[pointId] < 0)
+      {
+        newPointIds[pointId] = points->InsertNextPoint(contour->GetPoint(pointId));
+      }
+      polys->InsertCellPoint(newPointIds[pointId]);
+    }
+  }
+  vtkSmartPointer<vtkPolyData> renumberedContour = vtkSmartPointer<vtkPolyData>::New();
+  renumberedContour->SetPoints(points);
+  renumberedContour->SetPolys(polys);
+  return renumberedContour;
+}
+
+//-----------------------------------------------------------------------------
+// Compare the isodose contours of all levels extracted in a single pass, and the isodose surfaces created from them,
+// to the contours extracted by vtkFlyingEdges3D level by level from the original dose voxels. The expected transform
+// from the dose voxels to RAS is computed independently from the dose geometry and its parent transform.
+bool CompareIsodoseLevelsToSingleLevelContours(vtkMRMLScalarVolumeNode* doseVolumeNode, const char* caseName)
+{
+  vtkSmartPointer<vtkMatrix4x4> expectedIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseVolumeNode->GetIJKToRASMatrix(expectedIjkToRasMatrix);
+  vtkMRMLTransformNode* parentTransformNode = doseVolumeNode->GetParentTransformNode();
+  if (parentTransformNode)
+  {
+    vtkSmartPointer<vtkMatrix4x4> rasToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    parentTransformNode->GetMatrixTransformToWorld(rasToWorldMatrix);
+    vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    ijkToRasMatrix->DeepCopy(expectedIjkToRasMatrix);
+    vtkMatrix4x4::Multiply4x4(rasToWorldMatrix, ijkToRasMatrix, expectedIjkToRasMatrix);
+  }
+
+  // Linearly transformed doses are contoured on the original voxels
+  vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+  vtkSmartPointer<vtkMatrix4x4> doseIjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  if (!vtkSlicerIsodoseModuleLogic::GetDoseImageInIjk(doseVolumeNode, doseImageData, doseIjkToRasMatrix))
+  {
+    std::cerr << "ERROR: Failed to get dose image in IJK (" << caseName << ")" << std::endl;
+    return false;
+  }
+  if (doseImageData->GetScalarPointer() != doseVolumeNode->GetImageData()->GetScalarPointer())
+  {
+    std::cerr << "ERROR: Linearly transformed dose is not contoured on the original voxels (" << caseName << ")" << std::endl;
+    return false;
+  }
+  for (int row=0; row<4; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      if (fabs(doseIjkToRasMatrix->GetElement(row, column) - expectedIjkToRasMatrix->GetElement(row, column)) > 1.0e-6)
+      {
+        std::cerr << "ERROR: Dose IJK to RAS matrix differs from the expected matrix (" << caseName << ")" << std::endl;
+        return false;
+      }
+    }
+  }
+
+  // Levels spanning the dose range, including a duplicate and one above the maximum dose
+  double doseRange[2] = {0.0, 0.0};
+  doseVolumeNode->GetImageData()->GetScalarRange(doseRange);
+  std::vector<double> isoLevels;
+  isoLevels.push_back(0.8 * doseRange[1]);
+  isoLevels.push_back(0.2 * doseRange[1]);
+  isoLevels.push_back(0.5 * doseRange[1]);
+  isoLevels.push_back(0.2 * doseRange[1]);
+  isoLevels.push_back(0.95 * doseRange[1]);
+  isoLevels.push_back(2.0 * doseRange[1]);
+
+  std::vector<vtkSmartPointer<vtkPolyData> > isodoseContours;
+  vtkSlicerIsodoseModuleLogic::ExtractIsodoseContours(doseImageData, isoLevels, isodoseContours);
+  std::vector<vtkSmartPointer<vtkPolyData> > isodoseSurfaces;
+  vtkSlicerIsodoseModuleLogic::ComputeIsodoseSurfaces(doseImageData, doseIjkToRasMatrix, isoLevels, isodoseSurfaces);
+  if (isodoseContours.size() != isoLevels.size() || isodoseSurfaces.size() != isoLevels.size())
+  {
+    std::cerr << "ERROR: Number of isodose contours or surfaces differs from the number of levels (" << caseName << ")" << std::endl;
+    return false;
+  }
+
+  // Baseline: single level contour of the original voxels in IJK coordinate system
+  vtkSmartPointer<vtkImageData> doseIjkImageData = vtkSmartPointer<vtkImageData>::New();
+  doseIjkImageData->ShallowCopy(doseVolumeNode->GetImageData());
+  doseIjkImageData->SetOrigin(0.0, 0.0, 0.0);
+  doseIjkImageData->SetSpacing(1.0, 1.0, 1.0);
+  vtkSmartPointer<vtkMatrix4x4> identityMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  int numberOfNonEmptyLevels = 0;
+  for (size_t levelIndex=0; levelIndex<isoLevels.size(); ++levelIndex)
+  {
+    vtkSmartPointer<vtkFlyingEdges3D> flyingEdges = vtkSmartPointer<vtkFlyingEdges3D>::New();
+    flyingEdges->SetInputData(doseIjkImageData);
+    flyingEdges->SetValue(0, isoLevels[levelIndex]);
+    flyingEdges->ComputeScalarsOff();
+    flyingEdges->ComputeGradientsOff();
+    flyingEdges->ComputeNormalsOff();
+    flyingEdges->Update();
+    vtkSmartPointer<vtkPolyData> baselineContour = RenumberContourPoints(flyingEdges->GetOutput());
+
+    if (!CompareContours(isodoseContours[levelIndex], doseIjkToRasMatrix, baselineContour, expectedIjkToRasMatrix, 1.0e-4))
+    {
+      std::cerr << "ERROR: Isodose contour of level " << isoLevels[levelIndex] << " differs from the single level contour ("
+        << caseName << ")" << std::endl;
+      return false;
+    }
+    if (baselineContour->GetNumberOfPoints() == 0)
+    {
+      if (isodoseSurfaces[levelIndex]->GetNumberOfPoints() != 0)
+      {
+        std::cerr << "ERROR: Isodose surface of level " << isoLevels[levelIndex] << " is not empty (" << caseName << ")" << std::endl;
+        return false;
+      }
+      continue;
+    }
+    ++numberOfNonEmptyLevels;
+
+    // The contours are the same, so the post-processed surfaces in RAS need to be the same as well
+    vtkSmartPointer<vtkPolyData> baselineSurface = vtkSlicerIsodoseModuleLogic::CreateIsodoseSurface(baselineContour, expectedIjkToRasMatrix);
+    if (!CompareContours(isodoseSurfaces[levelIndex], identityMatrix, baselineSurface, identityMatrix, 1.0e-4))
+    {
+      std::cerr << "ERROR: Isodose surface of level " << isoLevels[levelIndex] << " differs from the single level surface ("
+        << caseName << ")" << std::endl;
+      return false;
+    }
+  }
+  if (numberOfNonEmptyLevels == 0)
+  {
+    std::cerr << "ERROR: All isodose levels are empty (" << caseName << ")" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Check that the preview dose image is the finest downsampled level within the voxel budget, and that its voxels
+// are the averages of the corresponding blocks of dose voxels, and are located at the centers of the blocks
+bool TestPreviewDoseImage(vtkSlicerIsodoseModuleLogic* isodoseLogic, vtkMRMLScalarVolumeNode* doseVolumeNode)
+{
+  vtkImageData* doseImageData = doseVolumeNode->GetImageData();
+  int doseExtent[6] = {0,-1,0,-1,0,-1};
+  doseImageData->GetExtent(doseExtent);
+  int doseDimensions[3] = {0, 0, 0};
+  doseImageData->GetDimensions(doseDimensions);
+  double doseRange[2] = {0.0, 0.0};
+  doseImageData->GetScalarRange(doseRange);
+  vtkIdType originalMaximumNumberOfVoxels = isodoseLogic->GetPreviewMaximumNumberOfVoxels();
+
+  // The whole dose is used if it is within the budget
+  isodoseLogic->SetPreviewMaximumNumberOfVoxels(doseImageData->GetNumberOfPoints());
+  vtkImageData* previewImageData = isodoseLogic->GetPreviewDoseImage(doseVolumeNode);
+  if (!previewImageData || previewImageData->GetNumberOfPoints() != doseImageData->GetNumberOfPoints())
+  {
+    std::cerr << "ERROR: Preview dose image is downsampled although the dose is within the voxel budget" << std::endl;
+    isodoseLogic->SetPreviewMaximumNumberOfVoxels(originalMaximumNumberOfVoxels);
+    return false;
+  }
+
+  // Budget that the dose downsampled once exceeds by one voxel, so it needs to be downsampled twice
+  const int shrinkFactor = 4;
+  vtkIdType onceDownsampledNumberOfVoxels = static_cast<vtkIdType>(doseDimensions[0]/2) * (doseDimensions[1]/2) * (doseDimensions[2]/2);
+  isodoseLogic->SetPreviewMaximumNumberOfVoxels(onceDownsampledNumberOfVoxels - 1);
+  previewImageData = isodoseLogic->GetPreviewDoseImage(doseVolumeNode);
+  isodoseLogic->SetPreviewMaximumNumberOfVoxels(originalMaximumNumberOfVoxels);
+  int previewDimensions[3] = {0, 0, 0};
+  if (previewImageData)
+  {
+    previewImageData->GetDimensions(previewDimensions);
+  }
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (previewDimensions[axis] != doseDimensions[axis] / 2 / 2)
+    {
+      std::cerr << "ERROR: Preview dose image is not the dose downsampled twice, its dimension along axis " << axis << " is "
+        << previewDimensions[axis] << " instead of " << doseDimensions[axis] / 2 / 2 << std::endl;
+      return false;
+    }
+  }
+
+  // Voxel (i,j,k) is the average of the dose voxels [4i,4i+3] x [4j,4j+3] x [4k,4k+3] in IJK coordinate system,
+  // so its center is at 4i+1.5 (half a voxel of each finer level further than the first dose voxel)
+  double previewOrigin[3] = {0.0, 0.0, 0.0};
+  previewImageData->GetOrigin(previewOrigin);
+  double previewSpacing[3] = {0.0, 0.0, 0.0};
+  previewImageData->GetSpacing(previewSpacing);
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (fabs(previewOrigin[axis] - 0.5*(shrinkFactor-1)) > 1.0e-6 || fabs(previewSpacing[axis] - shrinkFactor) > 1.0e-6)
+    {
+      std::cerr << "ERROR: Preview dose image origin " << previewOrigin[axis] << " or spacing " << previewSpacing[axis] << " along axis " << axis
+        << " differs from the expected " << 0.5*(shrinkFactor-1) << " and " << shrinkFactor << std::endl;
+      return false;
+    }
+  }
+  int previewExtent[6] = {0,-1,0,-1,0,-1};
+  previewImageData->GetExtent(previewExtent);
+  for (int k=previewExtent[4]; k<=previewExtent[5]; ++k)
+  {
+    for (int j=previewExtent[2]; j<=previewExtent[3]; ++j)
+    {
+      for (int i=previewExtent[0]; i<=previewExtent[1]; ++i)
+      {
+        double blockSum = 0.0;
+        for (int blockK=0; blockK<shrinkFactor; ++blockK)
+        {
+          for (int blockJ=0; blockJ<shrinkFactor; ++blockJ)
+          {
+            for (int blockI=0; blockI<shrinkFactor; ++blockI)
+            {
+              blockSum += doseImageData->GetScalarComponentAsDouble( doseExtent[0] + shrinkFactor*(i-previewExtent[0]) + blockI,
+                doseExtent[2] + shrinkFactor*(j-previewExtent[2]) + blockJ, doseExtent[4] + shrinkFactor*(k-previewExtent[4]) + blockK, 0 );
+            }
+          }
+        }
+        double blockAverage = blockSum / (shrinkFactor*shrinkFactor*shrinkFactor);
+        double previewValue = previewImageData->GetScalarComponentAsDouble(i, j, k, 0);
+        if (fabs(previewValue - blockAverage) > 1.0e-5 * doseRange[1])
+        {
+          std::cerr << "ERROR: Preview dose voxel (" << i << ", " << j << ", " << k << ") is " << previewValue
+            << " instead of the block average " << blockAverage << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+// Get the isodose model nodes of the dose volume by name
+std::map<std::string, vtkMRMLModelNode*> GetIsodoseModelNodes(vtkSlicerIsodoseModuleLogic* isodoseLogic, vtkMRMLIsodoseNode* parameterNode)
+{
+  std::map<std::string, vtkMRMLModelNode*> isodoseModelNodes;
+  vtkMRMLModelHierarchyNode* rootModelHierarchyNode = isodoseLogic->GetRootModelHierarchyNode(parameterNode);
+  if (!rootModelHierarchyNode)
+  {
+    return isodoseModelNodes;
+  }
+  std::vector<vtkMRMLHierarchyNode*> childrenNodes = rootModelHierarchyNode->GetChildrenNodes();
+  for (std::vector<vtkMRMLHierarchyNode*>::iterator childIt = childrenNodes.begin(); childIt != childrenNodes.end(); ++childIt)
+  {
+    vtkMRMLModelNode* modelNode = vtkMRMLModelNode::SafeDownCast((*childIt)->GetAssociatedNode());
+    if (modelNode && modelNode->GetName())
+    {
+      isodoseModelNodes[modelNode->GetName()] = modelNode;
+    }
+  }
+  return isodoseModelNodes;
+}
+
+//-----------------------------------------------------------------------------
+// Set the isodose levels of a color table, given as fractions of the maximum dose
+void SetIsodoseLevels(vtkMRMLColorTableNode* colorTableNode, double maximumDose, const std::vector<double>& levelFractions)
+{
+  colorTableNode->SetNumberOfColors(static_cast<int>(levelFractions.size()));
+  for (size_t levelIndex=0; levelIndex<levelFractions.size(); ++levelIndex)
+  {
+    std::ostringstream levelName;
+    levelName << levelFractions[levelIndex] * maximumDose;
+    colorTableNode->SetColor(static_cast<int>(levelIndex), levelName.str().c_str(), levelFractions[levelIndex], 0.5, 1.0 - levelFractions[levelIndex], 1.0);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Check that recomputing the isodose surfaces reuses the cached surfaces and the existing models,
+// and that adding or removing a level only adds or removes the model of that level
+bool TestIsodoseModelUpdates(vtkMRMLScene* mrmlScene, vtkSlicerIsodoseModuleLogic* isodoseLogic, vtkMRMLScalarVolumeNode* doseVolumeNode)
+{
+  double doseRange[2] = {0.0, 0.0};
+  doseVolumeNode->GetImageData()->GetScalarRange(doseRange);
+
+  vtkSmartPointer<vtkMRMLColorTableNode> colorTableNode = vtkSmartPointer<vtkMRMLColorTableNode>::New();
+  colorTableNode->SetTypeToUser();
+  mrmlScene->AddNode(colorTableNode);
+  vtkSmartPointer<vtkMRMLIsodoseNode> paramNode = vtkSmartPointer<vtkMRMLIsodoseNode>::New();
+  mrmlScene->AddNode(paramNode);
+  paramNode->SetAndObserveDoseVolumeNode(doseVolumeNode);
+  paramNode->SetAndObserveColorTableNode(colorTableNode);
+
+  // Two levels
+  std::vector<double> levelFractions;
+  levelFractions.push_back(0.3);
+  levelFractions.push_back(0.6);
+  SetIsodoseLevels(colorTableNode, doseRange[1], levelFractions);
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+  std::map<std::string, vtkMRMLModelNode*> modelNodes = GetIsodoseModelNodes(isodoseLogic, paramNode);
+  if (modelNodes.size() != 2)
+  {
+    std::cerr << "ERROR: " << modelNodes.size() << " isodose models are created for 2 levels" << std::endl;
+    return false;
+  }
+  std::map<std::string, vtkPolyData*> polyDatas;
+  for (std::map<std::string, vtkMRMLModelNode*>::iterator modelIt = modelNodes.begin(); modelIt != modelNodes.end(); ++modelIt)
+  {
+    polyDatas[modelIt->first] = modelIt->second->GetPolyData();
+  }
+  int numberOfModelNodes = mrmlScene->GetNumberOfNodesByClass("vtkMRMLModelNode");
+
+  // Same levels again: the models and their surfaces are reused
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+  std::map<std::string, vtkMRMLModelNode*> recomputedModelNodes = GetIsodoseModelNodes(isodoseLogic, paramNode);
+  if (recomputedModelNodes != modelNodes || mrmlScene->GetNumberOfNodesByClass("vtkMRMLModelNode") != numberOfModelNodes)
+  {
+    std::cerr << "ERROR: Isodose models are not reused when recomputing the same levels" << std::endl;
+    return false;
+  }
+  for (std::map<std::string, vtkMRMLModelNode*>::iterator modelIt = modelNodes.begin(); modelIt != modelNodes.end(); ++modelIt)
+  {
+    if (modelIt->second->GetPolyData() != polyDatas[modelIt->first])
+    {
+      std::cerr << "ERROR: Cached isodose surface is not reused for model " << modelIt->first << std::endl;
+      return false;
+    }
+  }
+
+  // Add a level: exactly one model is created, the others are kept with their surfaces
+  levelFractions.push_back(0.45);
+  SetIsodoseLevels(colorTableNode, doseRange[1], levelFractions);
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+  std::map<std::string, vtkMRMLModelNode*> addedLevelModelNodes = GetIsodoseModelNodes(isodoseLogic, paramNode);
+  if (addedLevelModelNodes.size() != 3 || mrmlScene->GetNumberOfNodesByClass("vtkMRMLModelNode") != numberOfModelNodes + 1)
+  {
+    std::cerr << "ERROR: Adding an isodose level does not create exactly one model" << std::endl;
+    return false;
+  }
+  for (std::map<std::string, vtkMRMLModelNode*>::iterator modelIt = modelNodes.begin(); modelIt != modelNodes.end(); ++modelIt)
+  {
+    if (addedLevelModelNodes[modelIt->first] != modelIt->second || modelIt->second->GetPolyData() != polyDatas[modelIt->first])
+    {
+      std::cerr << "ERROR: Isodose model " << modelIt->first << " is not kept when adding a level" << std::endl;
+      return false;
+    }
+  }
+
+  // Remove the first level: only its model is removed, the others are kept
+  std::ostringstream removedLevelName;
+  removedLevelName << levelFractions[0] * doseRange[1];
+  levelFractions.erase(levelFractions.begin());
+  SetIsodoseLevels(colorTableNode, doseRange[1], levelFractions);
+  isodoseLogic->CreateIsodoseSurfaces(paramNode);
+  std::map<std::string, vtkMRMLModelNode*> removedLevelModelNodes = GetIsodoseModelNodes(isodoseLogic, paramNode);
+  if (removedLevelModelNodes.size() != 2 || mrmlScene->GetNumberOfNodesByClass("vtkMRMLModelNode") != numberOfModelNodes)
+  {
+    std::cerr << "ERROR: Removing an isodose level does not remove exactly one model" << std::endl;
+    return false;
+  }
+  for (std::map<std::string, vtkMRMLModelNode*>::iterator modelIt = addedLevelModelNodes.begin(); modelIt != addedLevelModelNodes.end(); ++modelIt)
+  {
+    bool removedLevel = (modelIt->first.find(vtkSlicerIsodoseModuleLogic::ISODOSE_MODEL_NODE_NAME_PREFIX + removedLevelName.str()) == 0);
+    bool removed = (removedLevelModelNodes.find(modelIt->first) == removedLevelModelNodes.end());
+    if (removed != removedLevel || (!removed && removedLevelModelNodes[modelIt->first] != modelIt->second))
+    {
+      std::cerr << "ERROR: Isodose model " << modelIt->first << (removedLevel ? " is not removed" : " is not kept") << " when removing a level" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
 //-----------------------------------------------------------------------------
 int vtkSlicerIsodoseModuleLogicTest1( int argc, char * argv[] )
 {
@@ -229,6 +665,51 @@ int vtkSlicerIsodoseModuleLogicTest1( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  // The preview keeps the full resolution surfaces of the levels that are in the cache
+  vtkPolyData* isodosePolyData = modelNode->GetPolyData();
+  isodoseLogic->CreateIsodoseSurfacesPreview(paramNode);
+  if (modelNode->GetPolyData() != isodosePolyData)
+  {
+    std::cerr << "ERROR: Preview replaced the cached full resolution isodose surface!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Check the downsampled dose of the preview
+  if (!TestPreviewDoseImage(isodoseLogic, doseScalarVolumeNode))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Check the reuse of the cached surfaces and the existing models
+  if (!TestIsodoseModelUpdates(mrmlScene, isodoseLogic, doseScalarVolumeNode))
+  {
+    return EXIT_FAILURE;
+  }
+
+  // Compare the single pass multi-level contours to the contours of the individual levels,
+  // without transform and with a non-identity linear transform of the dose
+  if (!CompareIsodoseLevelsToSingleLevelContours(doseScalarVolumeNode, "identity transform"))
+  {
+    return EXIT_FAILURE;
+  }
+  vtkSmartPointer<vtkMatrix4x4> doseTransformMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  doseTransformMatrix->SetElement(0, 0, 0.8);
+  doseTransformMatrix->SetElement(0, 1, -0.6);
+  doseTransformMatrix->SetElement(1, 0, 0.6);
+  doseTransformMatrix->SetElement(1, 1, 0.8);
+  doseTransformMatrix->SetElement(0, 3, 12.5);
+  doseTransformMatrix->SetElement(1, 3, -20.0);
+  doseTransformMatrix->SetElement(2, 3, 7.25);
+  vtkSmartPointer<vtkMRMLLinearTransformNode> doseTransformNode = vtkSmartPointer<vtkMRMLLinearTransformNode>::New();
+  mrmlScene->AddNode(doseTransformNode);
+  doseTransformNode->SetMatrixTransformToParent(doseTransformMatrix);
+  doseScalarVolumeNode->SetAndObserveTransformNodeID(doseTransformNode->GetID());
+  if (!CompareIsodoseLevelsToSingleLevelContours(doseScalarVolumeNode, "linear transform"))
+  {
+    return EXIT_FAILURE;
+  }
+  doseScalarVolumeNode->SetAndObserveTransformNodeID(NULL);
+
   return EXIT_SUCCESS;
 }
 
@@ -22,6 +22,8 @@
 // Qt includes
 #include <QCheckBox>
 #include <QDebug>
+#include <QList>
+#include <QThread>
 
 // SlicerQt includes
 #include "qSlicerIsodoseModuleWidget.h"
@@ -54,13 +56,63 @@
 #include <vtkMRMLScene.h>
 
 // VTK includes
+#include <vtkAtomic.h>
 #include <vtkColorTransferFunction.h>
+#include <vtkImageData.h>
 #include <vtkLookupTable.h>
+#include <vtkMatrix4x4.h>
+#include <vtkPolyData.h>
 #include <vtkRenderer.h>
 #include <vtkRenderWindow.h>
 #include <vtkScalarBarWidget.h>
 #include <vtkVersion.h>
 
+//-----------------------------------------------------------------------------
+/// \ingroup SlicerRt_QtModules_Isodose
+/// \brief Computes the full resolution isodose surfaces in the background after the preview is shown.
+/// The dose image needs to be a copy that does not share its voxels with the scene (\sa qSlicerIsodoseModuleWidget::applyClicked),
+/// the scene is updated in the main thread when the computation is finished.
+class qSlicerIsodoseSurfaceComputationThread : public QThread
+{
+public:
+  qSlicerIsodoseSurfaceComputationThread(QObject* parent)
+    : QThread(parent)
+    , Generation(0)
+  {
+    this->DoseImageData = vtkSmartPointer<vtkImageData>::New();
+    this->IjkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+    this->AbortRequested = 0;
+  }
+
+  /// Stop the computation before the next isodose level. The result of an aborted computation is incomplete.
+  void requestAbort()
+  {
+    this->AbortRequested = 1;
+  }
+
+  /// Identifies the apply request the computation belongs to
+  int Generation;
+  /// ID of the parameter node the surfaces are computed for
+  QString ParameterNodeID;
+  /// Identifies the dose state the surfaces are computed from (\sa vtkSlicerIsodoseModuleLogic::GetDoseVolumeKey)
+  std::string DoseVolumeKey;
+
+  vtkSmartPointer<vtkImageData> DoseImageData;
+  vtkSmartPointer<vtkMatrix4x4> IjkToRasMatrix;
+  std::vector<double> IsoLevels;
+  /// Surfaces of all the levels. The ones found in the cache are set before the thread is started, only the others are computed
+  std::vector<vtkSmartPointer<vtkPolyData> > IsodoseSurfaces;
+  /// Set from the main thread to stop the computation (\sa requestAbort)
+  vtkAtomic<int> AbortRequested;
+
+protected:
+  virtual void run()
+  {
+    vtkSlicerIsodoseModuleLogic::ComputeMissingIsodoseSurfaces(this->DoseImageData, this->IjkToRasMatrix, this->IsoLevels,
+      this->IsodoseSurfaces, &this->AbortRequested);
+  }
+};
+
 //-----------------------------------------------------------------------------
 /// \ingroup SlicerRt_QtModules_Isodose
 class qSlicerIsodoseModuleWidgetPrivate: public Ui_qSlicerIsodoseModule
@@ -85,6 +137,11 @@ public:
   vtkSlicerRTScalarBarActor* ScalarBarActor2DRed;
   vtkSlicerRTScalarBarActor* ScalarBarActor2DYellow;
   vtkSlicerRTScalarBarActor* ScalarBarActor2DGreen;
+
+  /// Background computations of full resolution isodose surfaces that have not finished yet
+  QList<qSlicerIsodoseSurfaceComputationThread*> RefinementThreads;
+  /// Incremented on each apply, so that the results of outdated background computations are discarded
+  int RefinementGeneration;
 };
 
 //-----------------------------------------------------------------------------
@@ -93,6 +150,7 @@ public:
 //-----------------------------------------------------------------------------
 qSlicerIsodoseModuleWidgetPrivate::qSlicerIsodoseModuleWidgetPrivate(qSlicerIsodoseModuleWidget& object)
   : q_ptr(&object)
+  , RefinementGeneration(0)
 {
   this->ScalarBarWidget = vtkScalarBarWidget::New();
   this->ScalarBarActor = vtkSlicerRTScalarBarActor::New();
@@ -257,6 +315,15 @@ qSlicerIsodoseModuleWidget::qSlicerIsodoseModuleWidget(QWidget* _parent)
 //-----------------------------------------------------------------------------
 qSlicerIsodoseModuleWidget::~qSlicerIsodoseModuleWidget()
 {
+  Q_D(qSlicerIsodoseModuleWidget);
+
+  // The threads only access their own data, but they need to finish before being destroyed
+  foreach (qSlicerIsodoseSurfaceComputationThread* thread, d->RefinementThreads)
+  {
+    thread->disconnect(this);
+    thread->requestAbort();
+    thread->wait();
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -759,14 +826,90 @@ void qSlicerIsodoseModuleWidget::applyClicked()
     return;
   }
 
+  // Results of previous background computations are outdated, so stop them. They are removed when they have finished.
+  ++d->RefinementGeneration;
+  foreach (qSlicerIsodoseSurfaceComputationThread* runningThread, d->RefinementThreads)
+  {
+    runningThread->requestAbort();
+  }
+
   QApplication::setOverrideCursor(QCursor(Qt::BusyCursor));
 
-  // Compute the isodose surface for the selected dose volume
-  d->logic()->CreateIsodoseSurfaces(paramNode);
+  // Preview is not needed if the surfaces of all levels are cached
+  std::vector<vtkSmartPointer<vtkPolyData> > cachedIsodoseSurfaces;
+  if ( !d->checkBox_ProgressivePreview->isChecked()
+    || d->logic()->GetCachedIsodoseSurfaces(paramNode, cachedIsodoseSurfaces) )
+  {
+    // Compute the isodose surface for the selected dose volume
+    d->logic()->CreateIsodoseSurfaces(paramNode);
+    QApplication::restoreOverrideCursor();
+    return;
+  }
+
+  // Show surfaces computed from the downsampled dose immediately
+  d->logic()->CreateIsodoseSurfacesPreview(paramNode);
+
+  // Compute the full resolution surfaces in the background
+  qSlicerIsodoseSurfaceComputationThread* thread = new qSlicerIsodoseSurfaceComputationThread(this);
+  thread->Generation = d->RefinementGeneration;
+  thread->ParameterNodeID = QString(paramNode->GetID());
+  thread->DoseVolumeKey = vtkSlicerIsodoseModuleLogic::GetDoseVolumeKey(paramNode->GetDoseVolumeNode());
+  vtkSlicerIsodoseModuleLogic::GetIsoLevels(paramNode, thread->IsoLevels);
+  thread->IsodoseSurfaces = cachedIsodoseSurfaces;
+  vtkSmartPointer<vtkImageData> doseImageData = vtkSmartPointer<vtkImageData>::New();
+  if (!vtkSlicerIsodoseModuleLogic::GetDoseImageInIjk(paramNode->GetDoseVolumeNode(), doseImageData, thread->IjkToRasMatrix))
+  {
+    qCritical() << Q_FUNC_INFO << ": Failed to get dose image";
+    delete thread;
+    QApplication::restoreOverrideCursor();
+    return;
+  }
+  // The dose voxels of linearly transformed doses are shared with the scene, which may modify them
+  // while the thread is running, so the thread gets its own copy
+  if (doseImageData->GetScalarPointer() == paramNode->GetDoseVolumeNode()->GetImageData()->GetScalarPointer())
+  {
+    thread->DoseImageData->DeepCopy(doseImageData);
+  }
+  else
+  {
+    thread->DoseImageData->ShallowCopy(doseImageData);
+  }
+  d->RefinementThreads << thread;
+  connect(thread, SIGNAL(finished()), this, SLOT(onIsodoseRefinementFinished()));
+  thread->start(QThread::LowPriority);
 
   QApplication::restoreOverrideCursor();
 }
 
+//-----------------------------------------------------------------------------
+void qSlicerIsodoseModuleWidget::onIsodoseRefinementFinished()
+{
+  Q_D(qSlicerIsodoseModuleWidget);
+
+  qSlicerIsodoseSurfaceComputationThread* thread = dynamic_cast<qSlicerIsodoseSurfaceComputationThread*>(this->sender());
+  if (!thread)
+  {
+    return;
+  }
+  d->RefinementThreads.removeAll(thread);
+  thread->deleteLater();
+
+  // Discard the result if the isodose surfaces were recomputed, or the parameter node, the dose, or the levels changed meanwhile
+  vtkMRMLIsodoseNode* paramNode = vtkMRMLIsodoseNode::SafeDownCast(d->MRMLNodeComboBox_ParameterSet->currentNode());
+  std::vector<double> isoLevels;
+  vtkSlicerIsodoseModuleLogic::GetIsoLevels(paramNode, isoLevels);
+  if ( !this->mrmlScene() || !paramNode || thread->Generation != d->RefinementGeneration
+    || thread->ParameterNodeID != QString(paramNode->GetID()) || thread->IsoLevels != isoLevels
+    || thread->DoseVolumeKey != vtkSlicerIsodoseModuleLogic::GetDoseVolumeKey(paramNode->GetDoseVolumeNode()) )
+  {
+    return;
+  }
+
+  // Replace the preview surfaces with the full resolution ones
+  d->logic()->AddIsodoseSurfacesToCache(paramNode, thread->IsodoseSurfaces);
+  d->logic()->SetIsodoseSurfaces(paramNode, thread->IsodoseSurfaces);
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerIsodoseModuleWidget::updateButtonsState()
 {
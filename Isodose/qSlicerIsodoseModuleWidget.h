@@ -91,6 +91,9 @@ protected slots:
   /// Slot handling clicking the Apply button
   void applyClicked();
 
+  /// Slot handling the end of the background computation of the full resolution isodose surfaces
+  void onIsodoseRefinementFinished();
+
   /// Slot called on change in logic
   void onLogicModified();
 
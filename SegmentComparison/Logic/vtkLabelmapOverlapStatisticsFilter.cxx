@@ -0,0 +1,707 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkLabelmapOverlapStatisticsFilter.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkImageCast.h>
+#include <vtkImageData.h>
+#include <vtkMatrix4x4.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+/// Overlap counts and foreground index sums of one slice
+struct vtkLabelmapOverlapStatisticsSliceResult
+{
+  vtkLabelmapOverlapStatisticsSliceResult()
+    : TruePositives(0)
+    , FalsePositives(0)
+    , FalseNegatives(0)
+  {
+    for (int axis=0; axis<3; ++axis)
+    {
+      this->ReferenceIndexSum[axis] = 0.0;
+      this->CompareIndexSum[axis] = 0.0;
+    }
+  }
+
+  vtkIdType TruePositives;
+  vtkIdType FalsePositives;
+  vtkIdType FalseNegatives;
+  double ReferenceIndexSum[3];
+  double CompareIndexSum[3];
+};
+
+//----------------------------------------------------------------------------
+// Computes the overlap of the two labelmaps in a range of slices of the union extent.
+// Only the rows and columns covered by at least one of the labelmaps are visited, the
+// rest of the union extent is background in both.
+template <class ScalarType>
+class vtkLabelmapOverlapStatisticsFunctor
+{
+public:
+  vtkLabelmapOverlapStatisticsFunctor(vtkImageData* referenceImage, vtkImageData* compareImage,
+    const int* unionExtent, std::vector<vtkLabelmapOverlapStatisticsSliceResult>& sliceResults)
+    : ReferencePtr(NULL)
+    , ComparePtr(NULL)
+    , UnionExtent(unionExtent)
+    , SliceResults(sliceResults)
+  {
+    for (int i=0; i<6; ++i)
+    {
+      this->ReferenceExtent[i] = this->CompareExtent[i] = (i % 2 ? -1 : 0);
+    }
+    if (referenceImage)
+    {
+      this->ReferencePtr = static_cast<const ScalarType*>(referenceImage->GetScalarPointer());
+      referenceImage->GetExtent(this->ReferenceExtent);
+    }
+    if (compareImage)
+    {
+      this->ComparePtr = static_cast<const ScalarType*>(compareImage->GetScalarPointer());
+      compareImage->GetExtent(this->CompareExtent);
+    }
+  }
+
+  /// Get row of a labelmap (indexed from the first column of the extent), NULL if the row is outside the extent
+  static const ScalarType* GetRow(const ScalarType* scalarPtr, const int* extent, int j, int k)
+  {
+    if ( !scalarPtr || extent[0] > extent[1]
+      || j < extent[2] || j > extent[3] || k < extent[4] || k > extent[5] )
+    {
+      return NULL;
+    }
+    vtkIdType rowIndex = static_cast<vtkIdType>(k - extent[4]) * (extent[3] - extent[2] + 1) + (j - extent[2]);
+    return scalarPtr + rowIndex * (extent[1] - extent[0] + 1);
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    for (vtkIdType slice=begin; slice<end; ++slice)
+    {
+      int k = this->UnionExtent[4] + static_cast<int>(slice);
+      vtkLabelmapOverlapStatisticsSliceResult result;
+      for (int j=this->UnionExtent[2]; j<=this->UnionExtent[3]; ++j)
+      {
+        const ScalarType* referenceRow = GetRow(this->ReferencePtr, this->ReferenceExtent, j, k);
+        const ScalarType* compareRow = GetRow(this->ComparePtr, this->CompareExtent, j, k);
+        if (!referenceRow && !compareRow)
+        {
+          continue;
+        }
+        int firstI = std::min(referenceRow ? this->ReferenceExtent[0] : VTK_INT_MAX, compareRow ? this->CompareExtent[0] : VTK_INT_MAX);
+        int lastI = std::max(referenceRow ? this->ReferenceExtent[1] : VTK_INT_MIN, compareRow ? this->CompareExtent[1] : VTK_INT_MIN);
+        for (int i=firstI; i<=lastI; ++i)
+        {
+          bool reference = referenceRow && i >= this->ReferenceExtent[0] && i <= this->ReferenceExtent[1] && referenceRow[i - this->ReferenceExtent[0]] != 0;
+          bool compare = compareRow && i >= this->CompareExtent[0] && i <= this->CompareExtent[1] && compareRow[i - this->CompareExtent[0]] != 0;
+          if (reference)
+          {
+            result.ReferenceIndexSum[0] += i;
+            result.ReferenceIndexSum[1] += j;
+            result.ReferenceIndexSum[2] += k;
+            if (compare)
+            {
+              ++result.TruePositives;
+            }
+            else
+            {
+              ++result.FalseNegatives;
+            }
+          }
+          if (compare)
+          {
+            result.CompareIndexSum[0] += i;
+            result.CompareIndexSum[1] += j;
+            result.CompareIndexSum[2] += k;
+            if (!reference)
+            {
+              ++result.FalsePositives;
+            }
+          }
+        }
+      }
+      this->SliceResults[slice] = result;
+    }
+  }
+
+private:
+  const ScalarType* ReferencePtr;
+  const ScalarType* ComparePtr;
+  int ReferenceExtent[6];
+  int CompareExtent[6];
+  const int* UnionExtent;
+  std::vector<vtkLabelmapOverlapStatisticsSliceResult>& SliceResults;
+};
+
+//----------------------------------------------------------------------------
+template <class ScalarType>
+void vtkLabelmapOverlapStatisticsCompute(vtkImageData* referenceImage, vtkImageData* compareImage,
+  const int* unionExtent, std::vector<vtkLabelmapOverlapStatisticsSliceResult>& sliceResults, ScalarType*)
+{
+  vtkLabelmapOverlapStatisticsFunctor<ScalarType> functor(referenceImage, compareImage, unionExtent, sliceResults);
+  vtkSMPTools::For(0, static_cast<vtkIdType>(sliceResults.size()), functor);
+}
+
+//----------------------------------------------------------------------------
+/// Number of foreground voxels and foreground bounding box (voxel index range) of a labelmap or a slice
+struct vtkLabelmapOverlapStatisticsForeground
+{
+  vtkLabelmapOverlapStatisticsForeground()
+    : NumberOfVoxels(0)
+  {
+    for (int axis=0; axis<3; ++axis)
+    {
+      this->Extent[2*axis] = VTK_INT_MAX;
+      this->Extent[2*axis+1] = VTK_INT_MIN;
+    }
+  }
+
+  /// Extend with the foreground of another region
+  void Add(const vtkLabelmapOverlapStatisticsForeground& other)
+  {
+    this->NumberOfVoxels += other.NumberOfVoxels;
+    for (int axis=0; axis<3; ++axis)
+    {
+      this->Extent[2*axis] = std::min(this->Extent[2*axis], other.Extent[2*axis]);
+      this->Extent[2*axis+1] = std::max(this->Extent[2*axis+1], other.Extent[2*axis+1]);
+    }
+  }
+
+  vtkIdType NumberOfVoxels;
+  int Extent[6];
+};
+
+//----------------------------------------------------------------------------
+// Finds the foreground of a labelmap in a range of slices
+template <class ScalarType>
+class vtkLabelmapOverlapStatisticsForegroundFunctor
+{
+public:
+  vtkLabelmapOverlapStatisticsForegroundFunctor(vtkImageData* image, std::vector<vtkLabelmapOverlapStatisticsForeground>& sliceForegrounds)
+    : ScalarPtr(static_cast<const ScalarType*>(image->GetScalarPointer()))
+    , SliceForegrounds(sliceForegrounds)
+  {
+    image->GetExtent(this->Extent);
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    int dimensions[2] = { this->Extent[1]-this->Extent[0]+1, this->Extent[3]-this->Extent[2]+1 };
+    for (vtkIdType slice=begin; slice<end; ++slice)
+    {
+      vtkLabelmapOverlapStatisticsForeground foreground;
+      const ScalarType* voxelPtr = this->ScalarPtr + slice * dimensions[0] * dimensions[1];
+      for (int j=0; j<dimensions[1]; ++j)
+      {
+        for (int i=0; i<dimensions[0]; ++i, ++voxelPtr)
+        {
+          if (*voxelPtr == 0)
+          {
+            continue;
+          }
+          ++foreground.NumberOfVoxels;
+          foreground.Extent[0] = std::min(foreground.Extent[0], i);
+          foreground.Extent[1] = std::max(foreground.Extent[1], i);
+          foreground.Extent[2] = std::min(foreground.Extent[2], j);
+          foreground.Extent[3] = std::max(foreground.Extent[3], j);
+        }
+      }
+      if (foreground.NumberOfVoxels > 0)
+      {
+        foreground.Extent[4] = foreground.Extent[5] = static_cast<int>(slice);
+      }
+      this->SliceForegrounds[slice] = foreground;
+    }
+  }
+
+private:
+  const ScalarType* ScalarPtr;
+  int Extent[6];
+  std::vector<vtkLabelmapOverlapStatisticsForeground>& SliceForegrounds;
+};
+
+//----------------------------------------------------------------------------
+template <class ScalarType>
+void vtkLabelmapOverlapStatisticsComputeForeground(vtkImageData* image,
+  std::vector<vtkLabelmapOverlapStatisticsForeground>& sliceForegrounds, ScalarType*)
+{
+  vtkLabelmapOverlapStatisticsForegroundFunctor<ScalarType> functor(image, sliceForegrounds);
+  vtkSMPTools::For(0, static_cast<vtkIdType>(sliceForegrounds.size()), functor);
+}
+
+//----------------------------------------------------------------------------
+// Computes the Dice coefficients of a range of labelmap pairs. The foreground bounding boxes are in voxel indices
+// relative to the first voxel of the shared extent. Each pair writes only its own coefficient, so the result does
+// not depend on the scheduling of the pairs.
+template <class ScalarType>
+class vtkLabelmapOverlapStatisticsPairDiceFunctor
+{
+public:
+  vtkLabelmapOverlapStatisticsPairDiceFunctor(const std::vector<vtkSmartPointer<vtkImageData> >& images,
+    const std::vector<vtkLabelmapOverlapStatisticsForeground>& foregrounds, size_t numberOfReferenceLabelmaps,
+    const int* dimensions, double* diceCoefficients)
+    : Images(images)
+    , Foregrounds(foregrounds)
+    , NumberOfReferenceLabelmaps(numberOfReferenceLabelmaps)
+    , Dimensions(dimensions)
+    , DiceCoefficients(diceCoefficients)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    size_t numberOfCompareLabelmaps = this->Images.size() - this->NumberOfReferenceLabelmaps;
+    vtkIdType sliceSize = static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1];
+    for (vtkIdType pair=begin; pair<end; ++pair)
+    {
+      size_t referenceIndex = static_cast<size_t>(pair) / numberOfCompareLabelmaps;
+      size_t compareIndex = this->NumberOfReferenceLabelmaps + static_cast<size_t>(pair) % numberOfCompareLabelmaps;
+      const vtkLabelmapOverlapStatisticsForeground& referenceForeground = this->Foregrounds[referenceIndex];
+      const vtkLabelmapOverlapStatisticsForeground& compareForeground = this->Foregrounds[compareIndex];
+      vtkIdType denominator = referenceForeground.NumberOfVoxels + compareForeground.NumberOfVoxels;
+      if (referenceForeground.NumberOfVoxels == 0 || compareForeground.NumberOfVoxels == 0)
+      {
+        // No overlap, and zero if both are empty (same as GetDiceCoefficient)
+        this->DiceCoefficients[pair] = 0.0;
+        continue;
+      }
+
+      // Both labelmaps can be foreground only in the intersection of their bounding boxes
+      int overlapExtent[6] = {0, -1, 0, -1, 0, -1};
+      for (int axis=0; axis<3; ++axis)
+      {
+        overlapExtent[2*axis] = std::max(referenceForeground.Extent[2*axis], compareForeground.Extent[2*axis]);
+        overlapExtent[2*axis+1] = std::min(referenceForeground.Extent[2*axis+1], compareForeground.Extent[2*axis+1]);
+      }
+      vtkIdType truePositives = 0;
+      const ScalarType* referencePtr = static_cast<const ScalarType*>(this->Images[referenceIndex]->GetScalarPointer());
+      const ScalarType* comparePtr = static_cast<const ScalarType*>(this->Images[compareIndex]->GetScalarPointer());
+      for (int k=overlapExtent[4]; k<=overlapExtent[5]; ++k)
+      {
+        for (int j=overlapExtent[2]; j<=overlapExtent[3]; ++j)
+        {
+          vtkIdType rowOffset = k * sliceSize + static_cast<vtkIdType>(j) * this->Dimensions[0];
+          for (int i=overlapExtent[0]; i<=overlapExtent[1]; ++i)
+          {
+            if (referencePtr[rowOffset + i] != 0 && comparePtr[rowOffset + i] != 0)
+            {
+              ++truePositives;
+            }
+          }
+        }
+      }
+      this->DiceCoefficients[pair] = 2.0 * truePositives / static_cast<double>(denominator);
+    }
+  }
+
+private:
+  const std::vector<vtkSmartPointer<vtkImageData> >& Images;
+  const std::vector<vtkLabelmapOverlapStatisticsForeground>& Foregrounds;
+  size_t NumberOfReferenceLabelmaps;
+  const int* Dimensions;
+  double* DiceCoefficients;
+};
+
+//----------------------------------------------------------------------------
+template <class ScalarType>
+void vtkLabelmapOverlapStatisticsComputePairwiseDice(const std::vector<vtkSmartPointer<vtkImageData> >& images,
+  const std::vector<vtkLabelmapOverlapStatisticsForeground>& foregrounds, size_t numberOfReferenceLabelmaps,
+  const int* dimensions, double* diceCoefficients, ScalarType*)
+{
+  vtkLabelmapOverlapStatisticsPairDiceFunctor<ScalarType> functor(images, foregrounds, numberOfReferenceLabelmaps, dimensions, diceCoefficients);
+  vtkIdType numberOfPairs = static_cast<vtkIdType>(numberOfReferenceLabelmaps * (images.size() - numberOfReferenceLabelmaps));
+  vtkSMPTools::For(0, numberOfPairs, functor);
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLabelmapOverlapStatisticsFilter);
+
+//----------------------------------------------------------------------------
+vtkLabelmapOverlapStatisticsFilter::vtkLabelmapOverlapStatisticsFilter()
+{
+  this->ReferenceLabelmap = NULL;
+  this->CompareLabelmap = NULL;
+
+  this->NumberOfVoxels = 0;
+  this->TruePositives = 0;
+  this->TrueNegatives = 0;
+  this->FalsePositives = 0;
+  this->FalseNegatives = 0;
+  this->VoxelVolumeMm3 = 0.0;
+  for (int axis=0; axis<3; ++axis)
+  {
+    this->ReferenceCenter[axis] = 0.0;
+    this->CompareCenter[axis] = 0.0;
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapOverlapStatisticsFilter::~vtkLabelmapOverlapStatisticsFilter()
+{
+  this->SetReferenceLabelmap(NULL);
+  this->SetCompareLabelmap(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapOverlapStatisticsFilter::SetReferenceLabelmap(vtkOrientedImageData* referenceLabelmap)
+{
+  if (this->ReferenceLabelmap == referenceLabelmap)
+  {
+    return;
+  }
+  if (this->ReferenceLabelmap)
+  {
+    this->ReferenceLabelmap->UnRegister(this);
+  }
+  this->ReferenceLabelmap = referenceLabelmap;
+  if (this->ReferenceLabelmap)
+  {
+    this->ReferenceLabelmap->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapOverlapStatisticsFilter::SetCompareLabelmap(vtkOrientedImageData* compareLabelmap)
+{
+  if (this->CompareLabelmap == compareLabelmap)
+  {
+    return;
+  }
+  if (this->CompareLabelmap)
+  {
+    this->CompareLabelmap->UnRegister(this);
+  }
+  this->CompareLabelmap = compareLabelmap;
+  if (this->CompareLabelmap)
+  {
+    this->CompareLabelmap->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapOverlapStatisticsFilter::GetDiceCoefficient()
+{
+  vtkIdType denominator = 2 * this->TruePositives + this->FalsePositives + this->FalseNegatives;
+  if (denominator == 0)
+  {
+    return 0.0;
+  }
+  return 2.0 * this->TruePositives / static_cast<double>(denominator);
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapOverlapStatisticsFilter::GetJaccardIndex()
+{
+  vtkIdType denominator = this->TruePositives + this->FalsePositives + this->FalseNegatives;
+  if (denominator == 0)
+  {
+    return 0.0;
+  }
+  return this->TruePositives / static_cast<double>(denominator);
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapOverlapStatisticsFilter::GetReferenceVolumeMm3()
+{
+  return (this->TruePositives + this->FalseNegatives) * this->VoxelVolumeMm3;
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapOverlapStatisticsFilter::GetCompareVolumeMm3()
+{
+  return (this->TruePositives + this->FalsePositives) * this->VoxelVolumeMm3;
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapOverlapStatisticsFilter::GetTruePositivesVolumeMm3()
+{
+  return this->TruePositives * this->VoxelVolumeMm3;
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapOverlapStatisticsFilter::GetFalsePositivesVolumeMm3()
+{
+  return this->FalsePositives * this->VoxelVolumeMm3;
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapOverlapStatisticsFilter::GetFalseNegativesVolumeMm3()
+{
+  return this->FalseNegatives * this->VoxelVolumeMm3;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLabelmapOverlapStatisticsFilter::Update()
+{
+  this->NumberOfVoxels = 0;
+  this->TruePositives = 0;
+  this->TrueNegatives = 0;
+  this->FalsePositives = 0;
+  this->FalseNegatives = 0;
+  this->VoxelVolumeMm3 = 0.0;
+  for (int axis=0; axis<3; ++axis)
+  {
+    this->ReferenceCenter[axis] = 0.0;
+    this->CompareCenter[axis] = 0.0;
+  }
+
+  if (!this->ReferenceLabelmap || !this->CompareLabelmap)
+  {
+    vtkErrorMacro("Update: Reference and compare labelmaps need to be set");
+    return false;
+  }
+  if ( this->ReferenceLabelmap->GetNumberOfScalarComponents() != 1
+    || this->CompareLabelmap->GetNumberOfScalarComponents() != 1 )
+  {
+    vtkErrorMacro("Update: Labelmaps need to have a single scalar component");
+    return false;
+  }
+
+  // Use the compare labelmap buffer directly if it is on the reference lattice, otherwise resample it
+  vtkSmartPointer<vtkImageData> compareImage = this->CompareLabelmap;
+  if (!vtkOrientedImageDataResample::DoGeometriesMatch(this->ReferenceLabelmap, this->CompareLabelmap))
+  {
+    vtkSmartPointer<vtkOrientedImageData> resampledCompareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      this->CompareLabelmap, this->ReferenceLabelmap, resampledCompareLabelmap, false, true) )
+    {
+      vtkErrorMacro("Update: Failed to resample compare labelmap to reference geometry");
+      return false;
+    }
+    compareImage = resampledCompareLabelmap.GetPointer();
+  }
+  if (compareImage->GetScalarType() != this->ReferenceLabelmap->GetScalarType())
+  {
+    vtkSmartPointer<vtkImageCast> cast = vtkSmartPointer<vtkImageCast>::New();
+    cast->SetInputData(compareImage);
+    cast->SetOutputScalarType(this->ReferenceLabelmap->GetScalarType());
+    cast->Update();
+    compareImage = cast->GetOutput();
+  }
+
+  // Voxels of the union extent that are outside a labelmap are background in that labelmap
+  int referenceExtent[6] = {0, -1, 0, -1, 0, -1};
+  this->ReferenceLabelmap->GetExtent(referenceExtent);
+  int compareExtent[6] = {0, -1, 0, -1, 0, -1};
+  compareImage->GetExtent(compareExtent);
+  bool referenceEmpty = (referenceExtent[0] > referenceExtent[1] || referenceExtent[2] > referenceExtent[3] || referenceExtent[4] > referenceExtent[5]);
+  bool compareEmpty = (compareExtent[0] > compareExtent[1] || compareExtent[2] > compareExtent[3] || compareExtent[4] > compareExtent[5]);
+  int unionExtent[6] = {0, -1, 0, -1, 0, -1};
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (referenceEmpty || compareEmpty)
+    {
+      unionExtent[2*axis] = (referenceEmpty ? compareExtent[2*axis] : referenceExtent[2*axis]);
+      unionExtent[2*axis+1] = (referenceEmpty ? compareExtent[2*axis+1] : referenceExtent[2*axis+1]);
+    }
+    else
+    {
+      unionExtent[2*axis] = std::min(referenceExtent[2*axis], compareExtent[2*axis]);
+      unionExtent[2*axis+1] = std::max(referenceExtent[2*axis+1], compareExtent[2*axis+1]);
+    }
+  }
+  double spacing[3] = {1.0, 1.0, 1.0};
+  this->ReferenceLabelmap->GetSpacing(spacing);
+  this->VoxelVolumeMm3 = fabs(spacing[0] * spacing[1] * spacing[2]);
+  if (unionExtent[0] > unionExtent[1] || unionExtent[2] > unionExtent[3] || unionExtent[4] > unionExtent[5])
+  {
+    return true;
+  }
+  this->NumberOfVoxels = static_cast<vtkIdType>(unionExtent[1]-unionExtent[0]+1)
+    * (unionExtent[3]-unionExtent[2]+1) * (unionExtent[5]-unionExtent[4]+1);
+
+  // Count the overlap per slice in parallel
+  std::vector<vtkLabelmapOverlapStatisticsSliceResult> sliceResults(unionExtent[5]-unionExtent[4]+1);
+  switch (this->ReferenceLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro( vtkLabelmapOverlapStatisticsCompute( (referenceEmpty ? NULL : this->ReferenceLabelmap),
+      (compareEmpty ? NULL : compareImage.GetPointer()), unionExtent, sliceResults, static_cast<VTK_TT*>(NULL) ) );
+  default:
+    vtkErrorMacro("Update: Unsupported labelmap scalar type");
+    return false;
+  }
+
+  double referenceIndexSum[3] = {0.0, 0.0, 0.0};
+  double compareIndexSum[3] = {0.0, 0.0, 0.0};
+  for (std::vector<vtkLabelmapOverlapStatisticsSliceResult>::iterator resultIt = sliceResults.begin(); resultIt != sliceResults.end(); ++resultIt)
+  {
+    this->TruePositives += resultIt->TruePositives;
+    this->FalsePositives += resultIt->FalsePositives;
+    this->FalseNegatives += resultIt->FalseNegatives;
+    for (int axis=0; axis<3; ++axis)
+    {
+      referenceIndexSum[axis] += resultIt->ReferenceIndexSum[axis];
+      compareIndexSum[axis] += resultIt->CompareIndexSum[axis];
+    }
+  }
+  this->TrueNegatives = this->NumberOfVoxels - this->TruePositives - this->FalsePositives - this->FalseNegatives;
+
+  // Centers of mass in world coordinates
+  vtkSmartPointer<vtkMatrix4x4> imageToWorldMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  this->ReferenceLabelmap->GetImageToWorldMatrix(imageToWorldMatrix);
+  vtkIdType numberOfReferenceVoxels = this->TruePositives + this->FalseNegatives;
+  vtkIdType numberOfCompareVoxels = this->TruePositives + this->FalsePositives;
+  if (numberOfReferenceVoxels > 0)
+  {
+    double referenceCenterIjk[4] = { referenceIndexSum[0] / numberOfReferenceVoxels,
+      referenceIndexSum[1] / numberOfReferenceVoxels, referenceIndexSum[2] / numberOfReferenceVoxels, 1.0 };
+    double referenceCenterWorld[4] = {0.0, 0.0, 0.0, 1.0};
+    imageToWorldMatrix->MultiplyPoint(referenceCenterIjk, referenceCenterWorld);
+    std::copy(referenceCenterWorld, referenceCenterWorld+3, this->ReferenceCenter);
+  }
+  if (numberOfCompareVoxels > 0)
+  {
+    double compareCenterIjk[4] = { compareIndexSum[0] / numberOfCompareVoxels,
+      compareIndexSum[1] / numberOfCompareVoxels, compareIndexSum[2] / numberOfCompareVoxels, 1.0 };
+    double compareCenterWorld[4] = {0.0, 0.0, 0.0, 1.0};
+    imageToWorldMatrix->MultiplyPoint(compareCenterIjk, compareCenterWorld);
+    std::copy(compareCenterWorld, compareCenterWorld+3, this->CompareCenter);
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLabelmapOverlapStatisticsFilter::ComputePairwiseDiceCoefficients(
+  const std::vector<vtkSmartPointer<vtkOrientedImageData> >& referenceLabelmaps,
+  const std::vector<vtkSmartPointer<vtkOrientedImageData> >& compareLabelmaps, vtkDoubleArray* diceCoefficients)
+{
+  if (!diceCoefficients)
+  {
+    vtkErrorMacro("ComputePairwiseDiceCoefficients: Invalid output array");
+    return false;
+  }
+  size_t numberOfReferenceLabelmaps = referenceLabelmaps.size();
+  size_t numberOfPairs = numberOfReferenceLabelmaps * compareLabelmaps.size();
+  diceCoefficients->Initialize();
+  diceCoefficients->SetNumberOfComponents(1);
+  diceCoefficients->SetNumberOfTuples(static_cast<vtkIdType>(numberOfPairs));
+  diceCoefficients->Fill(0.0);
+  if (numberOfPairs == 0)
+  {
+    return true;
+  }
+
+  // All labelmaps need to be on the lattice of the first one
+  std::vector<vtkOrientedImageData*> labelmaps;
+  labelmaps.insert(labelmaps.end(), referenceLabelmaps.begin(), referenceLabelmaps.end());
+  labelmaps.insert(labelmaps.end(), compareLabelmaps.begin(), compareLabelmaps.end());
+  vtkOrientedImageData* sharedGeometryLabelmap = labelmaps[0];
+  int extent[6] = {0, -1, 0, -1, 0, -1};
+  if (sharedGeometryLabelmap)
+  {
+    sharedGeometryLabelmap->GetExtent(extent);
+  }
+  for (std::vector<vtkOrientedImageData*>::iterator labelmapIt=labelmaps.begin(); labelmapIt!=labelmaps.end(); ++labelmapIt)
+  {
+    if ( !(*labelmapIt) || (*labelmapIt)->GetNumberOfScalarComponents() != 1
+      || !std::equal(extent, extent+6, (*labelmapIt)->GetExtent())
+      || !vtkOrientedImageDataResample::DoGeometriesMatch(sharedGeometryLabelmap, *labelmapIt) )
+    {
+      vtkErrorMacro("ComputePairwiseDiceCoefficients: Labelmaps need to have a single scalar component and the same geometry");
+      return false;
+    }
+  }
+  int dimensions[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+  if (dimensions[0] < 1 || dimensions[1] < 1 || dimensions[2] < 1)
+  {
+    // All labelmaps are empty
+    return true;
+  }
+
+  // Read all buffers with the scalar type of the first labelmap (the same as the overlap of a pair is
+  // computed with the scalar type of the reference labelmap in Update)
+  int scalarType = sharedGeometryLabelmap->GetScalarType();
+  std::vector<vtkSmartPointer<vtkImageData> > images;
+  for (std::vector<vtkOrientedImageData*>::iterator labelmapIt=labelmaps.begin(); labelmapIt!=labelmaps.end(); ++labelmapIt)
+  {
+    vtkSmartPointer<vtkImageData> image = *labelmapIt;
+    if (image->GetScalarType() != scalarType)
+    {
+      vtkSmartPointer<vtkImageCast> cast = vtkSmartPointer<vtkImageCast>::New();
+      cast->SetInputData(image);
+      cast->SetOutputScalarType(scalarType);
+      cast->Update();
+      image = cast->GetOutput();
+    }
+    images.push_back(image);
+  }
+
+  // Find the foreground of each labelmap once
+  std::vector<vtkLabelmapOverlapStatisticsForeground> foregrounds(images.size());
+  std::vector<vtkLabelmapOverlapStatisticsForeground> sliceForegrounds(dimensions[2]);
+  for (size_t labelmapIndex=0; labelmapIndex<images.size(); ++labelmapIndex)
+  {
+    switch (scalarType)
+    {
+      vtkTemplateMacro(vtkLabelmapOverlapStatisticsComputeForeground(images[labelmapIndex], sliceForegrounds, static_cast<VTK_TT*>(NULL)));
+    default:
+      vtkErrorMacro("ComputePairwiseDiceCoefficients: Unsupported labelmap scalar type");
+      return false;
+    }
+    for (std::vector<vtkLabelmapOverlapStatisticsForeground>::iterator sliceIt=sliceForegrounds.begin(); sliceIt!=sliceForegrounds.end(); ++sliceIt)
+    {
+      foregrounds[labelmapIndex].Add(*sliceIt);
+    }
+  }
+
+  // Count the overlap of the pairs in parallel
+  switch (scalarType)
+  {
+    vtkTemplateMacro(vtkLabelmapOverlapStatisticsComputePairwiseDice(images, foregrounds, numberOfReferenceLabelmaps,
+      dimensions, diceCoefficients->GetPointer(0), static_cast<VTK_TT*>(NULL)));
+  default:
+    vtkErrorMacro("ComputePairwiseDiceCoefficients: Unsupported labelmap scalar type");
+    return false;
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapOverlapStatisticsFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os,indent);
+  os << indent << "ReferenceLabelmap: " << this->ReferenceLabelmap << "\n";
+  os << indent << "CompareLabelmap: " << this->CompareLabelmap << "\n";
+  os << indent << "NumberOfVoxels: " << this->NumberOfVoxels << "\n";
+  os << indent << "TruePositives: " << this->TruePositives << "\n";
+  os << indent << "TrueNegatives: " << this->TrueNegatives << "\n";
+  os << indent << "FalsePositives: " << this->FalsePositives << "\n";
+  os << indent << "FalseNegatives: " << this->FalseNegatives << "\n";
+  os << indent << "VoxelVolumeMm3: " << this->VoxelVolumeMm3 << "\n";
+  os << indent << "ReferenceCenter: (" << this->ReferenceCenter[0] << ", " << this->ReferenceCenter[1] << ", " << this->ReferenceCenter[2] << ")\n";
+  os << indent << "CompareCenter: (" << this->CompareCenter[0] << ", " << this->CompareCenter[1] << ", " << this->CompareCenter[2] << ")\n";
+}
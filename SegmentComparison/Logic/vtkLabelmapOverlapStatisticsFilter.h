@@ -0,0 +1,146 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkLabelmapOverlapStatisticsFilter_h
+#define __vtkLabelmapOverlapStatisticsFilter_h
+
+#include "vtkSlicerSegmentComparisonModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+class vtkDoubleArray;
+class vtkOrientedImageData;
+
+/// \ingroup SlicerRt_QtModules_SegmentComparison
+/// \brief Compute overlap statistics (Dice, Jaccard, volumes, centers of mass) of two binary labelmaps
+///
+/// The statistics are computed directly on the scalar buffers of the labelmaps in one parallel pass over
+/// the union of their extents (voxels outside the extent of a labelmap are considered background).
+/// Non-zero voxels are considered foreground. If the compare labelmap is not on the lattice of the
+/// reference labelmap, then it is resampled (nearest neighbor) to the reference geometry first.
+/// The results match the Dice statistics of Plastimatch.
+///
+/// To compute the Dice coefficients of many labelmaps pairwise, \sa ComputePairwiseDiceCoefficients finds the
+/// foreground of each labelmap only once and counts the overlap of each pair only where both can be foreground.
+class VTK_SLICER_SEGMENTCOMPARISON_MODULE_LOGIC_EXPORT vtkLabelmapOverlapStatisticsFilter : public vtkObject
+{
+public:
+  static vtkLabelmapOverlapStatisticsFilter* New();
+  vtkTypeMacro(vtkLabelmapOverlapStatisticsFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+public:
+  /// Set reference labelmap
+  void SetReferenceLabelmap(vtkOrientedImageData* referenceLabelmap);
+  /// Get reference labelmap
+  vtkGetObjectMacro(ReferenceLabelmap, vtkOrientedImageData);
+
+  /// Set compare labelmap
+  void SetCompareLabelmap(vtkOrientedImageData* compareLabelmap);
+  /// Get compare labelmap
+  vtkGetObjectMacro(CompareLabelmap, vtkOrientedImageData);
+
+  /// Compute overlap statistics
+  /// \return Success flag
+  bool Update();
+
+  /// Compute the Dice coefficient of every pair of a reference and a compare labelmap. The labelmaps need to have
+  /// the same geometry (lattice and extent). The number of foreground voxels and the foreground bounding box of each
+  /// labelmap are computed only once, then the true positives of each pair are counted only in the intersection of
+  /// the two bounding boxes. The pairs are processed in parallel. The coefficients are the same as those of
+  /// \sa GetDiceCoefficient for the pair (the reference and compare labelmaps set in the filter are not used).
+  /// \param diceCoefficients Output array with a value for each pair (all compare labelmaps for the first reference
+  ///   labelmap first)
+  /// \return Success flag
+  bool ComputePairwiseDiceCoefficients(const std::vector<vtkSmartPointer<vtkOrientedImageData> >& referenceLabelmaps,
+    const std::vector<vtkSmartPointer<vtkOrientedImageData> >& compareLabelmaps, vtkDoubleArray* diceCoefficients);
+
+  /// Get number of voxels in the union of the extents of the labelmaps
+  vtkGetMacro(NumberOfVoxels, vtkIdType);
+  /// Get number of voxels that are foreground in both labelmaps
+  vtkGetMacro(TruePositives, vtkIdType);
+  /// Get number of voxels that are background in both labelmaps
+  vtkGetMacro(TrueNegatives, vtkIdType);
+  /// Get number of voxels that are foreground only in the compare labelmap
+  vtkGetMacro(FalsePositives, vtkIdType);
+  /// Get number of voxels that are foreground only in the reference labelmap
+  vtkGetMacro(FalseNegatives, vtkIdType);
+
+  /// Get Dice similarity coefficient (2*TP / (2*TP + FP + FN)). Zero if both labelmaps are empty
+  double GetDiceCoefficient();
+  /// Get Jaccard index (TP / (TP + FP + FN)). Zero if both labelmaps are empty
+  double GetJaccardIndex();
+
+  /// Get volume of a voxel in mm^3
+  vtkGetMacro(VoxelVolumeMm3, double);
+  /// Get volume of the reference structure in mm^3
+  double GetReferenceVolumeMm3();
+  /// Get volume of the compare structure in mm^3
+  double GetCompareVolumeMm3();
+  /// Get volume of the true positive region in mm^3
+  double GetTruePositivesVolumeMm3();
+  /// Get volume of the false positive region in mm^3
+  double GetFalsePositivesVolumeMm3();
+  /// Get volume of the false negative region in mm^3
+  double GetFalseNegativesVolumeMm3();
+
+  /// Get center of mass of the reference structure in world (RAS) coordinates
+  vtkGetVector3Macro(ReferenceCenter, double);
+  /// Get center of mass of the compare structure in world (RAS) coordinates
+  vtkGetVector3Macro(CompareCenter, double);
+
+protected:
+  vtkLabelmapOverlapStatisticsFilter();
+  virtual ~vtkLabelmapOverlapStatisticsFilter();
+
+protected:
+  /// Reference labelmap
+  vtkOrientedImageData* ReferenceLabelmap;
+  /// Compare labelmap
+  vtkOrientedImageData* CompareLabelmap;
+
+  /// Number of voxels in the union of the extents
+  vtkIdType NumberOfVoxels;
+  /// Number of true positive voxels
+  vtkIdType TruePositives;
+  /// Number of true negative voxels
+  vtkIdType TrueNegatives;
+  /// Number of false positive voxels
+  vtkIdType FalsePositives;
+  /// Number of false negative voxels
+  vtkIdType FalseNegatives;
+  /// Volume of a voxel in mm^3
+  double VoxelVolumeMm3;
+  /// Center of mass of the reference structure
+  double ReferenceCenter[3];
+  /// Center of mass of the compare structure
+  double CompareCenter[3];
+
+private:
+  vtkLabelmapOverlapStatisticsFilter(const vtkLabelmapOverlapStatisticsFilter&); // Not implemented
+  void operator=(const vtkLabelmapOverlapStatisticsFilter&);                     // Not implemented
+};
+
+#endif // __vtkLabelmapOverlapStatisticsFilter_h
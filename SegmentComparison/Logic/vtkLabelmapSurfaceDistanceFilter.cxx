@@ -0,0 +1,1401 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkLabelmapSurfaceDistanceFilter.h"
+
+// SegmentationCore includes
+#include "vtkOrientedImageData.h"
+#include "vtkOrientedImageDataResample.h"
+
+// VTK includes
+#include <vtkDoubleArray.h>
+#include <vtkImageData.h>
+#include <vtkIntArray.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+#include <vtkTable.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+//----------------------------------------------------------------------------
+/// Label bits of the voxels in the label buffer of the computation domain
+enum
+{
+  REFERENCE_LABEL = 1,
+  COMPARE_LABEL = 2
+};
+
+//----------------------------------------------------------------------------
+/// Squared distance of the voxels that have not been reached by the distance transform. The distance transform
+/// is computed in double precision, so that distances equal to a tolerance are not pushed above it by rounding
+static const double vtkLabelmapSurfaceDistanceInfinity = VTK_DOUBLE_MAX;
+
+//----------------------------------------------------------------------------
+/// Bounding box (IJ) of the foreground voxels of one slice. Empty if Extent[0] > Extent[1]
+struct vtkLabelmapSurfaceDistanceSliceExtent
+{
+  vtkLabelmapSurfaceDistanceSliceExtent()
+  {
+    this->Extent[0] = this->Extent[2] = VTK_INT_MAX;
+    this->Extent[1] = this->Extent[3] = VTK_INT_MIN;
+  }
+
+  int Extent[4];
+};
+
+//----------------------------------------------------------------------------
+/// Distances and statistics of one slice of the computation domain
+struct vtkLabelmapSurfaceDistanceSliceResult
+{
+  vtkLabelmapSurfaceDistanceSliceResult()
+    : NumberOfReferenceVoxels(0)
+    , NumberOfCompareVoxels(0)
+    , ReferenceVolumeDistanceSum(0.0)
+    , CompareVolumeDistanceSum(0.0)
+  {
+  }
+
+  std::vector<double> ReferenceBoundaryDistances;
+  std::vector<double> CompareBoundaryDistances;
+  /// Exposed face areas of the reference and compare boundary voxels, in the order of the distances
+  std::vector<double> ReferenceBoundaryFaceAreas;
+  std::vector<double> CompareBoundaryFaceAreas;
+  /// In-plane distances of the reference contour voxels of the slice from the compare contours of the slice
+  /// (VTK_DOUBLE_MAX if the compare labelmap has no contour in the slice)
+  std::vector<double> ReferenceInPlaneBoundaryDistances;
+  /// Non-zero distances of the foreground voxels of both labelmaps
+  std::vector<double> VolumeDistances;
+  vtkIdType NumberOfReferenceVoxels;
+  vtkIdType NumberOfCompareVoxels;
+  double ReferenceVolumeDistanceSum;
+  double CompareVolumeDistanceSum;
+  std::vector<int> HistogramFrequencies;
+};
+
+//----------------------------------------------------------------------------
+/// Boundary voxels of a labelmap, used for the pairwise statistics
+struct vtkLabelmapSurfaceDistanceBoundary
+{
+  /// Indices of the boundary voxels in the labelmap in voxel order
+  std::vector<vtkIdType> VoxelIndices;
+  /// Flags telling whether the boundary voxels are on the contours of their slice (\sa GetAddedPathLengthMm)
+  std::vector<bool> InPlane;
+  /// Exposed face areas of the boundary voxels (\sa GetSurfaceDice)
+  std::vector<double> FaceAreas;
+};
+
+//----------------------------------------------------------------------------
+/// Distance statistics of the boundary voxels of a labelmap from the boundary of another labelmap
+struct vtkLabelmapSurfaceDistanceDirectedStatistics
+{
+  vtkLabelmapSurfaceDistanceDirectedStatistics()
+    : Maximum(0.0)
+    , Sum(0.0)
+    , FaceArea(0.0)
+  {
+  }
+
+  double Maximum;
+  double Sum;
+  /// Exposed face area of all boundary voxels
+  double FaceArea;
+  /// Exposed face area of the boundary voxels within each tolerance
+  std::vector<double> FaceAreaWithinTolerance;
+  /// Number of voxels on the contours of their slice farther than each tolerance from the contours
+  /// of the other labelmap in the same slice
+  std::vector<vtkIdType> NumberOfInPlaneVoxelsOutsideTolerance;
+};
+
+//----------------------------------------------------------------------------
+/// Area (mm^2) of the faces of a foreground voxel of the label buffer that are shared with a background voxel or the
+/// border of the domain. Zero if the voxel is not on the boundary. The face areas are indexed by their normal axis
+static double vtkLabelmapSurfaceDistanceGetExposedFaceArea(const unsigned char* labels, const int* dimensions,
+  vtkIdType index, unsigned char labelBit, const double* faceAreas)
+{
+  vtkIdType increments[3] = { 1, dimensions[0], static_cast<vtkIdType>(dimensions[0]) * dimensions[1] };
+  vtkIdType position[3] = { index % dimensions[0], (index / dimensions[0]) % dimensions[1], index / increments[2] };
+  double area = 0.0;
+  for (int axis=0; axis<3; ++axis)
+  {
+    if (position[axis] == 0 || !(labels[index-increments[axis]] & labelBit))
+    {
+      area += faceAreas[axis];
+    }
+    if (position[axis] == dimensions[axis]-1 || !(labels[index+increments[axis]] & labelBit))
+    {
+      area += faceAreas[axis];
+    }
+  }
+  return area;
+}
+
+//----------------------------------------------------------------------------
+// Computes the bounding box of the foreground voxels of an image slice by slice
+template <class ScalarType>
+class vtkLabelmapSurfaceDistanceExtentFunctor
+{
+public:
+  vtkLabelmapSurfaceDistanceExtentFunctor(vtkImageData* image, std::vector<vtkLabelmapSurfaceDistanceSliceExtent>& sliceExtents)
+    : ScalarPtr(static_cast<const ScalarType*>(image->GetScalarPointer()))
+    , SliceExtents(sliceExtents)
+  {
+    image->GetExtent(this->Extent);
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    int dimensions[2] = { this->Extent[1]-this->Extent[0]+1, this->Extent[3]-this->Extent[2]+1 };
+    for (vtkIdType slice=begin; slice<end; ++slice)
+    {
+      vtkLabelmapSurfaceDistanceSliceExtent sliceExtent;
+      const ScalarType* slicePtr = this->ScalarPtr + slice * dimensions[0] * dimensions[1];
+      for (int j=0; j<dimensions[1]; ++j)
+      {
+        const ScalarType* rowPtr = slicePtr + static_cast<vtkIdType>(j) * dimensions[0];
+        for (int i=0; i<dimensions[0]; ++i)
+        {
+          if (rowPtr[i] != 0)
+          {
+            sliceExtent.Extent[0] = std::min(sliceExtent.Extent[0], this->Extent[0] + i);
+            sliceExtent.Extent[1] = std::max(sliceExtent.Extent[1], this->Extent[0] + i);
+            sliceExtent.Extent[2] = std::min(sliceExtent.Extent[2], this->Extent[2] + j);
+            sliceExtent.Extent[3] = std::max(sliceExtent.Extent[3], this->Extent[2] + j);
+          }
+        }
+      }
+      this->SliceExtents[slice] = sliceExtent;
+    }
+  }
+
+private:
+  const ScalarType* ScalarPtr;
+  int Extent[6];
+  std::vector<vtkLabelmapSurfaceDistanceSliceExtent>& SliceExtents;
+};
+
+//----------------------------------------------------------------------------
+// Sets the label bit of the foreground voxels of an image in the label buffer of the computation domain
+template <class ScalarType>
+class vtkLabelmapSurfaceDistanceLabelFunctor
+{
+public:
+  vtkLabelmapSurfaceDistanceLabelFunctor(vtkImageData* image, const int* domainExtent, unsigned char* labels, unsigned char labelBit)
+    : ScalarPtr(static_cast<const ScalarType*>(image->GetScalarPointer()))
+    , DomainExtent(domainExtent)
+    , Labels(labels)
+    , LabelBit(labelBit)
+  {
+    image->GetExtent(this->Extent);
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    int domainDimensions[2] = { this->DomainExtent[1]-this->DomainExtent[0]+1, this->DomainExtent[3]-this->DomainExtent[2]+1 };
+    int imageDimensions[2] = { this->Extent[1]-this->Extent[0]+1, this->Extent[3]-this->Extent[2]+1 };
+    int firstI = std::max(this->DomainExtent[0], this->Extent[0]);
+    int lastI = std::min(this->DomainExtent[1], this->Extent[1]);
+    int firstJ = std::max(this->DomainExtent[2], this->Extent[2]);
+    int lastJ = std::min(this->DomainExtent[3], this->Extent[3]);
+    for (vtkIdType slice=begin; slice<end; ++slice)
+    {
+      int k = this->DomainExtent[4] + static_cast<int>(slice);
+      if (k < this->Extent[4] || k > this->Extent[5])
+      {
+        continue;
+      }
+      for (int j=firstJ; j<=lastJ; ++j)
+      {
+        const ScalarType* rowPtr = this->ScalarPtr
+          + (static_cast<vtkIdType>(k - this->Extent[4]) * imageDimensions[1] + (j - this->Extent[2])) * imageDimensions[0]
+          - this->Extent[0];
+        unsigned char* labelRowPtr = this->Labels
+          + (slice * domainDimensions[1] + (j - this->DomainExtent[2])) * domainDimensions[0]
+          - this->DomainExtent[0];
+        for (int i=firstI; i<=lastI; ++i)
+        {
+          if (rowPtr[i] != 0)
+          {
+            labelRowPtr[i] |= this->LabelBit;
+          }
+        }
+      }
+    }
+  }
+
+private:
+  const ScalarType* ScalarPtr;
+  int Extent[6];
+  const int* DomainExtent;
+  unsigned char* Labels;
+  unsigned char LabelBit;
+};
+
+//----------------------------------------------------------------------------
+template <class ScalarType>
+void vtkLabelmapSurfaceDistanceComputeExtent(vtkImageData* image, int* effectiveExtent, ScalarType*)
+{
+  int extent[6] = {0, -1, 0, -1, 0, -1};
+  image->GetExtent(extent);
+  std::vector<vtkLabelmapSurfaceDistanceSliceExtent> sliceExtents(extent[5]-extent[4]+1);
+  vtkLabelmapSurfaceDistanceExtentFunctor<ScalarType> functor(image, sliceExtents);
+  vtkSMPTools::For(0, static_cast<vtkIdType>(sliceExtents.size()), functor);
+
+  effectiveExtent[0] = effectiveExtent[2] = effectiveExtent[4] = VTK_INT_MAX;
+  effectiveExtent[1] = effectiveExtent[3] = effectiveExtent[5] = VTK_INT_MIN;
+  for (int k=extent[4]; k<=extent[5]; ++k)
+  {
+    const int* sliceExtent = sliceExtents[k-extent[4]].Extent;
+    if (sliceExtent[0] > sliceExtent[1])
+    {
+      continue;
+    }
+    effectiveExtent[0] = std::min(effectiveExtent[0], sliceExtent[0]);
+    effectiveExtent[1] = std::max(effectiveExtent[1], sliceExtent[1]);
+    effectiveExtent[2] = std::min(effectiveExtent[2], sliceExtent[2]);
+    effectiveExtent[3] = std::max(effectiveExtent[3], sliceExtent[3]);
+    effectiveExtent[4] = std::min(effectiveExtent[4], k);
+    effectiveExtent[5] = std::max(effectiveExtent[5], k);
+  }
+}
+
+//----------------------------------------------------------------------------
+template <class ScalarType>
+void vtkLabelmapSurfaceDistanceComputeLabels(vtkImageData* image, const int* domainExtent, unsigned char* labels, unsigned char labelBit, ScalarType*)
+{
+  vtkLabelmapSurfaceDistanceLabelFunctor<ScalarType> functor(image, domainExtent, labels, labelBit);
+  vtkSMPTools::For(0, domainExtent[5]-domainExtent[4]+1, functor);
+}
+
+//----------------------------------------------------------------------------
+// Initializes the squared distance buffers: zero at the boundary voxels of the labelmap, infinity elsewhere.
+// A foreground voxel is on the boundary if any of its face neighbors is background or outside the domain.
+// The in-plane buffer of the compare labelmap is zero only at the voxels on the contours of their slice
+// (that have a background I or J face neighbor)
+class vtkLabelmapSurfaceDistanceBoundaryFunctor
+{
+public:
+  vtkLabelmapSurfaceDistanceBoundaryFunctor(const unsigned char* labels, const int* dimensions,
+    double* referenceDistances, double* compareDistances, double* compareInPlaneDistances)
+    : Labels(labels)
+    , Dimensions(dimensions)
+    , ReferenceDistances(referenceDistances)
+    , CompareDistances(compareDistances)
+    , CompareInPlaneDistances(compareInPlaneDistances)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    vtkIdType increments[3] = { 1, this->Dimensions[0], static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1] };
+    for (vtkIdType k=begin; k<end; ++k)
+    {
+      for (int j=0; j<this->Dimensions[1]; ++j)
+      {
+        vtkIdType index = k * increments[2] + j * increments[1];
+        for (int i=0; i<this->Dimensions[0]; ++i, ++index)
+        {
+          unsigned char label = this->Labels[index];
+          // Labels of the voxel that are missing in at least one I or J face neighbor, and in any face neighbor
+          unsigned char inPlaneBoundary = 0;
+          unsigned char boundary = 0;
+          if (label)
+          {
+            inPlaneBoundary |= (i > 0 ? label & ~this->Labels[index-increments[0]] : label);
+            inPlaneBoundary |= (i < this->Dimensions[0]-1 ? label & ~this->Labels[index+increments[0]] : label);
+            inPlaneBoundary |= (j > 0 ? label & ~this->Labels[index-increments[1]] : label);
+            inPlaneBoundary |= (j < this->Dimensions[1]-1 ? label & ~this->Labels[index+increments[1]] : label);
+            boundary = inPlaneBoundary;
+            boundary |= (k > 0 ? label & ~this->Labels[index-increments[2]] : label);
+            boundary |= (k < this->Dimensions[2]-1 ? label & ~this->Labels[index+increments[2]] : label);
+          }
+          this->ReferenceDistances[index] = ((boundary & REFERENCE_LABEL) ? 0.0 : vtkLabelmapSurfaceDistanceInfinity);
+          this->CompareDistances[index] = ((boundary & COMPARE_LABEL) ? 0.0 : vtkLabelmapSurfaceDistanceInfinity);
+          this->CompareInPlaneDistances[index] = ((inPlaneBoundary & COMPARE_LABEL) ? 0.0 : vtkLabelmapSurfaceDistanceInfinity);
+        }
+      }
+    }
+  }
+
+private:
+  const unsigned char* Labels;
+  const int* Dimensions;
+  double* ReferenceDistances;
+  double* CompareDistances;
+  double* CompareInPlaneDistances;
+};
+
+//----------------------------------------------------------------------------
+// One pass of the separable squared Euclidean distance transform (Felzenszwalb and Huttenlocher):
+// computes the lower envelope of the parabolas rooted at the voxels of each line along the given axis.
+// The lines are independent, so they are distributed among the threads. Running only the I and J passes
+// computes the in-plane distance transform of each slice.
+class vtkLabelmapSurfaceDistanceTransformFunctor
+{
+public:
+  vtkLabelmapSurfaceDistanceTransformFunctor(double* distances, const int* dimensions, int axis, double spacing)
+    : Distances(distances)
+    , Dimensions(dimensions)
+    , Axis(axis)
+    , Spacing(spacing)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    vtkIdType increments[3] = { 1, this->Dimensions[0], static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1] };
+    int firstOtherAxis = (this->Axis == 0 ? 1 : 0);
+    int secondOtherAxis = (this->Axis == 2 ? 1 : 2);
+    int numberOfSamples = this->Dimensions[this->Axis];
+    vtkIdType stride = increments[this->Axis];
+
+    // Squared distances of the line, apexes of the parabolas of the envelope, and left end of their ranges
+    std::vector<double> lineDistances(numberOfSamples, 0.0);
+    std::vector<int> apexes(numberOfSamples, 0);
+    std::vector<double> rangeStarts(numberOfSamples, 0.0);
+    for (vtkIdType line=begin; line<end; ++line)
+    {
+      vtkIdType firstOtherIndex = line % this->Dimensions[firstOtherAxis];
+      vtkIdType secondOtherIndex = line / this->Dimensions[firstOtherAxis];
+      double* linePtr = this->Distances + firstOtherIndex * increments[firstOtherAxis] + secondOtherIndex * increments[secondOtherAxis];
+
+      int numberOfParabolas = 0;
+      for (int q=0; q<numberOfSamples; ++q)
+      {
+        double value = linePtr[q * stride];
+        if (value >= vtkLabelmapSurfaceDistanceInfinity)
+        {
+          continue;
+        }
+        lineDistances[q] = value;
+        double position = q * this->Spacing;
+        double intersection = 0.0;
+        while (numberOfParabolas > 0)
+        {
+          int apex = apexes[numberOfParabolas-1];
+          double apexPosition = apex * this->Spacing;
+          intersection = ( (value + position * position) - (lineDistances[apex] + apexPosition * apexPosition) )
+            / (2.0 * (position - apexPosition));
+          if (intersection > rangeStarts[numberOfParabolas-1])
+          {
+            break;
+          }
+          --numberOfParabolas;
+        }
+        apexes[numberOfParabolas] = q;
+        rangeStarts[numberOfParabolas] = (numberOfParabolas > 0 ? intersection : -VTK_DOUBLE_MAX);
+        ++numberOfParabolas;
+      }
+      if (numberOfParabolas == 0)
+      {
+        // No finite distance on the line yet
+        continue;
+      }
+
+      int parabola = 0;
+      for (int q=0; q<numberOfSamples; ++q)
+      {
+        double position = q * this->Spacing;
+        while (parabola+1 < numberOfParabolas && rangeStarts[parabola+1] < position)
+        {
+          ++parabola;
+        }
+        // Offset from the apex in voxels first, so that the distances do not depend on the position of the line
+        double offset = (q - apexes[parabola]) * this->Spacing;
+        linePtr[q * stride] = offset * offset + lineDistances[apexes[parabola]];
+      }
+    }
+  }
+
+private:
+  double* Distances;
+  const int* Dimensions;
+  int Axis;
+  double Spacing;
+};
+
+//----------------------------------------------------------------------------
+// Reads the distance of each foreground voxel from the other labelmap, collecting the boundary distances
+// and face areas, the in-plane distances of the reference contours, the volume distances, and the histogram of each slice
+class vtkLabelmapSurfaceDistanceFunctor
+{
+public:
+  vtkLabelmapSurfaceDistanceFunctor(const unsigned char* labels, const int* dimensions,
+    const double* referenceDistances, const double* compareDistances, const double* compareInPlaneDistances,
+    const double* faceAreas, double histogramMinimum, double histogramSpacing, int numberOfHistogramBins,
+    std::vector<vtkLabelmapSurfaceDistanceSliceResult>& sliceResults)
+    : Labels(labels)
+    , Dimensions(dimensions)
+    , ReferenceDistances(referenceDistances)
+    , CompareDistances(compareDistances)
+    , CompareInPlaneDistances(compareInPlaneDistances)
+    , FaceAreas(faceAreas)
+    , HistogramMinimum(histogramMinimum)
+    , HistogramSpacing(histogramSpacing)
+    , NumberOfHistogramBins(numberOfHistogramBins)
+    , SliceResults(sliceResults)
+  {
+  }
+
+  void AddToHistogram(std::vector<int>& frequencies, double distance)
+  {
+    int bin = static_cast<int>(floor((distance - this->HistogramMinimum) / this->HistogramSpacing));
+    if (bin >= 0 && bin < this->NumberOfHistogramBins)
+    {
+      ++frequencies[bin];
+    }
+  }
+
+  /// A foreground voxel is on the boundary within its slice if any of its I or J face neighbors is background
+  /// or outside the domain. These voxels form the contours of the slice
+  bool IsInPlaneBoundary(vtkIdType index, unsigned char labelBit)
+  {
+    vtkIdType i = index % this->Dimensions[0];
+    vtkIdType j = (index / this->Dimensions[0]) % this->Dimensions[1];
+    return i == 0 || !(this->Labels[index-1] & labelBit)
+      || i == this->Dimensions[0]-1 || !(this->Labels[index+1] & labelBit)
+      || j == 0 || !(this->Labels[index-this->Dimensions[0]] & labelBit)
+      || j == this->Dimensions[1]-1 || !(this->Labels[index+this->Dimensions[0]] & labelBit);
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    vtkIdType sliceSize = static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1];
+    for (vtkIdType k=begin; k<end; ++k)
+    {
+      vtkLabelmapSurfaceDistanceSliceResult& result = this->SliceResults[k];
+      result.HistogramFrequencies.assign(this->NumberOfHistogramBins, 0);
+      for (vtkIdType index=k*sliceSize; index<(k+1)*sliceSize; ++index)
+      {
+        unsigned char label = this->Labels[index];
+        if (label & REFERENCE_LABEL)
+        {
+          double distance = sqrt(this->CompareDistances[index]);
+          ++result.NumberOfReferenceVoxels;
+          if (!(label & COMPARE_LABEL))
+          {
+            result.ReferenceVolumeDistanceSum += distance;
+            result.VolumeDistances.push_back(distance);
+          }
+          if (this->ReferenceDistances[index] == 0.0)
+          {
+            result.ReferenceBoundaryDistances.push_back(distance);
+            result.ReferenceBoundaryFaceAreas.push_back(vtkLabelmapSurfaceDistanceGetExposedFaceArea(
+              this->Labels, this->Dimensions, index, REFERENCE_LABEL, this->FaceAreas));
+            this->AddToHistogram(result.HistogramFrequencies, distance);
+            if (this->IsInPlaneBoundary(index, REFERENCE_LABEL))
+            {
+              double inPlaneSquaredDistance = this->CompareInPlaneDistances[index];
+              result.ReferenceInPlaneBoundaryDistances.push_back(inPlaneSquaredDistance >= vtkLabelmapSurfaceDistanceInfinity
+                ? VTK_DOUBLE_MAX : sqrt(inPlaneSquaredDistance));
+            }
+          }
+        }
+        if (label & COMPARE_LABEL)
+        {
+          double distance = sqrt(this->ReferenceDistances[index]);
+          ++result.NumberOfCompareVoxels;
+          if (!(label & REFERENCE_LABEL))
+          {
+            result.CompareVolumeDistanceSum += distance;
+            result.VolumeDistances.push_back(distance);
+          }
+          if (this->CompareDistances[index] == 0.0)
+          {
+            result.CompareBoundaryDistances.push_back(distance);
+            result.CompareBoundaryFaceAreas.push_back(vtkLabelmapSurfaceDistanceGetExposedFaceArea(
+              this->Labels, this->Dimensions, index, COMPARE_LABEL, this->FaceAreas));
+            this->AddToHistogram(result.HistogramFrequencies, distance);
+          }
+        }
+      }
+    }
+  }
+
+private:
+  const unsigned char* Labels;
+  const int* Dimensions;
+  const double* ReferenceDistances;
+  const double* CompareDistances;
+  const double* CompareInPlaneDistances;
+  const double* FaceAreas;
+  double HistogramMinimum;
+  double HistogramSpacing;
+  int NumberOfHistogramBins;
+  std::vector<vtkLabelmapSurfaceDistanceSliceResult>& SliceResults;
+};
+
+//----------------------------------------------------------------------------
+// Collects the boundary voxels of a labelmap slice by slice, whether they are on the contours of their slice,
+// and their exposed face areas
+class vtkLabelmapSurfaceDistanceBoundaryVoxelsFunctor
+{
+public:
+  vtkLabelmapSurfaceDistanceBoundaryVoxelsFunctor(const unsigned char* labels, const int* dimensions,
+    const double* faceAreas, std::vector<vtkLabelmapSurfaceDistanceBoundary>& sliceBoundaries)
+    : Labels(labels)
+    , Dimensions(dimensions)
+    , FaceAreas(faceAreas)
+    , SliceBoundaries(sliceBoundaries)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    vtkIdType increments[3] = { 1, this->Dimensions[0], static_cast<vtkIdType>(this->Dimensions[0]) * this->Dimensions[1] };
+    for (vtkIdType k=begin; k<end; ++k)
+    {
+      vtkLabelmapSurfaceDistanceBoundary& sliceBoundary = this->SliceBoundaries[k];
+      for (int j=0; j<this->Dimensions[1]; ++j)
+      {
+        vtkIdType index = k * increments[2] + j * increments[1];
+        for (int i=0; i<this->Dimensions[0]; ++i, ++index)
+        {
+          if (!this->Labels[index])
+          {
+            continue;
+          }
+          bool inPlane = ( i == 0 || !this->Labels[index-increments[0]]
+            || i == this->Dimensions[0]-1 || !this->Labels[index+increments[0]]
+            || j == 0 || !this->Labels[index-increments[1]]
+            || j == this->Dimensions[1]-1 || !this->Labels[index+increments[1]] );
+          if ( inPlane
+            || k == 0 || !this->Labels[index-increments[2]]
+            || k == this->Dimensions[2]-1 || !this->Labels[index+increments[2]] )
+          {
+            sliceBoundary.VoxelIndices.push_back(index);
+            sliceBoundary.InPlane.push_back(inPlane);
+            sliceBoundary.FaceAreas.push_back(vtkLabelmapSurfaceDistanceGetExposedFaceArea(
+              this->Labels, this->Dimensions, index, REFERENCE_LABEL, this->FaceAreas));
+          }
+        }
+      }
+    }
+  }
+
+private:
+  const unsigned char* Labels;
+  const int* Dimensions;
+  const double* FaceAreas;
+  std::vector<vtkLabelmapSurfaceDistanceBoundary>& SliceBoundaries;
+};
+
+//----------------------------------------------------------------------------
+// Reads the distances of the boundary voxels of a set of labelmaps from a squared distance transform.
+// The labelmaps are independent, so they are distributed among the threads
+class vtkLabelmapSurfaceDistanceDirectedStatisticsFunctor
+{
+public:
+  vtkLabelmapSurfaceDistanceDirectedStatisticsFunctor(const double* squaredDistances,
+    const std::vector<vtkLabelmapSurfaceDistanceBoundary>& boundaries, const std::vector<double>& tolerancesMm,
+    std::vector<vtkLabelmapSurfaceDistanceDirectedStatistics>& statistics)
+    : SquaredDistances(squaredDistances)
+    , Boundaries(boundaries)
+    , TolerancesMm(tolerancesMm)
+    , Statistics(statistics)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    size_t numberOfTolerances = this->TolerancesMm.size();
+    for (vtkIdType labelmapIndex=begin; labelmapIndex<end; ++labelmapIndex)
+    {
+      const vtkLabelmapSurfaceDistanceBoundary& boundary = this->Boundaries[labelmapIndex];
+      vtkLabelmapSurfaceDistanceDirectedStatistics& statistics = this->Statistics[labelmapIndex];
+      statistics = vtkLabelmapSurfaceDistanceDirectedStatistics();
+      statistics.FaceAreaWithinTolerance.assign(numberOfTolerances, 0.0);
+      statistics.NumberOfInPlaneVoxelsOutsideTolerance.assign(numberOfTolerances, 0);
+      for (size_t voxel=0; voxel<boundary.VoxelIndices.size(); ++voxel)
+      {
+        double distance = sqrt(this->SquaredDistances[boundary.VoxelIndices[voxel]]);
+        statistics.Maximum = std::max(statistics.Maximum, distance);
+        statistics.Sum += distance;
+        statistics.FaceArea += boundary.FaceAreas[voxel];
+        for (size_t toleranceIndex=0; toleranceIndex<numberOfTolerances; ++toleranceIndex)
+        {
+          if (distance <= this->TolerancesMm[toleranceIndex])
+          {
+            statistics.FaceAreaWithinTolerance[toleranceIndex] += boundary.FaceAreas[voxel];
+          }
+        }
+      }
+    }
+  }
+
+private:
+  const double* SquaredDistances;
+  const std::vector<vtkLabelmapSurfaceDistanceBoundary>& Boundaries;
+  const std::vector<double>& TolerancesMm;
+  std::vector<vtkLabelmapSurfaceDistanceDirectedStatistics>& Statistics;
+};
+
+//----------------------------------------------------------------------------
+// Counts the voxels on the contours of their slice of a set of labelmaps that are farther than the tolerances from
+// the contours of another labelmap in the same slice, read from the in-plane squared distance transform of those
+// contours. A voxel in a slice without contours of the other labelmap is outside all tolerances
+class vtkLabelmapSurfaceDistanceInPlaneStatisticsFunctor
+{
+public:
+  vtkLabelmapSurfaceDistanceInPlaneStatisticsFunctor(const double* inPlaneSquaredDistances,
+    const std::vector<vtkLabelmapSurfaceDistanceBoundary>& boundaries, const std::vector<double>& tolerancesMm,
+    std::vector<vtkLabelmapSurfaceDistanceDirectedStatistics>& statistics)
+    : InPlaneSquaredDistances(inPlaneSquaredDistances)
+    , Boundaries(boundaries)
+    , TolerancesMm(tolerancesMm)
+    , Statistics(statistics)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    size_t numberOfTolerances = this->TolerancesMm.size();
+    for (vtkIdType labelmapIndex=begin; labelmapIndex<end; ++labelmapIndex)
+    {
+      const vtkLabelmapSurfaceDistanceBoundary& boundary = this->Boundaries[labelmapIndex];
+      vtkLabelmapSurfaceDistanceDirectedStatistics& statistics = this->Statistics[labelmapIndex];
+      statistics.NumberOfInPlaneVoxelsOutsideTolerance.assign(numberOfTolerances, 0);
+      for (size_t voxel=0; voxel<boundary.VoxelIndices.size(); ++voxel)
+      {
+        if (!boundary.InPlane[voxel])
+        {
+          continue;
+        }
+        double squaredDistance = this->InPlaneSquaredDistances[boundary.VoxelIndices[voxel]];
+        double distance = (squaredDistance >= vtkLabelmapSurfaceDistanceInfinity ? VTK_DOUBLE_MAX : sqrt(squaredDistance));
+        for (size_t toleranceIndex=0; toleranceIndex<numberOfTolerances; ++toleranceIndex)
+        {
+          if (distance > this->TolerancesMm[toleranceIndex])
+          {
+            ++statistics.NumberOfInPlaneVoxelsOutsideTolerance[toleranceIndex];
+          }
+        }
+      }
+    }
+  }
+
+private:
+  const double* InPlaneSquaredDistances;
+  const std::vector<vtkLabelmapSurfaceDistanceBoundary>& Boundaries;
+  const std::vector<double>& TolerancesMm;
+  std::vector<vtkLabelmapSurfaceDistanceDirectedStatistics>& Statistics;
+};
+
+//----------------------------------------------------------------------------
+/// Get Nth percentile of a set of distances consisting of the given values and a number of zeros.
+/// Uses selection instead of sorting, the order of the values is changed
+static double vtkLabelmapSurfaceDistanceGetPercentile(std::vector<double>& values, vtkIdType numberOfZeros, double n)
+{
+  vtkIdType numberOfValues = numberOfZeros + static_cast<vtkIdType>(values.size());
+  if (numberOfValues == 0)
+  {
+    return 0.0;
+  }
+  vtkIdType nthPercentileIndex = static_cast<vtkIdType>(vtkMath::Round( (n / 100.0) * (numberOfValues - 1) ));
+  if (nthPercentileIndex < numberOfZeros)
+  {
+    return 0.0;
+  }
+  std::vector<double>::iterator nthPercentileIt = values.begin() + (nthPercentileIndex - numberOfZeros);
+  std::nth_element(values.begin(), nthPercentileIt, values.end());
+  return *nthPercentileIt;
+}
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkLabelmapSurfaceDistanceFilter);
+
+//----------------------------------------------------------------------------
+vtkLabelmapSurfaceDistanceFilter::vtkLabelmapSurfaceDistanceFilter()
+{
+  this->ReferenceLabelmap = NULL;
+  this->CompareLabelmap = NULL;
+
+  this->ReferenceBoundaryDistances = vtkDoubleArray::New();
+  this->ReferenceBoundaryDistances->SetName("ReferenceBoundaryDistances");
+  this->CompareBoundaryDistances = vtkDoubleArray::New();
+  this->CompareBoundaryDistances->SetName("CompareBoundaryDistances");
+  this->ReferenceBoundaryFaceAreas = vtkDoubleArray::New();
+  this->ReferenceBoundaryFaceAreas->SetName("ReferenceBoundaryFaceAreas");
+  this->CompareBoundaryFaceAreas = vtkDoubleArray::New();
+  this->CompareBoundaryFaceAreas->SetName("CompareBoundaryFaceAreas");
+  this->OutputHistogram = vtkTable::New();
+  this->SortedReferenceBoundaryDistances = vtkDoubleArray::New();
+  this->SortedCompareBoundaryDistances = vtkDoubleArray::New();
+  this->SortedReferenceBoundaryCumulativeFaceAreas = vtkDoubleArray::New();
+  this->SortedCompareBoundaryCumulativeFaceAreas = vtkDoubleArray::New();
+  this->SortedReferenceInPlaneBoundaryDistances = vtkDoubleArray::New();
+
+  this->MaximumHausdorffDistance = 0.0;
+  this->AverageHausdorffDistance = 0.0;
+  this->Percent95HausdorffDistance = 0.0;
+  this->MaximumHausdorffDistanceForVolume = 0.0;
+  this->AverageHausdorffDistanceForVolume = 0.0;
+  this->Percent95HausdorffDistanceForVolume = 0.0;
+  this->AverageSymmetricSurfaceDistance = 0.0;
+  this->InPlaneVoxelSizeMm = 0.0;
+
+  this->HistogramMinimum = 0.0;
+  this->HistogramMaximum = 20.0;
+  this->HistogramSpacing = 0.2;
+}
+
+//----------------------------------------------------------------------------
+vtkLabelmapSurfaceDistanceFilter::~vtkLabelmapSurfaceDistanceFilter()
+{
+  this->SetReferenceLabelmap(NULL);
+  this->SetCompareLabelmap(NULL);
+
+  if (this->ReferenceBoundaryDistances)
+  {
+    this->ReferenceBoundaryDistances->Delete();
+    this->ReferenceBoundaryDistances = NULL;
+  }
+  if (this->CompareBoundaryDistances)
+  {
+    this->CompareBoundaryDistances->Delete();
+    this->CompareBoundaryDistances = NULL;
+  }
+  if (this->ReferenceBoundaryFaceAreas)
+  {
+    this->ReferenceBoundaryFaceAreas->Delete();
+    this->ReferenceBoundaryFaceAreas = NULL;
+  }
+  if (this->CompareBoundaryFaceAreas)
+  {
+    this->CompareBoundaryFaceAreas->Delete();
+    this->CompareBoundaryFaceAreas = NULL;
+  }
+  if (this->OutputHistogram)
+  {
+    this->OutputHistogram->Delete();
+    this->OutputHistogram = NULL;
+  }
+  if (this->SortedReferenceBoundaryDistances)
+  {
+    this->SortedReferenceBoundaryDistances->Delete();
+    this->SortedReferenceBoundaryDistances = NULL;
+  }
+  if (this->SortedCompareBoundaryDistances)
+  {
+    this->SortedCompareBoundaryDistances->Delete();
+    this->SortedCompareBoundaryDistances = NULL;
+  }
+  if (this->SortedReferenceBoundaryCumulativeFaceAreas)
+  {
+    this->SortedReferenceBoundaryCumulativeFaceAreas->Delete();
+    this->SortedReferenceBoundaryCumulativeFaceAreas = NULL;
+  }
+  if (this->SortedCompareBoundaryCumulativeFaceAreas)
+  {
+    this->SortedCompareBoundaryCumulativeFaceAreas->Delete();
+    this->SortedCompareBoundaryCumulativeFaceAreas = NULL;
+  }
+  if (this->SortedReferenceInPlaneBoundaryDistances)
+  {
+    this->SortedReferenceInPlaneBoundaryDistances->Delete();
+    this->SortedReferenceInPlaneBoundaryDistances = NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapSurfaceDistanceFilter::SetReferenceLabelmap(vtkOrientedImageData* referenceLabelmap)
+{
+  if (this->ReferenceLabelmap == referenceLabelmap)
+  {
+    return;
+  }
+  if (this->ReferenceLabelmap)
+  {
+    this->ReferenceLabelmap->UnRegister(this);
+  }
+  this->ReferenceLabelmap = referenceLabelmap;
+  if (this->ReferenceLabelmap)
+  {
+    this->ReferenceLabelmap->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapSurfaceDistanceFilter::SetCompareLabelmap(vtkOrientedImageData* compareLabelmap)
+{
+  if (this->CompareLabelmap == compareLabelmap)
+  {
+    return;
+  }
+  if (this->CompareLabelmap)
+  {
+    this->CompareLabelmap->UnRegister(this);
+  }
+  this->CompareLabelmap = compareLabelmap;
+  if (this->CompareLabelmap)
+  {
+    this->CompareLabelmap->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapSurfaceDistanceFilter::GetNthPercentileHausdorffDistance(double n)
+{
+  if (n < 0)
+  {
+    vtkErrorMacro("GetNthPercentileHausdorffDistance: N " << n << " must be equal to or greater than 0. Returning 0.0.");
+    return 0.0;
+  }
+  if (n > 100)
+  {
+    vtkErrorMacro("GetNthPercentileHausdorffDistance: N " << n << " must be equal to or less than 100. Returning 0.0.");
+    return 0.0;
+  }
+
+  vtkIdType numberOfReferenceDistances = this->ReferenceBoundaryDistances->GetNumberOfValues();
+  vtkIdType numberOfCompareDistances = this->CompareBoundaryDistances->GetNumberOfValues();
+  std::vector<double> distances(numberOfReferenceDistances + numberOfCompareDistances);
+  std::copy(this->ReferenceBoundaryDistances->GetPointer(0), this->ReferenceBoundaryDistances->GetPointer(0) + numberOfReferenceDistances, distances.begin());
+  std::copy(this->CompareBoundaryDistances->GetPointer(0), this->CompareBoundaryDistances->GetPointer(0) + numberOfCompareDistances, distances.begin() + numberOfReferenceDistances);
+  return vtkLabelmapSurfaceDistanceGetPercentile(distances, 0, n);
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapSurfaceDistanceFilter::SortBoundaryDistances()
+{
+  vtkDoubleArray* distanceArrays[2] = { this->ReferenceBoundaryDistances, this->CompareBoundaryDistances };
+  vtkDoubleArray* faceAreaArrays[2] = { this->ReferenceBoundaryFaceAreas, this->CompareBoundaryFaceAreas };
+  vtkDoubleArray* sortedDistanceArrays[2] = { this->SortedReferenceBoundaryDistances, this->SortedCompareBoundaryDistances };
+  vtkDoubleArray* cumulativeFaceAreaArrays[2] = { this->SortedReferenceBoundaryCumulativeFaceAreas, this->SortedCompareBoundaryCumulativeFaceAreas };
+  for (int direction=0; direction<2; ++direction)
+  {
+    vtkIdType numberOfDistances = distanceArrays[direction]->GetNumberOfValues();
+    if (sortedDistanceArrays[direction]->GetNumberOfValues() == numberOfDistances)
+    {
+      continue;
+    }
+    // Sort the distances together with the face areas, then accumulate the areas in distance order
+    std::vector<std::pair<double, double> > distanceFaceAreas(numberOfDistances);
+    for (vtkIdType index=0; index<numberOfDistances; ++index)
+    {
+      distanceFaceAreas[index] = std::make_pair(distanceArrays[direction]->GetValue(index), faceAreaArrays[direction]->GetValue(index));
+    }
+    std::sort(distanceFaceAreas.begin(), distanceFaceAreas.end());
+    sortedDistanceArrays[direction]->SetNumberOfValues(numberOfDistances);
+    cumulativeFaceAreaArrays[direction]->SetNumberOfValues(numberOfDistances);
+    double faceAreaSum = 0.0;
+    for (vtkIdType index=0; index<numberOfDistances; ++index)
+    {
+      faceAreaSum += distanceFaceAreas[index].second;
+      sortedDistanceArrays[direction]->SetValue(index, distanceFaceAreas[index].first);
+      cumulativeFaceAreaArrays[direction]->SetValue(index, faceAreaSum);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapSurfaceDistanceFilter::GetSurfaceDice(double toleranceMm)
+{
+  this->SortBoundaryDistances();
+  vtkDoubleArray* sortedDistanceArrays[2] = { this->SortedReferenceBoundaryDistances, this->SortedCompareBoundaryDistances };
+  vtkDoubleArray* cumulativeFaceAreaArrays[2] = { this->SortedReferenceBoundaryCumulativeFaceAreas, this->SortedCompareBoundaryCumulativeFaceAreas };
+  double faceArea = 0.0;
+  double faceAreaWithinTolerance = 0.0;
+  for (int direction=0; direction<2; ++direction)
+  {
+    vtkIdType numberOfDistances = sortedDistanceArrays[direction]->GetNumberOfValues();
+    if (numberOfDistances == 0)
+    {
+      continue;
+    }
+    double* distancesPtr = sortedDistanceArrays[direction]->GetPointer(0);
+    vtkIdType numberOfDistancesWithinTolerance = std::upper_bound(distancesPtr, distancesPtr + numberOfDistances, toleranceMm) - distancesPtr;
+    faceArea += cumulativeFaceAreaArrays[direction]->GetValue(numberOfDistances - 1);
+    if (numberOfDistancesWithinTolerance > 0)
+    {
+      faceAreaWithinTolerance += cumulativeFaceAreaArrays[direction]->GetValue(numberOfDistancesWithinTolerance - 1);
+    }
+  }
+  if (faceArea == 0.0)
+  {
+    return 0.0;
+  }
+  return faceAreaWithinTolerance / faceArea;
+}
+
+//----------------------------------------------------------------------------
+double vtkLabelmapSurfaceDistanceFilter::GetAddedPathLengthMm(double toleranceMm)
+{
+  vtkIdType numberOfReferenceDistances = this->SortedReferenceInPlaneBoundaryDistances->GetNumberOfValues();
+  if (numberOfReferenceDistances == 0)
+  {
+    return 0.0;
+  }
+  double* referenceDistancesPtr = this->SortedReferenceInPlaneBoundaryDistances->GetPointer(0);
+  vtkIdType numberOfReferenceDistancesOutsideTolerance = referenceDistancesPtr + numberOfReferenceDistances
+    - std::upper_bound(referenceDistancesPtr, referenceDistancesPtr + numberOfReferenceDistances, toleranceMm);
+  return numberOfReferenceDistancesOutsideTolerance * this->InPlaneVoxelSizeMm;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLabelmapSurfaceDistanceFilter::Update()
+{
+  this->ReferenceBoundaryDistances->Initialize();
+  this->CompareBoundaryDistances->Initialize();
+  this->ReferenceBoundaryFaceAreas->Initialize();
+  this->CompareBoundaryFaceAreas->Initialize();
+  this->SortedReferenceBoundaryDistances->Initialize();
+  this->SortedCompareBoundaryDistances->Initialize();
+  this->SortedReferenceBoundaryCumulativeFaceAreas->Initialize();
+  this->SortedCompareBoundaryCumulativeFaceAreas->Initialize();
+  this->SortedReferenceInPlaneBoundaryDistances->Initialize();
+  this->OutputHistogram->Initialize();
+  this->MaximumHausdorffDistance = 0.0;
+  this->AverageHausdorffDistance = 0.0;
+  this->Percent95HausdorffDistance = 0.0;
+  this->MaximumHausdorffDistanceForVolume = 0.0;
+  this->AverageHausdorffDistanceForVolume = 0.0;
+  this->Percent95HausdorffDistanceForVolume = 0.0;
+  this->AverageSymmetricSurfaceDistance = 0.0;
+  this->InPlaneVoxelSizeMm = 0.0;
+
+  if (!this->ReferenceLabelmap || !this->CompareLabelmap)
+  {
+    vtkErrorMacro("Update: Reference and compare labelmaps need to be set");
+    return false;
+  }
+  if ( this->ReferenceLabelmap->GetNumberOfScalarComponents() != 1
+    || this->CompareLabelmap->GetNumberOfScalarComponents() != 1 )
+  {
+    vtkErrorMacro("Update: Labelmaps need to have a single scalar component");
+    return false;
+  }
+  if (this->HistogramSpacing <= 0.0)
+  {
+    vtkErrorMacro("Update: Histogram spacing needs to be positive");
+    return false;
+  }
+
+  // Create the histogram bins
+  int histogramBinExtent = std::max(0, vtkMath::Ceil((this->HistogramMaximum - this->HistogramMinimum) / this->HistogramSpacing));
+  int numberOfHistogramBins = histogramBinExtent + 1;
+  vtkSmartPointer<vtkDoubleArray> bins = vtkSmartPointer<vtkDoubleArray>::New();
+  bins->SetName("Bins");
+  bins->SetNumberOfValues(numberOfHistogramBins);
+  vtkSmartPointer<vtkIntArray> frequencies = vtkSmartPointer<vtkIntArray>::New();
+  frequencies->SetName("Frequencies");
+  frequencies->SetNumberOfValues(numberOfHistogramBins);
+  for (int bin=0; bin<numberOfHistogramBins; ++bin)
+  {
+    bins->SetValue(bin, this->HistogramMinimum + bin * this->HistogramSpacing);
+    frequencies->SetValue(bin, 0);
+  }
+  this->OutputHistogram->AddColumn(bins);
+  this->OutputHistogram->AddColumn(frequencies);
+
+  // Use the compare labelmap buffer directly if it is on the reference lattice, otherwise resample it
+  vtkSmartPointer<vtkImageData> compareImage = this->CompareLabelmap;
+  if (!vtkOrientedImageDataResample::DoGeometriesMatch(this->ReferenceLabelmap, this->CompareLabelmap))
+  {
+    vtkSmartPointer<vtkOrientedImageData> resampledCompareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+      this->CompareLabelmap, this->ReferenceLabelmap, resampledCompareLabelmap, false, true) )
+    {
+      vtkErrorMacro("Update: Failed to resample compare labelmap to reference geometry");
+      return false;
+    }
+    compareImage = resampledCompareLabelmap.GetPointer();
+  }
+
+  // The computation domain is the bounding box of the foreground of the labelmaps. It contains all the
+  // boundary voxels, so the distance transform computed within the domain is exact for the voxels of interest
+  int referenceExtent[6] = {0, -1, 0, -1, 0, -1};
+  switch (this->ReferenceLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(vtkLabelmapSurfaceDistanceComputeExtent(this->ReferenceLabelmap, referenceExtent, static_cast<VTK_TT*>(NULL)));
+  default:
+    vtkErrorMacro("Update: Unsupported reference labelmap scalar type");
+    return false;
+  }
+  int compareExtent[6] = {0, -1, 0, -1, 0, -1};
+  switch (compareImage->GetScalarType())
+  {
+    vtkTemplateMacro(vtkLabelmapSurfaceDistanceComputeExtent(compareImage.GetPointer(), compareExtent, static_cast<VTK_TT*>(NULL)));
+  default:
+    vtkErrorMacro("Update: Unsupported compare labelmap scalar type");
+    return false;
+  }
+  if (referenceExtent[0] > referenceExtent[1] || compareExtent[0] > compareExtent[1])
+  {
+    // Distances are undefined if there is no boundary in one of the labelmaps
+    return true;
+  }
+  int domainExtent[6] = {0, -1, 0, -1, 0, -1};
+  int dimensions[3] = {0, 0, 0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    domainExtent[2*axis] = std::min(referenceExtent[2*axis], compareExtent[2*axis]);
+    domainExtent[2*axis+1] = std::max(referenceExtent[2*axis+1], compareExtent[2*axis+1]);
+    dimensions[axis] = domainExtent[2*axis+1] - domainExtent[2*axis] + 1;
+  }
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(dimensions[0]) * dimensions[1] * dimensions[2];
+
+  // Combine the foreground of the labelmaps into one label buffer
+  std::vector<unsigned char> labels(numberOfVoxels, 0);
+  switch (this->ReferenceLabelmap->GetScalarType())
+  {
+    vtkTemplateMacro(vtkLabelmapSurfaceDistanceComputeLabels(this->ReferenceLabelmap, domainExtent, &labels[0], REFERENCE_LABEL, static_cast<VTK_TT*>(NULL)));
+  }
+  switch (compareImage->GetScalarType())
+  {
+    vtkTemplateMacro(vtkLabelmapSurfaceDistanceComputeLabels(compareImage.GetPointer(), domainExtent, &labels[0], COMPARE_LABEL, static_cast<VTK_TT*>(NULL)));
+  }
+
+  // Compute the squared distance transform of the boundary of both labelmaps, one axis at a time, and the in-plane
+  // squared distance transform of the contours of the compare labelmap in each slice (only the I and J passes)
+  std::vector<double> referenceDistances(numberOfVoxels);
+  std::vector<double> compareDistances(numberOfVoxels);
+  std::vector<double> compareInPlaneDistances(numberOfVoxels);
+  vtkLabelmapSurfaceDistanceBoundaryFunctor boundaryFunctor(&labels[0], dimensions,
+    &referenceDistances[0], &compareDistances[0], &compareInPlaneDistances[0]);
+  vtkSMPTools::For(0, dimensions[2], boundaryFunctor);
+  double spacing[3] = {1.0, 1.0, 1.0};
+  this->ReferenceLabelmap->GetSpacing(spacing);
+  this->InPlaneVoxelSizeMm = 0.5 * (fabs(spacing[0]) + fabs(spacing[1]));
+  for (int axis=0; axis<3; ++axis)
+  {
+    vtkIdType numberOfLines = numberOfVoxels / dimensions[axis];
+    vtkLabelmapSurfaceDistanceTransformFunctor referenceTransformFunctor(&referenceDistances[0], dimensions, axis, fabs(spacing[axis]));
+    vtkSMPTools::For(0, numberOfLines, referenceTransformFunctor);
+    vtkLabelmapSurfaceDistanceTransformFunctor compareTransformFunctor(&compareDistances[0], dimensions, axis, fabs(spacing[axis]));
+    vtkSMPTools::For(0, numberOfLines, compareTransformFunctor);
+    if (axis < 2)
+    {
+      vtkLabelmapSurfaceDistanceTransformFunctor compareInPlaneTransformFunctor(&compareInPlaneDistances[0], dimensions, axis, fabs(spacing[axis]));
+      vtkSMPTools::For(0, numberOfLines, compareInPlaneTransformFunctor);
+    }
+  }
+
+  // Collect the distances of both directions and the histogram in one pass
+  double faceAreas[3] = { fabs(spacing[1] * spacing[2]), fabs(spacing[0] * spacing[2]), fabs(spacing[0] * spacing[1]) };
+  std::vector<vtkLabelmapSurfaceDistanceSliceResult> sliceResults(dimensions[2]);
+  vtkLabelmapSurfaceDistanceFunctor distanceFunctor(&labels[0], dimensions, &referenceDistances[0], &compareDistances[0],
+    &compareInPlaneDistances[0], faceAreas, this->HistogramMinimum, this->HistogramSpacing, numberOfHistogramBins, sliceResults);
+  vtkSMPTools::For(0, dimensions[2], distanceFunctor);
+
+  // Merge the slice results in slice order so that the output does not depend on the number of threads
+  vtkIdType numberOfReferenceBoundaryVoxels = 0;
+  vtkIdType numberOfCompareBoundaryVoxels = 0;
+  vtkIdType numberOfReferenceInPlaneBoundaryVoxels = 0;
+  vtkIdType numberOfReferenceVoxels = 0;
+  vtkIdType numberOfCompareVoxels = 0;
+  vtkIdType numberOfVolumeDistances = 0;
+  double referenceVolumeDistanceSum = 0.0;
+  double compareVolumeDistanceSum = 0.0;
+  std::vector<vtkLabelmapSurfaceDistanceSliceResult>::iterator resultIt;
+  for (resultIt = sliceResults.begin(); resultIt != sliceResults.end(); ++resultIt)
+  {
+    numberOfReferenceBoundaryVoxels += static_cast<vtkIdType>(resultIt->ReferenceBoundaryDistances.size());
+    numberOfCompareBoundaryVoxels += static_cast<vtkIdType>(resultIt->CompareBoundaryDistances.size());
+    numberOfReferenceInPlaneBoundaryVoxels += static_cast<vtkIdType>(resultIt->ReferenceInPlaneBoundaryDistances.size());
+    numberOfReferenceVoxels += resultIt->NumberOfReferenceVoxels;
+    numberOfCompareVoxels += resultIt->NumberOfCompareVoxels;
+    numberOfVolumeDistances += static_cast<vtkIdType>(resultIt->VolumeDistances.size());
+    referenceVolumeDistanceSum += resultIt->ReferenceVolumeDistanceSum;
+    compareVolumeDistanceSum += resultIt->CompareVolumeDistanceSum;
+    for (int bin=0; bin<numberOfHistogramBins; ++bin)
+    {
+      frequencies->SetValue(bin, frequencies->GetValue(bin) + resultIt->HistogramFrequencies[bin]);
+    }
+  }
+
+  this->ReferenceBoundaryDistances->SetNumberOfValues(numberOfReferenceBoundaryVoxels);
+  this->CompareBoundaryDistances->SetNumberOfValues(numberOfCompareBoundaryVoxels);
+  this->ReferenceBoundaryFaceAreas->SetNumberOfValues(numberOfReferenceBoundaryVoxels);
+  this->CompareBoundaryFaceAreas->SetNumberOfValues(numberOfCompareBoundaryVoxels);
+  this->SortedReferenceInPlaneBoundaryDistances->SetNumberOfValues(numberOfReferenceInPlaneBoundaryVoxels);
+  std::vector<double> boundaryDistances;
+  boundaryDistances.reserve(numberOfReferenceBoundaryVoxels + numberOfCompareBoundaryVoxels);
+  std::vector<double> volumeDistances;
+  volumeDistances.reserve(numberOfVolumeDistances);
+  double* referenceBoundaryDistancePtr = this->ReferenceBoundaryDistances->GetPointer(0);
+  double* compareBoundaryDistancePtr = this->CompareBoundaryDistances->GetPointer(0);
+  double* referenceBoundaryFaceAreaPtr = this->ReferenceBoundaryFaceAreas->GetPointer(0);
+  double* compareBoundaryFaceAreaPtr = this->CompareBoundaryFaceAreas->GetPointer(0);
+  double* referenceInPlaneBoundaryDistancePtr = this->SortedReferenceInPlaneBoundaryDistances->GetPointer(0);
+  for (resultIt = sliceResults.begin(); resultIt != sliceResults.end(); ++resultIt)
+  {
+    referenceBoundaryDistancePtr = std::copy(resultIt->ReferenceBoundaryDistances.begin(), resultIt->ReferenceBoundaryDistances.end(), referenceBoundaryDistancePtr);
+    compareBoundaryDistancePtr = std::copy(resultIt->CompareBoundaryDistances.begin(), resultIt->CompareBoundaryDistances.end(), compareBoundaryDistancePtr);
+    referenceBoundaryFaceAreaPtr = std::copy(resultIt->ReferenceBoundaryFaceAreas.begin(), resultIt->ReferenceBoundaryFaceAreas.end(), referenceBoundaryFaceAreaPtr);
+    compareBoundaryFaceAreaPtr = std::copy(resultIt->CompareBoundaryFaceAreas.begin(), resultIt->CompareBoundaryFaceAreas.end(), compareBoundaryFaceAreaPtr);
+    referenceInPlaneBoundaryDistancePtr = std::copy(resultIt->ReferenceInPlaneBoundaryDistances.begin(),
+      resultIt->ReferenceInPlaneBoundaryDistances.end(), referenceInPlaneBoundaryDistancePtr);
+    volumeDistances.insert(volumeDistances.end(), resultIt->VolumeDistances.begin(), resultIt->VolumeDistances.end());
+    // Release the slice result memory as soon as it is merged
+    std::vector<double>().swap(resultIt->VolumeDistances);
+  }
+  // Only the added path length uses the in-plane boundary distances, so they are not kept in voxel order
+  std::sort(this->SortedReferenceInPlaneBoundaryDistances->GetPointer(0),
+    this->SortedReferenceInPlaneBoundaryDistances->GetPointer(0) + numberOfReferenceInPlaneBoundaryVoxels);
+  boundaryDistances.insert(boundaryDistances.end(), this->ReferenceBoundaryDistances->GetPointer(0),
+    this->ReferenceBoundaryDistances->GetPointer(0) + numberOfReferenceBoundaryVoxels);
+  boundaryDistances.insert(boundaryDistances.end(), this->CompareBoundaryDistances->GetPointer(0),
+    this->CompareBoundaryDistances->GetPointer(0) + numberOfCompareBoundaryVoxels);
+
+  // Boundary statistics
+  double referenceBoundaryDistanceSum = 0.0;
+  for (vtkIdType index=0; index<numberOfReferenceBoundaryVoxels; ++index)
+  {
+    referenceBoundaryDistanceSum += boundaryDistances[index];
+  }
+  double compareBoundaryDistanceSum = 0.0;
+  for (vtkIdType index=numberOfReferenceBoundaryVoxels; index<numberOfReferenceBoundaryVoxels+numberOfCompareBoundaryVoxels; ++index)
+  {
+    compareBoundaryDistanceSum += boundaryDistances[index];
+  }
+  this->MaximumHausdorffDistance = *std::max_element(boundaryDistances.begin(), boundaryDistances.end());
+  this->AverageHausdorffDistance = 0.5 * ( referenceBoundaryDistanceSum / numberOfReferenceBoundaryVoxels
+    + compareBoundaryDistanceSum / numberOfCompareBoundaryVoxels );
+  this->AverageSymmetricSurfaceDistance = (referenceBoundaryDistanceSum + compareBoundaryDistanceSum)
+    / (numberOfReferenceBoundaryVoxels + numberOfCompareBoundaryVoxels);
+  this->Percent95HausdorffDistance = vtkLabelmapSurfaceDistanceGetPercentile(boundaryDistances, 0, 95.0);
+
+  // Volume statistics (the voxels that are inside the other labelmap have zero distance)
+  this->MaximumHausdorffDistanceForVolume = (volumeDistances.empty() ? 0.0 : *std::max_element(volumeDistances.begin(), volumeDistances.end()));
+  this->AverageHausdorffDistanceForVolume = 0.5 * ( referenceVolumeDistanceSum / numberOfReferenceVoxels
+    + compareVolumeDistanceSum / numberOfCompareVoxels );
+  this->Percent95HausdorffDistanceForVolume = vtkLabelmapSurfaceDistanceGetPercentile(volumeDistances,
+    numberOfReferenceVoxels + numberOfCompareVoxels - numberOfVolumeDistances, 95.0);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkLabelmapSurfaceDistanceFilter::ComputePairwiseStatistics(
+  const std::vector<vtkSmartPointer<vtkOrientedImageData> >& referenceLabelmaps,
+  const std::vector<vtkSmartPointer<vtkOrientedImageData> >& compareLabelmaps, vtkDoubleArray* tolerancesMm,
+  vtkDoubleArray* pairStatistics)
+{
+  if (!pairStatistics)
+  {
+    vtkErrorMacro("ComputePairwiseStatistics: Invalid output array");
+    return false;
+  }
+  std::vector<double> tolerances;
+  for (vtkIdType toleranceIndex=0; tolerancesMm && toleranceIndex<tolerancesMm->GetNumberOfValues(); ++toleranceIndex)
+  {
+    tolerances.push_back(tolerancesMm->GetValue(toleranceIndex));
+  }
+  size_t numberOfTolerances = tolerances.size();
+  size_t numberOfReferenceLabelmaps = referenceLabelmaps.size();
+  size_t numberOfCompareLabelmaps = compareLabelmaps.size();
+  size_t numberOfPairs = numberOfReferenceLabelmaps * numberOfCompareLabelmaps;
+  pairStatistics->Initialize();
+  pairStatistics->SetNumberOfComponents(static_cast<int>(2 + 2 * numberOfTolerances));
+  pairStatistics->SetNumberOfTuples(static_cast<vtkIdType>(numberOfPairs));
+  pairStatistics->Fill(vtkMath::Nan());
+  if (numberOfPairs == 0)
+  {
+    return true;
+  }
+
+  // All labelmaps need to be on the lattice of the first one
+  std::vector<vtkOrientedImageData*> labelmaps;
+  labelmaps.insert(labelmaps.end(), referenceLabelmaps.begin(), referenceLabelmaps.end());
+  labelmaps.insert(labelmaps.end(), compareLabelmaps.begin(), compareLabelmaps.end());
+  vtkOrientedImageData* sharedGeometryLabelmap = labelmaps[0];
+  int extent[6] = {0, -1, 0, -1, 0, -1};
+  if (sharedGeometryLabelmap)
+  {
+    sharedGeometryLabelmap->GetExtent(extent);
+  }
+  for (std::vector<vtkOrientedImageData*>::iterator labelmapIt=labelmaps.begin(); labelmapIt!=labelmaps.end(); ++labelmapIt)
+  {
+    if ( !(*labelmapIt) || (*labelmapIt)->GetNumberOfScalarComponents() != 1
+      || !std::equal(extent, extent+6, (*labelmapIt)->GetExtent())
+      || !vtkOrientedImageDataResample::DoGeometriesMatch(sharedGeometryLabelmap, *labelmapIt) )
+    {
+      vtkErrorMacro("ComputePairwiseStatistics: Labelmaps need to have a single scalar component and the same geometry");
+      return false;
+    }
+  }
+  int dimensions[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+  if (dimensions[0] < 1 || dimensions[1] < 1 || dimensions[2] < 1)
+  {
+    // All labelmaps are empty
+    return true;
+  }
+  vtkIdType numberOfVoxels = static_cast<vtkIdType>(dimensions[0]) * dimensions[1] * dimensions[2];
+
+  // Collect the boundary voxels of each labelmap
+  double spacing[3] = {1.0, 1.0, 1.0};
+  sharedGeometryLabelmap->GetSpacing(spacing);
+  double faceAreas[3] = { fabs(spacing[1] * spacing[2]), fabs(spacing[0] * spacing[2]), fabs(spacing[0] * spacing[1]) };
+  std::vector<vtkLabelmapSurfaceDistanceBoundary> referenceBoundaries(numberOfReferenceLabelmaps);
+  std::vector<vtkLabelmapSurfaceDistanceBoundary> compareBoundaries(numberOfCompareLabelmaps);
+  std::vector<unsigned char> labels(numberOfVoxels);
+  for (size_t labelmapIndex=0; labelmapIndex<labelmaps.size(); ++labelmapIndex)
+  {
+    std::fill(labels.begin(), labels.end(), 0);
+    switch (labelmaps[labelmapIndex]->GetScalarType())
+    {
+      vtkTemplateMacro(vtkLabelmapSurfaceDistanceComputeLabels(labelmaps[labelmapIndex], extent, &labels[0], REFERENCE_LABEL, static_cast<VTK_TT*>(NULL)));
+    default:
+      vtkErrorMacro("ComputePairwiseStatistics: Unsupported labelmap scalar type");
+      return false;
+    }
+    std::vector<vtkLabelmapSurfaceDistanceBoundary> sliceBoundaries(dimensions[2]);
+    vtkLabelmapSurfaceDistanceBoundaryVoxelsFunctor boundaryVoxelsFunctor(&labels[0], dimensions, faceAreas, sliceBoundaries);
+    vtkSMPTools::For(0, dimensions[2], boundaryVoxelsFunctor);
+    vtkLabelmapSurfaceDistanceBoundary& boundary = (labelmapIndex < numberOfReferenceLabelmaps ?
+      referenceBoundaries[labelmapIndex] : compareBoundaries[labelmapIndex - numberOfReferenceLabelmaps]);
+    for (std::vector<vtkLabelmapSurfaceDistanceBoundary>::iterator sliceIt=sliceBoundaries.begin(); sliceIt!=sliceBoundaries.end(); ++sliceIt)
+    {
+      boundary.VoxelIndices.insert(boundary.VoxelIndices.end(), sliceIt->VoxelIndices.begin(), sliceIt->VoxelIndices.end());
+      boundary.InPlane.insert(boundary.InPlane.end(), sliceIt->InPlane.begin(), sliceIt->InPlane.end());
+      boundary.FaceAreas.insert(boundary.FaceAreas.end(), sliceIt->FaceAreas.begin(), sliceIt->FaceAreas.end());
+    }
+  }
+  std::vector<unsigned char>().swap(labels);
+
+  // Compute the distance transform of the boundary of each labelmap once, and read the distances of the boundary voxels
+  // of all labelmaps of the other set from it
+  std::vector<double> squaredDistances(numberOfVoxels);
+  // Statistics of the reference boundaries from the compare boundaries and vice versa, by pair index
+  std::vector<vtkLabelmapSurfaceDistanceDirectedStatistics> referenceStatistics(numberOfPairs);
+  std::vector<vtkLabelmapSurfaceDistanceDirectedStatistics> compareStatistics(numberOfPairs);
+  for (int direction=0; direction<2; ++direction)
+  {
+    // The distance transform is computed from the labelmaps of one set, the distances are read for the labelmaps of the other set
+    const std::vector<vtkLabelmapSurfaceDistanceBoundary>& sourceBoundaries = (direction == 0 ? referenceBoundaries : compareBoundaries);
+    const std::vector<vtkLabelmapSurfaceDistanceBoundary>& targetBoundaries = (direction == 0 ? compareBoundaries : referenceBoundaries);
+    for (size_t sourceIndex=0; sourceIndex<sourceBoundaries.size(); ++sourceIndex)
+    {
+      const std::vector<vtkIdType>& sourceVoxelIndices = sourceBoundaries[sourceIndex].VoxelIndices;
+      if (sourceVoxelIndices.empty())
+      {
+        continue;
+      }
+      std::fill(squaredDistances.begin(), squaredDistances.end(), vtkLabelmapSurfaceDistanceInfinity);
+      for (std::vector<vtkIdType>::const_iterator voxelIt=sourceVoxelIndices.begin(); voxelIt!=sourceVoxelIndices.end(); ++voxelIt)
+      {
+        squaredDistances[*voxelIt] = 0.0;
+      }
+      for (int axis=0; axis<3; ++axis)
+      {
+        vtkLabelmapSurfaceDistanceTransformFunctor transformFunctor(&squaredDistances[0], dimensions, axis, fabs(spacing[axis]));
+        vtkSMPTools::For(0, numberOfVoxels / dimensions[axis], transformFunctor);
+      }
+
+      std::vector<vtkLabelmapSurfaceDistanceDirectedStatistics> targetStatistics(targetBoundaries.size());
+      vtkLabelmapSurfaceDistanceDirectedStatisticsFunctor statisticsFunctor(&squaredDistances[0], targetBoundaries, tolerances, targetStatistics);
+      vtkSMPTools::For(0, static_cast<vtkIdType>(targetBoundaries.size()), statisticsFunctor);
+
+      if (direction == 1)
+      {
+        // The added path length of the reference labelmaps is read from the in-plane distance transform of the
+        // contours of the compare labelmap in each slice, computed in the same buffer
+        std::fill(squaredDistances.begin(), squaredDistances.end(), vtkLabelmapSurfaceDistanceInfinity);
+        for (size_t voxel=0; voxel<sourceVoxelIndices.size(); ++voxel)
+        {
+          if (sourceBoundaries[sourceIndex].InPlane[voxel])
+          {
+            squaredDistances[sourceVoxelIndices[voxel]] = 0.0;
+          }
+        }
+        for (int axis=0; axis<2; ++axis)
+        {
+          vtkLabelmapSurfaceDistanceTransformFunctor inPlaneTransformFunctor(&squaredDistances[0], dimensions, axis, fabs(spacing[axis]));
+          vtkSMPTools::For(0, numberOfVoxels / dimensions[axis], inPlaneTransformFunctor);
+        }
+        vtkLabelmapSurfaceDistanceInPlaneStatisticsFunctor inPlaneStatisticsFunctor(&squaredDistances[0], targetBoundaries, tolerances, targetStatistics);
+        vtkSMPTools::For(0, static_cast<vtkIdType>(targetBoundaries.size()), inPlaneStatisticsFunctor);
+      }
+      for (size_t targetIndex=0; targetIndex<targetBoundaries.size(); ++targetIndex)
+      {
+        if (direction == 0)
+        {
+          compareStatistics[sourceIndex * numberOfCompareLabelmaps + targetIndex] = targetStatistics[targetIndex];
+        }
+        else
+        {
+          referenceStatistics[targetIndex * numberOfCompareLabelmaps + sourceIndex] = targetStatistics[targetIndex];
+        }
+      }
+    }
+  }
+
+  // Combine the two directions of each pair (\sa GetSurfaceDice, GetAddedPathLengthMm)
+  double inPlaneVoxelSizeMm = 0.5 * (fabs(spacing[0]) + fabs(spacing[1]));
+  std::vector<double> values(pairStatistics->GetNumberOfComponents());
+  for (size_t referenceIndex=0; referenceIndex<numberOfReferenceLabelmaps; ++referenceIndex)
+  {
+    for (size_t compareIndex=0; compareIndex<numberOfCompareLabelmaps; ++compareIndex)
+    {
+      vtkIdType numberOfReferenceBoundaryVoxels = static_cast<vtkIdType>(referenceBoundaries[referenceIndex].VoxelIndices.size());
+      vtkIdType numberOfCompareBoundaryVoxels = static_cast<vtkIdType>(compareBoundaries[compareIndex].VoxelIndices.size());
+      if (numberOfReferenceBoundaryVoxels == 0 || numberOfCompareBoundaryVoxels == 0)
+      {
+        // Distances are undefined if there is no boundary in one of the labelmaps
+        continue;
+      }
+      size_t pairIndex = referenceIndex * numberOfCompareLabelmaps + compareIndex;
+      const vtkLabelmapSurfaceDistanceDirectedStatistics& referenceToCompare = referenceStatistics[pairIndex];
+      const vtkLabelmapSurfaceDistanceDirectedStatistics& compareToReference = compareStatistics[pairIndex];
+      double numberOfBoundaryVoxels = static_cast<double>(numberOfReferenceBoundaryVoxels + numberOfCompareBoundaryVoxels);
+      double faceArea = referenceToCompare.FaceArea + compareToReference.FaceArea;
+      std::vector<double>::iterator valueIt = values.begin();
+      *(valueIt++) = std::max(referenceToCompare.Maximum, compareToReference.Maximum);
+      *(valueIt++) = (referenceToCompare.Sum + compareToReference.Sum) / numberOfBoundaryVoxels;
+      for (size_t toleranceIndex=0; toleranceIndex<numberOfTolerances; ++toleranceIndex)
+      {
+        *(valueIt++) = ( referenceToCompare.FaceAreaWithinTolerance[toleranceIndex]
+          + compareToReference.FaceAreaWithinTolerance[toleranceIndex] ) / faceArea;
+        *(valueIt++) = referenceToCompare.NumberOfInPlaneVoxelsOutsideTolerance[toleranceIndex] * inPlaneVoxelSizeMm;
+      }
+      pairStatistics->SetTuple(static_cast<vtkIdType>(pairIndex), &values[0]);
+    }
+  }
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkLabelmapSurfaceDistanceFilter::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os,indent);
+  os << indent << "ReferenceLabelmap: " << this->ReferenceLabelmap << "\n";
+  os << indent << "CompareLabelmap: " << this->CompareLabelmap << "\n";
+  os << indent << "NumberOfReferenceBoundaryDistances: " << this->ReferenceBoundaryDistances->GetNumberOfValues() << "\n";
+  os << indent << "NumberOfCompareBoundaryDistances: " << this->CompareBoundaryDistances->GetNumberOfValues() << "\n";
+  os << indent << "MaximumHausdorffDistance: " << this->MaximumHausdorffDistance << "\n";
+  os << indent << "AverageHausdorffDistance: " << this->AverageHausdorffDistance << "\n";
+  os << indent << "Percent95HausdorffDistance: " << this->Percent95HausdorffDistance << "\n";
+  os << indent << "MaximumHausdorffDistanceForVolume: " << this->MaximumHausdorffDistanceForVolume << "\n";
+  os << indent << "AverageHausdorffDistanceForVolume: " << this->AverageHausdorffDistanceForVolume << "\n";
+  os << indent << "Percent95HausdorffDistanceForVolume: " << this->Percent95HausdorffDistanceForVolume << "\n";
+  os << indent << "AverageSymmetricSurfaceDistance: " << this->AverageSymmetricSurfaceDistance << "\n";
+  os << indent << "HistogramMinimum: " << this->HistogramMinimum << "\n";
+  os << indent << "HistogramMaximum: " << this->HistogramMaximum << "\n";
+  os << indent << "HistogramSpacing: " << this->HistogramSpacing << "\n";
+}
@@ -0,0 +1,221 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkLabelmapSurfaceDistanceFilter_h
+#define __vtkLabelmapSurfaceDistanceFilter_h
+
+#include "vtkSlicerSegmentComparisonModuleLogicExport.h"
+
+// VTK includes
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+class vtkDoubleArray;
+class vtkOrientedImageData;
+class vtkTable;
+
+/// \ingroup SlicerRt_QtModules_SegmentComparison
+/// \brief Compute Hausdorff and surface distances of two binary labelmaps using Euclidean distance transforms
+///
+/// The boundary of a labelmap consists of its foreground voxels that have at least one background face neighbor
+/// (voxels outside the extent are background). The exact Euclidean distance transform of the boundary of both
+/// labelmaps is computed in linear time (separable lower envelope of parabolas by Felzenszwalb and Huttenlocher,
+/// each axis pass processed in parallel using vtkSMPTools), then a single parallel pass over the voxels reads
+/// the distance of every boundary voxel from the boundary of the other labelmap. The directed distances, the
+/// Hausdorff statistics, and the histogram are all computed in that pass. Distances are measured between voxel
+/// centers in mm. Non-zero voxels are considered foreground. If the compare labelmap is not on the lattice of
+/// the reference labelmap, then it is resampled (nearest neighbor) to the reference geometry first.
+///
+/// The statistics follow the definitions of Plastimatch: the maximum is taken over both directions, the average
+/// is the mean of the two directed averages, and the percentiles are computed from the distances of both directions.
+/// The volume statistics use the distance of every foreground voxel from the other labelmap (zero if inside it).
+///
+/// The surface Dice and the added path length can be queried for any number of tolerances after one update.
+/// The boundary distances are sorted once with the exposed face areas of the boundary voxels, then each query only
+/// looks up the accumulated face area of the distances within the tolerance. The added path length uses the in-plane
+/// distance transform of the compare contours of each slice, computed with the I and J passes of the transform.
+///
+/// To compare many labelmaps pairwise, \sa ComputePairwiseStatistics computes the distance transform of each
+/// labelmap only once instead of once per pair.
+class VTK_SLICER_SEGMENTCOMPARISON_MODULE_LOGIC_EXPORT vtkLabelmapSurfaceDistanceFilter : public vtkObject
+{
+public:
+  static vtkLabelmapSurfaceDistanceFilter* New();
+  vtkTypeMacro(vtkLabelmapSurfaceDistanceFilter, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+public:
+  /// Set reference labelmap
+  void SetReferenceLabelmap(vtkOrientedImageData* referenceLabelmap);
+  /// Get reference labelmap
+  vtkGetObjectMacro(ReferenceLabelmap, vtkOrientedImageData);
+
+  /// Set compare labelmap
+  void SetCompareLabelmap(vtkOrientedImageData* compareLabelmap);
+  /// Get compare labelmap
+  vtkGetObjectMacro(CompareLabelmap, vtkOrientedImageData);
+
+  /// Compute distances, statistics, and histogram.
+  /// If any of the labelmaps is empty, then there are no distances and all statistics are zero
+  /// \return Success flag
+  bool Update();
+
+  /// Get distances (mm) of the boundary voxels of the reference labelmap from the boundary of the compare labelmap
+  vtkGetObjectMacro(ReferenceBoundaryDistances, vtkDoubleArray);
+  /// Get distances (mm) of the boundary voxels of the compare labelmap from the boundary of the reference labelmap
+  vtkGetObjectMacro(CompareBoundaryDistances, vtkDoubleArray);
+  /// Get exposed face areas (mm^2) of the boundary voxels of the reference labelmap, in the order of the distances
+  vtkGetObjectMacro(ReferenceBoundaryFaceAreas, vtkDoubleArray);
+  /// Get exposed face areas (mm^2) of the boundary voxels of the compare labelmap, in the order of the distances
+  vtkGetObjectMacro(CompareBoundaryFaceAreas, vtkDoubleArray);
+  /// Get histogram of the boundary distances of both directions (columns "Bins" and "Frequencies")
+  vtkGetObjectMacro(OutputHistogram, vtkTable);
+
+  /// Get maximum of the boundary distances. This is what is traditionally called Hausdorff distance
+  vtkGetMacro(MaximumHausdorffDistance, double);
+  /// Get average of the boundary distances (mean of the two directed averages)
+  vtkGetMacro(AverageHausdorffDistance, double);
+  /// Get 95th percentile of the boundary distances
+  vtkGetMacro(Percent95HausdorffDistance, double);
+  /// Get Nth percentile of the boundary distances
+  double GetNthPercentileHausdorffDistance(double n);
+
+  /// Get maximum of the distances of the foreground voxels
+  vtkGetMacro(MaximumHausdorffDistanceForVolume, double);
+  /// Get average of the distances of the foreground voxels (mean of the two directed averages)
+  vtkGetMacro(AverageHausdorffDistanceForVolume, double);
+  /// Get 95th percentile of the distances of the foreground voxels
+  vtkGetMacro(Percent95HausdorffDistanceForVolume, double);
+
+  /// Get average symmetric surface distance (mean of the boundary distances of both directions)
+  vtkGetMacro(AverageSymmetricSurfaceDistance, double);
+  /// Get surface Dice at the given tolerance: the fraction of the boundary surface area of both labelmaps that is
+  /// within the tolerance (mm) from the boundary of the other labelmap. Zero if there are no distances.
+  /// The surface of a boundary voxel is its faces shared with background voxels, so each boundary voxel is weighted
+  /// by its exposed face area (faces perpendicular to the I, J, and K axes have the areas sy*sz, sx*sz, and sx*sy)
+  double GetSurfaceDice(double toleranceMm);
+  /// Get added path length (mm) at the given tolerance, considering the reference labelmap the ground truth:
+  /// the length of the reference contours that are farther than the tolerance (mm) from the compare contours in
+  /// the same slice. The contours of a slice consist of the voxels that have a background I or J neighbor in the
+  /// slice, and the distances are measured in the slice. All reference contours of a slice that has no compare
+  /// contours are added at any tolerance. The length is approximated as the number of such voxels multiplied by
+  /// the in-plane (IJ) voxel size
+  double GetAddedPathLengthMm(double toleranceMm);
+
+  /// Compute the boundary statistics of every pair of a reference and a compare labelmap. The labelmaps need to
+  /// have the same geometry (lattice and extent). The distance transform of the boundary of each labelmap is computed
+  /// only once, and the distances of the boundary voxels of all labelmaps of the other set are read from it, so
+  /// N+M distance transforms are computed instead of 2*N*M. The in-plane distance transform of the contours of each
+  /// compare labelmap is also computed once for the added path length. Only one distance transform is kept in memory
+  /// at a time.
+  /// The statistics are the same as those of \sa Update for the pair (the reference and compare labelmaps set in
+  /// the filter are not used).
+  /// \param tolerancesMm Tolerances (mm) of the surface Dice and the added path length. Can be NULL
+  /// \param pairStatistics Output array with a tuple for each pair (all compare labelmaps for the first reference
+  ///   labelmap first) and components: maximum Hausdorff distance, average symmetric surface distance, then surface
+  ///   Dice and added path length (mm) for each tolerance. All components are NaN if any of the labelmaps is empty
+  /// \return Success flag
+  bool ComputePairwiseStatistics(const std::vector<vtkSmartPointer<vtkOrientedImageData> >& referenceLabelmaps,
+    const std::vector<vtkSmartPointer<vtkOrientedImageData> >& compareLabelmaps, vtkDoubleArray* tolerancesMm,
+    vtkDoubleArray* pairStatistics);
+
+  /// Set the histogram minimum (left-most value).
+  vtkSetMacro(HistogramMinimum, double);
+  /// Get the histogram minimum (left-most value).
+  vtkGetMacro(HistogramMinimum, double);
+
+  /// Set the histogram maximum (right-most value).
+  vtkSetMacro(HistogramMaximum, double);
+  /// Get the histogram maximum (right-most value).
+  vtkGetMacro(HistogramMaximum, double);
+
+  /// Set the histogram spacing (width of the bins).
+  vtkSetMacro(HistogramSpacing, double);
+  /// Get the histogram spacing (width of the bins).
+  vtkGetMacro(HistogramSpacing, double);
+
+protected:
+  /// Sort the boundary distances of both directions and accumulate their face areas if not sorted yet since the last update
+  void SortBoundaryDistances();
+
+protected:
+  vtkLabelmapSurfaceDistanceFilter();
+  virtual ~vtkLabelmapSurfaceDistanceFilter();
+
+protected:
+  /// Reference labelmap
+  vtkOrientedImageData* ReferenceLabelmap;
+  /// Compare labelmap
+  vtkOrientedImageData* CompareLabelmap;
+
+  /// Distances of the reference boundary voxels
+  vtkDoubleArray* ReferenceBoundaryDistances;
+  /// Distances of the compare boundary voxels
+  vtkDoubleArray* CompareBoundaryDistances;
+  /// Exposed face areas of the reference boundary voxels
+  vtkDoubleArray* ReferenceBoundaryFaceAreas;
+  /// Exposed face areas of the compare boundary voxels
+  vtkDoubleArray* CompareBoundaryFaceAreas;
+  /// Histogram of the boundary distances
+  vtkTable* OutputHistogram;
+  /// Sorted distances of the reference boundary voxels, used for the tolerance queries
+  vtkDoubleArray* SortedReferenceBoundaryDistances;
+  /// Sorted distances of the compare boundary voxels, used for the tolerance queries
+  vtkDoubleArray* SortedCompareBoundaryDistances;
+  /// Face areas of the reference boundary voxels accumulated in the order of the sorted distances, used for the surface Dice
+  vtkDoubleArray* SortedReferenceBoundaryCumulativeFaceAreas;
+  /// Face areas of the compare boundary voxels accumulated in the order of the sorted distances, used for the surface Dice
+  vtkDoubleArray* SortedCompareBoundaryCumulativeFaceAreas;
+  /// Sorted in-plane distances of the reference contour voxels from the compare contours of their slice, used for the added path length
+  vtkDoubleArray* SortedReferenceInPlaneBoundaryDistances;
+
+  /// Maximum of the boundary distances
+  double MaximumHausdorffDistance;
+  /// Average of the boundary distances
+  double AverageHausdorffDistance;
+  /// 95th percentile of the boundary distances
+  double Percent95HausdorffDistance;
+  /// Maximum of the foreground voxel distances
+  double MaximumHausdorffDistanceForVolume;
+  /// Average of the foreground voxel distances
+  double AverageHausdorffDistanceForVolume;
+  /// 95th percentile of the foreground voxel distances
+  double Percent95HausdorffDistanceForVolume;
+  /// Average symmetric surface distance
+  double AverageSymmetricSurfaceDistance;
+  /// In-plane voxel size used for the added path length
+  double InPlaneVoxelSizeMm;
+
+  /// Histogram minimum
+  double HistogramMinimum;
+  /// Histogram maximum
+  double HistogramMaximum;
+  /// Histogram bin width
+  double HistogramSpacing;
+
+private:
+  vtkLabelmapSurfaceDistanceFilter(const vtkLabelmapSurfaceDistanceFilter&); // Not implemented
+  void operator=(const vtkLabelmapSurfaceDistanceFilter&);                   // Not implemented
+};
+
+#endif // __vtkLabelmapSurfaceDistanceFilter_h
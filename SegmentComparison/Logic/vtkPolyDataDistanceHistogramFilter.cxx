@@ -9,12 +9,60 @@
 #include <vtkInformationVector.h>
 #include <vtkIntArray.h>
 #include <vtkMath.h>
+#include <vtkMultiThreader.h>
 #include <vtkObjectFactory.h>
 #include <vtkPolyDataPointSampler.h>
+#include <vtkSMPTools.h>
 #include <vtkSmartPointer.h>
-#include <vtkSortDataArray.h>
 #include <vtkStreamingDemandDrivenPipeline.h>
 
+// STD includes
+#include <algorithm>
+#include <vector>
+
+//----------------------------------------------------------------------------
+/// Minimum number of sample points evaluated by one thread, so that building the
+/// distance function of the thread does not take longer than evaluating the points
+static const vtkIdType MINIMUM_NUMBER_OF_POINTS_PER_THREAD = 1000;
+
+//----------------------------------------------------------------------------
+// Evaluates the distance function at contiguous ranges of the sample points. Each range has its own
+// implicit distance function, because the cell locator used by the function is not thread-safe.
+class vtkPolyDataDistanceHistogramFilterEvaluateFunctor
+{
+public:
+  vtkPolyDataDistanceHistogramFilterEvaluateFunctor(vtkPoints* samplingPoints,
+    std::vector<vtkSmartPointer<vtkImplicitPolyDataDistance> >& distanceFields, double* distances)
+    : SamplingPoints(samplingPoints)
+    , DistanceFields(distanceFields)
+    , Distances(distances)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    vtkIdType numberOfPoints = this->SamplingPoints->GetNumberOfPoints();
+    vtkIdType numberOfRanges = static_cast<vtkIdType>(this->DistanceFields.size());
+    for (vtkIdType range=begin; range<end; ++range)
+    {
+      vtkImplicitPolyDataDistance* distanceField = this->DistanceFields[range];
+      vtkIdType firstPoint = range * numberOfPoints / numberOfRanges;
+      vtkIdType endPoint = (range + 1) * numberOfPoints / numberOfRanges;
+      double samplePoint[3] = {0.0, 0.0, 0.0};
+      for (vtkIdType pointIndex=firstPoint; pointIndex<endPoint; ++pointIndex)
+      {
+        this->SamplingPoints->GetPoint(pointIndex, samplePoint);
+        this->Distances[pointIndex] = distanceField->EvaluateFunction(samplePoint);
+      }
+    }
+  }
+
+private:
+  vtkPoints* SamplingPoints;
+  std::vector<vtkSmartPointer<vtkImplicitPolyDataDistance> >& DistanceFields;
+  double* Distances;
+};
+
 vtkStandardNewMacro(vtkPolyDataDistanceHistogramFilter);
 
 //----------------------------------------------------------------------------
@@ -29,6 +77,7 @@ vtkPolyDataDistanceHistogramFilter::vtkPolyDataDistanceHistogramFilter()
   , SamplePolyDataVertices(1)
   , SamplePolyDataEdges(0)
   , SamplePolyDataFaces(0)
+  , ParallelEvaluation(1)
   , SamplingDistance(0.01)
   , HistogramMinimum(-10.0)
   , HistogramMaximum(10.0)
@@ -38,6 +87,7 @@ vtkPolyDataDistanceHistogramFilter::vtkPolyDataDistanceHistogramFilter()
   this->InputReferencePolyData = vtkPolyData::New();
   this->OutputHistogram = vtkTable::New();
   this->OutputDistances = vtkDoubleArray::New();
+  this->PercentileDistances = vtkDoubleArray::New();
 
   //this->SetNumberOfInputPorts(2);
   //this->SetNumberOfOutputPorts(1); // See below why not 2
@@ -66,6 +116,11 @@ vtkPolyDataDistanceHistogramFilter::~vtkPolyDataDistanceHistogramFilter()
     this->OutputDistances->Delete();
     this->OutputDistances = NULL;
   }
+  if (this->PercentileDistances)
+  {
+    this->PercentileDistances->Delete();
+    this->PercentileDistances = NULL;
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -172,14 +227,24 @@ double vtkPolyDataDistanceHistogramFilter::GetNthPercentileHausdorffDistance(dou
     return 0.0;
   }
 
-  vtkSmartPointer<vtkDoubleArray> sortedDistances = vtkSmartPointer<vtkDoubleArray>::New();
-  sortedDistances->DeepCopy(this->OutputDistances);
+  vtkIdType numberOfDistances = this->OutputDistances->GetNumberOfValues();
+  if (numberOfDistances == 0)
+  {
+    vtkErrorMacro("GetPercentNthHausdorffDistance: There are no distances. Returning 0.0.");
+    return 0.0;
+  }
 
-  vtkSmartPointer<vtkSortDataArray> sortDataArray = vtkSmartPointer<vtkSortDataArray>::New();
-  sortDataArray->Sort(sortedDistances);
+  // Copy the distances only once after each update. Selection leaves the copy partially
+  // ordered around the selected element, which also makes the subsequent queries faster
+  if (this->PercentileDistances->GetNumberOfValues() != numberOfDistances)
+  {
+    this->PercentileDistances->DeepCopy(this->OutputDistances);
+  }
 
-  int nthPercentileIndex = vtkMath::Round( (n/ 100) * (sortedDistances->GetNumberOfValues() - 1) );
-  double percentileNthDistance = sortedDistances->GetValue( nthPercentileIndex );
+  vtkIdType nthPercentileIndex = vtkMath::Round( (n/ 100) * (numberOfDistances - 1) );
+  double* percentileDistancesPtr = this->PercentileDistances->GetPointer(0);
+  std::nth_element(percentileDistancesPtr, percentileDistancesPtr + nthPercentileIndex, percentileDistancesPtr + numberOfDistances);
+  double percentileNthDistance = percentileDistancesPtr[nthPercentileIndex];
   return percentileNthDistance;
 }
 
@@ -227,17 +292,39 @@ void vtkPolyDataDistanceHistogramFilter::ComputeDistances(vtkPolyData* reference
   pointSampler->Update();  
   vtkPoints* samplingPoints = pointSampler->GetOutput()->GetPoints();
   
-  // generate the distance field
-  vtkSmartPointer<vtkImplicitPolyDataDistance> distanceField = vtkSmartPointer<vtkImplicitPolyDataDistance>::New();
-  distanceField->SetInput(referencePolyData);
-  
-  int numPoints = samplingPoints->GetNumberOfPoints();
-  for (int i = 0; i < numPoints; i++)
+  vtkIdType numPoints = (samplingPoints ? samplingPoints->GetNumberOfPoints() : 0);
+  distanceArray->SetNumberOfValues(numPoints);
+  if (numPoints == 0)
   {
-    double samplePoint[3];
-    samplingPoints->GetPoint(i,samplePoint);
-    double newDistance = distanceField->EvaluateFunction(samplePoint);
-    distanceArray->InsertNextTuple1(newDistance);
+    return;
+  }
+
+  // generate the distance fields, one for each range of sample points evaluated in parallel.
+  // They are created here and not in the threads, because setting the input executes a pipeline
+  vtkIdType numberOfRanges = 1;
+  if (this->ParallelEvaluation)
+  {
+    numberOfRanges = std::min( static_cast<vtkIdType>(vtkMultiThreader::GetGlobalDefaultNumberOfThreads()),
+      numPoints / MINIMUM_NUMBER_OF_POINTS_PER_THREAD );
+    numberOfRanges = std::max(numberOfRanges, static_cast<vtkIdType>(1));
+  }
+  std::vector<vtkSmartPointer<vtkImplicitPolyDataDistance> > distanceFields;
+  for (vtkIdType range=0; range<numberOfRanges; ++range)
+  {
+    vtkSmartPointer<vtkImplicitPolyDataDistance> distanceField = vtkSmartPointer<vtkImplicitPolyDataDistance>::New();
+    distanceField->SetInput(referencePolyData);
+    distanceFields.push_back(distanceField);
+  }
+
+  // evaluate the distances directly into the preallocated array
+  vtkPolyDataDistanceHistogramFilterEvaluateFunctor functor(samplingPoints, distanceFields, distanceArray->GetPointer(0));
+  if (numberOfRanges > 1)
+  {
+    vtkSMPTools::For(0, numberOfRanges, 1, functor);
+  }
+  else
+  {
+    functor(0, 1);
   }
 }
 
@@ -253,6 +340,8 @@ void vtkPolyDataDistanceHistogramFilter::Update()
   vtkPolyData* inputPolyDataReference = this->GetInputReferencePolyData();
   vtkPolyData* inputPolyDataCompare = this->GetInputComparePolyData();
 
+  this->PercentileDistances->Initialize();
+
   vtkSmartPointer<vtkDoubleArray> distances = vtkSmartPointer<vtkDoubleArray>::New(); // hold the distances in this array until we copy to the output
   distances->SetName("Distances");
   this->ComputeDistances(inputPolyDataReference, inputPolyDataCompare, distances);
@@ -72,6 +72,7 @@ public:
 
   // Get the Nth percentile of the absolute of the minimum distances \sa GetOutputDistances from the compare mesh to the reference mesh.
   /// (this corresponds to the 'percent Hausdorff distance' in plastimatch: http://plastimatch.org/doxygen/classHausdorff__distance.html )
+  /// The distances are copied only once after each \sa Update, and each query selects the percentile in that copy (no sorting)
   double GetNthPercentileHausdorffDistance(double n);
   
   /// Set whether the filter should sample on the vertices of the input vtkPolyData objects.
@@ -95,6 +96,13 @@ public:
   /// Set whether the filter should sample on the faces of the input vtkPolyData objects.
   vtkBooleanMacro(SamplePolyDataFaces,int);
 
+  /// Set whether the distances of the sample points are evaluated in parallel.
+  vtkSetMacro(ParallelEvaluation, int);
+  /// Get whether the distances of the sample points are evaluated in parallel.
+  vtkGetMacro(ParallelEvaluation, int);
+  /// Set whether the distances of the sample points are evaluated in parallel.
+  vtkBooleanMacro(ParallelEvaluation, int);
+
   /// Set the sampling distance for points on edges or faces of the input vtkPolyData objects.
   vtkSetMacro(SamplingDistance, double);
   /// Get the sampling distance for points on edges or faces of the input vtkPolyData objects.
@@ -146,6 +154,8 @@ protected:
   vtkTable* OutputHistogram;
   /// Output distances for each reference vertex in an array
   vtkDoubleArray* OutputDistances;
+  /// Copy of the output distances used for percentile selection. Partially reordered by each query
+  vtkDoubleArray* PercentileDistances;
 
   /// Flag determining  whether the filter should sample on the vertices of the input vtkPolyData objects.
   /// All vertices from the vtkPolyData will be used, regardless of the sampling distance.
@@ -159,6 +169,11 @@ protected:
   /// The user can control the sampling distance using\sa/ SetSamplingDistance.
   /// Default is 0 (off).
   int SamplePolyDataFaces;
+  /// Flag determining whether the distances of the sample points are evaluated in parallel.
+  /// The sample points are split among the threads, each of which uses its own implicit distance function
+  /// (with its own cell locator) built from the reference polydata. The distances are the same as in serial mode.
+  /// Default is 1 (on).
+  int ParallelEvaluation;
 
   /// Sampling distance for points on edges or faces of the input vtkPolyData objects.
   /// Default is 0.01.
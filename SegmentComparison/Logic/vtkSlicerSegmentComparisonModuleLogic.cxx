@@ -21,6 +21,8 @@
 // SegmentComparison includes
 #include "vtkSlicerSegmentComparisonModuleLogic.h"
 #include "vtkMRMLSegmentComparisonNode.h"
+#include "vtkLabelmapOverlapStatisticsFilter.h"
+#include "vtkLabelmapSurfaceDistanceFilter.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -29,12 +31,13 @@
 // SegmentationCore includes
 #include "vtkOrientedImageData.h"
 #include "vtkOrientedImageDataResample.h"
+#include "vtkSegmentation.h"
+#include "vtkSegment.h"
 
 // SlicerRT includes
 #include "PlmCommon.h"
 
 // Plastimatch includes
-#include "dice_statistics.h"
 #include "hausdorff_distance.h"
 #if OPENMP_FOUND
   #include <omp.h> //TODO: #227
@@ -47,11 +50,20 @@
 
 // VTK includes
 #include <vtkNew.h>
+#include <vtkImageConstantPad.h>
 #include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkPointData.h>
+#include <vtkDataArray.h>
+#include <vtkDoubleArray.h>
 #include <vtkTimerLog.h>
 #include <vtkObjectFactory.h>
 #include <vtkStringArray.h>
 
+// STD includes
+#include <algorithm>
+#include <sstream>
+
 //-----------------------------------------------------------------------------
 /// \ingroup SlicerRt_QtModules_SegmentComparison
 class vtkSlicerSegmentComparisonModuleLogicPrivate : public vtkObject
@@ -60,6 +72,13 @@ public:
   static vtkSlicerSegmentComparisonModuleLogicPrivate *New();
   vtkTypeMacro(vtkSlicerSegmentComparisonModuleLogicPrivate,vtkObject);
 
+  /// Get input segments as binary labelmaps
+  /// \return Error message, empty string if no error
+  std::string GetInputSegmentsAsLabelmaps(
+    vtkMRMLSegmentComparisonNode* parameterNode,
+    vtkOrientedImageData* referenceSegmentLabelmap,
+    vtkOrientedImageData* compareSegmentLabelmap);
+
   /// Get input segments as labelmaps, then convert them to Plm_image volumes
   /// \return Error message, empty string if no error
   std::string GetInputSegmentsAsPlmVolumes(
@@ -68,6 +87,23 @@ public:
     Plm_image::Pointer& plmCmpSegmentLabelmap,
     double &checkpointItkConvertStart);
 
+  /// Get binary labelmaps of all segments of the reference and compare segmentations in a shared geometry.
+  /// The labelmaps are resampled to the lattice of the first non-empty labelmap if needed, and padded to
+  /// the union of their extents, so that they can be compared without any further resampling
+  /// \return Error message, empty string if no error
+  std::string GetSegmentationsAsLabelmapsInSharedGeometry(
+    vtkMRMLSegmentationNode* referenceSegmentationNode,
+    vtkMRMLSegmentationNode* compareSegmentationNode,
+    std::vector<vtkSmartPointer<vtkOrientedImageData> >& referenceLabelmaps,
+    std::vector<vtkSmartPointer<vtkOrientedImageData> >& compareLabelmaps);
+
+  /// Get names of the segments of a segmentation in the order of the segment IDs
+  static void GetSegmentNames(vtkMRMLSegmentationNode* segmentationNode, std::vector<std::string>& segmentNames);
+
+  /// Write matrix of values into a table node with a row for each reference segment and a column for each compare segment
+  static void SetMatrixToTableNode(vtkMRMLTableNode* tableNode, const std::vector<std::string>& referenceSegmentNames,
+    const std::vector<std::string>& compareSegmentNames, const std::vector<double>& values);
+
   void SetLogic(vtkSlicerSegmentComparisonModuleLogic* logic) { this->Logic = logic; };
 
 protected:
@@ -96,16 +132,15 @@ vtkSlicerSegmentComparisonModuleLogicPrivate::~vtkSlicerSegmentComparisonModuleL
 }
 
 //---------------------------------------------------------------------------
-std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmVolumes(
-  vtkMRMLSegmentComparisonNode* parameterNode, 
-  Plm_image::Pointer& plmRefSegmentLabelmap,
-  Plm_image::Pointer& plmCmpSegmentLabelmap,
-  double &checkpointItkConvertStart )
+std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsLabelmaps(
+  vtkMRMLSegmentComparisonNode* parameterNode,
+  vtkOrientedImageData* referenceSegmentLabelmap,
+  vtkOrientedImageData* compareSegmentLabelmap )
 {
-  if (!parameterNode || !this->Logic->GetMRMLScene())
+  if (!parameterNode || !this->Logic->GetMRMLScene() || !referenceSegmentLabelmap || !compareSegmentLabelmap)
   {
     std::string errorMessage("Invalid MRML scene or parameter set node");
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentsAsLabelmaps: " << errorMessage);
     return errorMessage;
   }
 
@@ -118,31 +153,47 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
   if (!referenceSegmentationNode || !referenceSegmentID)
   {
     std::string errorMessage("Invalid reference segment selection");
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentsAsLabelmaps: " << errorMessage);
     return errorMessage;
   }
   if (!compareSegmentationNode || !compareSegmentID)
   {
     std::string errorMessage("Invalid compare segment selection");
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentsAsLabelmaps: " << errorMessage);
     return errorMessage;
   }
 
   // Get segment binary labelmaps
-  vtkSmartPointer<vtkOrientedImageData> referenceSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
   if ( !vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(
     referenceSegmentationNode, referenceSegmentID, referenceSegmentLabelmap ) )
   {
     std::string errorMessage("Failed to get binary labelmap from reference segment: " + std::string(referenceSegmentID));
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentsAsLabelmaps: " << errorMessage);
     return errorMessage;
   }
-  vtkSmartPointer<vtkOrientedImageData> compareSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
   if ( !vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(
     compareSegmentationNode, compareSegmentID, compareSegmentLabelmap ) )
   {
     std::string errorMessage("Failed to get binary labelmap from reference segment: " + std::string(compareSegmentID));
-    vtkErrorMacro("GetInputSegmentsAsPlmVolumes: " << errorMessage);
+    vtkErrorMacro("GetInputSegmentsAsLabelmaps: " << errorMessage);
+    return errorMessage;
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmVolumes(
+  vtkMRMLSegmentComparisonNode* parameterNode,
+  Plm_image::Pointer& plmRefSegmentLabelmap,
+  Plm_image::Pointer& plmCmpSegmentLabelmap,
+  double &checkpointItkConvertStart )
+{
+  vtkSmartPointer<vtkOrientedImageData> referenceSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkSmartPointer<vtkOrientedImageData> compareSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  std::string errorMessage = this->GetInputSegmentsAsLabelmaps(parameterNode, referenceSegmentLabelmap, compareSegmentLabelmap);
+  if (!errorMessage.empty())
+  {
     return errorMessage;
   }
 
@@ -169,6 +220,163 @@ std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetInputSegmentsAsPlmV
   return "";
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentComparisonModuleLogicPrivate::GetSegmentationsAsLabelmapsInSharedGeometry(
+  vtkMRMLSegmentationNode* referenceSegmentationNode,
+  vtkMRMLSegmentationNode* compareSegmentationNode,
+  std::vector<vtkSmartPointer<vtkOrientedImageData> >& referenceLabelmaps,
+  std::vector<vtkSmartPointer<vtkOrientedImageData> >& compareLabelmaps )
+{
+  referenceLabelmaps.clear();
+  compareLabelmaps.clear();
+  if (!referenceSegmentationNode || !compareSegmentationNode)
+  {
+    std::string errorMessage("Invalid segmentation selection");
+    vtkErrorMacro("GetSegmentationsAsLabelmapsInSharedGeometry: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Rasterize each segment once
+  vtkMRMLSegmentationNode* segmentationNodes[2] = { referenceSegmentationNode, compareSegmentationNode };
+  std::vector<vtkSmartPointer<vtkOrientedImageData> >* labelmapLists[2] = { &referenceLabelmaps, &compareLabelmaps };
+  for (int segmentationIndex=0; segmentationIndex<2; ++segmentationIndex)
+  {
+    std::vector<std::string> segmentIDs;
+    segmentationNodes[segmentationIndex]->GetSegmentation()->GetSegmentIDs(segmentIDs);
+    for (std::vector<std::string>::iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
+    {
+      vtkSmartPointer<vtkOrientedImageData> labelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+      if ( !vtkSlicerSegmentationsModuleLogic::GetSegmentBinaryLabelmapRepresentation(
+        segmentationNodes[segmentationIndex], *segmentIdIt, labelmap ) )
+      {
+        std::string errorMessage("Failed to get binary labelmap from segment: " + (*segmentIdIt));
+        vtkErrorMacro("GetSegmentationsAsLabelmapsInSharedGeometry: " << errorMessage);
+        return errorMessage;
+      }
+      labelmapLists[segmentationIndex]->push_back(labelmap);
+    }
+  }
+
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > labelmaps(referenceLabelmaps);
+  labelmaps.insert(labelmaps.end(), compareLabelmaps.begin(), compareLabelmaps.end());
+
+  // Resample the labelmaps that are not on the shared lattice, and compute the union of the extents
+  vtkOrientedImageData* sharedGeometryLabelmap = NULL;
+  int unionExtent[6] = { VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN };
+  std::vector<bool> emptyLabelmaps(labelmaps.size(), true);
+  for (size_t labelmapIndex=0; labelmapIndex<labelmaps.size(); ++labelmapIndex)
+  {
+    vtkOrientedImageData* labelmap = labelmaps[labelmapIndex];
+    int* extent = labelmap->GetExtent();
+    if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+    {
+      continue;
+    }
+    emptyLabelmaps[labelmapIndex] = false;
+    if (!sharedGeometryLabelmap)
+    {
+      sharedGeometryLabelmap = labelmap;
+    }
+    else if (!vtkOrientedImageDataResample::DoGeometriesMatch(sharedGeometryLabelmap, labelmap))
+    {
+      vtkSmartPointer<vtkOrientedImageData> resampledLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+      if (!vtkOrientedImageDataResample::ResampleOrientedImageToReferenceOrientedImage(
+        labelmap, sharedGeometryLabelmap, resampledLabelmap, false, true) )
+      {
+        std::string errorMessage("Failed to resample segment labelmap to the shared geometry");
+        vtkErrorMacro("GetSegmentationsAsLabelmapsInSharedGeometry: " << errorMessage);
+        return errorMessage;
+      }
+      labelmap->DeepCopy(resampledLabelmap);
+      extent = labelmap->GetExtent();
+    }
+    for (int axis=0; axis<3; ++axis)
+    {
+      unionExtent[2*axis] = std::min(unionExtent[2*axis], extent[2*axis]);
+      unionExtent[2*axis+1] = std::max(unionExtent[2*axis+1], extent[2*axis+1]);
+    }
+  }
+  if (!sharedGeometryLabelmap)
+  {
+    std::string errorMessage("All input segments are empty");
+    vtkErrorMacro("GetSegmentationsAsLabelmapsInSharedGeometry: " << errorMessage);
+    return errorMessage;
+  }
+
+  // Pad all labelmaps to the union extent
+  double directions[3][3] = {{1.0,0.0,0.0}, {0.0,1.0,0.0}, {0.0,0.0,1.0}};
+  sharedGeometryLabelmap->GetDirections(directions);
+  for (size_t labelmapIndex=0; labelmapIndex<labelmaps.size(); ++labelmapIndex)
+  {
+    vtkOrientedImageData* labelmap = labelmaps[labelmapIndex];
+    if (emptyLabelmaps[labelmapIndex])
+    {
+      labelmap->SetExtent(unionExtent);
+      labelmap->SetOrigin(sharedGeometryLabelmap->GetOrigin());
+      labelmap->SetSpacing(sharedGeometryLabelmap->GetSpacing());
+      labelmap->SetDirections(directions);
+      labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+      labelmap->GetPointData()->GetScalars()->Fill(0);
+      continue;
+    }
+    int* extent = labelmap->GetExtent();
+    if (std::equal(extent, extent+6, unionExtent))
+    {
+      continue;
+    }
+    vtkSmartPointer<vtkImageConstantPad> padder = vtkSmartPointer<vtkImageConstantPad>::New();
+    padder->SetInputData(labelmap);
+    padder->SetOutputWholeExtent(unionExtent);
+    padder->Update();
+    labelmap->vtkImageData::DeepCopy(padder->GetOutput());
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerSegmentComparisonModuleLogicPrivate::GetSegmentNames(vtkMRMLSegmentationNode* segmentationNode,
+  std::vector<std::string>& segmentNames)
+{
+  segmentNames.clear();
+  std::vector<std::string> segmentIDs;
+  segmentationNode->GetSegmentation()->GetSegmentIDs(segmentIDs);
+  for (std::vector<std::string>::iterator segmentIdIt = segmentIDs.begin(); segmentIdIt != segmentIDs.end(); ++segmentIdIt)
+  {
+    segmentNames.push_back(segmentationNode->GetSegmentation()->GetSegment(*segmentIdIt)->GetName());
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerSegmentComparisonModuleLogicPrivate::SetMatrixToTableNode(vtkMRMLTableNode* tableNode,
+  const std::vector<std::string>& referenceSegmentNames, const std::vector<std::string>& compareSegmentNames, const std::vector<double>& values)
+{
+  if (!tableNode)
+  {
+    return;
+  }
+  tableNode->SetUseColumnNameAsColumnHeader(true);
+  tableNode->RemoveAllColumns();
+  vtkStringArray* header = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  header->SetName("Reference segment");
+  for (std::vector<std::string>::const_iterator nameIt = referenceSegmentNames.begin(); nameIt != referenceSegmentNames.end(); ++nameIt)
+  {
+    header->InsertNextValue(*nameIt);
+  }
+  for (size_t compareIndex=0; compareIndex<compareSegmentNames.size(); ++compareIndex)
+  {
+    vtkStringArray* column = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+    column->SetName(compareSegmentNames[compareIndex].c_str());
+    for (size_t referenceIndex=0; referenceIndex<referenceSegmentNames.size(); ++referenceIndex)
+    {
+      column->SetVariantValue(referenceIndex, vtkVariant(values[referenceIndex * compareSegmentNames.size() + compareIndex]));
+    }
+  }
+
+  // Trigger UI update
+  tableNode->Modified();
+}
+
 //-----------------------------------------------------------------------------
 // vtkSlicerSegmentComparisonModuleLogic methods
 
@@ -186,6 +394,7 @@ vtkSlicerSegmentComparisonModuleLogic::vtkSlicerSegmentComparisonModuleLogic()
   this->SetLogicPrivate(logicPrivate);
 
   this->LogSpeedMeasurementsOff();
+  this->UsePlastimatchHausdorff = false;
 }
 
 //----------------------------------------------------------------------------
@@ -298,56 +507,59 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRML
   vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
   double checkpointStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
-  double checkpointItkConvertStart = 0.0;
 
-  // Convert input images to the format Plastimatch can use
-  Plm_image::Pointer plmRefSegmentLabelmap;
-  Plm_image::Pointer plmCmpSegmentLabelmap;
-  std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(parameterNode, plmRefSegmentLabelmap, plmCmpSegmentLabelmap, checkpointItkConvertStart);
-  if (!inputToPlmResult.empty())
+  // Get input segment labelmaps
+  vtkSmartPointer<vtkOrientedImageData> referenceSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  vtkSmartPointer<vtkOrientedImageData> compareSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  std::string inputLabelmapsResult = this->LogicPrivate->GetInputSegmentsAsLabelmaps(parameterNode, referenceSegmentLabelmap, compareSegmentLabelmap);
+  if (!inputLabelmapsResult.empty())
   {
-    std::string errorMessage("Error occurred during ITK conversion");
-    vtkErrorMacro("ComputeDiceStatistics: " << errorMessage);
-    return errorMessage;
+    return inputLabelmapsResult;
   }
 
-  // Compute Dice similarity metrics
+  // Compute overlap statistics directly on the labelmaps
   double checkpointDiceStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointDiceStart); // Although it is used later, a warning is logged so needs to be suppressed
-  Dice_statistics dice;
-  dice.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
-  dice.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
-
-  dice.run();
+  vtkSmartPointer<vtkLabelmapOverlapStatisticsFilter> overlapStatistics = vtkSmartPointer<vtkLabelmapOverlapStatisticsFilter>::New();
+  overlapStatistics->SetReferenceLabelmap(referenceSegmentLabelmap);
+  overlapStatistics->SetCompareLabelmap(compareSegmentLabelmap);
+  if (!overlapStatistics->Update())
+  {
+    std::string errorMessage("Failed to compute overlap statistics");
+    vtkErrorMacro("ComputeDiceStatistics: " << errorMessage);
+    return errorMessage;
+  }
 
-  unsigned long numberOfVoxels = dice.get_true_positives() 
-    + dice.get_true_negatives() + dice.get_false_positives()
-    + dice.get_false_negatives();
+  double numberOfVoxels = static_cast<double>(overlapStatistics->GetNumberOfVoxels());
+  if (numberOfVoxels == 0.0)
+  {
+    std::string errorMessage("Input segments are empty");
+    vtkErrorMacro("ComputeDiceStatistics: " << errorMessage);
+    return errorMessage;
+  }
 
   // Set results to parameter set node
-  double diceCoefficient = dice.get_dice();
-  double truePositivesPercent = dice.get_true_positives() * 100.0 / (double)numberOfVoxels;
-  double trueNegativesPercent = dice.get_true_negatives() * 100.0 / (double)numberOfVoxels;
-  double falsePositivesPercent = dice.get_false_positives() * 100.0 / (double)numberOfVoxels;
-  double falseNegativesPercent = dice.get_false_negatives() * 100.0 / (double)numberOfVoxels;
+  double diceCoefficient = overlapStatistics->GetDiceCoefficient();
+  double jaccardIndex = overlapStatistics->GetJaccardIndex();
+  double truePositivesPercent = overlapStatistics->GetTruePositives() * 100.0 / numberOfVoxels;
+  double trueNegativesPercent = overlapStatistics->GetTrueNegatives() * 100.0 / numberOfVoxels;
+  double falsePositivesPercent = overlapStatistics->GetFalsePositives() * 100.0 / numberOfVoxels;
+  double falseNegativesPercent = overlapStatistics->GetFalseNegatives() * 100.0 / numberOfVoxels;
   parameterNode->SetDiceCoefficient(diceCoefficient);
   parameterNode->SetTruePositivesPercent(truePositivesPercent);
   parameterNode->SetTrueNegativesPercent(trueNegativesPercent);
   parameterNode->SetFalsePositivesPercent(falsePositivesPercent);
   parameterNode->SetFalseNegativesPercent(falseNegativesPercent);
 
-  itk::Vector<double, 3> referenceCenterItk = dice.get_reference_center();
-  double referenceCenterArray[3] =
-    { - referenceCenterItk[0], - referenceCenterItk[1], referenceCenterItk[2] };
+  double referenceCenterArray[3] = {0.0, 0.0, 0.0};
+  overlapStatistics->GetReferenceCenter(referenceCenterArray);
   parameterNode->SetReferenceCenter(referenceCenterArray);
-
-  itk::Vector<double, 3> compareCenterItk = dice.get_compare_center();
-  double compareCenterArray[3] =
-    { - compareCenterItk[0], - compareCenterItk[1], compareCenterItk[2] };
+  double compareCenterArray[3] = {0.0, 0.0, 0.0};
+  overlapStatistics->GetCompareCenter(compareCenterArray);
   parameterNode->SetCompareCenter(compareCenterArray);
 
-  double referenceVolumeCc = dice.get_reference_volume() / 1000.0;
-  double compareVolumeCc = dice.get_compare_volume() / 1000.0;
+  double referenceVolumeCc = overlapStatistics->GetReferenceVolumeMm3() / 1000.0;
+  double compareVolumeCc = overlapStatistics->GetCompareVolumeMm3() / 1000.0;
   parameterNode->SetReferenceVolumeCc(referenceVolumeCc);
   parameterNode->SetCompareVolumeCc(compareVolumeCc);
 
@@ -368,6 +580,7 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRML
     header->InsertNextValue("Compare segment");
     // Dice results
     header->InsertNextValue("Dice coefficient");
+    header->InsertNextValue("Jaccard index");
     header->InsertNextValue("True positives (%)");
     header->InsertNextValue("True negatives (%)");
     header->InsertNextValue("False positives (%)");
@@ -391,6 +604,7 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRML
     column->SetValue(row++, compareSegmentID);
 
     column->SetVariantValue(row++, vtkVariant(diceCoefficient));
+    column->SetVariantValue(row++, vtkVariant(jaccardIndex));
     column->SetVariantValue(row++, vtkVariant(truePositivesPercent));
     column->SetVariantValue(row++, vtkVariant(trueNegativesPercent));
     column->SetVariantValue(row++, vtkVariant(falsePositivesPercent));
@@ -413,8 +627,7 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeDiceStatistics(vtkMRML
     double checkpointEnd = timer->GetUniversalTime();
     UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
     vtkDebugMacro("ComputeDiceStatistics: Total Dice computation time: " << checkpointEnd-checkpointStart << " s\n"
-      << "\tApplying transforms: " << checkpointItkConvertStart-checkpointStart << " s\n"
-      << "\tConverting from VTK to ITK: " << checkpointDiceStart-checkpointItkConvertStart << " s\n"
+      << "\tGetting segment labelmaps: " << checkpointDiceStart-checkpointStart << " s\n"
       << "\tDice computation: " << checkpointEnd-checkpointDiceStart << " s");
   }
 
@@ -443,35 +656,79 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances(vtk
   double checkpointStart = timer->GetUniversalTime();
   UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
   double checkpointItkConvertStart = 0.0;
+  double checkpointHausdorffStart = 0.0;
+  UNUSED_VARIABLE(checkpointHausdorffStart); // Although it is used later, a warning is logged so needs to be suppressed
 
-  // Convert input images to the format Plastimatch can use
-  Plm_image::Pointer plmRefSegmentLabelmap;
-  Plm_image::Pointer plmCmpSegmentLabelmap;
-  std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(parameterNode, plmRefSegmentLabelmap, plmCmpSegmentLabelmap, checkpointItkConvertStart);
-  if (!inputToPlmResult.empty())
+  double maximumHausdorffDistanceForBoundaryMm = 0.0;
+  double averageHausdorffDistanceForBoundaryMm = 0.0;
+  double percent95HausdorffDistanceForBoundaryMm = 0.0;
+  if (this->UsePlastimatchHausdorff)
   {
-    std::string errorMessage("Error occurred during ITK conversion");
-    vtkErrorMacro("ComputeHausdorffDistances: " << errorMessage);
-    return errorMessage;
+    // Convert input images to the format Plastimatch can use
+    Plm_image::Pointer plmRefSegmentLabelmap;
+    Plm_image::Pointer plmCmpSegmentLabelmap;
+    std::string inputToPlmResult = this->LogicPrivate->GetInputSegmentsAsPlmVolumes(parameterNode, plmRefSegmentLabelmap, plmCmpSegmentLabelmap, checkpointItkConvertStart);
+    if (!inputToPlmResult.empty())
+    {
+      std::string errorMessage("Error occurred during ITK conversion");
+      vtkErrorMacro("ComputeHausdorffDistances: " << errorMessage);
+      return errorMessage;
+    }
+
+    // Compute Hausdorff distances
+    checkpointHausdorffStart = timer->GetUniversalTime();
+    Hausdorff_distance hausdorff;
+    hausdorff.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
+    hausdorff.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
+    hausdorff.set_volume_boundary_behavior(ZERO_PADDING);
+    hausdorff.run();
+
+    maximumHausdorffDistanceForBoundaryMm = hausdorff.get_boundary_hausdorff();
+    averageHausdorffDistanceForBoundaryMm = hausdorff.get_avg_average_boundary_hausdorff();
+    percent95HausdorffDistanceForBoundaryMm = hausdorff.get_percent_boundary_hausdorff();
+    parameterNode->SetMaximumHausdorffDistanceForVolumeMm(hausdorff.get_hausdorff());
+    parameterNode->SetAverageHausdorffDistanceForVolumeMm(hausdorff.get_avg_average_hausdorff());
+    parameterNode->SetPercent95HausdorffDistanceForVolumeMm(hausdorff.get_percent_hausdorff());
+  }
+  else
+  {
+    // Get input segment labelmaps
+    vtkSmartPointer<vtkOrientedImageData> referenceSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    vtkSmartPointer<vtkOrientedImageData> compareSegmentLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    std::string inputLabelmapsResult = this->LogicPrivate->GetInputSegmentsAsLabelmaps(parameterNode, referenceSegmentLabelmap, compareSegmentLabelmap);
+    if (!inputLabelmapsResult.empty())
+    {
+      return inputLabelmapsResult;
+    }
+    checkpointItkConvertStart = timer->GetUniversalTime();
+
+    // Compute Hausdorff distances from the distance transforms of the segment boundaries
+    checkpointHausdorffStart = timer->GetUniversalTime();
+    vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter> surfaceDistance = vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter>::New();
+    surfaceDistance->SetReferenceLabelmap(referenceSegmentLabelmap);
+    surfaceDistance->SetCompareLabelmap(compareSegmentLabelmap);
+    if (!surfaceDistance->Update())
+    {
+      std::string errorMessage("Failed to compute surface distances");
+      vtkErrorMacro("ComputeHausdorffDistances: " << errorMessage);
+      return errorMessage;
+    }
+    if (surfaceDistance->GetReferenceBoundaryDistances()->GetNumberOfValues() == 0)
+    {
+      std::string errorMessage("Input segments are empty");
+      vtkErrorMacro("ComputeHausdorffDistances: " << errorMessage);
+      return errorMessage;
+    }
+
+    maximumHausdorffDistanceForBoundaryMm = surfaceDistance->GetMaximumHausdorffDistance();
+    averageHausdorffDistanceForBoundaryMm = surfaceDistance->GetAverageHausdorffDistance();
+    percent95HausdorffDistanceForBoundaryMm = surfaceDistance->GetPercent95HausdorffDistance();
+    parameterNode->SetMaximumHausdorffDistanceForVolumeMm(surfaceDistance->GetMaximumHausdorffDistanceForVolume());
+    parameterNode->SetAverageHausdorffDistanceForVolumeMm(surfaceDistance->GetAverageHausdorffDistanceForVolume());
+    parameterNode->SetPercent95HausdorffDistanceForVolumeMm(surfaceDistance->GetPercent95HausdorffDistanceForVolume());
   }
-
-  // Compute Hausdorff distances
-  double checkpointHausdorffStart = timer->GetUniversalTime();
-  UNUSED_VARIABLE(checkpointHausdorffStart); // Although it is used later, a warning is logged so needs to be suppressed
-  Hausdorff_distance hausdorff;
-  hausdorff.set_reference_image(plmRefSegmentLabelmap->itk_uchar());
-  hausdorff.set_compare_image(plmCmpSegmentLabelmap->itk_uchar());
-  hausdorff.set_volume_boundary_behavior(ZERO_PADDING);
-  hausdorff.run();
-
-  double maximumHausdorffDistanceForBoundaryMm = hausdorff.get_boundary_hausdorff();
-  double averageHausdorffDistanceForBoundaryMm = hausdorff.get_avg_average_boundary_hausdorff();
-  double percent95HausdorffDistanceForBoundaryMm = hausdorff.get_percent_boundary_hausdorff();
-  parameterNode->SetMaximumHausdorffDistanceForVolumeMm(hausdorff.get_hausdorff());
   parameterNode->SetMaximumHausdorffDistanceForBoundaryMm(maximumHausdorffDistanceForBoundaryMm);
-  parameterNode->SetAverageHausdorffDistanceForVolumeMm(hausdorff.get_avg_average_hausdorff());
   parameterNode->SetAverageHausdorffDistanceForBoundaryMm(averageHausdorffDistanceForBoundaryMm);
-  parameterNode->SetPercent95HausdorffDistanceForVolumeMm(hausdorff.get_percent_hausdorff());
   parameterNode->SetPercent95HausdorffDistanceForBoundaryMm(percent95HausdorffDistanceForBoundaryMm);
   parameterNode->HausdorffResultsValidOn();
 
@@ -520,9 +777,250 @@ std::string vtkSlicerSegmentComparisonModuleLogic::ComputeHausdorffDistances(vtk
     UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
     vtkDebugMacro("ComputeHausdorffDistances: Total Hausdorff computation time: " << checkpointEnd-checkpointStart << " s\n"
       << "\tApplying transforms: " << checkpointItkConvertStart-checkpointStart << " s\n"
-      << "\tConverting from VTK to ITK: " << checkpointHausdorffStart-checkpointItkConvertStart << " s\n"
+      << "\tConverting from VTK to ITK: " << checkpointHausdorffStart-checkpointItkConvertStart << " s (only if using Plastimatch)\n"
       << "\tHausdorff computation: " << checkpointEnd-checkpointHausdorffStart << " s");
   }
 
   return "";
 }
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentComparisonModuleLogic::ComputeComparisonMatrices(vtkMRMLSegmentationNode* referenceSegmentationNode,
+  vtkMRMLSegmentationNode* compareSegmentationNode, vtkMRMLTableNode* diceTableNode, vtkMRMLTableNode* hausdorffTableNode)
+{
+  if (!referenceSegmentationNode || !compareSegmentationNode || !this->GetMRMLScene())
+  {
+    std::string errorMessage("Invalid MRML scene or input segmentation selection");
+    vtkErrorMacro("ComputeComparisonMatrices: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
+
+  // Rasterize all segments once into the shared geometry
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > referenceLabelmaps;
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > compareLabelmaps;
+  std::string labelmapsResult = this->LogicPrivate->GetSegmentationsAsLabelmapsInSharedGeometry(
+    referenceSegmentationNode, compareSegmentationNode, referenceLabelmaps, compareLabelmaps);
+  if (!labelmapsResult.empty())
+  {
+    return labelmapsResult;
+  }
+
+  std::vector<std::string> referenceSegmentNames;
+  vtkSlicerSegmentComparisonModuleLogicPrivate::GetSegmentNames(referenceSegmentationNode, referenceSegmentNames);
+  std::vector<std::string> compareSegmentNames;
+  vtkSlicerSegmentComparisonModuleLogicPrivate::GetSegmentNames(compareSegmentationNode, compareSegmentNames);
+  size_t numberOfReferenceSegments = referenceLabelmaps.size();
+  size_t numberOfCompareSegments = compareLabelmaps.size();
+
+  // Compute Dice coefficients. The labelmaps are on the same lattice, so the foreground of each segment is found
+  // only once, and the overlap of each pair is counted directly on the buffers within the overlap of their bounding boxes
+  double checkpointDiceStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointDiceStart); // Although it is used later, a warning is logged so needs to be suppressed
+  if (diceTableNode)
+  {
+    vtkSmartPointer<vtkDoubleArray> pairDiceCoefficients = vtkSmartPointer<vtkDoubleArray>::New();
+    vtkSmartPointer<vtkLabelmapOverlapStatisticsFilter> overlapStatistics = vtkSmartPointer<vtkLabelmapOverlapStatisticsFilter>::New();
+    if (!overlapStatistics->ComputePairwiseDiceCoefficients(referenceLabelmaps, compareLabelmaps, pairDiceCoefficients))
+    {
+      std::string errorMessage("Failed to compute overlap statistics");
+      vtkErrorMacro("ComputeComparisonMatrices: " << errorMessage);
+      return errorMessage;
+    }
+    std::vector<double> diceCoefficients(numberOfReferenceSegments * numberOfCompareSegments, 0.0);
+    for (size_t pairIndex=0; pairIndex<diceCoefficients.size(); ++pairIndex)
+    {
+      diceCoefficients[pairIndex] = pairDiceCoefficients->GetValue(static_cast<vtkIdType>(pairIndex));
+    }
+    vtkSlicerSegmentComparisonModuleLogicPrivate::SetMatrixToTableNode(diceTableNode, referenceSegmentNames, compareSegmentNames, diceCoefficients);
+  }
+
+  // Compute Hausdorff distances
+  double checkpointHausdorffStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointHausdorffStart); // Although it is used later, a warning is logged so needs to be suppressed
+  if (hausdorffTableNode && !this->UsePlastimatchHausdorff)
+  {
+    // The labelmaps are on the same lattice, so the distance transform of each segment boundary is computed
+    // only once and used for all pairs. Hausdorff distance is undefined (NaN) if one of the segments is empty
+    vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter> surfaceDistance = vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter>::New();
+    vtkSmartPointer<vtkDoubleArray> pairStatistics = vtkSmartPointer<vtkDoubleArray>::New();
+    if (!surfaceDistance->ComputePairwiseStatistics(referenceLabelmaps, compareLabelmaps, NULL, pairStatistics))
+    {
+      std::string errorMessage("Failed to compute surface distances");
+      vtkErrorMacro("ComputeComparisonMatrices: " << errorMessage);
+      return errorMessage;
+    }
+    std::vector<double> hausdorffDistances(numberOfReferenceSegments * numberOfCompareSegments, vtkMath::Nan());
+    for (size_t pairIndex=0; pairIndex<hausdorffDistances.size(); ++pairIndex)
+    {
+      hausdorffDistances[pairIndex] = pairStatistics->GetComponent(static_cast<vtkIdType>(pairIndex), 0);
+    }
+    vtkSlicerSegmentComparisonModuleLogicPrivate::SetMatrixToTableNode(hausdorffTableNode, referenceSegmentNames, compareSegmentNames, hausdorffDistances);
+  }
+  else if (hausdorffTableNode)
+  {
+    // Each labelmap is converted to Plm_image only once
+    std::vector<Plm_image::Pointer> plmReferenceLabelmaps;
+    std::vector<Plm_image::Pointer> plmCompareLabelmaps;
+    std::vector<bool> referenceEmpty;
+    std::vector<bool> compareEmpty;
+    for (size_t referenceIndex=0; referenceIndex<numberOfReferenceSegments; ++referenceIndex)
+    {
+      plmReferenceLabelmaps.push_back(PlmCommon::ConvertVtkOrientedImageDataToPlmImage(referenceLabelmaps[referenceIndex]));
+      referenceEmpty.push_back(referenceLabelmaps[referenceIndex]->GetScalarRange()[1] == 0.0);
+    }
+    for (size_t compareIndex=0; compareIndex<numberOfCompareSegments; ++compareIndex)
+    {
+      plmCompareLabelmaps.push_back(PlmCommon::ConvertVtkOrientedImageDataToPlmImage(compareLabelmaps[compareIndex]));
+      compareEmpty.push_back(compareLabelmaps[compareIndex]->GetScalarRange()[1] == 0.0);
+    }
+
+    std::vector<double> hausdorffDistances(numberOfReferenceSegments * numberOfCompareSegments, vtkMath::Nan());
+    for (size_t referenceIndex=0; referenceIndex<numberOfReferenceSegments; ++referenceIndex)
+    {
+      for (size_t compareIndex=0; compareIndex<numberOfCompareSegments; ++compareIndex)
+      {
+        // Hausdorff distance is undefined if one of the segments is empty
+        if ( referenceEmpty[referenceIndex] || compareEmpty[compareIndex]
+          || !plmReferenceLabelmaps[referenceIndex] || !plmCompareLabelmaps[compareIndex] )
+        {
+          continue;
+        }
+        Hausdorff_distance hausdorff;
+        hausdorff.set_reference_image(plmReferenceLabelmaps[referenceIndex]->itk_uchar());
+        hausdorff.set_compare_image(plmCompareLabelmaps[compareIndex]->itk_uchar());
+        hausdorff.set_volume_boundary_behavior(ZERO_PADDING);
+        hausdorff.run();
+        hausdorffDistances[referenceIndex * numberOfCompareSegments + compareIndex] = hausdorff.get_boundary_hausdorff();
+      }
+    }
+    vtkSlicerSegmentComparisonModuleLogicPrivate::SetMatrixToTableNode(hausdorffTableNode, referenceSegmentNames, compareSegmentNames, hausdorffDistances);
+  }
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
+    vtkDebugMacro("ComputeComparisonMatrices: Total comparison time for " << numberOfReferenceSegments << "x" << numberOfCompareSegments
+      << " segment pairs: " << checkpointEnd-checkpointStart << " s\n"
+      << "\tRasterizing segments: " << checkpointDiceStart-checkpointStart << " s\n"
+      << "\tDice computation: " << checkpointHausdorffStart-checkpointDiceStart << " s\n"
+      << "\tHausdorff computation: " << checkpointEnd-checkpointHausdorffStart << " s");
+  }
+
+  return "";
+}
+
+//---------------------------------------------------------------------------
+std::string vtkSlicerSegmentComparisonModuleLogic::ComputeSurfaceDice(vtkMRMLSegmentationNode* referenceSegmentationNode,
+  vtkMRMLSegmentationNode* compareSegmentationNode, vtkDoubleArray* tolerancesMm, vtkMRMLTableNode* tableNode)
+{
+  if (!referenceSegmentationNode || !compareSegmentationNode || !tolerancesMm || !tableNode || !this->GetMRMLScene())
+  {
+    std::string errorMessage("Invalid MRML scene, input segmentation, tolerance, or output table selection");
+    vtkErrorMacro("ComputeSurfaceDice: " << errorMessage);
+    return errorMessage;
+  }
+
+  vtkSmartPointer<vtkTimerLog> timer = vtkSmartPointer<vtkTimerLog>::New();
+  double checkpointStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointStart); // Although it is used later, a warning is logged so needs to be suppressed
+
+  // Rasterize all segments once into the shared geometry
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > referenceLabelmaps;
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > compareLabelmaps;
+  std::string labelmapsResult = this->LogicPrivate->GetSegmentationsAsLabelmapsInSharedGeometry(
+    referenceSegmentationNode, compareSegmentationNode, referenceLabelmaps, compareLabelmaps);
+  if (!labelmapsResult.empty())
+  {
+    return labelmapsResult;
+  }
+
+  std::vector<std::string> referenceSegmentNames;
+  vtkSlicerSegmentComparisonModuleLogicPrivate::GetSegmentNames(referenceSegmentationNode, referenceSegmentNames);
+  std::vector<std::string> compareSegmentNames;
+  vtkSlicerSegmentComparisonModuleLogicPrivate::GetSegmentNames(compareSegmentationNode, compareSegmentNames);
+  size_t numberOfReferenceSegments = referenceLabelmaps.size();
+  size_t numberOfCompareSegments = compareLabelmaps.size();
+  vtkIdType numberOfTolerances = tolerancesMm->GetNumberOfValues();
+
+  // Values of a pair: average symmetric surface distance, then surface Dice and added path length for each tolerance
+  size_t numberOfValuesPerPair = 1 + 2 * numberOfTolerances;
+  double checkpointDistanceStart = timer->GetUniversalTime();
+  UNUSED_VARIABLE(checkpointDistanceStart); // Although it is used later, a warning is logged so needs to be suppressed
+  // The distance transform of each segment boundary is computed only once and used for all pairs.
+  // Surface distances are undefined (NaN) if one of the segments is empty
+  vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter> surfaceDistance = vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter>::New();
+  vtkSmartPointer<vtkDoubleArray> pairStatistics = vtkSmartPointer<vtkDoubleArray>::New();
+  if (!surfaceDistance->ComputePairwiseStatistics(referenceLabelmaps, compareLabelmaps, tolerancesMm, pairStatistics))
+  {
+    std::string errorMessage("Failed to compute surface distances");
+    vtkErrorMacro("ComputeSurfaceDice: " << errorMessage);
+    return errorMessage;
+  }
+  // The pair statistics start with the maximum Hausdorff distance, which is not in the table
+  std::vector<double> values(numberOfReferenceSegments * numberOfCompareSegments * numberOfValuesPerPair, vtkMath::Nan());
+  for (size_t pairIndex=0; pairIndex<numberOfReferenceSegments * numberOfCompareSegments; ++pairIndex)
+  {
+    for (size_t valueIndex=0; valueIndex<numberOfValuesPerPair; ++valueIndex)
+    {
+      values[pairIndex * numberOfValuesPerPair + valueIndex] =
+        pairStatistics->GetComponent(static_cast<vtkIdType>(pairIndex), static_cast<int>(valueIndex + 1));
+    }
+  }
+
+  // Write table with a row for each segment pair
+  tableNode->SetUseColumnNameAsColumnHeader(true);
+  tableNode->RemoveAllColumns();
+  vtkStringArray* referenceColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  referenceColumn->SetName("Reference segment");
+  vtkStringArray* compareColumn = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+  compareColumn->SetName("Compare segment");
+  for (size_t referenceIndex=0; referenceIndex<numberOfReferenceSegments; ++referenceIndex)
+  {
+    for (size_t compareIndex=0; compareIndex<numberOfCompareSegments; ++compareIndex)
+    {
+      referenceColumn->InsertNextValue(referenceSegmentNames[referenceIndex]);
+      compareColumn->InsertNextValue(compareSegmentNames[compareIndex]);
+    }
+  }
+  std::vector<std::string> valueColumnNames;
+  valueColumnNames.push_back("Average surface distance (mm)");
+  for (vtkIdType toleranceIndex=0; toleranceIndex<numberOfTolerances; ++toleranceIndex)
+  {
+    std::stringstream surfaceDiceColumnName;
+    surfaceDiceColumnName << "Surface Dice (" << tolerancesMm->GetValue(toleranceIndex) << " mm)";
+    valueColumnNames.push_back(surfaceDiceColumnName.str());
+    std::stringstream addedPathLengthColumnName;
+    addedPathLengthColumnName << "Added path length (" << tolerancesMm->GetValue(toleranceIndex) << " mm)";
+    valueColumnNames.push_back(addedPathLengthColumnName.str());
+  }
+  size_t numberOfPairs = numberOfReferenceSegments * numberOfCompareSegments;
+  for (size_t valueIndex=0; valueIndex<numberOfValuesPerPair; ++valueIndex)
+  {
+    vtkStringArray* column = vtkStringArray::SafeDownCast(tableNode->AddColumn());
+    column->SetName(valueColumnNames[valueIndex].c_str());
+    for (size_t pairIndex=0; pairIndex<numberOfPairs; ++pairIndex)
+    {
+      column->SetVariantValue(pairIndex, vtkVariant(values[pairIndex * numberOfValuesPerPair + valueIndex]));
+    }
+  }
+
+  // Trigger UI update
+  tableNode->Modified();
+
+  if (this->LogSpeedMeasurements)
+  {
+    double checkpointEnd = timer->GetUniversalTime();
+    UNUSED_VARIABLE(checkpointEnd); // Although it is used just below, a warning is logged so needs to be suppressed
+    vtkDebugMacro("ComputeSurfaceDice: Total comparison time for " << numberOfReferenceSegments << "x" << numberOfCompareSegments
+      << " segment pairs at " << numberOfTolerances << " tolerances: " << checkpointEnd-checkpointStart << " s\n"
+      << "\tRasterizing segments: " << checkpointDistanceStart-checkpointStart << " s\n"
+      << "\tSurface distance computation: " << checkpointEnd-checkpointDistanceStart << " s");
+  }
+
+  return "";
+}
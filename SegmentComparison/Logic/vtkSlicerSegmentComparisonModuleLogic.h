@@ -32,7 +32,10 @@
 
 #include "vtkSlicerSegmentComparisonModuleLogicExport.h"
 
+class vtkDoubleArray;
 class vtkMRMLSegmentComparisonNode;
+class vtkMRMLSegmentationNode;
+class vtkMRMLTableNode;
 class vtkSlicerSegmentComparisonModuleLogicPrivate;
 
 /// \ingroup SlicerRt_QtModules_SegmentComparison
@@ -50,14 +53,48 @@ public:
   std::string ComputeDiceStatistics(vtkMRMLSegmentComparisonNode* parameterNode);
 
   /// Compute Hausdorff distances from the selected input segment labelmaps
+  ///
+  /// By default the distances are computed natively (\sa vtkLabelmapSurfaceDistanceFilter) from the Euclidean
+  /// distance transforms of the segment boundaries using multiple threads. The Plastimatch implementation can
+  /// be selected using \sa UsePlastimatchHausdorff
   /// \return Error message, empty string if no error
   std::string ComputeHausdorffDistances(vtkMRMLSegmentComparisonNode* parameterNode);
 
+  /// Compare every segment of the reference segmentation against every segment of the compare segmentation.
+  /// Each segment is rasterized only once into a geometry shared by all segments, then the Dice coefficients and
+  /// the maximum Hausdorff distances (for the boundary voxels) of all pairs are computed. The distance transform of
+  /// each segment boundary is computed only once (\sa vtkLabelmapSurfaceDistanceFilter::ComputePairwiseStatistics).
+  /// The output tables contain a row for each reference segment and a column for each compare segment.
+  /// \param diceTableNode Output table for the Dice coefficients. Dice coefficients are not computed if NULL
+  /// \param hausdorffTableNode Output table for the Hausdorff distances. Hausdorff distances are not computed if NULL
+  /// \return Error message, empty string if no error
+  std::string ComputeComparisonMatrices(vtkMRMLSegmentationNode* referenceSegmentationNode,
+    vtkMRMLSegmentationNode* compareSegmentationNode, vtkMRMLTableNode* diceTableNode, vtkMRMLTableNode* hausdorffTableNode);
+
+  /// Compute surface Dice, added path length, and average symmetric surface distance of every segment of the
+  /// reference segmentation against every segment of the compare segmentation (\sa vtkLabelmapSurfaceDistanceFilter).
+  /// The distance transform of each segment boundary is computed only once and used for all pairs, and the boundary
+  /// distances of each pair are evaluated at all tolerances in the same pass.
+  /// The output table contains a row for each segment pair, and columns for the average symmetric surface distance
+  /// and for the surface Dice and the added path length at each tolerance. Values of pairs with an empty segment are NaN
+  /// \param tolerancesMm Tolerances (mm) at which the surface Dice and the added path length are evaluated
+  /// \param tableNode Output table
+  /// \return Error message, empty string if no error
+  std::string ComputeSurfaceDice(vtkMRMLSegmentationNode* referenceSegmentationNode,
+    vtkMRMLSegmentationNode* compareSegmentationNode, vtkDoubleArray* tolerancesMm, vtkMRMLTableNode* tableNode);
+
 public:
   vtkGetMacro(LogSpeedMeasurements, bool);
   vtkSetMacro(LogSpeedMeasurements, bool);
   vtkBooleanMacro(LogSpeedMeasurements, bool);
 
+  /// Set flag determining whether Hausdorff distances are computed using Plastimatch instead of the native implementation
+  vtkSetMacro(UsePlastimatchHausdorff, bool);
+  /// Get flag determining whether Hausdorff distances are computed using Plastimatch instead of the native implementation
+  vtkGetMacro(UsePlastimatchHausdorff, bool);
+  /// Set flag determining whether Hausdorff distances are computed using Plastimatch instead of the native implementation
+  vtkBooleanMacro(UsePlastimatchHausdorff, bool);
+
 protected:
   /// Set private logic implementation
   void SetLogicPrivate(vtkSlicerSegmentComparisonModuleLogicPrivate* logicPrivate);
@@ -84,6 +121,9 @@ protected:
   /// Flag telling whether the speed measurements are logged on standard output
   bool LogSpeedMeasurements;
 
+  /// Flag determining whether Hausdorff distances are computed using Plastimatch instead of the native implementation
+  bool UsePlastimatchHausdorff;
+
   /// Private implementation class for the logic
   vtkSlicerSegmentComparisonModuleLogicPrivate* LogicPrivate;
 };
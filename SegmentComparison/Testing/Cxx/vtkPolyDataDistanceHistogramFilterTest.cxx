@@ -117,5 +117,42 @@ int vtkPolyDataDistanceHistogramFilterTest( int argc, char* argv[] )
   histogramWriter->SetFileName( histogramFilename );
   histogramWriter->Write();
 
+  // Percentiles are selected from a cached copy of the distances, so repeated queries need to give the same result
+  double percent95Distance = polyDataDistanceHistogramFilter->GetPercent95HausdorffDistance();
+  double medianDistance = polyDataDistanceHistogramFilter->GetNthPercentileHausdorffDistance( 50.0 );
+  if ( polyDataDistanceHistogramFilter->GetPercent95HausdorffDistance() != percent95Distance
+    || medianDistance > percent95Distance )
+  {
+    errorStream << "Inconsistent percentile distances: median " << medianDistance << ", 95% " << percent95Distance << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Serial evaluation needs to give the same distances as the parallel evaluation
+  vtkSmartPointer< vtkDoubleArray > parallelDistances = vtkSmartPointer< vtkDoubleArray >::New();
+  parallelDistances->DeepCopy( rawDistancesDoubleArray );
+  polyDataDistanceHistogramFilter->ParallelEvaluationOff();
+  polyDataDistanceHistogramFilter->Update();
+  vtkDoubleArray* serialDistances = polyDataDistanceHistogramFilter->GetOutputDistances();
+  if ( serialDistances->GetNumberOfValues() != parallelDistances->GetNumberOfValues() )
+  {
+    errorStream << "Number of distances mismatch between serial and parallel evaluation: "
+      << serialDistances->GetNumberOfValues() << " instead of " << parallelDistances->GetNumberOfValues() << std::endl;
+    return EXIT_FAILURE;
+  }
+  for ( vtkIdType i = 0; i < serialDistances->GetNumberOfValues(); ++i )
+  {
+    if ( serialDistances->GetValue( i ) != parallelDistances->GetValue( i ) )
+    {
+      errorStream << "Distance mismatch between serial and parallel evaluation at sample " << i << ": "
+        << serialDistances->GetValue( i ) << " instead of " << parallelDistances->GetValue( i ) << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if ( polyDataDistanceHistogramFilter->GetPercent95HausdorffDistance() != percent95Distance )
+  {
+    errorStream << "95% distance mismatch between serial and parallel evaluation" << std::endl;
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
@@ -21,6 +21,8 @@
 // SegmentComparison includes
 #include "vtkSlicerSegmentComparisonModuleLogic.h"
 #include "vtkMRMLSegmentComparisonNode.h"
+#include "vtkLabelmapOverlapStatisticsFilter.h"
+#include "vtkLabelmapSurfaceDistanceFilter.h"
 
 // Segmentations includes
 #include "vtkMRMLSegmentationNode.h"
@@ -32,15 +34,20 @@
 
 // SegmentationCore includes
 #include "vtkSegmentationConverterFactory.h"
+#include "vtkOrientedImageData.h"
 
 // MRML includes
 #include <vtkMRMLScalarVolumeNode.h>
 #include <vtkMRMLLinearTransformNode.h>
 #include <vtkMRMLScene.h>
+#include <vtkMRMLTableNode.h>
 
 // VTK includes
 #include <vtkNew.h>
+#include <vtkDoubleArray.h>
 #include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkTable.h>
 
 // ITK includes
 #include "itkFactoryRegistration.h"
@@ -48,7 +55,14 @@
 // VTKSYS includes
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <algorithm>
+
 bool CheckIfResultIsWithinOneTenthPercentFromBaseline(double result, double baseline);
+void CreateBoxLabelmap(vtkOrientedImageData* labelmap, const double spacing[3], const int boxExtent[6]);
+int TestSurfaceDistancesOfShiftedBoxes();
+int TestDistanceTransformWithAnisotropicSpacing();
+int TestPairwiseDiceCoefficientsOfBoxes();
 
 //-----------------------------------------------------------------------------
 int vtkSlicerSegmentComparisonModuleLogicTest1( int argc, char * argv[] )
@@ -384,8 +398,9 @@ int vtkSlicerSegmentComparisonModuleLogicTest1( int argc, char * argv[] )
   vtkSmartPointer<vtkSlicerSegmentComparisonModuleLogic> segmentComparisonLogic = vtkSmartPointer<vtkSlicerSegmentComparisonModuleLogic>::New();
   segmentComparisonLogic->SetMRMLScene(mrmlScene);
 
-  // Compute Dice and Hausdorff
+  // Compute Dice and Hausdorff (the baseline Hausdorff distances were computed by Plastimatch)
   std::string errorMessageDice = segmentComparisonLogic->ComputeDiceStatistics(paramNode);
+  segmentComparisonLogic->UsePlastimatchHausdorffOn();
   std::string errorMessageHausdorff = segmentComparisonLogic->ComputeHausdorffDistances(paramNode);
 
   if (!paramNode->GetHausdorffResultsValid() || !paramNode->GetDiceResultsValid())
@@ -418,6 +433,11 @@ int vtkSlicerSegmentComparisonModuleLogicTest1( int argc, char * argv[] )
     result = EXIT_FAILURE;
   }
 
+  // Plastimatch volume statistics, used as baseline for the native implementation
+  double resultHausdorffMaximumForVolumeMm = paramNode->GetMaximumHausdorffDistanceForVolumeMm();
+  double resultHausdorffAverageForVolumeMm = paramNode->GetAverageHausdorffDistanceForVolumeMm();
+  double resultHausdorff95PercentForVolumeMm = paramNode->GetPercent95HausdorffDistanceForVolumeMm();
+
   double resultDiceCoefficient = paramNode->GetDiceCoefficient();
   if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(resultDiceCoefficient, diceCoefficient))
   {
@@ -449,6 +469,134 @@ int vtkSlicerSegmentComparisonModuleLogicTest1( int argc, char * argv[] )
     result = EXIT_FAILURE;
   }
 
+  // Compute Hausdorff distances natively. The maximum is the largest distance between the centers of boundary
+  // voxels in both implementations. The average and the percentile may differ slightly due to the boundary extraction
+  segmentComparisonLogic->UsePlastimatchHausdorffOff();
+  errorMessageHausdorff = segmentComparisonLogic->ComputeHausdorffDistances(paramNode);
+  if (!errorMessageHausdorff.empty() || !paramNode->GetHausdorffResultsValid())
+  {
+    std::cerr << "Failed to compute native Hausdorff distances! " << errorMessageHausdorff << std::endl;
+    return EXIT_FAILURE;
+  }
+  double nativeHausdorffMaximumMm = paramNode->GetMaximumHausdorffDistanceForBoundaryMm();
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(nativeHausdorffMaximumMm, resultHausdorffMaximumMm))
+  {
+    std::cerr << "Native Hausdorff maximum (mm) mismatch: " << nativeHausdorffMaximumMm << " instead of " << resultHausdorffMaximumMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double nativeHausdorffAverageMm = paramNode->GetAverageHausdorffDistanceForBoundaryMm();
+  double nativeHausdorff95PercentMm = paramNode->GetPercent95HausdorffDistanceForBoundaryMm();
+  if ( fabs(nativeHausdorffAverageMm - resultHausdorffAverageMm) > 0.05 * resultHausdorffAverageMm + 0.0001
+    || fabs(nativeHausdorff95PercentMm - resultHausdorff95PercentMm) > 0.05 * resultHausdorff95PercentMm + 0.0001 )
+  {
+    std::cerr << "Native Hausdorff average and 95% (mm) differ by more than 5%: " << nativeHausdorffAverageMm << ", " << nativeHausdorff95PercentMm
+      << " instead of " << resultHausdorffAverageMm << ", " << resultHausdorff95PercentMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+  // The distance of a voxel from the other segment is the distance from its nearest voxel in both implementations
+  double nativeHausdorffMaximumForVolumeMm = paramNode->GetMaximumHausdorffDistanceForVolumeMm();
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(nativeHausdorffMaximumForVolumeMm, resultHausdorffMaximumForVolumeMm))
+  {
+    std::cerr << "Native Hausdorff maximum for volume (mm) mismatch: " << nativeHausdorffMaximumForVolumeMm
+      << " instead of " << resultHausdorffMaximumForVolumeMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double nativeHausdorffAverageForVolumeMm = paramNode->GetAverageHausdorffDistanceForVolumeMm();
+  double nativeHausdorff95PercentForVolumeMm = paramNode->GetPercent95HausdorffDistanceForVolumeMm();
+  if ( fabs(nativeHausdorffAverageForVolumeMm - resultHausdorffAverageForVolumeMm) > 0.05 * resultHausdorffAverageForVolumeMm + 0.0001
+    || fabs(nativeHausdorff95PercentForVolumeMm - resultHausdorff95PercentForVolumeMm) > 0.05 * resultHausdorff95PercentForVolumeMm + 0.0001 )
+  {
+    std::cerr << "Native Hausdorff average and 95% for volume (mm) differ by more than 5%: " << nativeHausdorffAverageForVolumeMm << ", "
+      << nativeHausdorff95PercentForVolumeMm << " instead of " << resultHausdorffAverageForVolumeMm << ", " << resultHausdorff95PercentForVolumeMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // Compute comparison matrices, which need to contain the same results for the only segment pair
+  vtkSmartPointer<vtkMRMLTableNode> diceTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(diceTableNode);
+  vtkSmartPointer<vtkMRMLTableNode> hausdorffTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(hausdorffTableNode);
+  std::string errorMessageMatrices = segmentComparisonLogic->ComputeComparisonMatrices(
+    referenceSegmentationNode, compareSegmentationNode, diceTableNode, hausdorffTableNode);
+  if ( !errorMessageMatrices.empty()
+    || diceTableNode->GetNumberOfRows() != 1 || diceTableNode->GetNumberOfColumns() != 2
+    || hausdorffTableNode->GetNumberOfRows() != 1 || hausdorffTableNode->GetNumberOfColumns() != 2 )
+  {
+    std::cerr << "Failed to compute comparison matrices! " << errorMessageMatrices << std::endl;
+    return EXIT_FAILURE;
+  }
+  double matrixDiceCoefficient = diceTableNode->GetTable()->GetValue(0, 1).ToDouble();
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(matrixDiceCoefficient, resultDiceCoefficient))
+  {
+    std::cerr << "Dice coefficient in comparison matrix mismatch: " << matrixDiceCoefficient << " instead of " << resultDiceCoefficient << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double matrixHausdorffMaximumMm = hausdorffTableNode->GetTable()->GetValue(0, 1).ToDouble();
+  if (!CheckIfResultIsWithinOneTenthPercentFromBaseline(matrixHausdorffMaximumMm, nativeHausdorffMaximumMm))
+  {
+    std::cerr << "Hausdorff maximum (mm) in comparison matrix mismatch: " << matrixHausdorffMaximumMm << " instead of " << nativeHausdorffMaximumMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // Compute surface Dice at increasing tolerances. All boundary voxels are within the Hausdorff distance (the last
+  // tolerance is increased by the 0.1% that the Hausdorff distances of the different computations may differ by)
+  vtkSmartPointer<vtkDoubleArray> tolerancesMm = vtkSmartPointer<vtkDoubleArray>::New();
+  tolerancesMm->InsertNextValue(0.0);
+  tolerancesMm->InsertNextValue(1.0);
+  tolerancesMm->InsertNextValue(nativeHausdorffMaximumMm * 1.001);
+  vtkSmartPointer<vtkMRMLTableNode> surfaceDiceTableNode = vtkSmartPointer<vtkMRMLTableNode>::New();
+  mrmlScene->AddNode(surfaceDiceTableNode);
+  std::string errorMessageSurfaceDice = segmentComparisonLogic->ComputeSurfaceDice(
+    referenceSegmentationNode, compareSegmentationNode, tolerancesMm, surfaceDiceTableNode);
+  if ( !errorMessageSurfaceDice.empty()
+    || surfaceDiceTableNode->GetNumberOfRows() != 1 || surfaceDiceTableNode->GetNumberOfColumns() != 9 )
+  {
+    std::cerr << "Failed to compute surface Dice! " << errorMessageSurfaceDice << std::endl;
+    return EXIT_FAILURE;
+  }
+  double averageSurfaceDistanceMm = surfaceDiceTableNode->GetTable()->GetValue(0, 2).ToDouble();
+  if (averageSurfaceDistanceMm < 0.0 || averageSurfaceDistanceMm > nativeHausdorffMaximumMm)
+  {
+    std::cerr << "Average surface distance (mm) out of range: " << averageSurfaceDistanceMm << std::endl;
+    result = EXIT_FAILURE;
+  }
+  double previousSurfaceDice = 0.0;
+  double previousAddedPathLengthMm = VTK_DOUBLE_MAX;
+  for (int toleranceIndex=0; toleranceIndex<3; ++toleranceIndex)
+  {
+    double surfaceDice = surfaceDiceTableNode->GetTable()->GetValue(0, 3 + 2 * toleranceIndex).ToDouble();
+    double addedPathLengthMm = surfaceDiceTableNode->GetTable()->GetValue(0, 4 + 2 * toleranceIndex).ToDouble();
+    if ( surfaceDice < previousSurfaceDice || surfaceDice > 1.0
+      || addedPathLengthMm > previousAddedPathLengthMm || addedPathLengthMm < 0.0 )
+    {
+      std::cerr << "Surface Dice and added path length (mm) are not monotonic in the tolerance: " << surfaceDice << ", " << addedPathLengthMm
+        << " at " << tolerancesMm->GetValue(toleranceIndex) << " mm" << std::endl;
+      result = EXIT_FAILURE;
+    }
+    previousSurfaceDice = surfaceDice;
+    previousAddedPathLengthMm = addedPathLengthMm;
+  }
+  // The added path length is measured in the slices, so it is not necessarily zero at the Hausdorff distance
+  if (previousSurfaceDice != 1.0)
+  {
+    std::cerr << "Surface Dice at the Hausdorff distance mismatch: " << previousSurfaceDice << " instead of 1" << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // Check the surface metrics and the distance transform against hand-computed values
+  if (TestSurfaceDistancesOfShiftedBoxes() != EXIT_SUCCESS)
+  {
+    result = EXIT_FAILURE;
+  }
+  if (TestDistanceTransformWithAnisotropicSpacing() != EXIT_SUCCESS)
+  {
+    result = EXIT_FAILURE;
+  }
+  if (TestPairwiseDiceCoefficientsOfBoxes() != EXIT_SUCCESS)
+  {
+    result = EXIT_FAILURE;
+  }
+
   return result;
 }
 
@@ -465,3 +613,293 @@ bool CheckIfResultIsWithinOneTenthPercentFromBaseline(double result, double base
 
   return absoluteDifferencePercent < 0.1;
 }
+
+//-----------------------------------------------------------------------------
+// Create box labelmap with the given foreground extent
+void CreateBoxLabelmap(vtkOrientedImageData* labelmap, const double spacing[3], const int boxExtent[6])
+{
+  labelmap->SetExtent(0, 13, 0, 13, 0, 9);
+  labelmap->SetSpacing(spacing[0], spacing[1], spacing[2]);
+  labelmap->AllocateScalars(VTK_UNSIGNED_CHAR, 1);
+  unsigned char* voxelPtr = static_cast<unsigned char*>(labelmap->GetScalarPointer());
+  for (int k=0; k<=9; ++k)
+  {
+    for (int j=0; j<=13; ++j)
+    {
+      for (int i=0; i<=13; ++i)
+      {
+        *(voxelPtr++) = ( i >= boxExtent[0] && i <= boxExtent[1] && j >= boxExtent[2] && j <= boxExtent[3]
+          && k >= boxExtent[4] && k <= boxExtent[5] ) ? 1 : 0;
+      }
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// Compare two 10x10x5 voxel boxes with spacing (1, 1, 2) mm, the compare box shifted by one slice (2 mm).
+// Both boundaries have 308 voxels (500 voxels minus the 8x8x3 interior). The faces perpendicular to the I and J axes
+// have an area of 2 mm^2 and the faces perpendicular to the K axis 1 mm^2, so the surface area of both boxes is
+// 200 + 200 + 200 = 600 mm^2. The reference boundary voxels:
+// - bottom cap (100 voxels, 100 + 80 mm^2 with the sides of the bottom slice): not in the compare box, 2 mm from the
+//   bottom cap of the compare box
+// - top cap interior ring (28 voxels, 28 mm^2): 1 mm from the side of the compare box
+// - top cap interior center (36 voxels, 36 mm^2): 2 mm from the top cap of the compare box
+// - side (144 voxels, 4 * 80 + 36 mm^2 with the top faces of the top slice ring): on the side of the compare box
+// The compare boundary is symmetric, so 2 * (28 + 356) mm^2 of the 1200 mm^2 are within 1.5 mm. The contours of
+// the reference slices are the 36 voxel rings of the 5 slices. The bottom slice has no compare contours, so its ring
+// (36 mm) is added at any tolerance, the rings of the other slices are on the compare contours of the same slice
+int TestSurfaceDistancesOfShiftedBoxes()
+{
+  double spacing[3] = {1.0, 1.0, 2.0};
+  int referenceBoxExtent[6] = {2, 11, 2, 11, 2, 6};
+  int compareBoxExtent[6] = {2, 11, 2, 11, 3, 7};
+  vtkSmartPointer<vtkOrientedImageData> referenceLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateBoxLabelmap(referenceLabelmap, spacing, referenceBoxExtent);
+  vtkSmartPointer<vtkOrientedImageData> compareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateBoxLabelmap(compareLabelmap, spacing, compareBoxExtent);
+
+  vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter> surfaceDistance = vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter>::New();
+  surfaceDistance->SetReferenceLabelmap(referenceLabelmap);
+  surfaceDistance->SetCompareLabelmap(compareLabelmap);
+  if ( !surfaceDistance->Update()
+    || surfaceDistance->GetReferenceBoundaryDistances()->GetNumberOfValues() != 308
+    || surfaceDistance->GetCompareBoundaryDistances()->GetNumberOfValues() != 308 )
+  {
+    std::cerr << "Failed to compute surface distances of shifted boxes!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int result(EXIT_SUCCESS);
+  double tolerance = 1.0e-4;
+  if ( fabs(surfaceDistance->GetMaximumHausdorffDistance() - 2.0) > tolerance
+    || fabs(surfaceDistance->GetAverageSymmetricSurfaceDistance() - 2.0 * (28.0 * 1.0 + 136.0 * 2.0) / 616.0) > tolerance )
+  {
+    std::cerr << "Hausdorff maximum and average surface distance (mm) of shifted boxes mismatch: " << surfaceDistance->GetMaximumHausdorffDistance()
+      << ", " << surfaceDistance->GetAverageSymmetricSurfaceDistance() << " instead of 2, " << 600.0 / 616.0 << std::endl;
+    result = EXIT_FAILURE;
+  }
+  // Tolerance below the shift: only the side and the top ring are within the tolerance
+  if ( fabs(surfaceDistance->GetSurfaceDice(1.5) - 2.0 * (356.0 + 28.0) / 1200.0) > tolerance
+    || fabs(surfaceDistance->GetAddedPathLengthMm(1.5) - 36.0) > tolerance )
+  {
+    std::cerr << "Surface Dice and added path length (mm) of shifted boxes at 1.5 mm mismatch: " << surfaceDistance->GetSurfaceDice(1.5)
+      << ", " << surfaceDistance->GetAddedPathLengthMm(1.5) << " instead of " << 768.0 / 1200.0 << ", 36" << std::endl;
+    result = EXIT_FAILURE;
+  }
+  // Tolerance above the shift: all boundary voxels are within the tolerance, but the bottom slice still has no compare contours
+  if ( fabs(surfaceDistance->GetSurfaceDice(2.5) - 1.0) > tolerance
+    || fabs(surfaceDistance->GetAddedPathLengthMm(2.5) - 36.0) > tolerance )
+  {
+    std::cerr << "Surface Dice and added path length (mm) of shifted boxes at 2.5 mm mismatch: " << surfaceDistance->GetSurfaceDice(2.5)
+      << ", " << surfaceDistance->GetAddedPathLengthMm(2.5) << " instead of 1, 36" << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  // Compute the same pair among others from the distance transforms shared by the pairs.
+  // Pairs: shifted boxes, identical boxes, reference box and empty labelmap
+  int emptyBoxExtent[6] = {0, -1, 0, -1, 0, -1};
+  vtkSmartPointer<vtkOrientedImageData> emptyLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateBoxLabelmap(emptyLabelmap, spacing, emptyBoxExtent);
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > referenceLabelmaps;
+  referenceLabelmaps.push_back(referenceLabelmap);
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > compareLabelmaps;
+  compareLabelmaps.push_back(compareLabelmap);
+  compareLabelmaps.push_back(referenceLabelmap);
+  compareLabelmaps.push_back(emptyLabelmap);
+  vtkSmartPointer<vtkDoubleArray> tolerancesMm = vtkSmartPointer<vtkDoubleArray>::New();
+  tolerancesMm->InsertNextValue(1.5);
+  tolerancesMm->InsertNextValue(2.5);
+  vtkSmartPointer<vtkDoubleArray> pairStatistics = vtkSmartPointer<vtkDoubleArray>::New();
+  if ( !surfaceDistance->ComputePairwiseStatistics(referenceLabelmaps, compareLabelmaps, tolerancesMm, pairStatistics)
+    || pairStatistics->GetNumberOfTuples() != 3 || pairStatistics->GetNumberOfComponents() != 6 )
+  {
+    std::cerr << "Failed to compute pairwise surface distances of boxes!" << std::endl;
+    return EXIT_FAILURE;
+  }
+  double expectedPairStatistics[2][6] =
+  {
+    { 2.0, 600.0 / 616.0, 768.0 / 1200.0, 36.0, 1.0, 36.0 },
+    { 0.0, 0.0, 1.0, 0.0, 1.0, 0.0 }
+  };
+  for (int pairIndex=0; pairIndex<2; ++pairIndex)
+  {
+    for (int component=0; component<6; ++component)
+    {
+      if (fabs(pairStatistics->GetComponent(pairIndex, component) - expectedPairStatistics[pairIndex][component]) > tolerance)
+      {
+        std::cerr << "Pairwise surface distance statistic " << component << " of pair " << pairIndex << " mismatch: "
+          << pairStatistics->GetComponent(pairIndex, component) << " instead of " << expectedPairStatistics[pairIndex][component] << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+  if (!vtkMath::IsNan(pairStatistics->GetComponent(2, 0)))
+  {
+    std::cerr << "Hausdorff distance of the pair with an empty labelmap is " << pairStatistics->GetComponent(2, 0) << " instead of NaN" << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+// Compare a single voxel reference labelmap to a box containing it with anisotropic spacing. The distance of every
+// compare voxel from the reference is the length of its offset from the reference voxel scaled by the spacing, and
+// the distance of the reference voxel from the compare boundary is the distance to the nearest face of the box
+int TestDistanceTransformWithAnisotropicSpacing()
+{
+  double spacing[3] = {0.7, 1.3, 2.1};
+  int referenceVoxel[3] = {3, 2, 2};
+  int referenceBoxExtent[6] = {referenceVoxel[0], referenceVoxel[0], referenceVoxel[1], referenceVoxel[1], referenceVoxel[2], referenceVoxel[2]};
+  int compareBoxExtent[6] = {1, 8, 1, 6, 1, 4};
+  vtkSmartPointer<vtkOrientedImageData> referenceLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateBoxLabelmap(referenceLabelmap, spacing, referenceBoxExtent);
+  vtkSmartPointer<vtkOrientedImageData> compareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+  CreateBoxLabelmap(compareLabelmap, spacing, compareBoxExtent);
+
+  vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter> surfaceDistance = vtkSmartPointer<vtkLabelmapSurfaceDistanceFilter>::New();
+  surfaceDistance->SetReferenceLabelmap(referenceLabelmap);
+  surfaceDistance->SetCompareLabelmap(compareLabelmap);
+  // Boundary of the 8x6x4 box: all voxels except the 6x4x2 interior
+  vtkDoubleArray* compareBoundaryDistances = surfaceDistance->GetCompareBoundaryDistances();
+  if ( !surfaceDistance->Update()
+    || surfaceDistance->GetReferenceBoundaryDistances()->GetNumberOfValues() != 1
+    || compareBoundaryDistances->GetNumberOfValues() != 8*6*4 - 6*4*2 )
+  {
+    std::cerr << "Failed to compute surface distances with anisotropic spacing!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The boundary distances are in voxel order
+  int result(EXIT_SUCCESS);
+  double tolerance = 1.0e-4;
+  vtkIdType boundaryVoxelIndex = 0;
+  double maximumDistance = 0.0;
+  double compareVolumeDistanceSum = 0.0;
+  for (int k=compareBoxExtent[4]; k<=compareBoxExtent[5]; ++k)
+  {
+    for (int j=compareBoxExtent[2]; j<=compareBoxExtent[3]; ++j)
+    {
+      for (int i=compareBoxExtent[0]; i<=compareBoxExtent[1]; ++i)
+      {
+        double offset[3] = { (i - referenceVoxel[0]) * spacing[0], (j - referenceVoxel[1]) * spacing[1], (k - referenceVoxel[2]) * spacing[2] };
+        double distance = sqrt(offset[0]*offset[0] + offset[1]*offset[1] + offset[2]*offset[2]);
+        maximumDistance = std::max(maximumDistance, distance);
+        compareVolumeDistanceSum += distance;
+        if ( i > compareBoxExtent[0] && i < compareBoxExtent[1] && j > compareBoxExtent[2] && j < compareBoxExtent[3]
+          && k > compareBoxExtent[4] && k < compareBoxExtent[5] )
+        {
+          continue;
+        }
+        double boundaryDistance = compareBoundaryDistances->GetValue(boundaryVoxelIndex++);
+        if (fabs(boundaryDistance - distance) > tolerance)
+        {
+          std::cerr << "Distance of compare boundary voxel (" << i << ", " << j << ", " << k << ") mismatch: "
+            << boundaryDistance << " instead of " << distance << std::endl;
+          result = EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  // The nearest face of the box is the one at the J index 1 (1.3 mm)
+  double referenceBoundaryDistance = surfaceDistance->GetReferenceBoundaryDistances()->GetValue(0);
+  if (fabs(referenceBoundaryDistance - 1.3) > tolerance)
+  {
+    std::cerr << "Distance of reference voxel from compare boundary mismatch: " << referenceBoundaryDistance << " instead of 1.3" << std::endl;
+    result = EXIT_FAILURE;
+  }
+  if ( fabs(surfaceDistance->GetMaximumHausdorffDistance() - maximumDistance) > tolerance
+    || fabs(surfaceDistance->GetMaximumHausdorffDistanceForVolume() - maximumDistance) > tolerance )
+  {
+    std::cerr << "Hausdorff maximum for boundary and volume (mm) with anisotropic spacing mismatch: " << surfaceDistance->GetMaximumHausdorffDistance()
+      << ", " << surfaceDistance->GetMaximumHausdorffDistanceForVolume() << " instead of " << maximumDistance << std::endl;
+    result = EXIT_FAILURE;
+  }
+  // The reference voxel is inside the compare box, so only the compare voxels contribute to the volume average
+  double expectedAverageForVolume = 0.5 * compareVolumeDistanceSum / (8*6*4);
+  if (fabs(surfaceDistance->GetAverageHausdorffDistanceForVolume() - expectedAverageForVolume) > tolerance)
+  {
+    std::cerr << "Hausdorff average for volume (mm) with anisotropic spacing mismatch: " << surfaceDistance->GetAverageHausdorffDistanceForVolume()
+      << " instead of " << expectedAverageForVolume << std::endl;
+    result = EXIT_FAILURE;
+  }
+
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+// Compute the Dice coefficients of boxes pairwise and compare them to the coefficients of the pairs computed one by one.
+// The pairs include overlapping, nested, touching, disjoint, and empty labelmaps. The 10x10x5 reference box and the
+// compare box shifted by one slice overlap in 10x10x4 voxels, so their Dice coefficient is 2*400 / (500+500) = 0.8
+int TestPairwiseDiceCoefficientsOfBoxes()
+{
+  double spacing[3] = {1.0, 1.0, 2.0};
+  int referenceBoxExtents[3][6] =
+  {
+    {2, 11, 2, 11, 2, 6}, // 10x10x5 box
+    {0, 3, 0, 3, 0, 2},   // corner box overlapping the first one in 2x2x1 voxels
+    {0, -1, 0, -1, 0, -1} // empty
+  };
+  int compareBoxExtents[5][6] =
+  {
+    {2, 11, 2, 11, 3, 7},   // shifted by one slice
+    {2, 11, 2, 11, 2, 6},   // identical to the first reference box
+    {12, 13, 12, 13, 7, 9}, // diagonally adjacent to the first reference box, disjoint from it
+    {4, 5, 4, 5, 4, 4},     // nested in the first reference box
+    {0, -1, 0, -1, 0, -1}   // empty
+  };
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > referenceLabelmaps;
+  for (int referenceIndex=0; referenceIndex<3; ++referenceIndex)
+  {
+    vtkSmartPointer<vtkOrientedImageData> referenceLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    CreateBoxLabelmap(referenceLabelmap, spacing, referenceBoxExtents[referenceIndex]);
+    referenceLabelmaps.push_back(referenceLabelmap);
+  }
+  std::vector<vtkSmartPointer<vtkOrientedImageData> > compareLabelmaps;
+  for (int compareIndex=0; compareIndex<5; ++compareIndex)
+  {
+    vtkSmartPointer<vtkOrientedImageData> compareLabelmap = vtkSmartPointer<vtkOrientedImageData>::New();
+    CreateBoxLabelmap(compareLabelmap, spacing, compareBoxExtents[compareIndex]);
+    compareLabelmaps.push_back(compareLabelmap);
+  }
+
+  vtkSmartPointer<vtkLabelmapOverlapStatisticsFilter> overlapStatistics = vtkSmartPointer<vtkLabelmapOverlapStatisticsFilter>::New();
+  vtkSmartPointer<vtkDoubleArray> diceCoefficients = vtkSmartPointer<vtkDoubleArray>::New();
+  if ( !overlapStatistics->ComputePairwiseDiceCoefficients(referenceLabelmaps, compareLabelmaps, diceCoefficients)
+    || diceCoefficients->GetNumberOfTuples() != 15 || diceCoefficients->GetNumberOfComponents() != 1 )
+  {
+    std::cerr << "Failed to compute pairwise Dice coefficients of boxes!" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  int result(EXIT_SUCCESS);
+  double tolerance = 1.0e-9;
+  if (fabs(diceCoefficients->GetValue(0) - 0.8) > tolerance)
+  {
+    std::cerr << "Pairwise Dice coefficient of shifted boxes mismatch: " << diceCoefficients->GetValue(0) << " instead of 0.8" << std::endl;
+    result = EXIT_FAILURE;
+  }
+  for (int referenceIndex=0; referenceIndex<3; ++referenceIndex)
+  {
+    overlapStatistics->SetReferenceLabelmap(referenceLabelmaps[referenceIndex]);
+    for (int compareIndex=0; compareIndex<5; ++compareIndex)
+    {
+      overlapStatistics->SetCompareLabelmap(compareLabelmaps[compareIndex]);
+      if (!overlapStatistics->Update())
+      {
+        std::cerr << "Failed to compute overlap statistics of boxes " << referenceIndex << " and " << compareIndex << "!" << std::endl;
+        return EXIT_FAILURE;
+      }
+      double pairDiceCoefficient = diceCoefficients->GetValue(referenceIndex * 5 + compareIndex);
+      if (fabs(pairDiceCoefficient - overlapStatistics->GetDiceCoefficient()) > tolerance)
+      {
+        std::cerr << "Pairwise Dice coefficient of boxes " << referenceIndex << " and " << compareIndex << " mismatch: "
+          << pairDiceCoefficient << " instead of " << overlapStatistics->GetDiceCoefficient() << std::endl;
+        result = EXIT_FAILURE;
+      }
+    }
+  }
+
+  return result;
+}
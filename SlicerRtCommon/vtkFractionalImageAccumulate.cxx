@@ -63,6 +63,128 @@ int vtkFractionalImageAccumulate::RequestInformation (
   return 1;
 }
 
+//----------------------------------------------------------------------------
+// Converts fractional labelmap values to fractions in the range of [0,1].
+template <class FractionalImageScalarType>
+class vtkFractionalImageAccumulateFractionConverter
+{
+public:
+  vtkFractionalImageAccumulateFractionConverter(double minimumFractionalValue, double maximumFractionalValue)
+    : MinimumFractionalValue(minimumFractionalValue)
+    , MaximumFractionalValue(maximumFractionalValue)
+    {
+    }
+
+  inline double operator()(FractionalImageScalarType value) const
+    {
+    return ( value - this->MinimumFractionalValue ) / (this->MaximumFractionalValue - this->MinimumFractionalValue);
+    }
+
+private:
+  double MinimumFractionalValue;
+  double MaximumFractionalValue;
+};
+
+//----------------------------------------------------------------------------
+// Fractional labelmaps are typically 8-bit (char or unsigned char), so the
+// fractions for all the possible values are computed in advance (with the same
+// expression as in the generic case, so that the results are identical).
+template <class FractionalImageScalarType>
+class vtkFractionalImageAccumulateFractionTable
+{
+public:
+  vtkFractionalImageAccumulateFractionTable(double minimumFractionalValue, double maximumFractionalValue)
+    {
+    for (int byteValue = 0; byteValue <= VTK_UNSIGNED_CHAR_MAX; ++byteValue)
+      {
+      FractionalImageScalarType value = static_cast<FractionalImageScalarType>(static_cast<unsigned char>(byteValue));
+      this->Fractions[byteValue] = ( value - minimumFractionalValue ) / (maximumFractionalValue - minimumFractionalValue);
+      }
+    }
+
+  inline double operator()(FractionalImageScalarType value) const
+    {
+    return this->Fractions[static_cast<unsigned char>(value)];
+    }
+
+private:
+  double Fractions[VTK_UNSIGNED_CHAR_MAX+1];
+};
+
+template <>
+class vtkFractionalImageAccumulateFractionConverter<char> : public vtkFractionalImageAccumulateFractionTable<char>
+{
+public:
+  vtkFractionalImageAccumulateFractionConverter(double minimumFractionalValue, double maximumFractionalValue)
+    : vtkFractionalImageAccumulateFractionTable<char>(minimumFractionalValue, maximumFractionalValue) { }
+};
+
+template <>
+class vtkFractionalImageAccumulateFractionConverter<signed char> : public vtkFractionalImageAccumulateFractionTable<signed char>
+{
+public:
+  vtkFractionalImageAccumulateFractionConverter(double minimumFractionalValue, double maximumFractionalValue)
+    : vtkFractionalImageAccumulateFractionTable<signed char>(minimumFractionalValue, maximumFractionalValue) { }
+};
+
+template <>
+class vtkFractionalImageAccumulateFractionConverter<unsigned char> : public vtkFractionalImageAccumulateFractionTable<unsigned char>
+{
+public:
+  vtkFractionalImageAccumulateFractionConverter(double minimumFractionalValue, double maximumFractionalValue)
+    : vtkFractionalImageAccumulateFractionTable<unsigned char>(minimumFractionalValue, maximumFractionalValue) { }
+};
+
+//----------------------------------------------------------------------------
+// Fast path for the common case of single component images (e.g. dose volumes).
+// Accumulates one span of the stencil. The order of operations is the same as
+// in the generic multi-component loop, so the results are identical.
+template <class BaseImageScalarType, class FractionalImageScalarType>
+void vtkFractionalImageAccumulateSingleComponentSpan(
+  BaseImageScalarType* inPtr, BaseImageScalarType* spanEndPtr,
+  FractionalImageScalarType* fractionalPtr, bool useFractionalLabelmap,
+  const vtkFractionalImageAccumulateFractionConverter<FractionalImageScalarType>& fractionConverter,
+  bool ignoreZero, double origin, double spacing, int outExtent[2], double* outPtr,
+  double& sum, double& sumSqr, double& min, double& max,
+  vtkIdType& voxelCount, double& fractionalVoxelCount)
+{
+  for (; inPtr != spanEndPtr; ++inPtr)
+    {
+    double v = static_cast<double>(*inPtr);
+    double f = 1.0;
+    if (useFractionalLabelmap)
+      {
+      f = fractionConverter(*fractionalPtr++);
+      }
+
+    double total = 0.0;
+    if (!ignoreZero || v != 0)
+      {
+      // gather statistics
+      sum += v*f;
+      sumSqr += v*v*f*f;
+      if (v > max)
+        {
+        max = v;
+        }
+      if (v < min)
+        {
+        min = v;
+        }
+      ++voxelCount;
+      fractionalVoxelCount += f;
+      total = f;
+      }
+
+    // compute the index and increment the bin if it is in range
+    int outIdx = vtkMath::Floor((v - origin) / spacing);
+    if (outIdx >= outExtent[0] && outIdx <= outExtent[1])
+      {
+      outPtr[outIdx - outExtent[0]] += total;
+      }
+    }
+}
+
 //----------------------------------------------------------------------------
 template<class BaseImageScalarType>
 int vtkFractionalImageAccumulateExecute(vtkFractionalImageAccumulate *self,
@@ -163,6 +285,13 @@ int vtkFractionalImageAccumulateExecute2(vtkFractionalImageAccumulate *self,
   vtkImageData* fractionalLabelmap = self->GetFractionalLabelmap();
   vtkImageStencilIterator<FractionalImageScalarType> fractionalIter(fractionalLabelmap, stencil, updateExtent, self);
 
+  // Get parameters outside the voxel loop
+  bool useFractionalLabelmap = self->GetUseFractionalLabelmap();
+  vtkFractionalImageAccumulateFractionConverter<FractionalImageScalarType> fractionConverter(
+    self->GetMinimumFractionalValue(), self->GetMaximumFractionalValue() );
+  // Single component images use the fast path if the bins are contiguous
+  bool singleComponent = (numC == 1 && outIncs[0] == 1);
+
   while (!inIter.IsAtEnd())
     {
     if (inIter.IsInStencil() ^ reverseStencil)
@@ -172,6 +301,14 @@ int vtkFractionalImageAccumulateExecute2(vtkFractionalImageAccumulate *self,
 
       FractionalImageScalarType* fractionalPtr = (FractionalImageScalarType*)fractionalIter.BeginSpan();
 
+      if (singleComponent)
+        {
+        vtkFractionalImageAccumulateSingleComponentSpan(inPtr, spanEndPtr, fractionalPtr, useFractionalLabelmap,
+          fractionConverter, ignoreZero, origin[0], spacing[0], outExtent, outPtr,
+          sum[0], sumSqr[0], min[0], max[0], *voxelCount, *fractionalVoxelCount);
+        inPtr = spanEndPtr;
+        }
+
       while (inPtr != spanEndPtr)
         {
         // find the bin for this pixel.
@@ -185,9 +322,9 @@ int vtkFractionalImageAccumulateExecute2(vtkFractionalImageAccumulate *self,
           double v = static_cast<double>(*inPtr++);
           double f = 1.0;
 
-          if (self->GetUseFractionalLabelmap())
+          if (useFractionalLabelmap)
           {
-            f = ( (*fractionalPtr++) - self->GetMinimumFractionalValue() ) / (self->GetMaximumFractionalValue() - self->GetMinimumFractionalValue());
+            f = fractionConverter(*fractionalPtr++);
           }
 
           if (!ignoreZero || v != 0)
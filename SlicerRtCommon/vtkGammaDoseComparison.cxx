@@ -0,0 +1,826 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkGammaDoseComparison.h"
+
+// VTK includes
+#include <vtkCommand.h>
+#include <vtkImageCast.h>
+#include <vtkImageData.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+//----------------------------------------------------------------------------
+/// Number of voxels along each axis of the blocks for which the compare dose bounds are computed
+static const int GAMMA_BOUND_BLOCK_SIZE = 4;
+/// Number of groups of slices after which progress is reported
+static const int GAMMA_NUMBER_OF_PROGRESS_STEPS = 10;
+
+//----------------------------------------------------------------------------
+/// Voxel offset within the search sphere
+struct vtkGammaDoseComparisonOffset
+{
+  int Offset[3];
+  /// Offset in the scalar array
+  vtkIdType Increment;
+  /// Squared distance of the offset divided by the squared DTA tolerance
+  double NormalizedDistanceSquared;
+
+  bool operator<(const vtkGammaDoseComparisonOffset& other) const
+  {
+    return this->NormalizedDistanceSquared < other.NormalizedDistanceSquared;
+  }
+};
+
+//----------------------------------------------------------------------------
+template <class MaskScalarType>
+void vtkGammaDoseComparisonGetMask(vtkImageData* maskImage, MaskScalarType* maskPtr, std::vector<unsigned char>& mask)
+{
+  vtkIdType numberOfVoxels = maskImage->GetNumberOfPoints();
+  mask.resize(numberOfVoxels);
+  for (vtkIdType i=0; i<numberOfVoxels; ++i)
+  {
+    mask[i] = (maskPtr[i] != 0 ? 1 : 0);
+  }
+}
+
+//----------------------------------------------------------------------------
+// Trilinear interpolation of the dose at a voxel index plus fractional offsets. The neighbor along an axis
+// is only accessed if the fraction along that axis is non-zero, so the last voxel can be sampled as well.
+static inline double vtkGammaDoseComparisonInterpolate(const float* dosePtr, const vtkIdType* dimensions,
+  vtkIdType i, vtkIdType j, vtkIdType k, double fi, double fj, double fk)
+{
+  vtkIdType base = (k * dimensions[1] + j) * dimensions[0] + i;
+  vtkIdType di = (fi > 0.0 ? 1 : 0);
+  vtkIdType dj = (fj > 0.0 ? dimensions[0] : 0);
+  vtkIdType dk = (fk > 0.0 ? dimensions[0] * dimensions[1] : 0);
+  double c00 = dosePtr[base] * (1.0-fi) + dosePtr[base+di] * fi;
+  double c10 = dosePtr[base+dj] * (1.0-fi) + dosePtr[base+dj+di] * fi;
+  double c01 = dosePtr[base+dk] * (1.0-fi) + dosePtr[base+dk+di] * fi;
+  double c11 = dosePtr[base+dk+dj] * (1.0-fi) + dosePtr[base+dk+dj+di] * fi;
+  double c0 = c00 * (1.0-fj) + c10 * fj;
+  double c1 = c01 * (1.0-fj) + c11 * fj;
+  return c0 * (1.0-fk) + c1 * fk;
+}
+
+//----------------------------------------------------------------------------
+// Computes the minimum and maximum dose of each block of voxels. A block covers the voxels from its first
+// voxel to the first voxel of the next block (inclusive), so the bounds also hold for any dose interpolated
+// between the voxels whose lower corner is in the block.
+static void vtkGammaDoseComparisonComputeBlockBounds(const float* dosePtr, const vtkIdType* dimensions,
+  vtkIdType* blockDimensions, std::vector<float>& blockMinimum, std::vector<float>& blockMaximum)
+{
+  const int blockSize = GAMMA_BOUND_BLOCK_SIZE;
+  for (int axis=0; axis<3; ++axis)
+  {
+    blockDimensions[axis] = (dimensions[axis] - 1) / blockSize + 1;
+  }
+  blockMinimum.resize(blockDimensions[0] * blockDimensions[1] * blockDimensions[2]);
+  blockMaximum.resize(blockMinimum.size());
+
+  vtkIdType blockIndex = 0;
+  for (vtkIdType bk=0; bk<blockDimensions[2]; ++bk)
+  {
+    vtkIdType lastK = std::min(bk*blockSize + blockSize, dimensions[2]-1);
+    for (vtkIdType bj=0; bj<blockDimensions[1]; ++bj)
+    {
+      vtkIdType lastJ = std::min(bj*blockSize + blockSize, dimensions[1]-1);
+      for (vtkIdType bi=0; bi<blockDimensions[0]; ++bi, ++blockIndex)
+      {
+        vtkIdType lastI = std::min(bi*blockSize + blockSize, dimensions[0]-1);
+        float minimum = dosePtr[(bk*blockSize * dimensions[1] + bj*blockSize) * dimensions[0] + bi*blockSize];
+        float maximum = minimum;
+        for (vtkIdType k=bk*blockSize; k<=lastK; ++k)
+        {
+          for (vtkIdType j=bj*blockSize; j<=lastJ; ++j)
+          {
+            const float* rowPtr = dosePtr + (k * dimensions[1] + j) * dimensions[0];
+            for (vtkIdType i=bi*blockSize; i<=lastI; ++i)
+            {
+              minimum = std::min(minimum, rowPtr[i]);
+              maximum = std::max(maximum, rowPtr[i]);
+            }
+          }
+        }
+        blockMinimum[blockIndex] = minimum;
+        blockMaximum[blockIndex] = maximum;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Computes the gamma values of a range of slices. The results of each voxel only depend on the inputs,
+// and the pass statistics are counted per slice, so the results do not depend on the number of threads.
+class vtkGammaDoseComparisonFunctor
+{
+public:
+  vtkGammaDoseComparisonFunctor(const float* referencePtr, const float* comparePtr, const unsigned char* maskPtr, float* gammaPtr,
+    const int* extent, const std::vector<vtkGammaDoseComparisonOffset>& offsets, const int* searchRadius,
+    double doseTolerance, double thresholdDose, double maximumGamma, bool localGamma, bool thresholdOnReferenceOnly, bool passFailOnly,
+    std::vector<vtkIdType>& analyzedVoxelsPerSlice, std::vector<vtkIdType>& passingVoxelsPerSlice)
+    : ReferencePtr(referencePtr)
+    , ComparePtr(comparePtr)
+    , MaskPtr(maskPtr)
+    , GammaPtr(gammaPtr)
+    , Extent(extent)
+    , Offsets(offsets)
+    , SearchRadius(searchRadius)
+    , DoseTolerance(doseTolerance)
+    , ThresholdDose(thresholdDose)
+    , MaximumGamma(maximumGamma)
+    , LocalGamma(localGamma)
+    , ThresholdOnReferenceOnly(thresholdOnReferenceOnly)
+    , PassFailOnly(passFailOnly)
+    , AnalyzedVoxelsPerSlice(analyzedVoxelsPerSlice)
+    , PassingVoxelsPerSlice(passingVoxelsPerSlice)
+    , BlockMinimum(NULL)
+    , BlockMaximum(NULL)
+    , BlockDimensions(NULL)
+    , SamplingRate(1)
+    , PruneSearch(true)
+    , InterpolationsPerSlice(NULL)
+  {
+    this->AxisWeight[0] = this->AxisWeight[1] = this->AxisWeight[2] = 0.0;
+  }
+
+  /// Enable sampling the compare dose between the voxels. If pruning is enabled, then the search is done in
+  /// the blocks of the compare dose bounds whose lower bound of gamma is below the minimum found so far.
+  /// Otherwise every position within the search sphere is sampled.
+  void SetInterpolatedSearch(const float* blockMinimum, const float* blockMaximum, const vtkIdType* blockDimensions,
+    const double* spacing, double dtaDistanceTolerance, int samplingRate, bool pruneSearch, std::vector<vtkIdType>& interpolationsPerSlice)
+  {
+    this->BlockMinimum = blockMinimum;
+    this->BlockMaximum = blockMaximum;
+    this->BlockDimensions = blockDimensions;
+    this->SamplingRate = samplingRate;
+    this->PruneSearch = pruneSearch;
+    this->InterpolationsPerSlice = &interpolationsPerSlice;
+    // Normalized squared distance of a unit step in index space along each axis
+    for (int axis=0; axis<3; ++axis)
+    {
+      this->AxisWeight[axis] = spacing[axis] * spacing[axis] / (dtaDistanceTolerance * dtaDistanceTolerance);
+    }
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    const int* extent = this->Extent;
+    vtkIdType dimensions[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+    double maximumGammaSquared = this->MaximumGamma * this->MaximumGamma;
+    size_t numberOfOffsets = this->Offsets.size();
+    const vtkGammaDoseComparisonOffset* offsets = (numberOfOffsets > 0 ? &(this->Offsets[0]) : NULL);
+    std::vector<std::pair<double, vtkIdType> > candidateBlocks;
+
+    for (vtkIdType k=begin; k<end; ++k)
+    {
+      vtkIdType analyzedVoxels = 0;
+      vtkIdType passingVoxels = 0;
+      vtkIdType interpolations = 0;
+      bool interiorK = (k - this->SearchRadius[2] >= 0 && k + this->SearchRadius[2] < dimensions[2]);
+      for (vtkIdType j=0; j<dimensions[1]; ++j)
+      {
+        bool interiorJK = interiorK && (j - this->SearchRadius[1] >= 0 && j + this->SearchRadius[1] < dimensions[1]);
+        vtkIdType rowStart = (k * dimensions[1] + j) * dimensions[0];
+        for (vtkIdType i=0; i<dimensions[0]; ++i)
+        {
+          vtkIdType voxelIndex = rowStart + i;
+          this->GammaPtr[voxelIndex] = 0.0f;
+          if (this->MaskPtr && !this->MaskPtr[voxelIndex])
+          {
+            continue;
+          }
+
+          // Skip voxels below the analysis threshold
+          double referenceDose = this->ReferencePtr[voxelIndex];
+          if (referenceDose < this->ThresholdDose
+            && (this->ThresholdOnReferenceOnly || this->ComparePtr[voxelIndex] < this->ThresholdDose) )
+          {
+            continue;
+          }
+
+          double doseTolerance = (this->LocalGamma ? this->DoseTolerance * referenceDose : this->DoseTolerance);
+          double inverseDoseToleranceSquared = (doseTolerance > 0.0 ? 1.0 / (doseTolerance * doseTolerance) : 0.0);
+          bool interior = interiorJK && (i - this->SearchRadius[0] >= 0 && i + this->SearchRadius[0] < dimensions[0]);
+
+          // Visit the compare voxels in the order of increasing distance. Once the distance term alone
+          // reaches the current minimum, no further voxel can improve it.
+          double gammaSquared = maximumGammaSquared;
+          for (size_t offsetIndex=0; offsetIndex<numberOfOffsets; ++offsetIndex)
+          {
+            const vtkGammaDoseComparisonOffset& offset = offsets[offsetIndex];
+            if (offset.NormalizedDistanceSquared >= gammaSquared)
+            {
+              break;
+            }
+            if ( !interior
+              && ( i+offset.Offset[0] < 0 || i+offset.Offset[0] >= dimensions[0]
+                || j+offset.Offset[1] < 0 || j+offset.Offset[1] >= dimensions[1]
+                || k+offset.Offset[2] < 0 || k+offset.Offset[2] >= dimensions[2] ) )
+            {
+              continue;
+            }
+            double doseDifference = this->ComparePtr[voxelIndex + offset.Increment] - referenceDose;
+            double currentGammaSquared = offset.NormalizedDistanceSquared;
+            if (doseTolerance > 0.0)
+            {
+              currentGammaSquared += doseDifference * doseDifference * inverseDoseToleranceSquared;
+            }
+            else if (doseDifference != 0.0)
+            {
+              continue;
+            }
+            if (currentGammaSquared < gammaSquared)
+            {
+              gammaSquared = currentGammaSquared;
+              if (this->PassFailOnly && gammaSquared <= 1.0)
+              {
+                break;
+              }
+            }
+          }
+
+          // Refine the minimum between the voxels where the compare dose bounds still allow a lower gamma value
+          if ( this->InterpolationsPerSlice && doseTolerance > 0.0 && gammaSquared > 0.0
+            && !(this->PassFailOnly && gammaSquared <= 1.0) )
+          {
+            interpolations += ( this->PruneSearch
+              ? this->RefineGammaSquared(i, j, k, dimensions, referenceDose, inverseDoseToleranceSquared, candidateBlocks, gammaSquared)
+              : this->SearchAllSamples(i, j, k, dimensions, referenceDose, inverseDoseToleranceSquared, gammaSquared) );
+          }
+
+          double gamma = std::min(sqrt(gammaSquared), this->MaximumGamma);
+          this->GammaPtr[voxelIndex] = static_cast<float>(gamma);
+          ++analyzedVoxels;
+          if (gamma <= 1.0)
+          {
+            ++passingVoxels;
+          }
+        }
+      }
+      this->AnalyzedVoxelsPerSlice[k] = analyzedVoxels;
+      this->PassingVoxelsPerSlice[k] = passingVoxels;
+      if (this->InterpolationsPerSlice)
+      {
+        (*this->InterpolationsPerSlice)[k] = interpolations;
+      }
+    }
+  }
+
+  /// Search the compare dose between the voxels around a reference voxel.
+  /// \param gammaSquared Minimum squared gamma found so far, updated if a lower value is found
+  /// \return Number of interpolations done
+  vtkIdType RefineGammaSquared(vtkIdType i, vtkIdType j, vtkIdType k, const vtkIdType* dimensions, double referenceDose,
+    double inverseDoseToleranceSquared, std::vector<std::pair<double, vtkIdType> >& candidateBlocks, double& gammaSquared)
+  {
+    const int blockSize = GAMMA_BOUND_BLOCK_SIZE;
+    const vtkIdType voxel[3] = {i, j, k};
+    const vtkIdType* blockDimensions = this->BlockDimensions;
+    const double* axisWeight = this->AxisWeight;
+
+    // Collect the blocks within the search radius in which gamma can be lower than the current minimum.
+    // The lower bound of gamma in a block is given by its distance and the dose difference from its dose range.
+    candidateBlocks.clear();
+    vtkIdType blockRange[6] = {0, -1, 0, -1, 0, -1};
+    for (int axis=0; axis<3; ++axis)
+    {
+      double radius = sqrt(gammaSquared / axisWeight[axis]);
+      vtkIdType first = std::max<vtkIdType>(0, static_cast<vtkIdType>(floor(voxel[axis] - radius)));
+      vtkIdType last = std::min<vtkIdType>(dimensions[axis]-1, static_cast<vtkIdType>(ceil(voxel[axis] + radius)));
+      blockRange[2*axis] = first / blockSize;
+      blockRange[2*axis+1] = last / blockSize;
+    }
+    for (vtkIdType bk=blockRange[4]; bk<=blockRange[5]; ++bk)
+    {
+      for (vtkIdType bj=blockRange[2]; bj<=blockRange[3]; ++bj)
+      {
+        for (vtkIdType bi=blockRange[0]; bi<=blockRange[1]; ++bi)
+        {
+          const vtkIdType block[3] = {bi, bj, bk};
+          double lowerBound = 0.0;
+          for (int axis=0; axis<3; ++axis)
+          {
+            vtkIdType first = block[axis] * blockSize;
+            vtkIdType last = std::min<vtkIdType>(first + blockSize, dimensions[axis]-1);
+            vtkIdType distance = (voxel[axis] < first ? first - voxel[axis] : (voxel[axis] > last ? voxel[axis] - last : 0));
+            lowerBound += distance * distance * axisWeight[axis];
+          }
+          if (lowerBound >= gammaSquared)
+          {
+            continue;
+          }
+          vtkIdType blockIndex = (bk * blockDimensions[1] + bj) * blockDimensions[0] + bi;
+          double doseDifference = 0.0;
+          if (referenceDose < this->BlockMinimum[blockIndex])
+          {
+            doseDifference = this->BlockMinimum[blockIndex] - referenceDose;
+          }
+          else if (referenceDose > this->BlockMaximum[blockIndex])
+          {
+            doseDifference = referenceDose - this->BlockMaximum[blockIndex];
+          }
+          lowerBound += doseDifference * doseDifference * inverseDoseToleranceSquared;
+          if (lowerBound < gammaSquared)
+          {
+            candidateBlocks.push_back(std::make_pair(lowerBound, blockIndex));
+          }
+        }
+      }
+    }
+    std::sort(candidateBlocks.begin(), candidateBlocks.end());
+
+    // Sample the candidate blocks in the order of their lower bounds. Sample positions are in units of
+    // 1/SamplingRate voxel, and each block samples the positions from its first voxel to the next block.
+    const vtkIdType rate = this->SamplingRate;
+    vtkIdType interpolations = 0;
+    for (size_t candidateIndex=0; candidateIndex<candidateBlocks.size(); ++candidateIndex)
+    {
+      if (candidateBlocks[candidateIndex].first >= gammaSquared)
+      {
+        break;
+      }
+      vtkIdType blockIndex = candidateBlocks[candidateIndex].second;
+      const vtkIdType block[3] = {
+        blockIndex % blockDimensions[0],
+        (blockIndex / blockDimensions[0]) % blockDimensions[1],
+        blockIndex / (blockDimensions[0] * blockDimensions[1]) };
+      vtkIdType sampleRange[6] = {0, -1, 0, -1, 0, -1};
+      bool emptyRange = false;
+      for (int axis=0; axis<3; ++axis)
+      {
+        double radius = sqrt(gammaSquared / axisWeight[axis]) * rate;
+        sampleRange[2*axis] = std::max<vtkIdType>(block[axis] * blockSize * rate,
+          static_cast<vtkIdType>(ceil(voxel[axis] * rate - radius)));
+        vtkIdType lastSample = (block[axis] == blockDimensions[axis]-1 ? (dimensions[axis]-1) * rate : (block[axis]+1) * blockSize * rate - 1);
+        sampleRange[2*axis+1] = std::min<vtkIdType>(lastSample, static_cast<vtkIdType>(floor(voxel[axis] * rate + radius)));
+        emptyRange = emptyRange || (sampleRange[2*axis] > sampleRange[2*axis+1]);
+      }
+      if (emptyRange)
+      {
+        continue;
+      }
+
+      for (vtkIdType sk=sampleRange[4]; sk<=sampleRange[5]; ++sk)
+      {
+        double distanceK = static_cast<double>(sk - voxel[2] * rate) / rate;
+        double distanceSquaredK = distanceK * distanceK * axisWeight[2];
+        if (distanceSquaredK >= gammaSquared)
+        {
+          continue;
+        }
+        for (vtkIdType sj=sampleRange[2]; sj<=sampleRange[3]; ++sj)
+        {
+          double distanceJ = static_cast<double>(sj - voxel[1] * rate) / rate;
+          double distanceSquaredJK = distanceSquaredK + distanceJ * distanceJ * axisWeight[1];
+          if (distanceSquaredJK >= gammaSquared)
+          {
+            continue;
+          }
+          for (vtkIdType si=sampleRange[0]; si<=sampleRange[1]; ++si)
+          {
+            // Voxel positions have already been visited by the search on the voxel lattice
+            if (si % rate == 0 && sj % rate == 0 && sk % rate == 0)
+            {
+              continue;
+            }
+            double distanceI = static_cast<double>(si - voxel[0] * rate) / rate;
+            double currentGammaSquared = distanceSquaredJK + distanceI * distanceI * axisWeight[0];
+            if (currentGammaSquared >= gammaSquared)
+            {
+              continue;
+            }
+            double compareDose = vtkGammaDoseComparisonInterpolate(this->ComparePtr, dimensions,
+              si / rate, sj / rate, sk / rate,
+              static_cast<double>(si % rate) / rate, static_cast<double>(sj % rate) / rate, static_cast<double>(sk % rate) / rate);
+            ++interpolations;
+            double doseDifference = compareDose - referenceDose;
+            currentGammaSquared += doseDifference * doseDifference * inverseDoseToleranceSquared;
+            if (currentGammaSquared < gammaSquared)
+            {
+              gammaSquared = currentGammaSquared;
+              if (this->PassFailOnly && gammaSquared <= 1.0)
+              {
+                return interpolations;
+              }
+            }
+          }
+        }
+      }
+    }
+    return interpolations;
+  }
+
+  /// Sample the compare dose at every position between the voxels within the search sphere around a reference voxel,
+  /// without using the compare dose bounds. Gives the same minimum as \sa RefineGammaSquared with many more interpolations.
+  /// \param gammaSquared Minimum squared gamma found so far, updated if a lower value is found
+  /// \return Number of interpolations done
+  vtkIdType SearchAllSamples(vtkIdType i, vtkIdType j, vtkIdType k, const vtkIdType* dimensions, double referenceDose,
+    double inverseDoseToleranceSquared, double& gammaSquared)
+  {
+    const vtkIdType voxel[3] = {i, j, k};
+    const double* axisWeight = this->AxisWeight;
+    const vtkIdType rate = this->SamplingRate;
+    double maximumGammaSquared = this->MaximumGamma * this->MaximumGamma;
+    vtkIdType sampleRange[6] = {0, -1, 0, -1, 0, -1};
+    for (int axis=0; axis<3; ++axis)
+    {
+      double radius = sqrt(maximumGammaSquared / axisWeight[axis]) * rate;
+      sampleRange[2*axis] = std::max<vtkIdType>(0, static_cast<vtkIdType>(ceil(voxel[axis] * rate - radius)));
+      sampleRange[2*axis+1] = std::min<vtkIdType>((dimensions[axis]-1) * rate, static_cast<vtkIdType>(floor(voxel[axis] * rate + radius)));
+    }
+
+    vtkIdType interpolations = 0;
+    for (vtkIdType sk=sampleRange[4]; sk<=sampleRange[5]; ++sk)
+    {
+      double distanceK = static_cast<double>(sk - voxel[2] * rate) / rate;
+      double distanceSquaredK = distanceK * distanceK * axisWeight[2];
+      for (vtkIdType sj=sampleRange[2]; sj<=sampleRange[3]; ++sj)
+      {
+        double distanceJ = static_cast<double>(sj - voxel[1] * rate) / rate;
+        double distanceSquaredJK = distanceSquaredK + distanceJ * distanceJ * axisWeight[1];
+        for (vtkIdType si=sampleRange[0]; si<=sampleRange[1]; ++si)
+        {
+          // Voxel positions have already been visited by the search on the voxel lattice
+          if (si % rate == 0 && sj % rate == 0 && sk % rate == 0)
+          {
+            continue;
+          }
+          double distanceI = static_cast<double>(si - voxel[0] * rate) / rate;
+          double currentGammaSquared = distanceSquaredJK + distanceI * distanceI * axisWeight[0];
+          if (currentGammaSquared >= maximumGammaSquared)
+          {
+            continue;
+          }
+          double compareDose = vtkGammaDoseComparisonInterpolate(this->ComparePtr, dimensions,
+            si / rate, sj / rate, sk / rate,
+            static_cast<double>(si % rate) / rate, static_cast<double>(sj % rate) / rate, static_cast<double>(sk % rate) / rate);
+          ++interpolations;
+          double doseDifference = compareDose - referenceDose;
+          currentGammaSquared += doseDifference * doseDifference * inverseDoseToleranceSquared;
+          if (currentGammaSquared < gammaSquared)
+          {
+            gammaSquared = currentGammaSquared;
+          }
+        }
+      }
+    }
+    return interpolations;
+  }
+
+private:
+  const float* ReferencePtr;
+  const float* ComparePtr;
+  const unsigned char* MaskPtr;
+  float* GammaPtr;
+  const int* Extent;
+  const std::vector<vtkGammaDoseComparisonOffset>& Offsets;
+  const int* SearchRadius;
+  double DoseTolerance;
+  double ThresholdDose;
+  double MaximumGamma;
+  bool LocalGamma;
+  bool ThresholdOnReferenceOnly;
+  bool PassFailOnly;
+  std::vector<vtkIdType>& AnalyzedVoxelsPerSlice;
+  std::vector<vtkIdType>& PassingVoxelsPerSlice;
+  const float* BlockMinimum;
+  const float* BlockMaximum;
+  const vtkIdType* BlockDimensions;
+  double AxisWeight[3];
+  int SamplingRate;
+  bool PruneSearch;
+  std::vector<vtkIdType>* InterpolationsPerSlice;
+};
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkGammaDoseComparison);
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparison::vtkGammaDoseComparison()
+{
+  this->ReferenceImage = NULL;
+  this->CompareImage = NULL;
+  this->MaskImage = NULL;
+  this->GammaImage = vtkImageData::New();
+
+  this->DtaDistanceTolerance = 3.0;
+  this->DoseDifferenceTolerance = 0.03;
+  this->ReferenceDose = 0.0;
+  this->AnalysisThreshold = 0.1;
+  this->MaximumGamma = 2.0;
+  this->LocalGamma = false;
+  this->ThresholdOnReferenceOnly = false;
+  this->PassFailOnly = false;
+  this->InterpolatedSearch = false;
+  this->InterpolationSamplingRate = 4;
+  this->PruneInterpolatedSearch = true;
+
+  this->NumberOfAnalyzedVoxels = 0;
+  this->NumberOfPassingVoxels = 0;
+  this->UsedReferenceDose = 0.0;
+  this->NumberOfInterpolations = 0;
+}
+
+//----------------------------------------------------------------------------
+vtkGammaDoseComparison::~vtkGammaDoseComparison()
+{
+  this->SetReferenceImage(NULL);
+  this->SetCompareImage(NULL);
+  this->SetMaskImage(NULL);
+  if (this->GammaImage)
+  {
+    this->GammaImage->Delete();
+    this->GammaImage = NULL;
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparison::SetReferenceImage(vtkImageData* referenceImage)
+{
+  if (this->ReferenceImage == referenceImage)
+  {
+    return;
+  }
+  if (this->ReferenceImage)
+  {
+    this->ReferenceImage->UnRegister(this);
+  }
+  this->ReferenceImage = referenceImage;
+  if (this->ReferenceImage)
+  {
+    this->ReferenceImage->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparison::SetCompareImage(vtkImageData* compareImage)
+{
+  if (this->CompareImage == compareImage)
+  {
+    return;
+  }
+  if (this->CompareImage)
+  {
+    this->CompareImage->UnRegister(this);
+  }
+  this->CompareImage = compareImage;
+  if (this->CompareImage)
+  {
+    this->CompareImage->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparison::SetMaskImage(vtkImageData* maskImage)
+{
+  if (this->MaskImage == maskImage)
+  {
+    return;
+  }
+  if (this->MaskImage)
+  {
+    this->MaskImage->UnRegister(this);
+  }
+  this->MaskImage = maskImage;
+  if (this->MaskImage)
+  {
+    this->MaskImage->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+double vtkGammaDoseComparison::GetPassFraction()
+{
+  if (this->NumberOfAnalyzedVoxels == 0)
+  {
+    return 0.0;
+  }
+  return static_cast<double>(this->NumberOfPassingVoxels) / static_cast<double>(this->NumberOfAnalyzedVoxels);
+}
+
+//----------------------------------------------------------------------------
+bool vtkGammaDoseComparison::Update()
+{
+  this->NumberOfAnalyzedVoxels = 0;
+  this->NumberOfPassingVoxels = 0;
+  this->UsedReferenceDose = 0.0;
+  this->NumberOfInterpolations = 0;
+
+  if (!this->ReferenceImage || !this->CompareImage)
+  {
+    vtkErrorMacro("Update: Reference and compare images need to be set");
+    return false;
+  }
+  if (this->ReferenceImage->GetNumberOfScalarComponents() != 1 || this->CompareImage->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("Update: Reference and compare images need to have a single scalar component");
+    return false;
+  }
+  int extent[6] = {0, -1, 0, -1, 0, -1};
+  this->ReferenceImage->GetExtent(extent);
+  int compareExtent[6] = {0, -1, 0, -1, 0, -1};
+  this->CompareImage->GetExtent(compareExtent);
+  int maskExtent[6] = {0, -1, 0, -1, 0, -1};
+  if (this->MaskImage)
+  {
+    this->MaskImage->GetExtent(maskExtent);
+  }
+  for (int i=0; i<6; ++i)
+  {
+    if (compareExtent[i] != extent[i] || (this->MaskImage && maskExtent[i] != extent[i]))
+    {
+      vtkErrorMacro("Update: Compare and mask images need to have the same extent as the reference image");
+      return false;
+    }
+  }
+  if (this->DtaDistanceTolerance <= 0.0 || this->MaximumGamma <= 0.0)
+  {
+    vtkErrorMacro("Update: DTA tolerance and maximum gamma need to be positive");
+    return false;
+  }
+
+  this->GammaImage->Initialize();
+  this->GammaImage->SetExtent(extent);
+  this->GammaImage->SetOrigin(this->ReferenceImage->GetOrigin());
+  this->GammaImage->SetSpacing(this->ReferenceImage->GetSpacing());
+  this->GammaImage->AllocateScalars(VTK_FLOAT, 1);
+  if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+  {
+    return true;
+  }
+
+  // The computation is done on float doses
+  vtkSmartPointer<vtkImageData> referenceImage = this->ReferenceImage;
+  if (referenceImage->GetScalarType() != VTK_FLOAT)
+  {
+    vtkSmartPointer<vtkImageCast> cast = vtkSmartPointer<vtkImageCast>::New();
+    cast->SetInputData(this->ReferenceImage);
+    cast->SetOutputScalarTypeToFloat();
+    cast->Update();
+    referenceImage = cast->GetOutput();
+  }
+  vtkSmartPointer<vtkImageData> compareImage = this->CompareImage;
+  if (compareImage->GetScalarType() != VTK_FLOAT)
+  {
+    vtkSmartPointer<vtkImageCast> cast = vtkSmartPointer<vtkImageCast>::New();
+    cast->SetInputData(this->CompareImage);
+    cast->SetOutputScalarTypeToFloat();
+    cast->Update();
+    compareImage = cast->GetOutput();
+  }
+  std::vector<unsigned char> mask;
+  if (this->MaskImage)
+  {
+    switch (this->MaskImage->GetScalarType())
+    {
+      vtkTemplateMacro( vtkGammaDoseComparisonGetMask( this->MaskImage, static_cast<VTK_TT*>(this->MaskImage->GetScalarPointer()), mask ) );
+    default:
+      vtkErrorMacro("Update: Unsupported mask scalar type");
+      return false;
+    }
+  }
+
+  // Reference dose for the global dose difference tolerance and the analysis threshold
+  this->UsedReferenceDose = this->ReferenceDose;
+  if (this->UsedReferenceDose <= 0.0)
+  {
+    this->UsedReferenceDose = referenceImage->GetScalarRange()[1];
+  }
+
+  // Offsets within the search sphere, sorted by distance. Compare voxels farther than DTA * maximum gamma
+  // cannot yield a gamma value below the maximum, so they do not need to be visited.
+  double spacing[3] = {1.0, 1.0, 1.0};
+  referenceImage->GetSpacing(spacing);
+  vtkIdType increments[3] = { 1, extent[1]-extent[0]+1, (extent[1]-extent[0]+1) * (extent[3]-extent[2]+1) };
+  double searchRadiusMm = this->DtaDistanceTolerance * this->MaximumGamma;
+  double maximumGammaSquared = this->MaximumGamma * this->MaximumGamma;
+  int searchRadius[3] = {0, 0, 0};
+  for (int axis=0; axis<3; ++axis)
+  {
+    searchRadius[axis] = static_cast<int>( floor(searchRadiusMm / fabs(spacing[axis])) );
+    searchRadius[axis] = std::min(searchRadius[axis], extent[2*axis+1] - extent[2*axis]);
+  }
+  std::vector<vtkGammaDoseComparisonOffset> offsets;
+  for (int dk=-searchRadius[2]; dk<=searchRadius[2]; ++dk)
+  {
+    for (int dj=-searchRadius[1]; dj<=searchRadius[1]; ++dj)
+    {
+      for (int di=-searchRadius[0]; di<=searchRadius[0]; ++di)
+      {
+        double distanceSquared = (di*spacing[0])*(di*spacing[0]) + (dj*spacing[1])*(dj*spacing[1]) + (dk*spacing[2])*(dk*spacing[2]);
+        double normalizedDistanceSquared = distanceSquared / (this->DtaDistanceTolerance * this->DtaDistanceTolerance);
+        if (normalizedDistanceSquared >= maximumGammaSquared)
+        {
+          continue;
+        }
+        vtkGammaDoseComparisonOffset offset;
+        offset.Offset[0] = di;
+        offset.Offset[1] = dj;
+        offset.Offset[2] = dk;
+        offset.Increment = di*increments[0] + dj*increments[1] + dk*increments[2];
+        offset.NormalizedDistanceSquared = normalizedDistanceSquared;
+        offsets.push_back(offset);
+      }
+    }
+  }
+  std::stable_sort(offsets.begin(), offsets.end());
+
+  // Compute gamma for the slabs of the volume in parallel
+  int numberOfSlices = extent[5] - extent[4] + 1;
+  std::vector<vtkIdType> analyzedVoxelsPerSlice(numberOfSlices, 0);
+  std::vector<vtkIdType> passingVoxelsPerSlice(numberOfSlices, 0);
+  vtkGammaDoseComparisonFunctor functor(
+    static_cast<float*>(referenceImage->GetScalarPointer()), static_cast<float*>(compareImage->GetScalarPointer()),
+    (mask.empty() ? NULL : &(mask[0])), static_cast<float*>(this->GammaImage->GetScalarPointer()),
+    extent, offsets, searchRadius,
+    this->DoseDifferenceTolerance * (this->LocalGamma ? 1.0 : this->UsedReferenceDose), this->AnalysisThreshold * this->UsedReferenceDose,
+    this->MaximumGamma, this->LocalGamma, this->ThresholdOnReferenceOnly, this->PassFailOnly,
+    analyzedVoxelsPerSlice, passingVoxelsPerSlice );
+
+  // Compute the compare dose bounds once for pruning the interpolated search
+  vtkIdType dimensions[3] = { extent[1]-extent[0]+1, extent[3]-extent[2]+1, extent[5]-extent[4]+1 };
+  vtkIdType blockDimensions[3] = {0, 0, 0};
+  std::vector<float> blockMinimum;
+  std::vector<float> blockMaximum;
+  std::vector<vtkIdType> interpolationsPerSlice(numberOfSlices, 0);
+  if (this->InterpolatedSearch)
+  {
+    vtkGammaDoseComparisonComputeBlockBounds(static_cast<float*>(compareImage->GetScalarPointer()), dimensions,
+      blockDimensions, blockMinimum, blockMaximum);
+    functor.SetInterpolatedSearch(&(blockMinimum[0]), &(blockMaximum[0]), blockDimensions,
+      spacing, this->DtaDistanceTolerance, this->InterpolationSamplingRate, this->PruneInterpolatedSearch, interpolationsPerSlice);
+  }
+
+  // Process the slices in groups, and report progress between the groups from the calling thread,
+  // so that the observers are not invoked from the worker threads
+  double progress = 0.0;
+  this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+  int slicesPerProgressStep = (numberOfSlices + GAMMA_NUMBER_OF_PROGRESS_STEPS - 1) / GAMMA_NUMBER_OF_PROGRESS_STEPS;
+  for (int firstSlice=0; firstSlice<numberOfSlices; firstSlice+=slicesPerProgressStep)
+  {
+    int endSlice = std::min(firstSlice + slicesPerProgressStep, numberOfSlices);
+    vtkSMPTools::For(firstSlice, endSlice, functor);
+    progress = static_cast<double>(endSlice) / numberOfSlices;
+    this->InvokeEvent(vtkCommand::ProgressEvent, &progress);
+  }
+
+  for (int k=0; k<numberOfSlices; ++k)
+  {
+    this->NumberOfAnalyzedVoxels += analyzedVoxelsPerSlice[k];
+    this->NumberOfPassingVoxels += passingVoxelsPerSlice[k];
+    this->NumberOfInterpolations += interpolationsPerSlice[k];
+  }
+
+  this->GammaImage->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkGammaDoseComparison::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os,indent);
+  os << indent << "ReferenceImage: " << this->ReferenceImage << "\n";
+  os << indent << "CompareImage: " << this->CompareImage << "\n";
+  os << indent << "MaskImage: " << this->MaskImage << "\n";
+  os << indent << "DtaDistanceTolerance: " << this->DtaDistanceTolerance << "\n";
+  os << indent << "DoseDifferenceTolerance: " << this->DoseDifferenceTolerance << "\n";
+  os << indent << "ReferenceDose: " << this->ReferenceDose << "\n";
+  os << indent << "AnalysisThreshold: " << this->AnalysisThreshold << "\n";
+  os << indent << "MaximumGamma: " << this->MaximumGamma << "\n";
+  os << indent << "LocalGamma: " << (this->LocalGamma ? "true" : "false") << "\n";
+  os << indent << "ThresholdOnReferenceOnly: " << (this->ThresholdOnReferenceOnly ? "true" : "false") << "\n";
+  os << indent << "PassFailOnly: " << (this->PassFailOnly ? "true" : "false") << "\n";
+  os << indent << "InterpolatedSearch: " << (this->InterpolatedSearch ? "true" : "false") << "\n";
+  os << indent << "InterpolationSamplingRate: " << this->InterpolationSamplingRate << "\n";
+  os << indent << "PruneInterpolatedSearch: " << (this->PruneInterpolatedSearch ? "true" : "false") << "\n";
+  os << indent << "NumberOfAnalyzedVoxels: " << this->NumberOfAnalyzedVoxels << "\n";
+  os << indent << "NumberOfPassingVoxels: " << this->NumberOfPassingVoxels << "\n";
+  os << indent << "NumberOfInterpolations: " << this->NumberOfInterpolations << "\n";
+}
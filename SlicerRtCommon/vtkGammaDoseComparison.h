@@ -0,0 +1,212 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkGammaDoseComparison_h
+#define __vtkGammaDoseComparison_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+class vtkImageData;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Compute gamma dose comparison of two dose images on the same lattice
+///
+/// Same metric as the gamma dose comparison of Plastimatch: for each reference voxel above the analysis
+/// threshold (and inside the mask, if any) the gamma value is the minimum over the compare voxels of
+/// sqrt( distance^2 / DTA^2 + doseDifference^2 / doseTolerance^2 ), clamped to \sa MaximumGamma.
+/// Voxels that are not analyzed get a gamma value of 0.
+///
+/// The compare image needs to be resampled to the lattice of the reference image before the computation.
+/// The search is limited to the sphere in which a compare voxel can still yield a gamma value below the
+/// maximum (radius DTA * MaximumGamma). The offsets within the sphere are visited in the order of increasing
+/// distance, so the search of a voxel stops as soon as the distance term alone reaches the current minimum.
+/// The volume is split into slabs that are processed in parallel using vtkSMPTools. Progress is reported
+/// by vtkCommand::ProgressEvent (the call data is a pointer to the progress as a double between 0 and 1).
+///
+/// If \sa InterpolatedSearch is enabled, then the compare dose is also sampled between the voxels using
+/// trilinear interpolation. The minimum and maximum compare dose of each block of voxels is computed once,
+/// and the blocks that cannot yield a lower gamma value than the best one found on the voxel lattice are
+/// skipped before doing any interpolation.
+class VTK_SLICERRTCOMMON_EXPORT vtkGammaDoseComparison : public vtkObject
+{
+public:
+  static vtkGammaDoseComparison* New();
+  vtkTypeMacro(vtkGammaDoseComparison, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+public:
+  /// Set reference dose image
+  void SetReferenceImage(vtkImageData* referenceImage);
+  /// Get reference dose image
+  vtkGetObjectMacro(ReferenceImage, vtkImageData);
+
+  /// Set compare dose image. Needs to have the same extent and spacing as the reference dose image
+  void SetCompareImage(vtkImageData* compareImage);
+  /// Get compare dose image
+  vtkGetObjectMacro(CompareImage, vtkImageData);
+
+  /// Set optional mask image. Only the voxels where the mask is non-zero are analyzed.
+  /// Needs to have the same extent as the reference dose image
+  void SetMaskImage(vtkImageData* maskImage);
+  /// Get mask image
+  vtkGetObjectMacro(MaskImage, vtkImageData);
+
+  /// Compute gamma image and pass statistics
+  /// \return Success flag
+  bool Update();
+
+  /// Get gamma image computed by \sa Update (on the lattice of the reference image)
+  vtkGetObjectMacro(GammaImage, vtkImageData);
+  /// Get number of voxels above the analysis threshold (and inside the mask)
+  vtkGetMacro(NumberOfAnalyzedVoxels, vtkIdType);
+  /// Get number of analyzed voxels with gamma value of at most 1
+  vtkGetMacro(NumberOfPassingVoxels, vtkIdType);
+  /// Get fraction of the analyzed voxels that pass (between 0 and 1)
+  double GetPassFraction();
+  /// Get reference dose used for the dose difference tolerance and the analysis threshold in the last \sa Update
+  vtkGetMacro(UsedReferenceDose, double);
+  /// Get number of compare dose interpolations done in the last \sa Update (only if \sa InterpolatedSearch is enabled)
+  vtkGetMacro(NumberOfInterpolations, vtkIdType);
+
+  /// Set distance to agreement (DTA) tolerance in mm
+  vtkSetMacro(DtaDistanceTolerance, double);
+  /// Get distance to agreement (DTA) tolerance in mm
+  vtkGetMacro(DtaDistanceTolerance, double);
+
+  /// Set dose difference tolerance as a fraction of the reference dose (e.g. 0.03 for 3%)
+  vtkSetMacro(DoseDifferenceTolerance, double);
+  /// Get dose difference tolerance as a fraction of the reference dose
+  vtkGetMacro(DoseDifferenceTolerance, double);
+
+  /// Set reference dose (Gy). If not positive, then the maximum of the reference image is used
+  vtkSetMacro(ReferenceDose, double);
+  /// Get reference dose (Gy)
+  vtkGetMacro(ReferenceDose, double);
+
+  /// Set analysis threshold as a fraction of the reference dose. Voxels below the threshold are not analyzed
+  vtkSetMacro(AnalysisThreshold, double);
+  /// Get analysis threshold as a fraction of the reference dose
+  vtkGetMacro(AnalysisThreshold, double);
+
+  /// Set maximum gamma value. Gamma values are clamped to this value, which also limits the search radius
+  vtkSetMacro(MaximumGamma, double);
+  /// Get maximum gamma value
+  vtkGetMacro(MaximumGamma, double);
+
+  /// Set flag determining whether the dose difference tolerance is relative to the local reference dose
+  /// of each voxel (local gamma) instead of the reference dose (global gamma)
+  vtkSetMacro(LocalGamma, bool);
+  /// Get local gamma flag
+  vtkGetMacro(LocalGamma, bool);
+  /// Set local gamma flag
+  vtkBooleanMacro(LocalGamma, bool);
+
+  /// Set flag determining whether only the reference dose is checked against the analysis threshold.
+  /// If disabled, then a voxel is analyzed if either the reference or the compare dose is above the threshold
+  vtkSetMacro(ThresholdOnReferenceOnly, bool);
+  /// Get flag determining whether only the reference dose is checked against the analysis threshold
+  vtkGetMacro(ThresholdOnReferenceOnly, bool);
+  /// Set flag determining whether only the reference dose is checked against the analysis threshold
+  vtkBooleanMacro(ThresholdOnReferenceOnly, bool);
+
+  /// Set flag determining whether the search of a voxel stops as soon as it is proven to pass (gamma <= 1).
+  /// The pass statistics are the same, but the gamma values of the passing voxels are then only upper bounds.
+  vtkSetMacro(PassFailOnly, bool);
+  /// Get flag determining whether the search of a voxel stops as soon as it is proven to pass
+  vtkGetMacro(PassFailOnly, bool);
+  /// Set flag determining whether the search of a voxel stops as soon as it is proven to pass
+  vtkBooleanMacro(PassFailOnly, bool);
+
+  /// Set flag determining whether the compare dose is sampled between the voxels using trilinear interpolation
+  vtkSetMacro(InterpolatedSearch, bool);
+  /// Get flag determining whether the compare dose is sampled between the voxels
+  vtkGetMacro(InterpolatedSearch, bool);
+  /// Set flag determining whether the compare dose is sampled between the voxels
+  vtkBooleanMacro(InterpolatedSearch, bool);
+
+  /// Set number of samples per voxel along each axis in the interpolated search (e.g. 4 for quarter voxel steps)
+  vtkSetClampMacro(InterpolationSamplingRate, int, 1, 32);
+  /// Get number of samples per voxel along each axis in the interpolated search
+  vtkGetMacro(InterpolationSamplingRate, int);
+
+  /// Set flag determining whether the interpolated search skips the blocks that cannot yield a lower gamma value (on by default).
+  /// If disabled, then every position within the search sphere is sampled. The gamma values are the same, but the number of
+  /// interpolations is much higher, so it is only useful as a reference.
+  vtkSetMacro(PruneInterpolatedSearch, bool);
+  /// Get flag determining whether the interpolated search skips the blocks that cannot yield a lower gamma value
+  vtkGetMacro(PruneInterpolatedSearch, bool);
+  /// Set flag determining whether the interpolated search skips the blocks that cannot yield a lower gamma value
+  vtkBooleanMacro(PruneInterpolatedSearch, bool);
+
+protected:
+  vtkGammaDoseComparison();
+  virtual ~vtkGammaDoseComparison();
+
+protected:
+  /// Reference dose image
+  vtkImageData* ReferenceImage;
+  /// Compare dose image
+  vtkImageData* CompareImage;
+  /// Mask image
+  vtkImageData* MaskImage;
+  /// Output gamma image
+  vtkImageData* GammaImage;
+
+  /// Distance to agreement tolerance in mm
+  double DtaDistanceTolerance;
+  /// Dose difference tolerance as a fraction of the reference dose
+  double DoseDifferenceTolerance;
+  /// Reference dose. Maximum of the reference image is used if not positive
+  double ReferenceDose;
+  /// Analysis threshold as a fraction of the reference dose
+  double AnalysisThreshold;
+  /// Maximum gamma value
+  double MaximumGamma;
+  /// Local gamma flag
+  bool LocalGamma;
+  /// Flag determining whether only the reference dose is checked against the analysis threshold
+  bool ThresholdOnReferenceOnly;
+  /// Flag determining whether the search of a voxel stops as soon as it is proven to pass
+  bool PassFailOnly;
+  /// Flag determining whether the compare dose is sampled between the voxels
+  bool InterpolatedSearch;
+  /// Number of samples per voxel along each axis in the interpolated search
+  int InterpolationSamplingRate;
+  /// Flag determining whether the interpolated search skips the blocks that cannot yield a lower gamma value
+  bool PruneInterpolatedSearch;
+
+  /// Number of voxels analyzed in the last update
+  vtkIdType NumberOfAnalyzedVoxels;
+  /// Number of analyzed voxels that passed in the last update
+  vtkIdType NumberOfPassingVoxels;
+  /// Reference dose used in the last update
+  double UsedReferenceDose;
+  /// Number of compare dose interpolations in the last update
+  vtkIdType NumberOfInterpolations;
+
+private:
+  vtkGammaDoseComparison(const vtkGammaDoseComparison&); // Not implemented
+  void operator=(const vtkGammaDoseComparison&);         // Not implemented
+};
+
+#endif // __vtkGammaDoseComparison_h
@@ -0,0 +1,803 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkMultiLabelImageAccumulate.h"
+
+// VTK includes
+#include <vtkImageData.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+// Threshold above the background value for a voxel to be considered inside the labelmap.
+// Same as the one used for creating stencils from labelmaps for DVH computation.
+static const double LABELMAP_THRESHOLD_EPSILON = 1e-10;
+
+//----------------------------------------------------------------------------
+struct vtkMultiLabelImageAccumulateEntry
+{
+  vtkMultiLabelImageAccumulateEntry()
+    : MinimumValue(0.0)
+    , MaximumValue(1.0)
+    , BinOrigin(0.0)
+    , BinSpacing(1.0)
+    , NumberOfBins(0)
+    , VoxelCount(0)
+    , FractionalVoxelCount(0.0)
+    , Sum(0.0)
+    , Min(VTK_DOUBLE_MAX)
+    , Max(VTK_DOUBLE_MIN)
+    , HistogramUnderflow(0.0)
+  {
+    for (int i=0; i<6; ++i)
+    {
+      this->Extent[i] = 0;
+    }
+  }
+
+  /// Reset results before accumulation
+  void Reset()
+  {
+    this->VoxelCount = 0;
+    this->FractionalVoxelCount = 0.0;
+    this->Sum = 0.0;
+    this->Min = VTK_DOUBLE_MAX;
+    this->Max = VTK_DOUBLE_MIN;
+    this->HistogramUnderflow = 0.0;
+    this->Histogram.assign(this->NumberOfBins > 0 ? this->NumberOfBins : 0, 0.0);
+  }
+
+  // Inputs
+  vtkSmartPointer<vtkImageData> Labelmap;
+  double MinimumValue;
+  double MaximumValue;
+  double BinOrigin;
+  double BinSpacing;
+  int NumberOfBins;
+
+  /// Labelmap extent clipped to the input image extent (empty if no overlap)
+  int Extent[6];
+
+  // Results
+  vtkIdType VoxelCount;
+  double FractionalVoxelCount;
+  double Sum;
+  double Min;
+  double Max;
+  std::vector<double> Histogram;
+  /// (Fractional) number of voxels below the first histogram bin
+  double HistogramUnderflow;
+
+  /// Fractions of all the possible values of 8-bit labelmaps (indexed by the value cast to unsigned char).
+  /// Empty for other labelmap types.
+  std::vector<double> FractionTable;
+};
+
+//----------------------------------------------------------------------------
+class vtkMultiLabelImageAccumulate::vtkInternal
+{
+public:
+  std::vector<vtkMultiLabelImageAccumulateEntry> Entries;
+};
+
+//----------------------------------------------------------------------------
+// Fill the fraction table of an 8-bit labelmap. The fractions are computed with the same
+// expression as in the generic case, so that the results are identical.
+template <class LabelScalarType>
+void vtkMultiLabelImageAccumulateFillFractionTable(LabelScalarType* vtkNotUsed(labelTypePtr), vtkMultiLabelImageAccumulateEntry& entry)
+{
+  double fractionalRange = entry.MaximumValue - entry.MinimumValue;
+  entry.FractionTable.resize(VTK_UNSIGNED_CHAR_MAX+1);
+  for (int byteValue = 0; byteValue <= VTK_UNSIGNED_CHAR_MAX; ++byteValue)
+  {
+    LabelScalarType value = static_cast<LabelScalarType>(static_cast<unsigned char>(byteValue));
+    entry.FractionTable[byteValue] = (static_cast<double>(value) - entry.MinimumValue) / fractionalRange;
+  }
+}
+
+//----------------------------------------------------------------------------
+// Converts fractional labelmap values to fractions in the range of [0,1].
+template <class LabelScalarType>
+class vtkMultiLabelImageAccumulateFractionConverter
+{
+public:
+  vtkMultiLabelImageAccumulateFractionConverter(const vtkMultiLabelImageAccumulateEntry& entry)
+    : MinimumValue(entry.MinimumValue)
+    , FractionalRange(entry.MaximumValue - entry.MinimumValue)
+  {
+  }
+
+  inline double operator()(LabelScalarType value) const
+  {
+    return (static_cast<double>(value) - this->MinimumValue) / this->FractionalRange;
+  }
+
+private:
+  double MinimumValue;
+  double FractionalRange;
+};
+
+//----------------------------------------------------------------------------
+// Fractional labelmaps are typically 8-bit (char or unsigned char), so the fractions
+// of all the possible values are looked up from the table of the labelmap entry.
+template <class LabelScalarType>
+class vtkMultiLabelImageAccumulateFractionTableConverter
+{
+public:
+  vtkMultiLabelImageAccumulateFractionTableConverter(const vtkMultiLabelImageAccumulateEntry& entry)
+    : Fractions(entry.FractionTable.empty() ? NULL : &(entry.FractionTable[0]))
+  {
+  }
+
+  inline double operator()(LabelScalarType value) const
+  {
+    return this->Fractions[static_cast<unsigned char>(value)];
+  }
+
+private:
+  const double* Fractions;
+};
+
+template <>
+class vtkMultiLabelImageAccumulateFractionConverter<char> : public vtkMultiLabelImageAccumulateFractionTableConverter<char>
+{
+public:
+  vtkMultiLabelImageAccumulateFractionConverter(const vtkMultiLabelImageAccumulateEntry& entry)
+    : vtkMultiLabelImageAccumulateFractionTableConverter<char>(entry) { }
+};
+
+template <>
+class vtkMultiLabelImageAccumulateFractionConverter<signed char> : public vtkMultiLabelImageAccumulateFractionTableConverter<signed char>
+{
+public:
+  vtkMultiLabelImageAccumulateFractionConverter(const vtkMultiLabelImageAccumulateEntry& entry)
+    : vtkMultiLabelImageAccumulateFractionTableConverter<signed char>(entry) { }
+};
+
+template <>
+class vtkMultiLabelImageAccumulateFractionConverter<unsigned char> : public vtkMultiLabelImageAccumulateFractionTableConverter<unsigned char>
+{
+public:
+  vtkMultiLabelImageAccumulateFractionConverter(const vtkMultiLabelImageAccumulateEntry& entry)
+    : vtkMultiLabelImageAccumulateFractionTableConverter<unsigned char>(entry) { }
+};
+
+//----------------------------------------------------------------------------
+// Accumulate one row of voxels within a labelmap. The order of operations is the same as in
+// vtkImageAccumulate and vtkFractionalImageAccumulate so that the results are identical.
+// The parameters and the running statistics are kept in local variables within the row, and
+// the fractions of 8-bit labelmaps are looked up instead of divided per voxel.
+template <class InputScalarType, class LabelScalarType>
+void vtkMultiLabelImageAccumulateRow(InputScalarType* inPtr, LabelScalarType* labelPtr, int numberOfVoxels,
+                                     bool useFractionalLabelmap, vtkMultiLabelImageAccumulateEntry& entry)
+{
+  const double threshold = (useFractionalLabelmap ? entry.MinimumValue + LABELMAP_THRESHOLD_EPSILON : LABELMAP_THRESHOLD_EPSILON);
+  const vtkMultiLabelImageAccumulateFractionConverter<LabelScalarType> fractionConverter(entry);
+  double* histogram = (entry.Histogram.empty() ? NULL : &(entry.Histogram[0]));
+  const double binOrigin = entry.BinOrigin;
+  const double binSpacing = entry.BinSpacing;
+  const int numberOfBins = entry.NumberOfBins;
+
+  double sum = entry.Sum;
+  double min = entry.Min;
+  double max = entry.Max;
+  vtkIdType voxelCount = entry.VoxelCount;
+  double fractionalVoxelCount = entry.FractionalVoxelCount;
+  double histogramUnderflow = entry.HistogramUnderflow;
+
+  for (int i=0; i<numberOfVoxels; ++i)
+  {
+    if (static_cast<double>(labelPtr[i]) < threshold)
+    {
+      continue;
+    }
+
+    double v = static_cast<double>(inPtr[i]);
+    double f = 1.0;
+    if (useFractionalLabelmap)
+    {
+      f = fractionConverter(labelPtr[i]);
+      sum += v*f;
+    }
+    else
+    {
+      sum += v;
+    }
+    if (v > max)
+    {
+      max = v;
+    }
+    if (v < min)
+    {
+      min = v;
+    }
+    voxelCount++;
+    fractionalVoxelCount += f;
+
+    if (histogram)
+    {
+      int binIndex = vtkMath::Floor((v - binOrigin) / binSpacing);
+      if (binIndex < 0)
+      {
+        histogramUnderflow += f;
+      }
+      else if (binIndex < numberOfBins)
+      {
+        histogram[binIndex] += f;
+      }
+    }
+  }
+
+  entry.Sum = sum;
+  entry.Min = min;
+  entry.Max = max;
+  entry.VoxelCount = voxelCount;
+  entry.FractionalVoxelCount = fractionalVoxelCount;
+  entry.HistogramUnderflow = histogramUnderflow;
+}
+
+//----------------------------------------------------------------------------
+// Get the two input voxel indices and the interpolation weight of the second one along one axis.
+// Continuous indices outside the input extent are clamped to the border (the labelmap extents are
+// clipped to half a voxel around the input extent, same as the border handling of vtkImageReslice).
+inline void vtkMultiLabelImageAccumulateInterpolationIndex(double continuousIndex, int minIndex, int maxIndex,
+                                                           int& index0, int& index1, double& fraction)
+{
+  if (continuousIndex <= minIndex)
+  {
+    index0 = index1 = minIndex;
+    fraction = 0.0;
+    return;
+  }
+  if (continuousIndex >= maxIndex)
+  {
+    index0 = index1 = maxIndex;
+    fraction = 0.0;
+    return;
+  }
+  index0 = vtkMath::Floor(continuousIndex);
+  index1 = index0 + 1;
+  fraction = continuousIndex - index0;
+}
+
+//----------------------------------------------------------------------------
+// Linearly interpolate the input image at the centers of a row of labelmap voxels.
+// The labelmap voxel (x,y,z) is at continuous index (x*scale[0]+offset[0], ...) of the input image.
+template <class InputScalarType>
+void vtkMultiLabelImageAccumulateInterpolateRow(vtkImageData* inputImage, InputScalarType* vtkNotUsed(inputTypePtr),
+                                                int xMin, int xMax, int y, int z, const double* scale, const double* offset,
+                                                double* outPtr)
+{
+  int inputExtent[6] = {0,-1,0,-1,0,-1};
+  inputImage->GetExtent(inputExtent);
+  vtkIdType increments[3] = {0,0,0};
+  inputImage->GetIncrements(increments);
+  InputScalarType* inputPtr = static_cast<InputScalarType*>(inputImage->GetScalarPointer(inputExtent[0], inputExtent[2], inputExtent[4]));
+
+  int y0 = 0, y1 = 0, z0 = 0, z1 = 0;
+  double fy = 0.0, fz = 0.0;
+  vtkMultiLabelImageAccumulateInterpolationIndex(y*scale[1]+offset[1], inputExtent[2], inputExtent[3], y0, y1, fy);
+  vtkMultiLabelImageAccumulateInterpolationIndex(z*scale[2]+offset[2], inputExtent[4], inputExtent[5], z0, z1, fz);
+  InputScalarType* row00 = inputPtr + (y0-inputExtent[2])*increments[1] + (z0-inputExtent[4])*increments[2];
+  InputScalarType* row10 = inputPtr + (y1-inputExtent[2])*increments[1] + (z0-inputExtent[4])*increments[2];
+  InputScalarType* row01 = inputPtr + (y0-inputExtent[2])*increments[1] + (z1-inputExtent[4])*increments[2];
+  InputScalarType* row11 = inputPtr + (y1-inputExtent[2])*increments[1] + (z1-inputExtent[4])*increments[2];
+
+  for (int x=xMin; x<=xMax; ++x)
+  {
+    int x0 = 0, x1 = 0;
+    double fx = 0.0;
+    vtkMultiLabelImageAccumulateInterpolationIndex(x*scale[0]+offset[0], inputExtent[0], inputExtent[1], x0, x1, fx);
+    x0 -= inputExtent[0];
+    x1 -= inputExtent[0];
+    double v00 = row00[x0] + fx*(row00[x1]-row00[x0]);
+    double v10 = row10[x0] + fx*(row10[x1]-row10[x0]);
+    double v01 = row01[x0] + fx*(row01[x1]-row01[x0]);
+    double v11 = row11[x0] + fx*(row11[x1]-row11[x0]);
+    double v0 = v00 + fy*(v10-v00);
+    double v1 = v01 + fy*(v11-v01);
+    *(outPtr++) = v0 + fz*(v1-v0);
+  }
+}
+
+//----------------------------------------------------------------------------
+// Sweep the input image row by row, and accumulate every labelmap in the given range that covers
+// the current row. This way the input image is read only once regardless of the number of labelmaps.
+// If the input index mapping is given, then the rows are swept on the lattice of the labelmaps, and
+// each row is interpolated from the input image once for all the labelmaps that cover it.
+template <class InputScalarType>
+void vtkMultiLabelImageAccumulateExecute(vtkImageData* inputImage, InputScalarType* inputTypePtr,
+                                         vtkMultiLabelImageAccumulateEntry* entries, vtkIdType numberOfEntries,
+                                         bool useFractionalLabelmap, const double* inputIndexScale, const double* inputIndexOffset)
+{
+  // Determine the region that is covered by any of the labelmaps
+  int sweepExtent[6] = { VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN, VTK_INT_MAX, VTK_INT_MIN };
+  for (vtkIdType entryIndex=0; entryIndex<numberOfEntries; ++entryIndex)
+  {
+    int* extent = entries[entryIndex].Extent;
+    if (extent[0] > extent[1] || extent[2] > extent[3] || extent[4] > extent[5])
+    {
+      continue;
+    }
+    for (int axis=0; axis<3; ++axis)
+    {
+      sweepExtent[axis*2] = std::min(sweepExtent[axis*2], extent[axis*2]);
+      sweepExtent[axis*2+1] = std::max(sweepExtent[axis*2+1], extent[axis*2+1]);
+    }
+  }
+
+  if (sweepExtent[0] > sweepExtent[1])
+  {
+    return;
+  }
+
+  bool interpolateInput = (inputIndexScale && inputIndexOffset);
+  std::vector<double> interpolatedRow;
+  if (interpolateInput)
+  {
+    interpolatedRow.resize(sweepExtent[1] - sweepExtent[0] + 1);
+  }
+
+  for (int z=sweepExtent[4]; z<=sweepExtent[5]; ++z)
+  {
+    for (int y=sweepExtent[2]; y<=sweepExtent[3]; ++y)
+    {
+      bool rowInterpolated = false;
+      for (vtkIdType entryIndex=0; entryIndex<numberOfEntries; ++entryIndex)
+      {
+        vtkMultiLabelImageAccumulateEntry& entry = entries[entryIndex];
+        int* extent = entry.Extent;
+        if ( z < extent[4] || z > extent[5] || y < extent[2] || y > extent[3] || extent[0] > extent[1] )
+        {
+          continue;
+        }
+
+        void* labelPtr = entry.Labelmap->GetScalarPointer(extent[0], y, z);
+        int numberOfVoxels = extent[1] - extent[0] + 1;
+        if (interpolateInput)
+        {
+          if (!rowInterpolated)
+          {
+            vtkMultiLabelImageAccumulateInterpolateRow(inputImage, inputTypePtr, sweepExtent[0], sweepExtent[1], y, z,
+              inputIndexScale, inputIndexOffset, &(interpolatedRow[0]));
+            rowInterpolated = true;
+          }
+          double* inPtr = &(interpolatedRow[extent[0] - sweepExtent[0]]);
+          switch (entry.Labelmap->GetScalarType())
+          {
+            vtkTemplateMacro( vtkMultiLabelImageAccumulateRow( inPtr, static_cast<VTK_TT*>(labelPtr),
+              numberOfVoxels, useFractionalLabelmap, entry ) );
+          default:
+            break;
+          }
+          continue;
+        }
+
+        InputScalarType* inPtr = static_cast<InputScalarType*>(inputImage->GetScalarPointer(extent[0], y, z));
+        switch (entry.Labelmap->GetScalarType())
+        {
+          vtkTemplateMacro( vtkMultiLabelImageAccumulateRow( inPtr, static_cast<VTK_TT*>(labelPtr),
+            numberOfVoxels, useFractionalLabelmap, entry ) );
+        default:
+          break;
+        }
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+// Accumulates a range of labelmaps. The labelmaps are distributed among the threads, and every
+// labelmap is accumulated entirely by one thread in the same voxel order as in the serial case,
+// so the results do not depend on the number of threads.
+class vtkMultiLabelImageAccumulateFunctor
+{
+public:
+  vtkMultiLabelImageAccumulateFunctor(vtkImageData* inputImage, std::vector<vtkMultiLabelImageAccumulateEntry>& entries, bool useFractionalLabelmap,
+                                      const double* inputIndexScale, const double* inputIndexOffset)
+    : InputImage(inputImage)
+    , Entries(entries)
+    , UseFractionalLabelmap(useFractionalLabelmap)
+    , InputIndexScale(inputIndexScale)
+    , InputIndexOffset(inputIndexOffset)
+  {
+  }
+
+  void operator()(vtkIdType begin, vtkIdType end)
+  {
+    switch (this->InputImage->GetScalarType())
+    {
+      vtkTemplateMacro( vtkMultiLabelImageAccumulateExecute( this->InputImage, static_cast<VTK_TT*>(NULL),
+        &(this->Entries[begin]), end-begin, this->UseFractionalLabelmap, this->InputIndexScale, this->InputIndexOffset ) );
+    default:
+      break;
+    }
+  }
+
+private:
+  vtkImageData* InputImage;
+  std::vector<vtkMultiLabelImageAccumulateEntry>& Entries;
+  bool UseFractionalLabelmap;
+  const double* InputIndexScale;
+  const double* InputIndexOffset;
+};
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkMultiLabelImageAccumulate);
+
+//----------------------------------------------------------------------------
+vtkMultiLabelImageAccumulate::vtkMultiLabelImageAccumulate()
+{
+  this->InputData = NULL;
+  this->UseFractionalLabelmap = false;
+  this->InterpolateInput = false;
+  for (int axis=0; axis<3; ++axis)
+  {
+    this->InputIndexScale[axis] = 1.0;
+    this->InputIndexOffset[axis] = 0.0;
+  }
+  this->Internal = new vtkInternal();
+}
+
+//----------------------------------------------------------------------------
+vtkMultiLabelImageAccumulate::~vtkMultiLabelImageAccumulate()
+{
+  this->SetInputData(NULL);
+  delete this->Internal;
+  this->Internal = NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiLabelImageAccumulate::SetInputData(vtkImageData* inputImage)
+{
+  if (this->InputData == inputImage)
+  {
+    return;
+  }
+  if (this->InputData)
+  {
+    this->InputData->UnRegister(this);
+  }
+  this->InputData = inputImage;
+  if (this->InputData)
+  {
+    this->InputData->Register(this);
+  }
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMultiLabelImageAccumulate::AddLabelmap(vtkImageData* labelmap, double minimumValue/*=0.0*/, double maximumValue/*=1.0*/)
+{
+  if (!labelmap)
+  {
+    vtkErrorMacro("AddLabelmap: Invalid labelmap");
+    return -1;
+  }
+  if (labelmap->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("AddLabelmap: Labelmap needs to have a single scalar component");
+    return -1;
+  }
+
+  vtkMultiLabelImageAccumulateEntry entry;
+  entry.Labelmap = labelmap;
+  entry.MinimumValue = minimumValue;
+  entry.MaximumValue = maximumValue;
+  this->Internal->Entries.push_back(entry);
+
+  this->Modified();
+  return static_cast<int>(this->Internal->Entries.size()) - 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiLabelImageAccumulate::RemoveAllLabelmaps()
+{
+  this->Internal->Entries.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkMultiLabelImageAccumulate::GetNumberOfLabelmaps()
+{
+  return static_cast<int>(this->Internal->Entries.size());
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkMultiLabelImageAccumulate::GetLabelmap(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetLabelmap: Invalid labelmap index " << labelIndex);
+    return NULL;
+  }
+  return this->Internal->Entries[labelIndex].Labelmap;
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiLabelImageAccumulate::SetBinning(int labelIndex, double origin, double spacing, int numberOfBins)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("SetBinning: Invalid labelmap index " << labelIndex);
+    return;
+  }
+  if (numberOfBins > 0 && spacing == 0.0)
+  {
+    vtkErrorMacro("SetBinning: Invalid bin spacing");
+    return;
+  }
+  vtkMultiLabelImageAccumulateEntry& entry = this->Internal->Entries[labelIndex];
+  entry.BinOrigin = origin;
+  entry.BinSpacing = spacing;
+  entry.NumberOfBins = numberOfBins;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiLabelImageAccumulate::SetBinningForAllLabelmaps(double origin, double spacing, int numberOfBins)
+{
+  for (int labelIndex=0; labelIndex<this->GetNumberOfLabelmaps(); ++labelIndex)
+  {
+    this->SetBinning(labelIndex, origin, spacing, numberOfBins);
+  }
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiLabelImageAccumulate::GetBinOrigin(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetBinOrigin: Invalid labelmap index " << labelIndex);
+    return 0.0;
+  }
+  return this->Internal->Entries[labelIndex].BinOrigin;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiLabelImageAccumulate::GetBinSpacing(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetBinSpacing: Invalid labelmap index " << labelIndex);
+    return 0.0;
+  }
+  return this->Internal->Entries[labelIndex].BinSpacing;
+}
+
+//----------------------------------------------------------------------------
+int vtkMultiLabelImageAccumulate::GetNumberOfBins(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetNumberOfBins: Invalid labelmap index " << labelIndex);
+    return 0;
+  }
+  return this->Internal->Entries[labelIndex].NumberOfBins;
+}
+
+//----------------------------------------------------------------------------
+bool vtkMultiLabelImageAccumulate::Update()
+{
+  for (std::vector<vtkMultiLabelImageAccumulateEntry>::iterator entryIt=this->Internal->Entries.begin(); entryIt!=this->Internal->Entries.end(); ++entryIt)
+  {
+    entryIt->Reset();
+  }
+  return this->Accumulate();
+}
+
+//----------------------------------------------------------------------------
+bool vtkMultiLabelImageAccumulate::Accumulate()
+{
+  if (!this->InputData)
+  {
+    vtkErrorMacro("Accumulate: Invalid input image");
+    return false;
+  }
+  if (this->InputData->GetNumberOfScalarComponents() != 1)
+  {
+    vtkErrorMacro("Accumulate: Input image needs to have a single scalar component");
+    return false;
+  }
+  if (!this->InputData->GetScalarPointer())
+  {
+    vtkErrorMacro("Accumulate: Input image contains no scalars");
+    return false;
+  }
+
+  if ( this->InterpolateInput
+    && (this->InputIndexScale[0] <= 0.0 || this->InputIndexScale[1] <= 0.0 || this->InputIndexScale[2] <= 0.0) )
+  {
+    vtkErrorMacro("Accumulate: Invalid input index scale");
+    return false;
+  }
+
+  // Clip the labelmap extents to the input extent. If the input is interpolated, then the labelmap voxels
+  // within half an input voxel around the input extent are kept, same as the border in vtkImageReslice.
+  int inputExtent[6] = {0,-1,0,-1,0,-1};
+  this->InputData->GetExtent(inputExtent);
+  if (this->InterpolateInput)
+  {
+    const double tolerance = 1e-3;
+    for (int axis=0; axis<3; ++axis)
+    {
+      if (inputExtent[axis*2] > inputExtent[axis*2+1])
+      {
+        continue;
+      }
+      int clippedMin = static_cast<int>(ceil( (inputExtent[axis*2] - 0.5 - this->InputIndexOffset[axis]) / this->InputIndexScale[axis] - tolerance ));
+      int clippedMax = static_cast<int>(floor( (inputExtent[axis*2+1] + 0.5 - this->InputIndexOffset[axis]) / this->InputIndexScale[axis] + tolerance ));
+      inputExtent[axis*2] = clippedMin;
+      inputExtent[axis*2+1] = clippedMax;
+    }
+  }
+  for (std::vector<vtkMultiLabelImageAccumulateEntry>::iterator entryIt=this->Internal->Entries.begin(); entryIt!=this->Internal->Entries.end(); ++entryIt)
+  {
+    int labelmapExtent[6] = {0,-1,0,-1,0,-1};
+    entryIt->Labelmap->GetExtent(labelmapExtent);
+    for (int axis=0; axis<3; ++axis)
+    {
+      entryIt->Extent[axis*2] = std::max(labelmapExtent[axis*2], inputExtent[axis*2]);
+      entryIt->Extent[axis*2+1] = std::min(labelmapExtent[axis*2+1], inputExtent[axis*2+1]);
+    }
+    if (!entryIt->Labelmap->GetScalarPointer())
+    {
+      // Empty labelmap, nothing to accumulate
+      entryIt->Extent[1] = entryIt->Extent[0] - 1;
+    }
+
+    // Compute fractions of 8-bit labelmaps in advance
+    entryIt->FractionTable.clear();
+    switch (entryIt->Labelmap->GetScalarType())
+    {
+      case VTK_CHAR:
+        vtkMultiLabelImageAccumulateFillFractionTable(static_cast<char*>(NULL), *entryIt);
+        break;
+      case VTK_SIGNED_CHAR:
+        vtkMultiLabelImageAccumulateFillFractionTable(static_cast<signed char*>(NULL), *entryIt);
+        break;
+      case VTK_UNSIGNED_CHAR:
+        vtkMultiLabelImageAccumulateFillFractionTable(static_cast<unsigned char*>(NULL), *entryIt);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (this->Internal->Entries.empty())
+  {
+    return true;
+  }
+
+  // Accumulate the labelmaps in parallel. Grain size of one allows each labelmap to be processed
+  // by a different thread, while labelmaps that end up in the same chunk share one sweep.
+  vtkMultiLabelImageAccumulateFunctor functor(this->InputData, this->Internal->Entries, this->UseFractionalLabelmap,
+    this->InterpolateInput ? this->InputIndexScale : NULL, this->InterpolateInput ? this->InputIndexOffset : NULL);
+  vtkSMPTools::For(0, static_cast<vtkIdType>(this->Internal->Entries.size()), 1, functor);
+
+  return true;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkMultiLabelImageAccumulate::GetVoxelCount(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetVoxelCount: Invalid labelmap index " << labelIndex);
+    return 0;
+  }
+  return this->Internal->Entries[labelIndex].VoxelCount;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiLabelImageAccumulate::GetFractionalVoxelCount(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetFractionalVoxelCount: Invalid labelmap index " << labelIndex);
+    return 0.0;
+  }
+  return this->Internal->Entries[labelIndex].FractionalVoxelCount;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiLabelImageAccumulate::GetMin(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetMin: Invalid labelmap index " << labelIndex);
+    return 0.0;
+  }
+  return this->Internal->Entries[labelIndex].Min;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiLabelImageAccumulate::GetMax(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetMax: Invalid labelmap index " << labelIndex);
+    return 0.0;
+  }
+  return this->Internal->Entries[labelIndex].Max;
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiLabelImageAccumulate::GetMean(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetMean: Invalid labelmap index " << labelIndex);
+    return 0.0;
+  }
+  vtkMultiLabelImageAccumulateEntry& entry = this->Internal->Entries[labelIndex];
+  if (this->UseFractionalLabelmap)
+  {
+    return (entry.FractionalVoxelCount != 0.0 ? entry.Sum / entry.FractionalVoxelCount : 0.0);
+  }
+  return (entry.VoxelCount > 0 ? entry.Sum / static_cast<double>(entry.VoxelCount) : 0.0);
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiLabelImageAccumulate::GetHistogramValue(int labelIndex, int binIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetHistogramValue: Invalid labelmap index " << labelIndex);
+    return 0.0;
+  }
+  vtkMultiLabelImageAccumulateEntry& entry = this->Internal->Entries[labelIndex];
+  if (binIndex < 0 || binIndex >= static_cast<int>(entry.Histogram.size()))
+  {
+    vtkErrorMacro("GetHistogramValue: Invalid bin index " << binIndex);
+    return 0.0;
+  }
+  return entry.Histogram[binIndex];
+}
+
+//----------------------------------------------------------------------------
+double vtkMultiLabelImageAccumulate::GetHistogramUnderflow(int labelIndex)
+{
+  if (labelIndex < 0 || labelIndex >= this->GetNumberOfLabelmaps())
+  {
+    vtkErrorMacro("GetHistogramUnderflow: Invalid labelmap index " << labelIndex);
+    return 0.0;
+  }
+  return this->Internal->Entries[labelIndex].HistogramUnderflow;
+}
+
+//----------------------------------------------------------------------------
+void vtkMultiLabelImageAccumulate::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os,indent);
+  os << indent << "InputData: " << this->InputData << "\n";
+  os << indent << "UseFractionalLabelmap: " << (this->UseFractionalLabelmap ? "true" : "false") << "\n";
+  os << indent << "InterpolateInput: " << (this->InterpolateInput ? "true" : "false") << "\n";
+  os << indent << "InputIndexScale: " << this->InputIndexScale[0] << ", " << this->InputIndexScale[1] << ", " << this->InputIndexScale[2] << "\n";
+  os << indent << "InputIndexOffset: " << this->InputIndexOffset[0] << ", " << this->InputIndexOffset[1] << ", " << this->InputIndexOffset[2] << "\n";
+  os << indent << "NumberOfLabelmaps: " << this->GetNumberOfLabelmaps() << "\n";
+}
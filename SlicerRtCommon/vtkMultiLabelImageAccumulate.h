@@ -0,0 +1,170 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkMultiLabelImageAccumulate_h
+#define __vtkMultiLabelImageAccumulate_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+class vtkImageData;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Compute statistics and histograms of an image within multiple labelmaps in one sweep
+///
+/// Equivalent to running vtkImageAccumulate (or vtkFractionalImageAccumulate in fractional mode)
+/// once per labelmap with a stencil created from the labelmap, but the input image is traversed
+/// only once for all the labelmaps. Each labelmap needs to be on the same lattice as the input
+/// image, but may cover only a part of it (e.g. the bounding box of the structure). Voxels outside
+/// the labelmap extent are considered background, so regions not covered by any labelmap are skipped.
+///
+/// The labelmaps are accumulated in parallel using vtkSMPTools. Every labelmap is accumulated by a
+/// single thread in the same order as in the serial case, so the results are identical regardless
+/// of the number of threads.
+///
+/// The input image needs to have a single scalar component.
+///
+/// If \sa InterpolateInput is enabled, then the labelmaps may be on a finer lattice than the input image
+/// (e.g. oversampled structure labelmaps on a dose volume of native resolution), as long as the axes of
+/// the two lattices are aligned. The input image is then linearly interpolated at the labelmap voxel
+/// centers on the fly, so the input does not need to be resampled to the lattice of the labelmaps.
+class VTK_SLICERRTCOMMON_EXPORT vtkMultiLabelImageAccumulate : public vtkObject
+{
+public:
+  static vtkMultiLabelImageAccumulate* New();
+  vtkTypeMacro(vtkMultiLabelImageAccumulate, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+public:
+  /// Set image the statistics are computed on (e.g. dose volume)
+  void SetInputData(vtkImageData* inputImage);
+  /// Get image the statistics are computed on
+  vtkGetObjectMacro(InputData, vtkImageData);
+
+  /// Add labelmap within which the statistics are computed
+  /// \param labelmap Labelmap on the same lattice as the input image (or on an aligned lattice if \sa InterpolateInput is enabled)
+  /// \param minimumValue Background value of the labelmap (only used in fractional mode)
+  /// \param maximumValue Value of fully covered voxels in the labelmap (only used in fractional mode)
+  /// \return Index of the added labelmap, which identifies the results
+  int AddLabelmap(vtkImageData* labelmap, double minimumValue=0.0, double maximumValue=1.0);
+  /// Remove all labelmaps and their results
+  void RemoveAllLabelmaps();
+  /// Get number of added labelmaps
+  int GetNumberOfLabelmaps();
+  /// Get labelmap by index
+  vtkImageData* GetLabelmap(int labelIndex);
+
+  /// Set histogram bins for a labelmap. Bin i covers the range [origin + i*spacing, origin + (i+1)*spacing)
+  /// Set number of bins to 0 if only the statistics need to be computed.
+  void SetBinning(int labelIndex, double origin, double spacing, int numberOfBins);
+  /// Set the same histogram bins for all labelmaps added so far. \sa SetBinning
+  void SetBinningForAllLabelmaps(double origin, double spacing, int numberOfBins);
+  /// Get histogram origin for a labelmap
+  double GetBinOrigin(int labelIndex);
+  /// Get histogram bin spacing for a labelmap
+  double GetBinSpacing(int labelIndex);
+  /// Get number of histogram bins for a labelmap
+  int GetNumberOfBins(int labelIndex);
+
+  /// Compute statistics and histograms for all labelmaps
+  /// \return Success flag
+  bool Update();
+
+  /// Add the statistics and histograms of the current input image to the results of the previous
+  /// \sa Update or \sa Accumulate calls, without resetting them. Allows processing a large image in
+  /// parts (e.g. slabs along the third axis, in increasing order to get the same results as with one
+  /// \sa Update call on the whole image). The bins must not be changed between the calls.
+  /// \return Success flag
+  bool Accumulate();
+
+  /// Get number of voxels inside the given labelmap
+  vtkIdType GetVoxelCount(int labelIndex);
+  /// Get sum of the fractions of the voxels inside the given labelmap.
+  /// Equals to voxel count if fractional labelmap is not used.
+  double GetFractionalVoxelCount(int labelIndex);
+  /// Get minimum value of the input image within the given labelmap
+  double GetMin(int labelIndex);
+  /// Get maximum value of the input image within the given labelmap
+  double GetMax(int labelIndex);
+  /// Get mean value of the input image within the given labelmap (weighted by fractions in fractional mode)
+  double GetMean(int labelIndex);
+  /// Get (fractional) number of voxels in a histogram bin of the given labelmap
+  double GetHistogramValue(int labelIndex, int binIndex);
+  /// Get (fractional) number of voxels below the first histogram bin of the given labelmap.
+  /// Allows computing cumulative histograms without a separate pass for the values below the bins.
+  double GetHistogramUnderflow(int labelIndex);
+
+  /// Set flag determining whether the labelmaps are interpreted as fractional labelmaps
+  vtkSetMacro(UseFractionalLabelmap, bool);
+  /// Get flag determining whether the labelmaps are interpreted as fractional labelmaps
+  vtkGetMacro(UseFractionalLabelmap, bool);
+  /// Set flag determining whether the labelmaps are interpreted as fractional labelmaps
+  vtkBooleanMacro(UseFractionalLabelmap, bool);
+
+  /// Set flag determining whether the input image is interpolated at the labelmap voxels using the
+  /// input index mapping (\sa InputIndexScale, \sa InputIndexOffset) instead of being on the same lattice
+  vtkSetMacro(InterpolateInput, bool);
+  /// Get flag determining whether the input image is interpolated at the labelmap voxels
+  vtkGetMacro(InterpolateInput, bool);
+  /// Set flag determining whether the input image is interpolated at the labelmap voxels
+  vtkBooleanMacro(InterpolateInput, bool);
+
+  /// Set scaling of the mapping from labelmap voxel indices to continuous input voxel indices:
+  /// inputIndex[axis] = labelmapIndex[axis] * InputIndexScale[axis] + InputIndexOffset[axis].
+  /// E.g. 0.5 if the labelmaps are oversampled by a factor of two. Only used if \sa InterpolateInput is enabled.
+  vtkSetVector3Macro(InputIndexScale, double);
+  /// Get scaling of the mapping from labelmap voxel indices to continuous input voxel indices
+  vtkGetVector3Macro(InputIndexScale, double);
+  /// Set offset of the mapping from labelmap voxel indices to continuous input voxel indices. \sa SetInputIndexScale
+  vtkSetVector3Macro(InputIndexOffset, double);
+  /// Get offset of the mapping from labelmap voxel indices to continuous input voxel indices
+  vtkGetVector3Macro(InputIndexOffset, double);
+
+protected:
+  vtkMultiLabelImageAccumulate();
+  virtual ~vtkMultiLabelImageAccumulate();
+
+protected:
+  /// Image the statistics are computed on
+  vtkImageData* InputData;
+
+  /// Flag determining whether the labelmaps are interpreted as fractional labelmaps
+  bool UseFractionalLabelmap;
+
+  /// Flag determining whether the input image is interpolated at the labelmap voxels
+  bool InterpolateInput;
+
+  /// Scaling of the mapping from labelmap voxel indices to continuous input voxel indices
+  double InputIndexScale[3];
+
+  /// Offset of the mapping from labelmap voxel indices to continuous input voxel indices
+  double InputIndexOffset[3];
+
+  class vtkInternal;
+  vtkInternal* Internal;
+
+private:
+  vtkMultiLabelImageAccumulate(const vtkMultiLabelImageAccumulate&); // Not implemented
+  void operator=(const vtkMultiLabelImageAccumulate&);               // Not implemented
+};
+
+#endif // __vtkMultiLabelImageAccumulate_h
@@ -44,6 +44,9 @@
 // VTK sys tools
 #include <vtksys/SystemTools.hxx>
 
+// STD includes
+#include <sstream>
+
 //----------------------------------------------------------------------------
 // Constant strings
 //----------------------------------------------------------------------------
@@ -256,6 +259,49 @@ bool vtkSlicerRtCommon::DoVolumeLatticesMatch(vtkMRMLScalarVolumeNode* volume1,
   return true;
 }
 
+//---------------------------------------------------------------------------
+std::string vtkSlicerRtCommon::GetVolumeNodeStateKey(vtkMRMLScalarVolumeNode* volumeNode, bool includeVoxels/*=true*/)
+{
+  if (!volumeNode)
+  {
+    return "";
+  }
+
+  std::ostringstream key;
+  key.precision(17);
+  key << (volumeNode->GetID() ? volumeNode->GetID() : "") << ";";
+  vtkImageData* imageData = volumeNode->GetImageData();
+  if (imageData)
+  {
+    int extent[6] = {0,-1,0,-1,0,-1};
+    imageData->GetExtent(extent);
+    key << extent[0] << "," << extent[1] << "," << extent[2] << "," << extent[3] << "," << extent[4] << "," << extent[5] << ";";
+    if (includeVoxels)
+    {
+      key << imageData << "," << imageData->GetMTime() << ";";
+    }
+  }
+  vtkSmartPointer<vtkMatrix4x4> ijkToRasMatrix = vtkSmartPointer<vtkMatrix4x4>::New();
+  volumeNode->GetIJKToRASMatrix(ijkToRasMatrix);
+  for (int row=0; row<3; ++row)
+  {
+    for (int column=0; column<4; ++column)
+    {
+      key << ijkToRasMatrix->GetElement(row, column) << ",";
+    }
+  }
+  // The transform node is not necessarily modified when its transform is, so the modified time of the transform is included too
+  for (vtkMRMLTransformNode* transformNode = volumeNode->GetParentTransformNode(); transformNode; transformNode = transformNode->GetParentTransformNode())
+  {
+    key << ";" << (transformNode->GetID() ? transformNode->GetID() : "") << "," << transformNode->GetMTime();
+    if (transformNode->GetTransformToParent())
+    {
+      key << "," << transformNode->GetTransformToParent()->GetMTime();
+    }
+  }
+  return key.str();
+}
+
 //---------------------------------------------------------------------------
 bool vtkSlicerRtCommon::AreEqualWithTolerance(double a, double b)
 {
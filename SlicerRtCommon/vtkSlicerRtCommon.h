@@ -138,6 +138,13 @@ public:
   /// Check if the lattice (grid, geometry) of two volumes are the same
   static bool DoVolumeLatticesMatch(vtkMRMLScalarVolumeNode* volume1, vtkMRMLScalarVolumeNode* volume2);
 
+  /// Get a string that changes whenever the geometry (or optionally the voxels) of the volume or any of its
+  /// parent transforms change. Used as key of cached data computed from the volume (\sa vtkSlicerRtDataObjectCache).
+  /// The key starts with the node ID followed by a semicolon, so the data of a volume can be found by this prefix.
+  /// \param includeVoxels If true, then the key also changes when the voxels are modified
+  /// \return Empty string if the volume node is invalid
+  static std::string GetVolumeNodeStateKey(vtkMRMLScalarVolumeNode* volumeNode, bool includeVoxels=true);
+
   /// Determine if two numbers are equal within a small tolerance (0.0001)
   static bool AreEqualWithTolerance(double a, double b);
 
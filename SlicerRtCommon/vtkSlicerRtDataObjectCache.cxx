@@ -0,0 +1,179 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#include "vtkSlicerRtDataObjectCache.h"
+
+// VTK includes
+#include <vtkDataObject.h>
+#include <vtkObjectFactory.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <list>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro(vtkSlicerRtDataObjectCache);
+
+//----------------------------------------------------------------------------
+class vtkSlicerRtDataObjectCache::vtkInternal
+{
+public:
+  struct Item
+  {
+    std::string Key;
+    vtkSmartPointer<vtkDataObject> DataObject;
+    /// Modified time of the object when it was added
+    vtkMTimeType DataObjectMTime;
+    /// Size of the object when it was added in megabytes
+    double SizeMB;
+  };
+
+  /// Cached objects, most recently used first
+  std::list<Item> Items;
+};
+
+//----------------------------------------------------------------------------
+vtkSlicerRtDataObjectCache::vtkSlicerRtDataObjectCache()
+{
+  this->MemoryLimitMB = 256.0;
+  this->Internal = new vtkInternal();
+}
+
+//----------------------------------------------------------------------------
+vtkSlicerRtDataObjectCache::~vtkSlicerRtDataObjectCache()
+{
+  delete this->Internal;
+  this->Internal = NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtDataObjectCache::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os, indent);
+  os << indent << "MemoryLimitMB: " << this->MemoryLimitMB << "\n";
+  os << indent << "NumberOfItems: " << this->GetNumberOfItems() << "\n";
+  os << indent << "SizeMB: " << this->GetSizeMB() << "\n";
+}
+
+//----------------------------------------------------------------------------
+vtkDataObject* vtkSlicerRtDataObjectCache::GetItem(const std::string& key)
+{
+  std::list<vtkInternal::Item>::iterator itemIt;
+  for (itemIt=this->Internal->Items.begin(); itemIt!=this->Internal->Items.end(); ++itemIt)
+  {
+    if (itemIt->Key != key)
+    {
+      continue;
+    }
+    if (itemIt->DataObject->GetMTime() != itemIt->DataObjectMTime)
+    {
+      // The object was modified after it was added, so it does not correspond to the key any more
+      this->Internal->Items.erase(itemIt);
+      return NULL;
+    }
+    this->Internal->Items.splice(this->Internal->Items.begin(), this->Internal->Items, itemIt);
+    return this->Internal->Items.front().DataObject;
+  }
+  return NULL;
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtDataObjectCache::AddItem(const std::string& key, vtkDataObject* dataObject)
+{
+  if (!dataObject)
+  {
+    vtkErrorMacro("AddItem: Invalid data object");
+    return;
+  }
+
+  std::list<vtkInternal::Item>::iterator itemIt;
+  for (itemIt=this->Internal->Items.begin(); itemIt!=this->Internal->Items.end(); ++itemIt)
+  {
+    if (itemIt->Key == key)
+    {
+      this->Internal->Items.erase(itemIt);
+      break;
+    }
+  }
+
+  vtkInternal::Item item;
+  item.Key = key;
+  item.DataObject = dataObject;
+  item.DataObjectMTime = dataObject->GetMTime();
+  item.SizeMB = dataObject->GetActualMemorySize() / 1024.0;
+  if (item.SizeMB > this->MemoryLimitMB)
+  {
+    return;
+  }
+  this->Internal->Items.push_front(item);
+
+  double cacheSizeMB = 0.0;
+  for (itemIt=this->Internal->Items.begin(); itemIt!=this->Internal->Items.end(); ++itemIt)
+  {
+    cacheSizeMB += itemIt->SizeMB;
+    if (cacheSizeMB > this->MemoryLimitMB)
+    {
+      // The least recently used items are at the end
+      this->Internal->Items.erase(itemIt, this->Internal->Items.end());
+      break;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtDataObjectCache::RemoveItemsWithKeyPrefix(const std::string& keyPrefix)
+{
+  std::list<vtkInternal::Item>::iterator itemIt;
+  for (itemIt=this->Internal->Items.begin(); itemIt!=this->Internal->Items.end(); )
+  {
+    if (itemIt->Key.compare(0, keyPrefix.size(), keyPrefix) == 0)
+    {
+      itemIt = this->Internal->Items.erase(itemIt);
+    }
+    else
+    {
+      ++itemIt;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkSlicerRtDataObjectCache::RemoveAllItems()
+{
+  this->Internal->Items.clear();
+}
+
+//----------------------------------------------------------------------------
+int vtkSlicerRtDataObjectCache::GetNumberOfItems()
+{
+  return static_cast<int>(this->Internal->Items.size());
+}
+
+//----------------------------------------------------------------------------
+double vtkSlicerRtDataObjectCache::GetSizeMB()
+{
+  double cacheSizeMB = 0.0;
+  std::list<vtkInternal::Item>::iterator itemIt;
+  for (itemIt=this->Internal->Items.begin(); itemIt!=this->Internal->Items.end(); ++itemIt)
+  {
+    cacheSizeMB += itemIt->SizeMB;
+  }
+  return cacheSizeMB;
+}
@@ -0,0 +1,91 @@
+/*==============================================================================
+
+  Copyright (c) Laboratory for Percutaneous Surgery (PerkLab)
+  Queen's University, Kingston, ON, Canada. All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+  This file was originally developed by Csaba Pinter, PerkLab, Queen's University
+  and was supported through the Applied Cancer Research Unit program of Cancer Care
+  Ontario with funds provided by the Ontario Ministry of Health and Long-Term Care
+
+==============================================================================*/
+
+#ifndef __vtkSlicerRtDataObjectCache_h
+#define __vtkSlicerRtDataObjectCache_h
+
+#include "vtkSlicerRtCommonWin32Header.h"
+
+// VTK includes
+#include <vtkObject.h>
+
+// STD includes
+#include <string>
+
+class vtkDataObject;
+
+/// \ingroup SlicerRt_SlicerRtCommon
+/// \brief Memory limited cache of data objects (e.g. resampled doses or isodose surfaces) identified by string keys
+///
+/// When the total size of the cached objects exceeds \sa MemoryLimitMB, the least recently used objects are removed.
+/// The keys typically contain the state of the inputs the objects were computed from (\sa vtkSlicerRtCommon::GetVolumeNodeStateKey),
+/// so that an object is not found any more once its inputs change. The cache keeps a reference to the objects, so they
+/// need to be treated as read-only. If an object is modified anyway (e.g. a cached surface is edited in another module),
+/// then it is removed from the cache when it is next requested.
+class VTK_SLICERRTCOMMON_EXPORT vtkSlicerRtDataObjectCache : public vtkObject
+{
+public:
+  static vtkSlicerRtDataObjectCache* New();
+  vtkTypeMacro(vtkSlicerRtDataObjectCache, vtkObject);
+  void PrintSelf(ostream& os, vtkIndent indent) VTK_OVERRIDE;
+
+public:
+  /// Get cached object and mark it as most recently used
+  /// \return NULL if there is no object with the key in the cache, or it was modified since it was added
+  vtkDataObject* GetItem(const std::string& key);
+
+  /// Add object to the cache (replacing the object with the same key), and remove the least recently used
+  /// objects if the cache exceeds the memory limit. Objects larger than the limit are not added.
+  void AddItem(const std::string& key, vtkDataObject* dataObject);
+
+  /// Remove the objects with keys starting with the given prefix (e.g. all objects computed from a removed volume)
+  void RemoveItemsWithKeyPrefix(const std::string& keyPrefix);
+
+  /// Remove all objects
+  void RemoveAllItems();
+
+  /// Get number of cached objects
+  int GetNumberOfItems();
+
+  /// Get total size of the cached objects in megabytes
+  double GetSizeMB();
+
+  /// Memory limit in megabytes. 0 disables caching. Default is 256.
+  vtkGetMacro(MemoryLimitMB, double);
+  /// Set memory limit in megabytes. Objects are removed if needed when the next object is added.
+  vtkSetMacro(MemoryLimitMB, double);
+
+protected:
+  vtkSlicerRtDataObjectCache();
+  ~vtkSlicerRtDataObjectCache();
+
+protected:
+  /// Memory limit in megabytes
+  double MemoryLimitMB;
+
+  class vtkInternal;
+  vtkInternal* Internal;
+
+private:
+  vtkSlicerRtDataObjectCache(const vtkSlicerRtDataObjectCache&); // Not implemented
+  void operator=(const vtkSlicerRtDataObjectCache&);             // Not implemented
+};
+
+#endif